@@ -0,0 +1,157 @@
+/*
+ * Copyright (c) 2023 Oliver Sintaj
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Project overrides for the FreeRTOS-Sim configuration.
+ *
+ * The simulator ships its own FreeRTOSConfig.h inside the FreeRTOS-Sim
+ * submodule. This directory is placed in front of it on the include path,
+ * so the original file is pulled in first and only the options owned by
+ * this project are redefined below.
+ */
+
+#ifndef __FREERTOS_CONFIG_OVERRIDES_H
+#define __FREERTOS_CONFIG_OVERRIDES_H
+
+#include_next <FreeRTOSConfig.h>
+
+#if defined(FREERTOS_SIM_RUN_TIME_STATS) && (FREERTOS_SIM_RUN_TIME_STATS > 0)
+
+/* ---------- Run time statistics ---------- */
+
+/**
+ * @brief Collect per task run time counters, read by uxTaskGetSystemState().
+ *        The counter is a host monotonic clock in microseconds, see
+ *        FreeRTOSRunTimeStats.c.
+ * **/
+#undef configGENERATE_RUN_TIME_STATS
+#define configGENERATE_RUN_TIME_STATS                   1
+
+/**
+ * @brief Needed for uxTaskGetSystemState() and the TCB number used to key the
+ *        context switch counters.
+ * **/
+#undef configUSE_TRACE_FACILITY
+#define configUSE_TRACE_FACILITY                        1
+
+#undef portCONFIGURE_TIMER_FOR_RUN_TIME_STATS
+#define portCONFIGURE_TIMER_FOR_RUN_TIME_STATS()        vConfigureTimerForRunTimeStats()
+
+#undef portGET_RUN_TIME_COUNTER_VALUE
+#define portGET_RUN_TIME_COUNTER_VALUE()                ulGetRunTimeCounterValue()
+
+/**
+ * @brief Count context switches per task. Only expanded inside tasks.c,
+ *        where pxCurrentTCB is visible.
+ * **/
+#define simRUN_TIME_STATS_SWITCHED_IN()                 vRunTimeStatsTaskSwitchedIn(pxCurrentTCB->uxTCBNumber)
+
+#include "FreeRTOSRunTimeStats.h"
+
+#else
+#define simRUN_TIME_STATS_SWITCHED_IN()
+#endif /* FREERTOS_SIM_RUN_TIME_STATS */
+
+#if defined(FREERTOS_SIM_TRACE) && (FREERTOS_SIM_TRACE > 0)
+
+/* ---------- Event trace ---------- */
+
+/** @brief Needed for the TCB and queue numbers used to key the trace rings **/
+#undef configUSE_TRACE_FACILITY
+#define configUSE_TRACE_FACILITY                        1
+
+#define simTRACE_SWITCHED_IN()                          vTraceTaskSwitchedIn(pxCurrentTCB->uxTCBNumber, pxCurrentTCB->pcTaskName)
+
+#undef traceTASK_SWITCHED_OUT
+#define traceTASK_SWITCHED_OUT()                        vTraceTaskSwitchedOut(pxCurrentTCB->uxTCBNumber)
+
+/**
+ * @brief Queue hooks. Only expanded inside queue.c, where the queue
+ *        internals are visible. Semaphores and mutexes are queues as well,
+ *        they are filtered out by their type.
+ * **/
+#define simTRACE_IS_MAILBOX(pxQueue)                    ((pxQueue)->ucQueueType == queueQUEUE_TYPE_BASE)
+
+#undef traceQUEUE_CREATE
+#define traceQUEUE_CREATE(pxNewQueue)                   ((pxNewQueue)->uxQueueNumber = ulTraceQueueCreated())
+
+#undef traceQUEUE_SEND
+#define traceQUEUE_SEND(pxQueue)                                                        \
+    do                                                                                  \
+    {                                                                                   \
+        if (simTRACE_IS_MAILBOX(pxQueue))                                               \
+        {                                                                               \
+            vTraceQueueEvent("mbox post", (pxQueue)->uxQueueNumber,                     \
+                             (pxQueue)->uxMessagesWaiting + 1);                         \
+        }                                                                               \
+    } while (0)
+
+#undef traceQUEUE_SEND_FAILED
+#define traceQUEUE_SEND_FAILED(pxQueue)                                                 \
+    do                                                                                  \
+    {                                                                                   \
+        if (simTRACE_IS_MAILBOX(pxQueue))                                               \
+        {                                                                               \
+            vTraceQueueEvent("mbox full", (pxQueue)->uxQueueNumber,                     \
+                             (pxQueue)->uxMessagesWaiting);                             \
+        }                                                                               \
+    } while (0)
+
+#undef traceQUEUE_RECEIVE
+#define traceQUEUE_RECEIVE(pxQueue)                                                     \
+    do                                                                                  \
+    {                                                                                   \
+        if (simTRACE_IS_MAILBOX(pxQueue))                                               \
+        {                                                                               \
+            vTraceQueueEvent("mbox fetch", (pxQueue)->uxQueueNumber,                    \
+                             (pxQueue)->uxMessagesWaiting - 1);                         \
+        }                                                                               \
+    } while (0)
+
+#undef traceBLOCKING_ON_QUEUE_RECEIVE
+#define traceBLOCKING_ON_QUEUE_RECEIVE(pxQueue)                                         \
+    do                                                                                  \
+    {                                                                                   \
+        if (simTRACE_IS_MAILBOX(pxQueue))                                               \
+        {                                                                               \
+            vTraceQueueEvent("mbox wait", (pxQueue)->uxQueueNumber, 0);                 \
+        }                                                                               \
+    } while (0)
+
+#include "FreeRTOSTrace.h"
+
+#else
+#define simTRACE_SWITCHED_IN()
+#endif /* FREERTOS_SIM_TRACE */
+
+#if defined(FREERTOS_SIM_VIRTUAL_TIME) && (FREERTOS_SIM_VIRTUAL_TIME > 0)
+
+/* ---------- Virtual time ---------- */
+
+/** @brief The idle hook advances the clock, see FreeRTOSVirtualTime.c **/
+#undef configUSE_IDLE_HOOK
+#define configUSE_IDLE_HOOK                             1
+
+/** @brief Time is only charged once the scheduler runs **/
+#undef INCLUDE_xTaskGetSchedulerState
+#define INCLUDE_xTaskGetSchedulerState                  1
+
+#include "FreeRTOSVirtualTime.h"
+
+#endif /* FREERTOS_SIM_VIRTUAL_TIME */
+
+#if (defined(FREERTOS_SIM_RUN_TIME_STATS) && (FREERTOS_SIM_RUN_TIME_STATS > 0)) || \
+    (defined(FREERTOS_SIM_TRACE) && (FREERTOS_SIM_TRACE > 0))
+#undef traceTASK_SWITCHED_IN
+#define traceTASK_SWITCHED_IN()                                                         \
+    do                                                                                  \
+    {                                                                                   \
+        simRUN_TIME_STATS_SWITCHED_IN();                                                \
+        simTRACE_SWITCHED_IN();                                                         \
+    } while (0)
+#endif
+
+#endif /* __FREERTOS_CONFIG_OVERRIDES_H */
@@ -0,0 +1,50 @@
+/*
+ * Copyright (c) 2023 Oliver Sintaj
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef __FREERTOS_RUN_TIME_STATS_H
+#define __FREERTOS_RUN_TIME_STATS_H
+
+/**
+ * @brief Number of slots for the per task context switch counters. Tasks are
+ *        mapped to slots by their TCB number, so it should be larger than the
+ *        number of tasks ever created by the application.
+ * **/
+#ifndef configRUN_TIME_STATS_MAX_TASKS
+#define configRUN_TIME_STATS_MAX_TASKS      64
+#endif
+
+/**
+ * @brief Latch the host monotonic clock as the run time counter origin
+ * @note Called by the kernel through portCONFIGURE_TIMER_FOR_RUN_TIME_STATS()
+ *       when the scheduler is started.
+ * @return non
+ * **/
+void vConfigureTimerForRunTimeStats(void);
+
+/**
+ * @brief Read the run time counter
+ * @note Called by the kernel through portGET_RUN_TIME_COUNTER_VALUE() on every
+ *       context switch.
+ * @return Microseconds elapsed since the scheduler was started (wraps at 32 bits)
+ * **/
+unsigned long ulGetRunTimeCounterValue(void);
+
+/**
+ * @brief Account one context switch to the task with the given TCB number
+ * @note Called by the kernel through traceTASK_SWITCHED_IN().
+ * @param ulTaskNumber TCB number of the task being switched in
+ * @return non
+ * **/
+void vRunTimeStatsTaskSwitchedIn(unsigned long ulTaskNumber);
+
+/**
+ * @brief Get number of times a task has been switched in
+ * @param ulTaskNumber TCB number of the task, as reported in TaskStatus_t::xTaskNumber
+ * @return Context switch count (wraps at 32 bits)
+ * **/
+unsigned long ulRunTimeStatsGetSwitchCount(unsigned long ulTaskNumber);
+
+#endif /* __FREERTOS_RUN_TIME_STATS_H */
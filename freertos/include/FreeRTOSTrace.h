@@ -0,0 +1,147 @@
+/*
+ * Copyright (c) 2023 Oliver Sintaj
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef __FREERTOS_TRACE_H
+#define __FREERTOS_TRACE_H
+
+#include <stdint.h>
+
+/**
+ * @brief Number of per task event rings. Tasks are mapped to rings by their
+ *        TCB number, so it should be larger than the number of tasks ever
+ *        created by the application.
+ * **/
+#ifndef configTRACE_MAX_TASKS
+#define configTRACE_MAX_TASKS               32
+#endif
+
+/**
+ * @brief Number of events kept by every ring, must be a power of two. When a
+ *        ring is full the oldest events are overwritten, so the dump always
+ *        holds the end of the run.
+ * **/
+#ifndef configTRACE_RING_LENGTH
+#define configTRACE_RING_LENGTH             4096
+#endif
+
+#if defined(FREERTOS_SIM_TRACE) && (FREERTOS_SIM_TRACE > 0)
+
+/**
+ * @brief Enable tracing and arrange for the trace to be written on exit
+ * @note The trace is written by an atexit() handler, and on SIGINT or SIGTERM
+ *       which is how the simulator is normally stopped. The signal handler
+ *       only stops the recording, a thread of the tracer writes the file
+ *       and then ends the process with the same signal.
+ * @param pcFileName path of the Chrome trace event JSON file to be written
+ * @return non
+ * **/
+void vTraceStart(const char *pcFileName);
+
+/**
+ * @brief Get trace timestamp
+ * @return Nanoseconds elapsed since vTraceStart()
+ * **/
+uint64_t ullTraceTimestamp(void);
+
+/**
+ * @brief Record an instant event on the timeline of the calling task
+ * @param pcName event name, it must be a string literal as only the pointer
+ *               is stored
+ * @param ulArg value shown with the event
+ * @return non
+ * **/
+void vTraceInstant(const char *pcName, uint32_t ulArg);
+
+/**
+ * @brief Record a slice on the timeline of the calling task which started
+ *        at @p ullStartNs and ends now
+ * @param pcName slice name, it must be a string literal
+ * @param ullStartNs start of the slice, as returned by ullTraceTimestamp()
+ * @param ulArg value shown with the slice
+ * @return non
+ * **/
+void vTraceSlice(const char *pcName, uint64_t ullStartNs, uint32_t ulArg);
+
+/**
+ * @brief Record a new value of a counter
+ * @param pcName counter name, it must be a string literal
+ * @param usId instance of the counter, appended to the name
+ * @param ulValue new counter value
+ * @return non
+ * **/
+void vTraceCounter(const char *pcName, uint16_t usId, uint32_t ulValue);
+
+/**
+ * @brief Kernel hook, start a scheduler slice of the given task
+ * @note Called through traceTASK_SWITCHED_IN().
+ * @param ulTaskNumber TCB number of the task being switched in
+ * @param pcTaskName name of the task being switched in
+ * @return non
+ * **/
+void vTraceTaskSwitchedIn(unsigned long ulTaskNumber, const char *pcTaskName);
+
+/**
+ * @brief Kernel hook, close the scheduler slice of the given task
+ * @note Called through traceTASK_SWITCHED_OUT().
+ * @param ulTaskNumber TCB number of the task being switched out
+ * @return non
+ * **/
+void vTraceTaskSwitchedOut(unsigned long ulTaskNumber);
+
+/**
+ * @brief Kernel hook, number a newly created queue
+ * @note Called through traceQUEUE_CREATE().
+ * @return Number identifying the queue in the trace
+ * **/
+unsigned long ulTraceQueueCreated(void);
+
+/**
+ * @brief Kernel hook, record an operation on a queue
+ * @note Called through the traceQUEUE_* macros for plain queues only, which
+ *       in this simulator are the lwIP mailboxes (tcpip thread and netconns).
+ * @param pcName operation name, it must be a string literal
+ * @param ulQueueNumber number given by ulTraceQueueCreated()
+ * @param ulMessagesWaiting queue depth after the operation
+ * @return non
+ * **/
+void vTraceQueueEvent(const char *pcName, unsigned long ulQueueNumber,
+                      unsigned long ulMessagesWaiting);
+
+#else
+
+static inline void vTraceStart(const char *pcFileName)
+{
+    (void)pcFileName;
+}
+
+static inline uint64_t ullTraceTimestamp(void)
+{
+    return 0;
+}
+
+static inline void vTraceInstant(const char *pcName, uint32_t ulArg)
+{
+    (void)pcName;
+    (void)ulArg;
+}
+
+static inline void vTraceSlice(const char *pcName, uint64_t ullStartNs, uint32_t ulArg)
+{
+    (void)pcName;
+    (void)ullStartNs;
+    (void)ulArg;
+}
+
+static inline void vTraceCounter(const char *pcName, uint16_t usId, uint32_t ulValue)
+{
+    (void)pcName;
+    (void)usId;
+    (void)ulValue;
+}
+
+#endif /* FREERTOS_SIM_TRACE */
+
+#endif /* __FREERTOS_TRACE_H */
@@ -0,0 +1,65 @@
+/*
+ * Copyright (c) 2023 Oliver Sintaj
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef __FREERTOS_VIRTUAL_TIME_H
+#define __FREERTOS_VIRTUAL_TIME_H
+
+#include <stdint.h>
+
+/*
+ * Discrete event clock for reproducible runs.
+ *
+ * The host interval timer of the simulator is never armed, the tick count
+ * only moves when the application runs out of work: every pass of the idle
+ * task advances it by one tick, which wakes the next delayed task without
+ * any host time passing. Drivers can charge the time an event takes, e.g.
+ * a frame on a link, with vVirtualTimeCharge(), so a task that never blocks
+ * still sees time moving. Ticks are processed synchronously by the running
+ * task, so the interleaving of tasks only depends on the program, not on
+ * the load of the host.
+ *
+ * Included by FreeRTOSConfig.h, before the kernel types are known.
+ */
+
+/**
+ * @brief Run the scheduler on virtual time
+ * @note Call it before vTaskStartScheduler(), the host tick timer is not
+ *       started then. Tasks must not block in host system calls, nothing
+ *       would wake them up.
+ * @return non
+ * **/
+void vVirtualTimeEnable(void);
+
+/**
+ * @brief Check whether the scheduler runs on virtual time
+ * @return 1 if vVirtualTimeEnable() has been called, 0 otherwise
+ * **/
+int xVirtualTimeIsEnabled(void);
+
+/**
+ * @brief Advance the clock by one tick, called by the idle hook
+ * @note Does nothing on host time.
+ * @return non
+ * **/
+void vVirtualTimeIdle(void);
+
+/**
+ * @brief Account the duration of an event to the calling task
+ * @note Whole ticks are processed at once, which may switch to a task woken
+ *       by them. Does nothing on host time or before the scheduler runs.
+ * @param ulNs duration in nanoseconds
+ * @return non
+ * **/
+void vVirtualTimeCharge(uint32_t ulNs);
+
+/**
+ * @brief Read the virtual clock
+ * @return Nanoseconds since the scheduler was started, the tick count plus
+ *         the time charged since the last tick
+ * **/
+uint64_t ullVirtualTimeNs(void);
+
+#endif /* __FREERTOS_VIRTUAL_TIME_H */
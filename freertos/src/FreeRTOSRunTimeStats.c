@@ -0,0 +1,58 @@
+/*
+ * Copyright (c) 2023 Oliver Sintaj
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <stdint.h>
+#include <time.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "FreeRTOSRunTimeStats.h"
+
+/** @brief Host time at which the scheduler has been started **/
+static struct timespec xRunTimeOrigin;
+
+/** @brief Context switch counters, indexed by TCB number **/
+static volatile unsigned long ulSwitchCount[configRUN_TIME_STATS_MAX_TASKS];
+
+/** see header **/
+void vConfigureTimerForRunTimeStats(void)
+{
+    clock_gettime(CLOCK_MONOTONIC, &xRunTimeOrigin);
+}
+
+/** see header **/
+unsigned long ulGetRunTimeCounterValue(void)
+{
+    struct timespec xNow;
+    int64_t llElapsedUs;
+
+#if defined(FREERTOS_SIM_VIRTUAL_TIME) && (FREERTOS_SIM_VIRTUAL_TIME > 0)
+    if (xVirtualTimeIsEnabled())
+    {
+        return (unsigned long)(uint32_t)(ullVirtualTimeNs() / 1000ULL);
+    }
+#endif
+
+    clock_gettime(CLOCK_MONOTONIC, &xNow);
+
+    llElapsedUs = ((int64_t)xNow.tv_sec - (int64_t)xRunTimeOrigin.tv_sec) * 1000000LL +
+                  ((int64_t)xNow.tv_nsec - (int64_t)xRunTimeOrigin.tv_nsec) / 1000LL;
+
+    return (unsigned long)(uint32_t)llElapsedUs;
+}
+
+/** see header **/
+void vRunTimeStatsTaskSwitchedIn(unsigned long ulTaskNumber)
+{
+    ulSwitchCount[ulTaskNumber % configRUN_TIME_STATS_MAX_TASKS]++;
+}
+
+/** see header **/
+unsigned long ulRunTimeStatsGetSwitchCount(unsigned long ulTaskNumber)
+{
+    return ulSwitchCount[ulTaskNumber % configRUN_TIME_STATS_MAX_TASKS];
+}
@@ -0,0 +1,570 @@
+/*
+ * Copyright (c) 2023 Oliver Sintaj
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "FreeRTOSTrace.h"
+
+#if (configTRACE_RING_LENGTH & (configTRACE_RING_LENGTH - 1)) != 0
+#error "configTRACE_RING_LENGTH must be a power of two"
+#endif
+
+/* Chrome trace viewer processes used to group the timelines */
+#define traceSCHEDULER_PID      1
+#define traceTASKS_PID          2
+
+#define traceWRITE_BUFFER_SIZE  65536
+
+/* How long the writer waits for events being recorded, in 1 ms steps */
+#define traceWRITER_WAIT_MS     100
+
+typedef enum
+{
+    eTraceInstant = 0,
+    eTraceSlice,
+    eTraceCounter,
+    eTraceQueue
+} eTraceEventType;
+
+/** @brief Fixed size binary event, formatted only when the trace is written **/
+typedef struct xTRACE_EVENT
+{
+    uint64_t ullTimeNs;         /* Event time, or start of a slice */
+    uint64_t ullDurationNs;     /* Slice duration */
+    const char *pcName;         /* String literal, NULL for a scheduler slice */
+    uint32_t ulArg;             /* Argument, counter value or queue depth */
+    uint16_t usId;              /* Counter instance, queue or task slot */
+    uint8_t ucType;             /* eTraceEventType */
+} TraceEvent_t;
+
+/**
+ * @brief Single producer ring. The producer is the task owning the ring (or
+ *        the scheduler for the scheduler ring), the consumer is the trace
+ *        writer running at exit.
+ * **/
+typedef struct xTRACE_RING
+{
+    uint32_t ulHead;            /* Number of events ever written */
+    uint32_t ulWriting;         /* Set while the producer fills a slot */
+    TraceEvent_t xEvents[configTRACE_RING_LENGTH];
+} TraceRing_t;
+
+typedef struct xTRACE_TASK
+{
+    unsigned long ulNumber;     /* TCB number of the task owning the slot */
+    char cName[configMAX_TASK_NAME_LEN];
+    uint64_t ullSwitchedInNs;   /* Start of the current scheduler slice */
+    TraceRing_t xRing;
+} TraceTask_t;
+
+static TraceTask_t xTraceTasks[configTRACE_MAX_TASKS];
+static TraceRing_t xSchedulerRing;
+
+/** @brief TCB number of the running task, 0 until the scheduler is started **/
+static volatile unsigned long ulCurrentTask;
+
+static volatile int xTraceRunning;
+static int xTraceWritten;
+static struct timespec xTraceOrigin;
+static const char *pcTraceFileName;
+static unsigned long ulQueueCount;
+
+static char cWriteBuffer[traceWRITE_BUFFER_SIZE];
+static size_t xWriteLength;
+static int xWriteFd = -1;
+
+/* Posted by the signal handler, the writer thread does the rest */
+static sem_t xSignalSem;
+static volatile sig_atomic_t xSignalNumber;
+
+/*-----------------------------------------------------------*/
+
+/* NULL once the trace is being written. The producer flags the ring before
+ * it looks at xTraceRunning and the writer clears xTraceRunning before it
+ * looks at the flags, both sequentially consistent, so either the writer
+ * sees the event in progress or the producer sees the trace stopped. */
+static TraceEvent_t *prvRingReserve(TraceRing_t *pxRing)
+{
+    __atomic_store_n(&pxRing->ulWriting, 1, __ATOMIC_SEQ_CST);
+
+    if (!__atomic_load_n(&xTraceRunning, __ATOMIC_SEQ_CST))
+    {
+        __atomic_store_n(&pxRing->ulWriting, 0, __ATOMIC_RELEASE);
+        return NULL;
+    }
+
+    return &pxRing->xEvents[pxRing->ulHead & (configTRACE_RING_LENGTH - 1)];
+}
+
+static void prvRingCommit(TraceRing_t *pxRing)
+{
+    __atomic_store_n(&pxRing->ulHead, pxRing->ulHead + 1, __ATOMIC_RELEASE);
+    __atomic_store_n(&pxRing->ulWriting, 0, __ATOMIC_RELEASE);
+}
+
+static TraceRing_t *prvCurrentRing(void)
+{
+    return &xTraceTasks[ulCurrentTask % configTRACE_MAX_TASKS].xRing;
+}
+
+static void prvRecord(uint8_t ucType, const char *pcName, uint64_t ullTimeNs,
+                      uint64_t ullDurationNs, uint16_t usId, uint32_t ulArg)
+{
+    TraceRing_t *pxRing = prvCurrentRing();
+    TraceEvent_t *pxEvent = prvRingReserve(pxRing);
+
+    if (pxEvent == NULL)
+    {
+        return;
+    }
+
+    pxEvent->ullTimeNs = ullTimeNs;
+    pxEvent->ullDurationNs = ullDurationNs;
+    pxEvent->pcName = pcName;
+    pxEvent->ulArg = ulArg;
+    pxEvent->usId = usId;
+    pxEvent->ucType = ucType;
+
+    prvRingCommit(pxRing);
+}
+
+/*-----------------------------------------------------------*/
+
+static void prvWriteFlush(void)
+{
+    size_t xOffset = 0;
+
+    while (xOffset < xWriteLength)
+    {
+        ssize_t xRet = write(xWriteFd, &cWriteBuffer[xOffset], xWriteLength - xOffset);
+
+        if (xRet <= 0)
+        {
+            break;
+        }
+
+        xOffset += (size_t)xRet;
+    }
+
+    xWriteLength = 0;
+}
+
+/* Formats into a static buffer, only called by the one writer. */
+static void prvWritef(const char *pcFormat, ...)
+{
+    va_list xArgs;
+    int xLength;
+
+    if ((traceWRITE_BUFFER_SIZE - xWriteLength) < 512)
+    {
+        prvWriteFlush();
+    }
+
+    va_start(xArgs, pcFormat);
+    xLength = vsnprintf(&cWriteBuffer[xWriteLength], traceWRITE_BUFFER_SIZE - xWriteLength,
+                        pcFormat, xArgs);
+    va_end(xArgs);
+
+    if (xLength > 0)
+    {
+        xWriteLength += (size_t)xLength;
+        if (xWriteLength > traceWRITE_BUFFER_SIZE)
+        {
+            xWriteLength = traceWRITE_BUFFER_SIZE;
+        }
+    }
+}
+
+/* Chrome expects microseconds, keep the nanoseconds as decimals */
+#define traceUS_FMT             "%llu.%03u"
+#define traceUS_ARG(ns)         (unsigned long long)((ns) / 1000U), (unsigned)((ns) % 1000U)
+
+/* Task names are free text, escape them for a JSON string */
+static const char *prvJsonString(const char *pcIn, char *pcOut, size_t xSize)
+{
+    size_t xLength = 0;
+
+    for (; (*pcIn != '\0') && ((xLength + 7) <= xSize); pcIn++)
+    {
+        unsigned char ucChar = (unsigned char)*pcIn;
+
+        if ((ucChar == '"') || (ucChar == '\\'))
+        {
+            pcOut[xLength++] = '\\';
+            pcOut[xLength++] = (char)ucChar;
+        }
+        else if (ucChar < 0x20U)
+        {
+            xLength += (size_t)snprintf(&pcOut[xLength], xSize - xLength, "\\u%04x", ucChar);
+        }
+        else
+        {
+            pcOut[xLength++] = (char)ucChar;
+        }
+    }
+    pcOut[xLength] = '\0';
+
+    return pcOut;
+}
+
+/* Worst case of a name where every character is escaped as \u00XX */
+#define traceNAME_JSON_SIZE     (configMAX_TASK_NAME_LEN * 6 + 1)
+
+static void prvWriteEvent(const TraceEvent_t *pxEvent, unsigned long ulTid)
+{
+    switch (pxEvent->ucType)
+    {
+        case eTraceSlice:
+            prvWritef(",\n{\"name\":\"%s\",\"ph\":\"X\",\"ts\":" traceUS_FMT ",\"dur\":" traceUS_FMT
+                      ",\"pid\":%d,\"tid\":%lu,\"args\":{\"arg\":%lu}}",
+                      pxEvent->pcName, traceUS_ARG(pxEvent->ullTimeNs), traceUS_ARG(pxEvent->ullDurationNs),
+                      traceTASKS_PID, ulTid, (unsigned long)pxEvent->ulArg);
+            break;
+
+        case eTraceCounter:
+            prvWritef(",\n{\"name\":\"%s %u\",\"ph\":\"C\",\"ts\":" traceUS_FMT
+                      ",\"pid\":%d,\"args\":{\"value\":%lu}}",
+                      pxEvent->pcName, (unsigned)pxEvent->usId, traceUS_ARG(pxEvent->ullTimeNs),
+                      traceTASKS_PID, (unsigned long)pxEvent->ulArg);
+            break;
+
+        case eTraceQueue:
+            prvWritef(",\n{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"ts\":" traceUS_FMT
+                      ",\"pid\":%d,\"tid\":%lu,\"args\":{\"queue\":%u,\"depth\":%lu}}",
+                      pxEvent->pcName, traceUS_ARG(pxEvent->ullTimeNs), traceTASKS_PID, ulTid,
+                      (unsigned)pxEvent->usId, (unsigned long)pxEvent->ulArg);
+            prvWritef(",\n{\"name\":\"queue %u\",\"ph\":\"C\",\"ts\":" traceUS_FMT
+                      ",\"pid\":%d,\"args\":{\"depth\":%lu}}",
+                      (unsigned)pxEvent->usId, traceUS_ARG(pxEvent->ullTimeNs), traceTASKS_PID,
+                      (unsigned long)pxEvent->ulArg);
+            break;
+
+        case eTraceInstant:
+        default:
+            prvWritef(",\n{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"ts\":" traceUS_FMT
+                      ",\"pid\":%d,\"tid\":%lu,\"args\":{\"arg\":%lu}}",
+                      pxEvent->pcName, traceUS_ARG(pxEvent->ullTimeNs), traceTASKS_PID, ulTid,
+                      (unsigned long)pxEvent->ulArg);
+            break;
+    }
+}
+
+static void prvWriteSchedulerSlice(const TraceEvent_t *pxEvent)
+{
+    const TraceTask_t *pxTask = &xTraceTasks[pxEvent->usId];
+    char cName[traceNAME_JSON_SIZE];
+
+    prvWritef(",\n{\"name\":\"%s\",\"ph\":\"X\",\"ts\":" traceUS_FMT ",\"dur\":" traceUS_FMT
+              ",\"pid\":%d,\"tid\":0}",
+              prvJsonString(pxTask->cName, cName, sizeof(cName)), traceUS_ARG(pxEvent->ullTimeNs), traceUS_ARG(pxEvent->ullDurationNs),
+              traceSCHEDULER_PID);
+}
+
+static void prvWriteRing(const TraceRing_t *pxRing, unsigned long ulTid, int xScheduler)
+{
+    int xWriting = __atomic_load_n(&pxRing->ulWriting, __ATOMIC_SEQ_CST);
+    uint32_t ulHead = __atomic_load_n(&pxRing->ulHead, __ATOMIC_ACQUIRE);
+    uint32_t ulIndex = (ulHead > configTRACE_RING_LENGTH) ? (ulHead - configTRACE_RING_LENGTH) : 0;
+
+    /* An event still being recorded overwrites the oldest one of a full
+     * ring, leave that one out */
+    if (xWriting && (ulHead >= configTRACE_RING_LENGTH))
+    {
+        ulIndex++;
+    }
+
+    for (; ulIndex != ulHead; ulIndex++)
+    {
+        const TraceEvent_t *pxEvent = &pxRing->xEvents[ulIndex & (configTRACE_RING_LENGTH - 1)];
+
+        if (xScheduler)
+        {
+            prvWriteSchedulerSlice(pxEvent);
+        }
+        else
+        {
+            prvWriteEvent(pxEvent, ulTid);
+        }
+    }
+}
+
+static int prvRingsBusy(void)
+{
+    if (__atomic_load_n(&xSchedulerRing.ulWriting, __ATOMIC_SEQ_CST))
+    {
+        return 1;
+    }
+
+    for (unsigned long ulSlot = 0; ulSlot < configTRACE_MAX_TASKS; ulSlot++)
+    {
+        if (__atomic_load_n(&xTraceTasks[ulSlot].xRing.ulWriting, __ATOMIC_SEQ_CST))
+        {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/* Once tracing is stopped, a producer has at most the event it started to
+ * finish. A task the scheduler does not run again, e.g. while another one
+ * exits, never does, prvWriteRing() then leaves out the slot it fills. */
+static void prvWaitProducers(void)
+{
+    for (int i = 0; (i < traceWRITER_WAIT_MS) && prvRingsBusy(); i++)
+    {
+        usleep(1000);
+    }
+}
+
+static void prvTraceWrite(void)
+{
+    char cName[traceNAME_JSON_SIZE];
+
+    if (__atomic_exchange_n(&xTraceWritten, 1, __ATOMIC_ACQ_REL))
+    {
+        return;
+    }
+
+    __atomic_store_n(&xTraceRunning, 0, __ATOMIC_SEQ_CST);
+    prvWaitProducers();
+
+    xWriteFd = open(pcTraceFileName, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (xWriteFd < 0)
+    {
+        return;
+    }
+
+    prvWritef("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n"
+              "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"scheduler\"}},\n"
+              "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":0,\"args\":{\"name\":\"cpu\"}},\n"
+              "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"tasks\"}}",
+              traceSCHEDULER_PID, traceSCHEDULER_PID, traceTASKS_PID);
+
+    for (unsigned long ulSlot = 0; ulSlot < configTRACE_MAX_TASKS; ulSlot++)
+    {
+        const TraceTask_t *pxTask = &xTraceTasks[ulSlot];
+
+        if (pxTask->cName[0] != '\0')
+        {
+            prvWritef(",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%lu,"
+                      "\"args\":{\"name\":\"%s\"}}",
+                      traceTASKS_PID, ulSlot, prvJsonString(pxTask->cName, cName, sizeof(cName)));
+        }
+    }
+
+    prvWriteRing(&xSchedulerRing, 0, 1);
+
+    for (unsigned long ulSlot = 0; ulSlot < configTRACE_MAX_TASKS; ulSlot++)
+    {
+        prvWriteRing(&xTraceTasks[ulSlot].xRing, ulSlot, 0);
+    }
+
+    prvWritef("\n]}\n");
+    prvWriteFlush();
+    close(xWriteFd);
+}
+
+static void prvTraceAtExit(void)
+{
+    prvTraceWrite();
+}
+
+/* Only async-signal-safe calls here: stop recording and wake the writer */
+static void prvTraceSignalHandler(int xSignal)
+{
+    __atomic_store_n(&xTraceRunning, 0, __ATOMIC_SEQ_CST);
+    xSignalNumber = xSignal;
+    sem_post(&xSignalSem);
+}
+
+/* Plain thread with every signal blocked, it runs whatever state the
+ * scheduler is in. */
+static void *prvTraceSignalThread(void *pvArg)
+{
+    int xSignal;
+
+    (void)pvArg;
+
+    while (sem_wait(&xSignalSem) != 0)
+    {
+    }
+    xSignal = xSignalNumber;
+
+    prvTraceWrite();
+
+    /* The handler has been installed with SA_RESETHAND, so this terminates
+     * the process as if the handler had never been there. */
+    kill(getpid(), xSignal);
+
+    return NULL;
+}
+
+/*-----------------------------------------------------------*/
+
+/** see header **/
+void vTraceStart(const char *pcFileName)
+{
+    struct sigaction xAction;
+    sigset_t xAll;
+    sigset_t xOld;
+    pthread_t xThread;
+
+    pcTraceFileName = pcFileName;
+    clock_gettime(CLOCK_MONOTONIC, &xTraceOrigin);
+
+    /* Events recorded before the scheduler is started */
+    strncpy(xTraceTasks[0].cName, "main", sizeof(xTraceTasks[0].cName) - 1);
+
+    atexit(prvTraceAtExit);
+
+    sem_init(&xSignalSem, 0, 0);
+    sigfillset(&xAll);
+    pthread_sigmask(SIG_BLOCK, &xAll, &xOld);
+    if (pthread_create(&xThread, NULL, prvTraceSignalThread, NULL) == 0)
+    {
+        pthread_detach(xThread);
+    }
+    pthread_sigmask(SIG_SETMASK, &xOld, NULL);
+
+    memset(&xAction, 0, sizeof(xAction));
+    xAction.sa_handler = prvTraceSignalHandler;
+    xAction.sa_flags = SA_RESETHAND;
+    sigemptyset(&xAction.sa_mask);
+    sigaction(SIGINT, &xAction, NULL);
+    sigaction(SIGTERM, &xAction, NULL);
+
+    xTraceRunning = 1;
+}
+
+/** see header **/
+uint64_t ullTraceTimestamp(void)
+{
+    struct timespec xNow;
+
+#if defined(FREERTOS_SIM_VIRTUAL_TIME) && (FREERTOS_SIM_VIRTUAL_TIME > 0)
+    if (xVirtualTimeIsEnabled())
+    {
+        return ullVirtualTimeNs();
+    }
+#endif
+
+    clock_gettime(CLOCK_MONOTONIC, &xNow);
+
+    return (uint64_t)(xNow.tv_sec - xTraceOrigin.tv_sec) * 1000000000ULL +
+           (uint64_t)(xNow.tv_nsec - xTraceOrigin.tv_nsec);
+}
+
+/** see header **/
+void vTraceInstant(const char *pcName, uint32_t ulArg)
+{
+    if (xTraceRunning)
+    {
+        prvRecord(eTraceInstant, pcName, ullTraceTimestamp(), 0, 0, ulArg);
+    }
+}
+
+/** see header **/
+void vTraceSlice(const char *pcName, uint64_t ullStartNs, uint32_t ulArg)
+{
+    if (xTraceRunning)
+    {
+        prvRecord(eTraceSlice, pcName, ullStartNs, ullTraceTimestamp() - ullStartNs, 0, ulArg);
+    }
+}
+
+/** see header **/
+void vTraceCounter(const char *pcName, uint16_t usId, uint32_t ulValue)
+{
+    if (xTraceRunning)
+    {
+        prvRecord(eTraceCounter, pcName, ullTraceTimestamp(), 0, usId, ulValue);
+    }
+}
+
+/** see header **/
+void vTraceTaskSwitchedIn(unsigned long ulTaskNumber, const char *pcTaskName)
+{
+    TraceTask_t *pxTask = &xTraceTasks[ulTaskNumber % configTRACE_MAX_TASKS];
+
+    ulCurrentTask = ulTaskNumber;
+
+    if (!xTraceRunning)
+    {
+        return;
+    }
+
+    /* A slot is reused when more than configTRACE_MAX_TASKS tasks have been
+     * created, the events left by the previous owner get the new name. */
+    if (pxTask->ulNumber != ulTaskNumber)
+    {
+        pxTask->ulNumber = ulTaskNumber;
+        strncpy(pxTask->cName, pcTaskName, sizeof(pxTask->cName) - 1);
+    }
+
+    pxTask->ullSwitchedInNs = ullTraceTimestamp();
+}
+
+/** see header **/
+void vTraceTaskSwitchedOut(unsigned long ulTaskNumber)
+{
+    unsigned long ulSlot = ulTaskNumber % configTRACE_MAX_TASKS;
+    TraceTask_t *pxTask = &xTraceTasks[ulSlot];
+    TraceEvent_t *pxEvent;
+    uint64_t ullNow;
+
+    /* Skip the slice the task was running in when tracing got enabled */
+    if (!xTraceRunning || (pxTask->ulNumber != ulTaskNumber) || (pxTask->ullSwitchedInNs == 0))
+    {
+        return;
+    }
+
+    ullNow = ullTraceTimestamp();
+
+    pxEvent = prvRingReserve(&xSchedulerRing);
+    if (pxEvent == NULL)
+    {
+        return;
+    }
+
+    pxEvent->ullTimeNs = pxTask->ullSwitchedInNs;
+    pxEvent->ullDurationNs = ullNow - pxTask->ullSwitchedInNs;
+    pxEvent->pcName = NULL;
+    pxEvent->ulArg = 0;
+    pxEvent->usId = (uint16_t)ulSlot;
+    pxEvent->ucType = eTraceSlice;
+    prvRingCommit(&xSchedulerRing);
+}
+
+/** see header **/
+unsigned long ulTraceQueueCreated(void)
+{
+    return __atomic_add_fetch(&ulQueueCount, 1, __ATOMIC_RELAXED);
+}
+
+/** see header **/
+void vTraceQueueEvent(const char *pcName, unsigned long ulQueueNumber,
+                      unsigned long ulMessagesWaiting)
+{
+    if (xTraceRunning)
+    {
+        prvRecord(eTraceQueue, pcName, ullTraceTimestamp(), 0, (uint16_t)ulQueueNumber,
+                  (uint32_t)ulMessagesWaiting);
+    }
+}
@@ -0,0 +1,112 @@
+/*
+ * Copyright (c) 2023 Oliver Sintaj
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "FreeRTOSVirtualTime.h"
+
+/** @brief Length of a tick **/
+#define virtualTICK_NS      (1000000000ULL / configTICK_RATE_HZ)
+
+/** @brief Set by vVirtualTimeEnable() **/
+static volatile int xVirtualTimeOn;
+
+/** @brief Ticks processed since the scheduler was started **/
+static uint64_t ullVirtualTicks;
+
+/** @brief Time charged since the last tick, always below a tick **/
+static uint64_t ullVirtualResidueNs;
+
+/* The simulator port arms ITIMER_REAL in xPortStartScheduler(), the link
+ * step diverts that call here with -Wl,--wrap=setitimer. */
+int __real_setitimer(int xWhich, const struct itimerval *pxNew, struct itimerval *pxOld);
+int __wrap_setitimer(int xWhich, const struct itimerval *pxNew, struct itimerval *pxOld);
+
+int __wrap_setitimer(int xWhich, const struct itimerval *pxNew, struct itimerval *pxOld)
+{
+    if (xVirtualTimeOn && (xWhich == ITIMER_REAL))
+    {
+        if (pxOld != NULL)
+        {
+            memset(pxOld, 0, sizeof(*pxOld));
+        }
+        return 0;
+    }
+
+    return __real_setitimer(xWhich, pxNew, pxOld);
+}
+
+/* Process ulTicks ticks from task context, ullNs is the new residue. Ticks
+ * given to the kernel while the scheduler is suspended are pended, and
+ * processed by xTaskResumeAll(), which also switches to a task they woke. */
+static void prvAdvance(uint32_t ulTicks, uint64_t ullNs)
+{
+    vTaskSuspendAll();
+    {
+        ullVirtualTicks += ulTicks;
+        ullVirtualResidueNs = ullNs;
+        while (ulTicks-- > 0)
+        {
+            (void)xTaskIncrementTick();
+        }
+    }
+    (void)xTaskResumeAll();
+}
+
+/*-----------------------------------------------------------*/
+
+/** see header **/
+void vVirtualTimeEnable(void)
+{
+    xVirtualTimeOn = 1;
+}
+
+/** see header **/
+int xVirtualTimeIsEnabled(void)
+{
+    return xVirtualTimeOn;
+}
+
+/** see header **/
+void vVirtualTimeIdle(void)
+{
+    if (xVirtualTimeOn)
+    {
+        prvAdvance(1, 0);
+    }
+}
+
+/** see header **/
+void vVirtualTimeCharge(uint32_t ulNs)
+{
+    uint64_t ullNs;
+
+    if (!xVirtualTimeOn || (xTaskGetSchedulerState() != taskSCHEDULER_RUNNING))
+    {
+        return;
+    }
+
+    ullNs = ullVirtualResidueNs + ulNs;
+    if (ullNs < virtualTICK_NS)
+    {
+        ullVirtualResidueNs = ullNs;
+    }
+    else
+    {
+        prvAdvance((uint32_t)(ullNs / virtualTICK_NS), ullNs % virtualTICK_NS);
+    }
+}
+
+/** see header **/
+uint64_t ullVirtualTimeNs(void)
+{
+    return ullVirtualTicks * virtualTICK_NS + ullVirtualResidueNs;
+}
@@ -0,0 +1,330 @@
+/*
+ * Copyright (c) 2023 Oliver Sintaj
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Packet rate benchmark of batchif, with one end of a socketpair() as the
+ * link and a host thread as the peer, so no tap device is needed.
+ *
+ * rx: the peer sends UDP frames as fast as the socket accepts them, lwIP
+ *     receives them on a raw UDP pcb.
+ * tx: a task sends broadcast UDP frames as fast as lwIP accepts them, the
+ *     peer counts them.
+ *
+ * Batch 1 gives the behaviour of tapif, a system call and a core lock for
+ * every frame, to compare with larger batches.
+ *
+ * Usage: batchif_bench [-b batch] [-s payload size] [-t seconds] [rx|tx]
+ */
+
+#define _GNU_SOURCE /* recvmmsg(), sendmmsg() */
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+
+#include "lwip/opt.h"
+#include "lwip/etharp.h"
+#include "lwip/inet_chksum.h"
+#include "lwip/init.h"
+#include "lwip/ip_addr.h"
+#include "lwip/netif.h"
+#include "lwip/sys.h"
+#include "lwip/tcpip.h"
+#include "lwip/udp.h"
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "netif/batchif.h"
+
+#define BENCH_PORT       5001
+#define BENCH_PEER_BATCH 64
+#define BENCH_HDR_LEN    (14 + 20 + 8)
+
+static struct netif bench_netif;
+static int bench_tx;
+static u16_t bench_batch;
+static unsigned bench_seconds = 5;
+static u16_t bench_size = 18;
+static int peer_fd;
+static u8_t frame[BENCH_HDR_LEN + 1500];
+
+static volatile int running;
+static volatile u32_t peer_frames;
+static volatile u32_t stack_frames;
+
+void vAssertCalled(unsigned long ulLine, const char * const pcFileName);
+void vApplicationIdleHook(void);
+void vApplicationTickHook(void);
+void vApplicationMallocFailedHook(void);
+
+void
+vAssertCalled(unsigned long ulLine, const char * const pcFileName)
+{
+  printf("[ASSERT] %s:%lu\n", pcFileName, ulLine);
+  exit(EXIT_FAILURE);
+}
+
+void
+vApplicationIdleHook(void)
+{
+}
+
+void
+vApplicationTickHook(void)
+{
+}
+
+void
+vApplicationMallocFailedHook(void)
+{
+  vAssertCalled(__LINE__, __FILE__);
+}
+
+static uint64_t
+now_ns(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (uint64_t)ts.tv_sec * 1000000000U + (uint64_t)ts.tv_nsec;
+}
+
+/* Ethernet, IPv4 and UDP frame from 192.168.0.1 to the lwIP address */
+static u16_t
+build_frame(void)
+{
+  u16_t ip_len = (u16_t)(20 + 8 + bench_size);
+  u8_t *ip = frame + 14;
+  u8_t *udp = ip + 20;
+  u16_t chksum;
+
+  memcpy(frame, bench_netif.hwaddr, 6);
+  memcpy(frame + 6, "\x02\x00\x00\x00\x00\x01", 6);
+  frame[12] = 0x08;
+  frame[13] = 0x00;
+
+  ip[0] = 0x45;
+  ip[2] = (u8_t)(ip_len >> 8);
+  ip[3] = (u8_t)ip_len;
+  ip[6] = 0x40;
+  ip[8] = 64;
+  ip[9] = IP_PROTO_UDP;
+  memcpy(ip + 12, "\xc0\xa8\x00\x01\xc0\xa8\x00\x02", 8);
+  chksum = inet_chksum(ip, 20);
+  memcpy(ip + 10, &chksum, sizeof(chksum));
+
+  /* A zero UDP checksum is not verified */
+  udp[0] = (u8_t)(BENCH_PORT >> 8);
+  udp[1] = (u8_t)BENCH_PORT;
+  udp[2] = (u8_t)(BENCH_PORT >> 8);
+  udp[3] = (u8_t)BENCH_PORT;
+  udp[4] = (u8_t)((8 + bench_size) >> 8);
+  udp[5] = (u8_t)(8 + bench_size);
+  memset(udp + 8, 'z', bench_size);
+
+  return (u16_t)(14 + ip_len);
+}
+
+/* Host side of the link, must not call into FreeRTOS or lwIP */
+static void *
+peer_thread(void *arg)
+{
+  struct mmsghdr msgs[BENCH_PEER_BATCH];
+  struct iovec iov[BENCH_PEER_BATCH];
+  static u8_t rx_buf[BENCH_PEER_BATCH][BATCHIF_FRAME_SIZE];
+  u16_t len = 0;
+  int i;
+
+  LWIP_UNUSED_ARG(arg);
+
+  while (!running) {
+    usleep(1000);
+  }
+
+  if (!bench_tx) {
+    len = build_frame();
+  }
+  memset(msgs, 0, sizeof(msgs));
+  for (i = 0; i < BENCH_PEER_BATCH; i++) {
+    iov[i].iov_base = bench_tx ? rx_buf[i] : frame;
+    iov[i].iov_len = bench_tx ? sizeof(rx_buf[i]) : len;
+    msgs[i].msg_hdr.msg_iov = &iov[i];
+    msgs[i].msg_hdr.msg_iovlen = 1;
+  }
+
+  while (running) {
+    int ret;
+
+    if (bench_tx) {
+      ret = recvmmsg(peer_fd, msgs, BENCH_PEER_BATCH, MSG_WAITFORONE, NULL);
+    } else {
+      ret = sendmmsg(peer_fd, msgs, BENCH_PEER_BATCH, 0);
+    }
+    if (ret > 0) {
+      peer_frames += (u32_t)ret;
+    }
+  }
+
+  return NULL;
+}
+
+static void
+bench_recv(void *arg, struct udp_pcb *pcb, struct pbuf *p,
+           const ip_addr_t *addr, u16_t port)
+{
+  LWIP_UNUSED_ARG(arg);
+  LWIP_UNUSED_ARG(pcb);
+  LWIP_UNUSED_ARG(addr);
+  LWIP_UNUSED_ARG(port);
+
+  stack_frames++;
+  pbuf_free(p);
+}
+
+static void
+bench_task(void *arg)
+{
+  struct batchif_stats stats;
+  struct udp_pcb *pcb;
+  uint64_t start;
+  uint64_t end;
+  u32_t frames;
+  double seconds;
+
+  LWIP_UNUSED_ARG(arg);
+
+  LOCK_TCPIP_CORE();
+  pcb = udp_new();
+  udp_bind(pcb, IP4_ADDR_ANY, BENCH_PORT);
+  udp_recv(pcb, bench_recv, NULL);
+  ip_set_option(pcb, SOF_BROADCAST);
+  UNLOCK_TCPIP_CORE();
+
+  start = now_ns();
+  end = start + (uint64_t)bench_seconds * 1000000000U;
+  running = 1;
+
+  if (bench_tx) {
+    while (now_ns() < end) {
+      int i;
+
+      for (i = 0; i < 256; i++) {
+        struct pbuf *p = pbuf_alloc(PBUF_TRANSPORT, bench_size, PBUF_RAM);
+
+        if (p == NULL) {
+          break;
+        }
+        memset(p->payload, 'z', bench_size);
+        LOCK_TCPIP_CORE();
+        udp_sendto(pcb, p, IP4_ADDR_BROADCAST, BENCH_PORT);
+        UNLOCK_TCPIP_CORE();
+        pbuf_free(p);
+        stack_frames++;
+      }
+    }
+  } else {
+    sys_msleep(bench_seconds * 1000U);
+  }
+
+  running = 0;
+  end = now_ns();
+  seconds = (double)(end - start) / 1e9;
+  batchif_get_stats(&bench_netif, &stats);
+  frames = bench_tx ? peer_frames : stack_frames;
+
+  printf("%s batch %u size %u: %.0f frames/s (%u sent, %u received)\n",
+         bench_tx ? "tx" : "rx", (unsigned)bench_batch, (unsigned)bench_size,
+         frames / seconds,
+         (unsigned)(bench_tx ? stack_frames : peer_frames), (unsigned)frames);
+  printf("rx: %u wakeups, %u syscalls, %u frames\n",
+         (unsigned)stats.rx_wakeups, (unsigned)stats.rx_syscalls,
+         (unsigned)stats.rx_frames);
+  printf("tx: %u flushes, %u syscalls, %u frames\n",
+         (unsigned)stats.tx_flushes, (unsigned)stats.tx_syscalls,
+         (unsigned)stats.tx_frames);
+
+  exit(EXIT_SUCCESS);
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct batchif_config config;
+  ip4_addr_t ipaddr, netmask, gw;
+  struct timeval timeout = { 0, 100000 };
+  sigset_t all, old;
+  pthread_t peer;
+  int sv[2];
+  int opt;
+
+  config.fd = -1;
+  config.batch = 0;
+
+  while ((opt = getopt(argc, argv, "b:s:t:")) != -1) {
+    switch (opt) {
+      case 'b':
+        config.batch = (u16_t)atoi(optarg);
+        break;
+      case 's':
+        bench_size = (u16_t)LWIP_MIN(atoi(optarg), 1472);
+        break;
+      case 't':
+        bench_seconds = (unsigned)atoi(optarg);
+        break;
+      default:
+        printf("usage: %s [-b batch] [-s payload size] [-t seconds] [rx|tx]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+  }
+  bench_tx = (optind < argc) && (strcmp(argv[optind], "tx") == 0);
+
+  if (socketpair(AF_UNIX, SOCK_DGRAM, 0, sv) != 0) {
+    perror("socketpair");
+    return EXIT_FAILURE;
+  }
+  config.fd = sv[0];
+  peer_fd = sv[1];
+  /* Lets the peer notice the end of a tx run */
+  setsockopt(peer_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+  lwip_init();
+  if (sys_mutex_new(&lock_tcpip_core) != ERR_OK) {
+    return EXIT_FAILURE;
+  }
+
+  IP4_ADDR(&gw, 192, 168, 0, 1);
+  IP4_ADDR(&ipaddr, 192, 168, 0, 2);
+  IP4_ADDR(&netmask, 255, 255, 255, 0);
+  if (netif_add(&bench_netif, &ipaddr, &netmask, &gw, &config, batchif_init,
+                ethernet_input) == NULL) {
+    printf("batchif_init failed\n");
+    return EXIT_FAILURE;
+  }
+  netif_set_default(&bench_netif);
+  netif_set_up(&bench_netif);
+
+  /* The simulator drives its tasks with signals, keep them away from the
+     peer thread */
+  sigfillset(&all);
+  pthread_sigmask(SIG_BLOCK, &all, &old);
+  pthread_create(&peer, NULL, peer_thread, NULL);
+  pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+  bench_batch = (config.batch != 0) ? LWIP_MIN(config.batch, BATCHIF_BATCH_MAX) : BATCHIF_BATCH_MAX;
+  sys_thread_new("bench", bench_task, NULL, DEFAULT_THREAD_STACKSIZE,
+                 DEFAULT_THREAD_PRIO);
+  vTaskStartScheduler();
+
+  return EXIT_FAILURE;
+}
@@ -0,0 +1,233 @@
+/*
+ * Copyright (c) 2023 Oliver Sintaj
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Microbenchmark of lwip_sim_chksum() against the stock
+ * lwip_standard_chksum(), over the payload sizes seen by zperf and every
+ * alignment within a 64 bit word. Both results are compared on every call,
+ * the exit status is non zero on any mismatch.
+ *
+ * lwip_sim_chksum_copy() is compared the same way against what lwIP does
+ * without it, memcpy() followed by a checksum of the copy.
+ *
+ * Usage: chksum_bench [iterations]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "lwip/opt.h"
+#include "lwip/arch.h"
+
+#include "arch/chksum.h"
+
+#define BENCH_MAX_SIZE   65535
+#define BENCH_ALIGNMENTS 8
+
+typedef uint16_t (*chksum_fn)(const void *dataptr, int len);
+
+static const int sizes[] = { 1, 2, 3, 20, 40, 63, 64, 65, 128, 256, 333, 512,
+                             1024, 1460, 1472, 1500, 4096, 9000, BENCH_MAX_SIZE };
+
+static u8_t buffer[BENCH_MAX_SIZE + BENCH_ALIGNMENTS];
+static u8_t copy[BENCH_MAX_SIZE + BENCH_ALIGNMENTS];
+
+static uint64_t
+now_ns(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (uint64_t)ts.tv_sec * 1000000000U + (uint64_t)ts.tv_nsec;
+}
+
+static uint64_t
+bench(chksum_fn fn, const u8_t *data, int len, unsigned iterations)
+{
+  volatile uint16_t sink = 0;
+  uint64_t start = now_ns();
+  unsigned i;
+
+  for (i = 0; i < iterations; i++) {
+    sink ^= fn(data, len);
+  }
+  (void)sink;
+
+  return now_ns() - start;
+}
+
+/* Stock LWIP_CHKSUM_COPY, as lwip_chksum_copy() in core/inet_chksum.c */
+static uint16_t
+copy_then_chksum(void *dst, const void *src, uint16_t len)
+{
+  memcpy(dst, src, len);
+
+  return lwip_standard_chksum(dst, len);
+}
+
+static uint64_t
+bench_copy(uint16_t (*fn)(void *, const void *, uint16_t), u8_t *dst,
+           const u8_t *src, uint16_t len, unsigned iterations)
+{
+  volatile uint16_t sink = 0;
+  uint64_t start = now_ns();
+  unsigned i;
+
+  for (i = 0; i < iterations; i++) {
+    sink ^= fn(dst, src, len);
+  }
+  (void)sink;
+
+  return now_ns() - start;
+}
+
+/* The copy must be exact and must not write past dst + len */
+static int
+verify_copy(int src_align, int dst_align, int len)
+{
+  const u8_t *src = buffer + src_align;
+  u8_t *dst = copy + dst_align;
+  uint16_t ref = lwip_standard_chksum(src, len);
+  uint16_t sim;
+
+  memset(copy, 0x5a, sizeof(copy));
+  sim = lwip_sim_chksum_copy(dst, src, (uint16_t)len);
+
+  if ((sim != ref) || (memcmp(dst, src, (size_t)len) != 0) ||
+      (dst[len] != 0x5a) || ((dst_align > 0) && (dst[-1] != 0x5a))) {
+    return 1;
+  }
+
+  return 0;
+}
+
+/* Exhaustive comparison on small lengths and random data, including all
+ * zero and all one bytes which stress the carry folding. */
+static int
+verify(void)
+{
+  int errors = 0;
+  int fill;
+  int len;
+  int align;
+
+  for (fill = 0; fill < 3; fill++) {
+    size_t i;
+
+    for (i = 0; i < sizeof(buffer); i++) {
+      buffer[i] = (fill == 0) ? 0x00 : (fill == 1) ? 0xff : (u8_t)rand();
+    }
+
+    for (align = 0; align < BENCH_ALIGNMENTS; align++) {
+      for (len = 0; len <= 1024; len++) {
+        uint16_t ref = lwip_standard_chksum(buffer + align, len);
+        uint16_t sim = lwip_sim_chksum(buffer + align, len);
+
+        if (ref != sim) {
+          if (errors++ < 10) {
+            printf("mismatch: fill %d align %d len %d: %04x != %04x\n",
+                   fill, align, len, sim, ref);
+          }
+        }
+
+        /* Source and destination alignments differ in pbufs */
+        if (verify_copy(align, (align * 3) % BENCH_ALIGNMENTS, len) != 0) {
+          if (errors++ < 10) {
+            printf("copy mismatch: fill %d align %d len %d\n", fill, align, len);
+          }
+        }
+      }
+    }
+  }
+
+  return errors;
+}
+
+int
+main(int argc, char *argv[])
+{
+  unsigned iterations = (argc > 1) ? (unsigned)strtoul(argv[1], NULL, 10) : 0;
+  int errors;
+  size_t s;
+  size_t i;
+
+  srand(1);
+  errors = verify();
+
+  for (i = 0; i < sizeof(buffer); i++) {
+    buffer[i] = (u8_t)rand();
+  }
+
+  printf("lwip_sim_chksum (%s) vs lwip_standard_chksum\n", lwip_sim_chksum_impl());
+  printf("%6s %5s %10s %10s %8s %8s %7s\n",
+         "size", "align", "stock ns", "sim ns", "stock", "sim", "speedup");
+
+  for (s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+    int len = sizes[s];
+    /* About 64 MiB per measurement, so each one runs for a few ms */
+    unsigned n = (iterations != 0) ? iterations : (unsigned)((64U << 20) / (unsigned)len);
+    int align;
+
+    for (align = 0; align < BENCH_ALIGNMENTS; align++) {
+      const u8_t *data = buffer + align;
+      uint64_t stock;
+      uint64_t sim;
+
+      if (lwip_standard_chksum(data, len) != lwip_sim_chksum(data, len)) {
+        printf("mismatch: align %d len %d\n", align, len);
+        errors++;
+      }
+
+      stock = bench(lwip_standard_chksum, data, len, n);
+      sim = bench(lwip_sim_chksum, data, len, n);
+
+      printf("%6d %5d %10.1f %10.1f %6.2fG/s %6.2fG/s %6.2fx\n", len, align,
+             (double)stock / n, (double)sim / n,
+             (double)len * n / (double)stock, (double)len * n / (double)sim,
+             (sim != 0) ? (double)stock / (double)sim : 0.0);
+    }
+  }
+
+  printf("\nlwip_sim_chksum_copy vs memcpy + lwip_standard_chksum\n");
+  printf("%6s %5s %10s %10s %8s %8s %7s\n",
+         "size", "align", "stock ns", "sim ns", "stock", "sim", "speedup");
+
+  for (s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+    int len = sizes[s];
+    unsigned n = (iterations != 0) ? iterations : (unsigned)((64U << 20) / (unsigned)len);
+    int align;
+
+    for (align = 0; align < BENCH_ALIGNMENTS; align++) {
+      const u8_t *src = buffer + align;
+      u8_t *dst = copy + ((align * 3) % BENCH_ALIGNMENTS);
+      uint64_t stock;
+      uint64_t sim;
+
+      if (verify_copy(align, (align * 3) % BENCH_ALIGNMENTS, len) != 0) {
+        printf("copy mismatch: align %d len %d\n", align, len);
+        errors++;
+      }
+
+      stock = bench_copy(copy_then_chksum, dst, src, (uint16_t)len, n);
+      sim = bench_copy(lwip_sim_chksum_copy, dst, src, (uint16_t)len, n);
+
+      printf("%6d %5d %10.1f %10.1f %6.2fG/s %6.2fG/s %6.2fx\n", len, align,
+             (double)stock / n, (double)sim / n,
+             (double)len * n / (double)stock, (double)len * n / (double)sim,
+             (sim != 0) ? (double)stock / (double)sim : 0.0);
+    }
+  }
+
+  if (errors != 0) {
+    printf("%d mismatches\n", errors);
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
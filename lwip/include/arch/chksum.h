@@ -0,0 +1,44 @@
+/*
+ * Copyright (c) 2023 Oliver Sintaj
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef LWIP_ARCH_CHKSUM_H
+#define LWIP_ARCH_CHKSUM_H
+
+#include <stdint.h>
+
+/**
+ * @brief Internet checksum of the simulator, used by lwIP as LWIP_CHKSUM
+ * @note Same result as lwip_standard_chksum(): the ones' complement sum of
+ *       the data read as 16 bit words in host byte order, not complemented.
+ *       The implementation (AVX2, SSE2 or portable) is selected at build time
+ *       with the LWIP_CHKSUM_IMPL CMake cache variable, see port/chksum.c.
+ * @param dataptr start of the data, no alignment required
+ * @param len number of bytes
+ * @return Folded 16 bit sum
+ * **/
+uint16_t lwip_sim_chksum(const void *dataptr, int len);
+
+/**
+ * @brief Copy data and return its checksum, used by lwIP as LWIP_CHKSUM_COPY
+ *        when copying application data into pbufs
+ * @note Reads every byte once, unlike memcpy() followed by a checksum.
+ * @param dst destination, must not overlap @p src
+ * @param src data to copy
+ * @param len number of bytes
+ * @return Same value as lwip_sim_chksum(dst, len)
+ * **/
+uint16_t lwip_sim_chksum_copy(void *dst, const void *src, uint16_t len);
+
+/**
+ * @brief Name of the implementation compiled in, e.g. "sse2"
+ * **/
+const char *lwip_sim_chksum_impl(void);
+
+/* The stock routine is kept built as a reference, it is only declared by
+ * inet_chksum.c when LWIP_CHKSUM is not overridden. */
+uint16_t lwip_standard_chksum(const void *dataptr, int len);
+
+#endif /* LWIP_ARCH_CHKSUM_H */
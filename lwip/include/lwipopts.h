@@ -40,6 +40,8 @@
 // #define MEMP_NUM_SYS_TIMEOUT 5000
 #define LWIP_FREERTOS_CHECK_CORE_LOCKING 1
 #define LWIP_SO_RCVTIMEO 1
+/* SO_RCVBUF bounds the datagrams queued on a UDP socket */
+#define LWIP_SO_RCVBUF 1
 #define SOCKETS_DEBUG LWIP_DBG_ON
 
 #define LWIP_DBG_MIN_LEVEL 0
@@ -80,7 +82,9 @@
 /*#define SIO_DEBUG		LWIP_DBG_ON*/
 
 #define TCPIP_MBOX_SIZE						5
-#define DEFAULT_TCP_RECVMBOX_SIZE           5
+/* A segment takes an entry until the socket reads it, a full mailbox
+   drops what arrives, so there is one per segment of a full window */
+#define DEFAULT_TCP_RECVMBOX_SIZE           (TCP_WND / TCP_MSS)
 #define DEFAULT_UDP_RECVMBOX_SIZE           5
 
 extern unsigned char debug_flags;
@@ -104,8 +108,10 @@ extern unsigned char debug_flags;
 #define MEM_ALIGNMENT           4
 
 /* MEM_SIZE: the size of the heap memory. If the application will send
-a lot of data that needs to be copied, this should be set high. */
-#define MEM_SIZE               10240 
+a lot of data that needs to be copied, this should be set high. The
+data sent on TCP waits here until acknowledged, enough for the
+TCP_SND_BUF of an upload and of the server sending back. */
+#define MEM_SIZE               163840
 
 /* MEMP_NUM_PBUF: the number of memp struct pbufs. If the application
    sends a lot of data out of ROM (or other static memory), this
@@ -115,8 +121,8 @@ a lot of data that needs to be copied, this should be set high. */
    per active RAW "connection". */
 #define MEMP_NUM_RAW_PCB        3
 /* MEMP_NUM_UDP_PCB: the number of UDP protocol control blocks. One
-   per active UDP "connection". */
-#define MEMP_NUM_UDP_PCB        6
+   per active UDP "connection". The UDP server uses two per port. */
+#define MEMP_NUM_UDP_PCB        24
 /* MEMP_NUM_TCP_PCB: the number of simulatenously active TCP
    connections. */
 #define MEMP_NUM_TCP_PCB        5
@@ -125,7 +131,7 @@ a lot of data that needs to be copied, this should be set high. */
 #define MEMP_NUM_TCP_PCB_LISTEN 8
 /* MEMP_NUM_TCP_SEG: the number of simultaneously queued TCP
    segments. */
-#define MEMP_NUM_TCP_SEG        16
+#define MEMP_NUM_TCP_SEG        (2 * TCP_SND_QUEUELEN)
 /* MEMP_NUM_SYS_TIMEOUT: the number of simulateously active
    timeouts. */
 #define MEMP_NUM_SYS_TIMEOUT    18
@@ -135,7 +141,7 @@ a lot of data that needs to be copied, this should be set high. */
 /* MEMP_NUM_NETBUF: the number of struct netbufs. */
 #define MEMP_NUM_NETBUF         2
 /* MEMP_NUM_NETCONN: the number of struct netconns. */
-#define MEMP_NUM_NETCONN        10
+#define MEMP_NUM_NETCONN        32
 /* MEMP_NUM_TCPIP_MSG_*: the number of struct tcpip_msg, which is used
    for sequential API communication and incoming packets. Used in
    src/api/tcpip.c. */
@@ -144,7 +150,7 @@ a lot of data that needs to be copied, this should be set high. */
 
 /* ---------- Pbuf options ---------- */
 /* PBUF_POOL_SIZE: the number of buffers in the pbuf pool. */
-#define PBUF_POOL_SIZE          200
+#define PBUF_POOL_SIZE          400
 
 /* PBUF_POOL_BUFSIZE: the size of each pbuf in the pbuf pool. */
 /*#define PBUF_POOL_BUFSIZE       128*/
@@ -154,6 +160,10 @@ a lot of data that needs to be copied, this should be set high. */
    link level header. */
 #define PBUF_LINK_HLEN          16 
 
+/* LWIP_SUPPORT_CUSTOM_PBUF: the receive buffers of port/netif/batchif.c
+   are custom pbufs. */
+#define LWIP_SUPPORT_CUSTOM_PBUF 1
+
 /** SYS_LIGHTWEIGHT_PROT
  * define SYS_LIGHTWEIGHT_PROT in lwipopts.h if you want inter-task protection
  * for certain critical regions during buffer allocation, deallocation and memory
@@ -176,8 +186,9 @@ a lot of data that needs to be copied, this should be set high. */
 /* TCP Maximum segment size. */
 #define TCP_MSS                 1024
 
-/* TCP sender buffer space (bytes). */
-#define TCP_SND_BUF             2048
+/* TCP sender buffer space (bytes). The largest one, zperf can give a
+   connection less of it. */
+#define TCP_SND_BUF             (64 * TCP_MSS)
 
 /* TCP sender buffer space (pbufs). This must be at least = 2 *
    TCP_SND_BUF/TCP_MSS for things to work. */
@@ -188,8 +199,14 @@ a lot of data that needs to be copied, this should be set high. */
    available in the tcp snd_buf for select to return writable */
 #define TCP_SNDLOWAT		(TCP_SND_BUF/2)
 
-/* TCP receive window. */
-#define TCP_WND                 8096
+/* TCP receive window. The largest one, zperf can give a connection a
+   smaller one. It takes the pbuf pool to hold a full window. */
+#define TCP_WND                 (64 * TCP_MSS)
+
+/* Windows above 64 KiB (RFC 7323), the scale advertised leaves room for
+   TCP_WND up to 256 KiB */
+#define LWIP_WND_SCALE          1
+#define TCP_RCV_SCALE           2
 
 /* Maximum number of retransmissions of data segments. */
 #define TCP_MAXRTX              12
@@ -219,6 +236,18 @@ a lot of data that needs to be copied, this should be set high. */
 
 #define LWIP_IGMP               1
 
+/* Multicast sent with IP_MULTICAST_LOOP is also handed back to the sending
+   netif, so that a receiver of the same process gets the group (-L) */
+#define LWIP_NETIF_LOOPBACK     1
+#define LWIP_LOOPBACK_MAX_PBUFS 64
+
+/* Both ends of the in-process link, see port/netif/pairif.c, are in one
+   subnet, traffic to the address of one end has to leave through the other */
+struct netif;
+struct ip4_addr;
+struct netif *pairif_route(const struct ip4_addr *src, const struct ip4_addr *dest);
+#define LWIP_HOOK_IP4_ROUTE_SRC(src, dest) pairif_route(src, dest)
+
 /* ---------- ICMP options ---------- */
 #define ICMP_TTL                255
 
@@ -257,6 +286,21 @@ extern void sntp_set_system_time(uint32_t sec);
 #define LWIP_RAW                1
 #define RAW_TTL                 255
 
+/* ---------- Checksum options ---------- */
+/* Use the vectorized checksum of port/chksum.c. Algorithm 2 is still built
+   as lwip_standard_chksum(), the reference of bench/chksum_bench.c. */
+#include "arch/chksum.h"
+#define LWIP_CHKSUM             lwip_sim_chksum
+#define LWIP_CHKSUM_ALGORITHM   2
+
+/* Checksum application data while copying it into pbufs, in tcp_write() and
+   for UDP in lwip_sendto(). The latter only copies, instead of referencing
+   the caller's buffer, with a single pbuf per packet. Received data is still
+   checksummed by udp_input() and tcp_input() before it is copied out. */
+#define LWIP_CHECKSUM_ON_COPY     1
+#define LWIP_NETIF_TX_SINGLE_PBUF 1
+#define LWIP_CHKSUM_COPY(dst, src, len) lwip_sim_chksum_copy(dst, src, len)
+
 /* ---------- Statistics options ---------- */
 /* individual STATS options can be turned off by defining them to 0 
  * (e.g #define TCP_STATS 0). All of them are turned off if LWIP_STATS
@@ -0,0 +1,88 @@
+/*
+ * Copyright (c) 2023 Oliver Sintaj
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef LWIP_BATCHIF_H
+#define LWIP_BATCHIF_H
+
+#include "lwip/opt.h"
+#include "lwip/err.h"
+#include "lwip/netif.h"
+
+/**
+ * @brief Maximum number of frames read per wakeup and written per flush
+ * **/
+#ifndef BATCHIF_BATCH_MAX
+#define BATCHIF_BATCH_MAX     32
+#endif
+
+/**
+ * @brief Number of preallocated receive buffers. Received frames stay in
+ *        them until lwIP frees the pbuf, e.g. until the application has read
+ *        a UDP datagram, so this bounds the data queued in the stack.
+ * **/
+#ifndef BATCHIF_RX_SLOTS
+#define BATCHIF_RX_SLOTS      128
+#endif
+
+/**
+ * @brief Size of a receive buffer, an Ethernet frame without FCS
+ * **/
+#ifndef BATCHIF_FRAME_SIZE
+#define BATCHIF_FRAME_SIZE    1536
+#endif
+
+/**
+ * @brief Queued transmit frames made of more pbufs than this are copied
+ *        into a single pbuf
+ * **/
+#ifndef BATCHIF_TX_IOV_MAX
+#define BATCHIF_TX_IOV_MAX    4
+#endif
+
+/**
+ * @brief Optional configuration, passed as the state argument of netif_add()
+ * **/
+struct batchif_config {
+  /** Open datagram socket or tap device, or -1 to open the tap device named
+      by the PRECONFIGURED_TAPIF environment variable (tap0 by default) */
+  int fd;
+  /** Frames per receive wakeup and per transmit flush, from 1 to
+      BATCHIF_BATCH_MAX, 0 for the maximum. 1 behaves like tapif: a system
+      call for every frame. */
+  u16_t batch;
+};
+
+/**
+ * @brief Counters of the driver, to compare batch sizes
+ * **/
+struct batchif_stats {
+  u32_t rx_wakeups;
+  u32_t rx_syscalls;
+  u32_t rx_frames;
+  u32_t tx_flushes;
+  u32_t tx_syscalls;
+  u32_t tx_frames;
+};
+
+/**
+ * @brief netif_add() init function of the batched Ethernet driver
+ * @note The input function given to netif_add() is called from the receive
+ *       task with the lwIP core locked, so it should be ethernet_input().
+ * @param netif interface being added, netif->state may point to a
+ *              struct batchif_config
+ * @return ERR_OK, ERR_MEM or ERR_IF when the device can not be opened
+ * **/
+err_t batchif_init(struct netif *netif);
+
+/**
+ * @brief Get the driver counters
+ * @param netif interface initialized with batchif_init()
+ * @param stats filled with the counters since initialization
+ * @return non
+ * **/
+void batchif_get_stats(struct netif *netif, struct batchif_stats *stats);
+
+#endif /* LWIP_BATCHIF_H */
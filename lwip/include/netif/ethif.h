@@ -0,0 +1,34 @@
+/*
+ * Copyright (c) 2023 Oliver Sintaj
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef LWIP_ETHIF_H
+#define LWIP_ETHIF_H
+
+#include "lwip/opt.h"
+#include "lwip/netif.h"
+
+/**
+ * @brief Last byte of the MAC address of tapif, 02:12:34:56:78:ab. A
+ *        driver with two ends gives the second one the next address.
+ * **/
+#define ETHIF_MAC_TAPIF       0xab
+
+/**
+ * @brief Common part of the init functions of the simulator Ethernet
+ *        drivers: ARP and IPv6 output, the locally administered MAC address
+ *        of tapif with its last byte replaced, an MTU of 1500, broadcast,
+ *        IGMP and MLD flags. Brings the link up.
+ * @param netif interface being added
+ * @param state driver state, stored in netif->state
+ * @param name two letter interface name
+ * @param linkoutput transmit function of the driver
+ * @param speed link speed in bit/s, for SNMP
+ * @param mac last byte of the MAC address, ETHIF_MAC_TAPIF to match tapif
+ * **/
+void ethif_setup(struct netif *netif, void *state, const char *name,
+                 netif_linkoutput_fn linkoutput, u32_t speed, u8_t mac);
+
+#endif /* LWIP_ETHIF_H */
@@ -0,0 +1,75 @@
+/*
+ * Copyright (c) 2023 Oliver Sintaj
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef LWIP_PAIRIF_H
+#define LWIP_PAIRIF_H
+
+#include "lwip/opt.h"
+#include "lwip/err.h"
+#include "lwip/ip4_addr.h"
+#include "lwip/netif.h"
+
+/**
+ * @brief Frames queued in each direction of the link, more are dropped
+ * **/
+#ifndef PAIRIF_QUEUE_LEN
+#define PAIRIF_QUEUE_LEN      256
+#endif
+
+/**
+ * @brief Largest frame carried by the link
+ * **/
+#ifndef PAIRIF_FRAME_SIZE
+#define PAIRIF_FRAME_SIZE     1536
+#endif
+
+/**
+ * @brief Link rate used when no configuration is given, in kbit/s
+ * **/
+#ifndef PAIRIF_RATE_KBPS
+#define PAIRIF_RATE_KBPS      1000000
+#endif
+
+/**
+ * @brief Optional configuration, passed as the state argument of netif_add()
+ * **/
+struct pairif_config {
+  /** Link rate in kbit/s, charged to the sender on virtual time. 0 leaves
+      the time a frame takes out */
+  u32_t rate_kbps;
+  /** One way delay of the frames in ms, on top of the wire time. 0 hands
+      them over at once */
+  u32_t delay_ms;
+};
+
+/**
+ * @brief netif_add() init function of a link between two netifs of this
+ *        stack, so a test can run against itself in a single process
+ * @note The other end is added by this function, with the gateway address
+ *       of the netif being added, so the gateway has to be set apart from
+ *       the netif address. Frames are copied into a queue and handed to the
+ *       input function of the other end by a link task, with the lwIP core
+ *       locked, so it should be ethernet_input(). On virtual time the
+ *       sender is charged the wire time of every frame, which makes the
+ *       link rate the limit of a test. A delay holds the frames back in
+ *       the queue, so it has to hold what is sent in the meantime.
+ * @param netif interface being added, netif->state may point to a
+ *              struct pairif_config
+ * @return ERR_OK, ERR_ARG without a usable gateway address, ERR_MEM or
+ *         ERR_IF if the other end can not be added
+ * **/
+err_t pairif_init(struct netif *netif);
+
+/**
+ * @brief LWIP_HOOK_IP4_ROUTE_SRC hook. Both ends share a subnet, traffic
+ *        to the address of one end has to leave through the other one.
+ * @param src source address, unused
+ * @param dest destination address
+ * @return end of the link to send from, NULL to use the routing table
+ * **/
+struct netif *pairif_route(const ip4_addr_t *src, const ip4_addr_t *dest);
+
+#endif /* LWIP_PAIRIF_H */
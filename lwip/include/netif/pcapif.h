@@ -0,0 +1,61 @@
+/*
+ * Copyright (c) 2023 Oliver Sintaj
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef LWIP_PCAPIF_H
+#define LWIP_PCAPIF_H
+
+#include "lwip/opt.h"
+#include "lwip/err.h"
+#include "lwip/netif.h"
+
+/**
+ * @brief Delay between the start of the replay task and the first frame,
+ *        which lets the application start its receivers
+ * **/
+#ifndef PCAPIF_START_DELAY_MS
+#define PCAPIF_START_DELAY_MS  1000
+#endif
+
+/**
+ * @brief Configuration of the replay driver, passed as the state argument of
+ *        netif_add()
+ * **/
+struct pcapif_config {
+  /** pcap file with Ethernet frames, read into memory by pcapif_init() */
+  const char *path;
+  /** Replay speed in percent of the original timing, 100 keeps the captured
+      gaps between frames, 0 replays as fast as possible */
+  u32_t speed;
+};
+
+/**
+ * @brief netif_add() init function of the replay driver. Frames of the file
+ *        are fed to the input function of the netif by a replay task, with
+ *        the lwIP core locked, so it should be ethernet_input().
+ *        Frames sent by the netif address itself, i.e. the outgoing half of
+ *        a capture made with pcapif_record(), are skipped. Frames sent by
+ *        lwIP are discarded.
+ * @note lwIP only receives the frames sent to its own addresses, set them to
+ *       the ones of the capture.
+ * @param netif interface being added, netif->state must point to a
+ *              struct pcapif_config
+ * @return ERR_OK, ERR_ARG when the file can not be read, ERR_MEM
+ * **/
+err_t pcapif_init(struct netif *netif);
+
+/**
+ * @brief Record every frame received and sent by a netif into a pcap file,
+ *        with nanosecond timestamps
+ * @note Call it after netif_add(), it wraps netif->input and
+ *       netif->linkoutput. The file is buffered, it is completed when the
+ *       process exits, including on SIGINT and SIGTERM.
+ * @param netif interface to record, with any driver
+ * @param path pcap file to be written
+ * @return 0 on success, -1 when the file can not be created
+ * **/
+int pcapif_record(struct netif *netif, const char *path);
+
+#endif /* LWIP_PCAPIF_H */
@@ -0,0 +1,73 @@
+/*
+ * Copyright (c) 2023 Oliver Sintaj
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef LWIP_SHMIF_H
+#define LWIP_SHMIF_H
+
+#include "lwip/opt.h"
+#include "lwip/err.h"
+#include "lwip/netif.h"
+
+/**
+ * @brief Frames in each direction of the link
+ * **/
+#ifndef SHMIF_RING_SLOTS
+#define SHMIF_RING_SLOTS      256
+#endif
+
+/**
+ * @brief Largest frame carried by the link
+ * **/
+#ifndef SHMIF_FRAME_SIZE
+#define SHMIF_FRAME_SIZE      1536
+#endif
+
+/**
+ * @brief Time a sender waits for the peer to make room in a full ring
+ *        before dropping the frame
+ * **/
+#ifndef SHMIF_TX_WAIT_MS
+#define SHMIF_TX_WAIT_MS      10
+#endif
+
+/**
+ * @brief Time the receive task keeps yielding on an empty ring before it
+ *        sleeps on the doorbell
+ * **/
+#ifndef SHMIF_SPIN_US
+#define SHMIF_SPIN_US         50
+#endif
+
+/**
+ * @brief Shared memory object used when no configuration is given
+ * **/
+#define SHMIF_DEFAULT_NAME    "/zperf-shmif"
+
+/**
+ * @brief Optional configuration, passed as the state argument of netif_add()
+ * **/
+struct shmif_config {
+  /** POSIX shared memory object name, starting with '/' */
+  const char *name;
+};
+
+/**
+ * @brief netif_add() init function of the shared memory link between two
+ *        simulator processes
+ * @note The first process creates the link, the second one attaches to it
+ *       and removes the name, so every pair of runs gets a fresh link. Frames
+ *       sent before the peer is there wait in the ring. The two sides get
+ *       different MAC addresses, their IP addresses have to be set apart by
+ *       the caller. The input function given to netif_add() is called from
+ *       the receive task with the lwIP core locked, so it should be
+ *       ethernet_input().
+ * @param netif interface being added, netif->state may point to a
+ *              struct shmif_config
+ * @return ERR_OK, ERR_MEM or ERR_IF when the link can not be set up
+ * **/
+err_t shmif_init(struct netif *netif);
+
+#endif /* LWIP_SHMIF_H */
@@ -0,0 +1,269 @@
+/*
+ * Copyright (c) 2023 Oliver Sintaj
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Internet checksum for the simulator build of lwIP.
+ *
+ * lwip_standard_chksum() adds one 16 bit word at a time. Here the bulk of
+ * the data is summed in blocks, and the tail with 32, 16 and 8 bit loads.
+ * lwip_sim_chksum_copy() does the same while copying each block, so data
+ * copied from the application into a pbuf is read only once.
+ * The ones' complement sum does not depend on the width of the words added
+ * as long as no carry is lost, so all paths keep a 64 bit accumulator and
+ * fold it to 16 bits once at the end.
+ *
+ * The vector paths use the byte sum of PSADBW: with S the sum of all bytes
+ * and O the sum of the bytes at odd offsets, the sum of the little endian
+ * 16 bit words is S + 255 * O. The implementation is picked from the
+ * instruction set enabled for this file, see LWIP_CHKSUM_IMPL in
+ * lwip/CMakeLists.txt.
+ */
+
+#include <stddef.h>
+#include <string.h>
+
+#include "lwip/opt.h"
+#include "lwip/arch.h"
+
+#include "arch/chksum.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define CHKSUM_IMPL       "avx2"
+#define CHKSUM_BLOCK_SIZE 64U
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define CHKSUM_IMPL       "sse2"
+#define CHKSUM_BLOCK_SIZE 32U
+#else
+#define CHKSUM_IMPL       "portable"
+#define CHKSUM_BLOCK_SIZE 32U
+#endif
+
+#if defined(__AVX2__)
+
+static uint64_t
+chksum_blocks(const u8_t *p, size_t len)
+{
+  const __m256i zero = _mm256_setzero_si256();
+  __m256i all = zero;
+  __m256i odd = zero;
+  __m128i acc;
+  uint64_t sums[2];
+  size_t i;
+
+  for (i = 0; i < len; i += CHKSUM_BLOCK_SIZE) {
+    __m256i a = _mm256_loadu_si256((const __m256i *)(const void *)(p + i));
+    __m256i b = _mm256_loadu_si256((const __m256i *)(const void *)(p + i + 32));
+
+    all = _mm256_add_epi64(all, _mm256_sad_epu8(a, zero));
+    all = _mm256_add_epi64(all, _mm256_sad_epu8(b, zero));
+    odd = _mm256_add_epi64(odd, _mm256_sad_epu8(_mm256_srli_epi16(a, 8), zero));
+    odd = _mm256_add_epi64(odd, _mm256_sad_epu8(_mm256_srli_epi16(b, 8), zero));
+  }
+
+  /* all + 255 * odd, lane by lane, then across lanes */
+  all = _mm256_add_epi64(all, _mm256_sub_epi64(_mm256_slli_epi64(odd, 8), odd));
+  acc = _mm_add_epi64(_mm256_castsi256_si128(all), _mm256_extracti128_si256(all, 1));
+  _mm_storeu_si128((__m128i *)(void *)sums, acc);
+
+  return sums[0] + sums[1];
+}
+
+static uint64_t
+chksum_copy_blocks(u8_t *dst, const u8_t *src, size_t len)
+{
+  const __m256i zero = _mm256_setzero_si256();
+  __m256i all = zero;
+  __m256i odd = zero;
+  __m128i acc;
+  uint64_t sums[2];
+  size_t i;
+
+  for (i = 0; i < len; i += CHKSUM_BLOCK_SIZE) {
+    __m256i a = _mm256_loadu_si256((const __m256i *)(const void *)(src + i));
+    __m256i b = _mm256_loadu_si256((const __m256i *)(const void *)(src + i + 32));
+
+    _mm256_storeu_si256((__m256i *)(void *)(dst + i), a);
+    _mm256_storeu_si256((__m256i *)(void *)(dst + i + 32), b);
+    all = _mm256_add_epi64(all, _mm256_sad_epu8(a, zero));
+    all = _mm256_add_epi64(all, _mm256_sad_epu8(b, zero));
+    odd = _mm256_add_epi64(odd, _mm256_sad_epu8(_mm256_srli_epi16(a, 8), zero));
+    odd = _mm256_add_epi64(odd, _mm256_sad_epu8(_mm256_srli_epi16(b, 8), zero));
+  }
+
+  all = _mm256_add_epi64(all, _mm256_sub_epi64(_mm256_slli_epi64(odd, 8), odd));
+  acc = _mm_add_epi64(_mm256_castsi256_si128(all), _mm256_extracti128_si256(all, 1));
+  _mm_storeu_si128((__m128i *)(void *)sums, acc);
+
+  return sums[0] + sums[1];
+}
+
+#elif defined(__SSE2__)
+
+static uint64_t
+chksum_blocks(const u8_t *p, size_t len)
+{
+  const __m128i zero = _mm_setzero_si128();
+  __m128i all = zero;
+  __m128i odd = zero;
+  uint64_t sums[2];
+  size_t i;
+
+  for (i = 0; i < len; i += CHKSUM_BLOCK_SIZE) {
+    __m128i a = _mm_loadu_si128((const __m128i *)(const void *)(p + i));
+    __m128i b = _mm_loadu_si128((const __m128i *)(const void *)(p + i + 16));
+
+    all = _mm_add_epi64(all, _mm_sad_epu8(a, zero));
+    all = _mm_add_epi64(all, _mm_sad_epu8(b, zero));
+    odd = _mm_add_epi64(odd, _mm_sad_epu8(_mm_srli_epi16(a, 8), zero));
+    odd = _mm_add_epi64(odd, _mm_sad_epu8(_mm_srli_epi16(b, 8), zero));
+  }
+
+  all = _mm_add_epi64(all, _mm_sub_epi64(_mm_slli_epi64(odd, 8), odd));
+  _mm_storeu_si128((__m128i *)(void *)sums, all);
+
+  return sums[0] + sums[1];
+}
+
+static uint64_t
+chksum_copy_blocks(u8_t *dst, const u8_t *src, size_t len)
+{
+  const __m128i zero = _mm_setzero_si128();
+  __m128i all = zero;
+  __m128i odd = zero;
+  uint64_t sums[2];
+  size_t i;
+
+  for (i = 0; i < len; i += CHKSUM_BLOCK_SIZE) {
+    __m128i a = _mm_loadu_si128((const __m128i *)(const void *)(src + i));
+    __m128i b = _mm_loadu_si128((const __m128i *)(const void *)(src + i + 16));
+
+    _mm_storeu_si128((__m128i *)(void *)(dst + i), a);
+    _mm_storeu_si128((__m128i *)(void *)(dst + i + 16), b);
+    all = _mm_add_epi64(all, _mm_sad_epu8(a, zero));
+    all = _mm_add_epi64(all, _mm_sad_epu8(b, zero));
+    odd = _mm_add_epi64(odd, _mm_sad_epu8(_mm_srli_epi16(a, 8), zero));
+    odd = _mm_add_epi64(odd, _mm_sad_epu8(_mm_srli_epi16(b, 8), zero));
+  }
+
+  all = _mm_add_epi64(all, _mm_sub_epi64(_mm_slli_epi64(odd, 8), odd));
+  _mm_storeu_si128((__m128i *)(void *)sums, all);
+
+  return sums[0] + sums[1];
+}
+
+#else
+
+static uint64_t
+chksum_blocks(const u8_t *p, size_t len)
+{
+  /* Two accumulators so that consecutive adds do not depend on each other */
+  uint64_t sum0 = 0;
+  uint64_t sum1 = 0;
+  size_t i;
+
+  for (i = 0; i < len; i += CHKSUM_BLOCK_SIZE) {
+    u32_t w[CHKSUM_BLOCK_SIZE / sizeof(u32_t)];
+
+    memcpy(w, p + i, sizeof(w));
+    sum0 += (uint64_t)w[0] + w[2] + w[4] + w[6];
+    sum1 += (uint64_t)w[1] + w[3] + w[5] + w[7];
+  }
+
+  return sum0 + sum1;
+}
+
+static uint64_t
+chksum_copy_blocks(u8_t *dst, const u8_t *src, size_t len)
+{
+  uint64_t sum0 = 0;
+  uint64_t sum1 = 0;
+  size_t i;
+
+  for (i = 0; i < len; i += CHKSUM_BLOCK_SIZE) {
+    u32_t w[CHKSUM_BLOCK_SIZE / sizeof(u32_t)];
+
+    memcpy(w, src + i, sizeof(w));
+    memcpy(dst + i, w, sizeof(w));
+    sum0 += (uint64_t)w[0] + w[2] + w[4] + w[6];
+    sum1 += (uint64_t)w[1] + w[3] + w[5] + w[7];
+  }
+
+  return sum0 + sum1;
+}
+
+#endif
+
+/* Add the last bytes, less than a block, and fold the sum to 16 bits */
+static uint16_t
+chksum_finish(const u8_t *p, size_t left, uint64_t sum)
+{
+  while (left >= sizeof(u32_t)) {
+    u32_t w;
+
+    memcpy(&w, p, sizeof(w));
+    sum += w;
+    p += sizeof(w);
+    left -= sizeof(w);
+  }
+
+  if (left >= sizeof(u16_t)) {
+    u16_t w;
+
+    memcpy(&w, p, sizeof(w));
+    sum += w;
+    p += sizeof(w);
+    left -= sizeof(w);
+  }
+
+  /* Odd trailing byte, in the first byte of the last word */
+  if (left > 0) {
+    u16_t w = 0;
+
+    ((u8_t *)&w)[0] = *p;
+    sum += w;
+  }
+
+  /* Fold, every step keeps a non zero sum non zero */
+  while (sum >> 16) {
+    sum = (sum & 0xffffU) + (sum >> 16);
+  }
+
+  return (uint16_t)sum;
+}
+
+uint16_t
+lwip_sim_chksum(const void *dataptr, int len)
+{
+  const u8_t *p = (const u8_t *)dataptr;
+  size_t left = (len > 0) ? (size_t)len : 0;
+  size_t bulk = left - (left % CHKSUM_BLOCK_SIZE);
+  /* Headers are shorter than a block, skip the vector setup for them */
+  uint64_t sum = (bulk != 0) ? chksum_blocks(p, bulk) : 0;
+
+  return chksum_finish(p + bulk, left - bulk, sum);
+}
+
+uint16_t
+lwip_sim_chksum_copy(void *dst, const void *src, uint16_t len)
+{
+  u8_t *d = (u8_t *)dst;
+  const u8_t *s = (const u8_t *)src;
+  size_t bulk = len - (len % CHKSUM_BLOCK_SIZE);
+  uint64_t sum = (bulk != 0) ? chksum_copy_blocks(d, s, bulk) : 0;
+
+  /* The tail is summed from dst, where it was just written */
+  memcpy(d + bulk, s + bulk, len - bulk);
+
+  return chksum_finish(d + bulk, len - bulk, sum);
+}
+
+const char *
+lwip_sim_chksum_impl(void)
+{
+  return CHKSUM_IMPL;
+}
@@ -0,0 +1,487 @@
+/*
+ * Copyright (c) 2023 Oliver Sintaj
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Batched Ethernet netif for the simulator.
+ *
+ * It does the same job as tapif from lwip-contrib, which makes a read() or
+ * write() and takes the lwIP core for every single frame, but moves frames
+ * in batches:
+ * - the receive task waits until the descriptor is readable, then reads up
+ *   to a batch of frames straight into preallocated custom pbufs, and feeds
+ *   all of them to lwIP under one core lock,
+ * - transmitted pbufs are queued by reference, and written together when the
+ *   queue is full, after a receive batch, or by the transmit task once the
+ *   sending task lets it run.
+ * On a datagram socket, e.g. one end of a socketpair(), a batch is one
+ * recvmmsg() or sendmmsg() call. A tap device returns one frame per read(),
+ * there a batch saves the wakeups and core lock round trips only.
+ *
+ * There is no tcpip thread in this simulator, lwIP is driven by the calling
+ * tasks under the core lock. A batch is therefore handed to the stack under
+ * a single LOCK_TCPIP_CORE() instead of a single tcpip message.
+ */
+
+#define _GNU_SOURCE /* recvmmsg(), sendmmsg() */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <linux/if.h>
+#include <linux/if_tun.h>
+
+#include "lwip/opt.h"
+#include "lwip/def.h"
+#include "lwip/pbuf.h"
+#include "lwip/snmp.h"
+#include "lwip/stats.h"
+#include "lwip/sys.h"
+#include "lwip/tcpip.h"
+
+#include "netif/ethif.h"
+#include "netif/batchif.h"
+
+#if !LWIP_TCPIP_CORE_LOCKING
+#error "batchif delivers frames under the core lock, LWIP_TCPIP_CORE_LOCKING is required"
+#endif
+
+#ifndef BATCHIF_DEBUG
+#define BATCHIF_DEBUG LWIP_DBG_OFF
+#endif
+
+#define BATCHIF_DEVTAP     "/dev/net/tun"
+#define BATCHIF_DEFAULT_IF "tap0"
+
+/* Receive buffer, the pbuf_custom must come first */
+struct batchif_slot {
+  struct pbuf_custom pc;
+  struct batchif *bif;
+  struct batchif_slot *next;
+  u8_t frame[BATCHIF_FRAME_SIZE];
+};
+
+struct batchif {
+  int fd;
+  int is_socket;
+  u16_t batch;
+  struct batchif_stats stats;
+
+  /* Free receive buffers, returned by the task freeing the pbuf */
+  struct batchif_slot *free_slots;
+  struct batchif_slot slots[BATCHIF_RX_SLOTS];
+
+  /* Used by the receive task only */
+  struct batchif_slot *rx_slots[BATCHIF_BATCH_MAX];
+  struct mmsghdr rx_msgs[BATCHIF_BATCH_MAX];
+  struct iovec rx_iov[BATCHIF_BATCH_MAX];
+  u8_t rx_scratch[BATCHIF_FRAME_SIZE];
+
+  /* Transmit queue, used with the core locked */
+  struct pbuf *txq[BATCHIF_BATCH_MAX];
+  u16_t txq_len;
+  struct mmsghdr tx_msgs[BATCHIF_BATCH_MAX];
+  struct iovec tx_iov[BATCHIF_BATCH_MAX * BATCHIF_TX_IOV_MAX];
+  sys_sem_t tx_sem;
+};
+
+static void
+batchif_put_slot(struct batchif *bif, struct batchif_slot *slot)
+{
+  SYS_ARCH_DECL_PROTECT(lev);
+
+  SYS_ARCH_PROTECT(lev);
+  slot->next = bif->free_slots;
+  bif->free_slots = slot;
+  SYS_ARCH_UNPROTECT(lev);
+}
+
+static u16_t
+batchif_take_slots(struct batchif *bif, struct batchif_slot **slots, u16_t max)
+{
+  u16_t n = 0;
+  SYS_ARCH_DECL_PROTECT(lev);
+
+  SYS_ARCH_PROTECT(lev);
+  while ((n < max) && (bif->free_slots != NULL)) {
+    slots[n] = bif->free_slots;
+    bif->free_slots = slots[n]->next;
+    n++;
+  }
+  SYS_ARCH_UNPROTECT(lev);
+
+  return n;
+}
+
+/* custom_free_function of the receive pbufs */
+static void
+batchif_slot_free(struct pbuf *p)
+{
+  struct batchif_slot *slot = (struct batchif_slot *)(void *)p;
+
+  batchif_put_slot(slot->bif, slot);
+}
+
+/* Read up to n frames into the given slots, returns the number read */
+static int
+batchif_read_frames(struct batchif *bif, struct batchif_slot **slots,
+                    u16_t n)
+{
+  int i;
+
+  if (bif->is_socket) {
+    int ret;
+
+    for (i = 0; i < n; i++) {
+      bif->rx_iov[i].iov_base = slots[i]->frame;
+      bif->rx_iov[i].iov_len = BATCHIF_FRAME_SIZE;
+      memset(&bif->rx_msgs[i], 0, sizeof(bif->rx_msgs[i]));
+      bif->rx_msgs[i].msg_hdr.msg_iov = &bif->rx_iov[i];
+      bif->rx_msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    bif->stats.rx_syscalls++;
+    ret = recvmmsg(bif->fd, bif->rx_msgs, n, MSG_DONTWAIT, NULL);
+
+    return LWIP_MAX(ret, 0);
+  }
+
+  /* A tap device has no batched read, drain it until it would block */
+  for (i = 0; i < n; i++) {
+    ssize_t len;
+
+    bif->stats.rx_syscalls++;
+    len = read(bif->fd, slots[i]->frame, BATCHIF_FRAME_SIZE);
+    if (len <= 0) {
+      break;
+    }
+    bif->rx_msgs[i].msg_len = (unsigned int)len;
+  }
+
+  return i;
+}
+
+static void
+batchif_input(struct netif *netif, struct pbuf *p)
+{
+  MIB2_STATS_NETIF_ADD(netif, ifinoctets, p->tot_len);
+  LINK_STATS_INC(link.recv);
+
+  if (netif->input(p, netif) != ERR_OK) {
+    LWIP_DEBUGF(BATCHIF_DEBUG, ("batchif_input: netif input error\n"));
+    LINK_STATS_INC(link.drop);
+    pbuf_free(p);
+  }
+}
+
+static void batchif_flush(struct netif *netif);
+
+/* All receive buffers are held by the stack, fall back to a pool pbuf */
+static void
+batchif_input_copy(struct netif *netif)
+{
+  struct batchif *bif = (struct batchif *)netif->state;
+  struct pbuf *p;
+  ssize_t len;
+
+  bif->stats.rx_syscalls++;
+  len = read(bif->fd, bif->rx_scratch, sizeof(bif->rx_scratch));
+  if (len <= 0) {
+    return;
+  }
+
+  p = pbuf_alloc(PBUF_RAW, (u16_t)len, PBUF_POOL);
+  if (p == NULL) {
+    LINK_STATS_INC(link.memerr);
+    LINK_STATS_INC(link.drop);
+    MIB2_STATS_NETIF_INC(netif, ifindiscards);
+    return;
+  }
+  pbuf_take(p, bif->rx_scratch, (u16_t)len);
+
+  LOCK_TCPIP_CORE();
+  batchif_input(netif, p);
+  batchif_flush(netif);
+  UNLOCK_TCPIP_CORE();
+
+  bif->stats.rx_frames++;
+}
+
+static void
+batchif_rx_thread(void *arg)
+{
+  struct netif *netif = (struct netif *)arg;
+  struct batchif *bif = (struct batchif *)netif->state;
+  struct pollfd pfd;
+
+  pfd.fd = bif->fd;
+  pfd.events = POLLIN;
+
+  while (1) {
+    u16_t n;
+    int got;
+    int i;
+
+    /* The simulator ticks are signals, EINTR is expected */
+    if (poll(&pfd, 1, -1) <= 0) {
+      continue;
+    }
+    if (pfd.revents & (POLLERR | POLLHUP | POLLNVAL)) {
+      LWIP_DEBUGF(BATCHIF_DEBUG, ("batchif_rx_thread: descriptor closed\n"));
+      sys_msleep(1000);
+      continue;
+    }
+    bif->stats.rx_wakeups++;
+
+    n = batchif_take_slots(bif, bif->rx_slots, bif->batch);
+    if (n == 0) {
+      batchif_input_copy(netif);
+      continue;
+    }
+
+    got = batchif_read_frames(bif, bif->rx_slots, n);
+    for (i = got; i < n; i++) {
+      batchif_put_slot(bif, bif->rx_slots[i]);
+    }
+    if (got == 0) {
+      continue;
+    }
+
+    LOCK_TCPIP_CORE();
+    for (i = 0; i < got; i++) {
+      struct batchif_slot *slot = bif->rx_slots[i];
+      u16_t len = (u16_t)bif->rx_msgs[i].msg_len;
+      struct pbuf *p;
+
+      if (bif->rx_msgs[i].msg_hdr.msg_flags & MSG_TRUNC) {
+        LINK_STATS_INC(link.lenerr);
+        LINK_STATS_INC(link.drop);
+        batchif_put_slot(bif, slot);
+        continue;
+      }
+
+      p = pbuf_alloced_custom(PBUF_RAW, len, PBUF_REF, &slot->pc,
+                              slot->frame, BATCHIF_FRAME_SIZE);
+      batchif_input(netif, p);
+    }
+    /* Send the replies to the whole batch together */
+    batchif_flush(netif);
+    UNLOCK_TCPIP_CORE();
+
+    bif->stats.rx_frames += (u32_t)got;
+  }
+}
+
+/* Write the transmit queue, with the core locked */
+static void
+batchif_flush(struct netif *netif)
+{
+  struct batchif *bif = (struct batchif *)netif->state;
+  u16_t n = bif->txq_len;
+  u16_t sent = 0;
+  u16_t iov = 0;
+  u16_t i;
+
+  if (n == 0) {
+    return;
+  }
+
+  /* Gather straight from the pbufs, no copy into a linear buffer */
+  for (i = 0; i < n; i++) {
+    struct pbuf *q;
+
+    memset(&bif->tx_msgs[i], 0, sizeof(bif->tx_msgs[i]));
+    bif->tx_msgs[i].msg_hdr.msg_iov = &bif->tx_iov[iov];
+    for (q = bif->txq[i]; q != NULL; q = q->next) {
+      bif->tx_iov[iov].iov_base = q->payload;
+      bif->tx_iov[iov].iov_len = q->len;
+      iov++;
+      bif->tx_msgs[i].msg_hdr.msg_iovlen++;
+    }
+  }
+
+  if (bif->is_socket) {
+    while (sent < n) {
+      int ret;
+
+      bif->stats.tx_syscalls++;
+      ret = sendmmsg(bif->fd, &bif->tx_msgs[sent], n - sent, 0);
+      if (ret <= 0) {
+        break;
+      }
+      sent += (u16_t)ret;
+    }
+  } else {
+    for (sent = 0; sent < n; sent++) {
+      const struct msghdr *msg = &bif->tx_msgs[sent].msg_hdr;
+
+      bif->stats.tx_syscalls++;
+      if (writev(bif->fd, msg->msg_iov, (int)msg->msg_iovlen) < 0) {
+        break;
+      }
+    }
+  }
+
+  for (i = 0; i < n; i++) {
+    if (i < sent) {
+      MIB2_STATS_NETIF_ADD(netif, ifoutoctets, bif->txq[i]->tot_len);
+      LINK_STATS_INC(link.xmit);
+    } else {
+      MIB2_STATS_NETIF_INC(netif, ifoutdiscards);
+      LINK_STATS_INC(link.drop);
+    }
+    pbuf_free(bif->txq[i]);
+  }
+  if (sent < n) {
+    LWIP_DEBUGF(BATCHIF_DEBUG, ("batchif_flush: %d frames dropped, errno %d\n",
+                                n - sent, errno));
+  }
+
+  bif->txq_len = 0;
+  bif->stats.tx_flushes++;
+  bif->stats.tx_frames += sent;
+}
+
+static err_t
+batchif_linkoutput(struct netif *netif, struct pbuf *p)
+{
+  struct batchif *bif = (struct batchif *)netif->state;
+
+  LWIP_ASSERT_CORE_LOCKED();
+
+  if (pbuf_clen(p) > BATCHIF_TX_IOV_MAX) {
+    p = pbuf_clone(PBUF_RAW, PBUF_RAM, p);
+    if (p == NULL) {
+      LINK_STATS_INC(link.memerr);
+      LINK_STATS_INC(link.drop);
+      return ERR_MEM;
+    }
+  } else {
+    /* Held until the flush, TCP does not touch segments in use */
+    pbuf_ref(p);
+  }
+
+  bif->txq[bif->txq_len++] = p;
+  if (bif->txq_len >= bif->batch) {
+    batchif_flush(netif);
+  } else if (bif->txq_len == 1) {
+    sys_sem_signal(&bif->tx_sem);
+  }
+
+  return ERR_OK;
+}
+
+/* Flushes what the senders queued since they last let this task run */
+static void
+batchif_tx_thread(void *arg)
+{
+  struct netif *netif = (struct netif *)arg;
+  struct batchif *bif = (struct batchif *)netif->state;
+
+  while (1) {
+    sys_arch_sem_wait(&bif->tx_sem, 0);
+
+    LOCK_TCPIP_CORE();
+    batchif_flush(netif);
+    UNLOCK_TCPIP_CORE();
+  }
+}
+
+static int
+batchif_open_tap(void)
+{
+  const char *name = getenv("PRECONFIGURED_TAPIF");
+  struct ifreq ifr;
+  int fd;
+
+  fd = open(BATCHIF_DEVTAP, O_RDWR);
+  if (fd < 0) {
+    return -1;
+  }
+
+  memset(&ifr, 0, sizeof(ifr));
+  ifr.ifr_flags = IFF_TAP | IFF_NO_PI;
+  strncpy(ifr.ifr_name, (name != NULL) ? name : BATCHIF_DEFAULT_IF,
+          sizeof(ifr.ifr_name) - 1);
+  if (ioctl(fd, TUNSETIFF, (void *)&ifr) < 0) {
+    close(fd);
+    return -1;
+  }
+
+  return fd;
+}
+
+err_t
+batchif_init(struct netif *netif)
+{
+  const struct batchif_config *config = (const struct batchif_config *)netif->state;
+  struct batchif *bif;
+  struct stat st;
+  u16_t i;
+
+  bif = (struct batchif *)calloc(1, sizeof(struct batchif));
+  if (bif == NULL) {
+    return ERR_MEM;
+  }
+
+  if ((config != NULL) && (config->fd >= 0)) {
+    bif->fd = config->fd;
+  } else {
+    bif->fd = batchif_open_tap();
+  }
+  if (bif->fd < 0) {
+    LWIP_DEBUGF(BATCHIF_DEBUG, ("batchif_init: cannot open %s\n", BATCHIF_DEVTAP));
+    free(bif);
+    return ERR_IF;
+  }
+
+  bif->batch = BATCHIF_BATCH_MAX;
+  if ((config != NULL) && (config->batch != 0)) {
+    bif->batch = LWIP_MIN(config->batch, BATCHIF_BATCH_MAX);
+  }
+
+  /* Sockets use MSG_DONTWAIT on receive and block on send, the tap read
+     loop needs a non blocking descriptor */
+  bif->is_socket = (fstat(bif->fd, &st) == 0) && S_ISSOCK(st.st_mode);
+  if (!bif->is_socket) {
+    fcntl(bif->fd, F_SETFL, fcntl(bif->fd, F_GETFL) | O_NONBLOCK);
+  }
+
+  for (i = 0; i < BATCHIF_RX_SLOTS; i++) {
+    bif->slots[i].bif = bif;
+    bif->slots[i].pc.custom_free_function = batchif_slot_free;
+    batchif_put_slot(bif, &bif->slots[i]);
+  }
+
+  if (sys_sem_new(&bif->tx_sem, 0) != ERR_OK) {
+    free(bif);
+    return ERR_MEM;
+  }
+
+  /* Same locally administered address as tapif */
+  ethif_setup(netif, bif, "bt", batchif_linkoutput, 100000000, ETHIF_MAC_TAPIF);
+
+  sys_thread_new("batchif_rx", batchif_rx_thread, netif,
+                 DEFAULT_THREAD_STACKSIZE, DEFAULT_THREAD_PRIO);
+  sys_thread_new("batchif_tx", batchif_tx_thread, netif,
+                 DEFAULT_THREAD_STACKSIZE, DEFAULT_THREAD_PRIO);
+
+  return ERR_OK;
+}
+
+void
+batchif_get_stats(struct netif *netif, struct batchif_stats *stats)
+{
+  const struct batchif *bif = (const struct batchif *)netif->state;
+
+  *stats = bif->stats;
+}
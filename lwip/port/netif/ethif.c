@@ -0,0 +1,48 @@
+/*
+ * Copyright (c) 2023 Oliver Sintaj
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Setup shared by the Ethernet drivers of the simulator, so that batchif,
+ * pcapif, pairif and shmif look the same to the stack as tapif does.
+ */
+
+#include "lwip/opt.h"
+#include "lwip/etharp.h"
+#include "lwip/ethip6.h"
+#include "lwip/snmp.h"
+
+#include "netif/ethif.h"
+
+void
+ethif_setup(struct netif *netif, void *state, const char *name,
+            netif_linkoutput_fn linkoutput, u32_t speed, u8_t mac)
+{
+  netif->state = state;
+  netif->name[0] = name[0];
+  netif->name[1] = name[1];
+#if LWIP_IPV4
+  netif->output = etharp_output;
+#endif
+#if LWIP_IPV6
+  netif->output_ip6 = ethip6_output;
+#endif
+  netif->linkoutput = linkoutput;
+  MIB2_INIT_NETIF(netif, snmp_ifType_ethernet_csmacd, speed);
+
+  /* Locally administered address of tapif */
+  netif->hwaddr_len = ETH_HWADDR_LEN;
+  netif->hwaddr[0] = 0x02;
+  netif->hwaddr[1] = 0x12;
+  netif->hwaddr[2] = 0x34;
+  netif->hwaddr[3] = 0x56;
+  netif->hwaddr[4] = 0x78;
+  netif->hwaddr[5] = mac;
+  netif->mtu = 1500;
+  netif->flags = NETIF_FLAG_BROADCAST | NETIF_FLAG_ETHARP | NETIF_FLAG_IGMP |
+                 NETIF_FLAG_MLD6;
+
+  netif_set_link_up(netif);
+}
@@ -0,0 +1,298 @@
+/*
+ * Copyright (c) 2023 Oliver Sintaj
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Ethernet link between two netifs of the same stack.
+ *
+ * The netif given to netif_add() is one end, the other end is a second
+ * netif created with it, at the gateway address. An uploader sending to the
+ * gateway address reaches a receiver of the same process through a real
+ * Ethernet, ARP and IP path, without any host device. pairif_route() keeps
+ * lwIP from short-cutting it through the routing table, which would pick
+ * the first netif of the shared subnet.
+ *
+ * Every direction has a queue of frame slots. The sender copies the frame in
+ * with the core locked, the link task copies queued frames into pool pbufs
+ * and feeds them to the other end, all of them under one core lock. A full
+ * queue drops the frame, like a receiver that can not keep up.
+ *
+ * A link with a delay stamps every frame with the time it is due at the
+ * other end. The link task hands over the frames that are due, then sleeps
+ * until the next one is, which on the virtual clock lets time jump there.
+ * The delay is the same in both directions, the round trip takes twice
+ * as long.
+ *
+ * Nothing waits for the host, so the link can run on the virtual clock of
+ * the simulator. The sender is then charged the wire time of each frame at
+ * the link rate, which is what lets time move on while a task sends
+ * without blocking.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "lwip/opt.h"
+#include "lwip/def.h"
+#include "lwip/pbuf.h"
+#include "lwip/snmp.h"
+#include "lwip/stats.h"
+#include "lwip/sys.h"
+#include "lwip/tcpip.h"
+
+#include "FreeRTOS.h"
+
+#include "netif/ethif.h"
+#include "netif/pairif.h"
+
+#if !LWIP_TCPIP_CORE_LOCKING
+#error "pairif delivers frames under the core lock, LWIP_TCPIP_CORE_LOCKING is required"
+#endif
+
+#ifndef PAIRIF_DEBUG
+#define PAIRIF_DEBUG LWIP_DBG_OFF
+#endif
+
+/* Preamble, start of frame delimiter, FCS and inter frame gap */
+#define PAIRIF_WIRE_OVERHEAD 24
+
+#if defined(FREERTOS_SIM_VIRTUAL_TIME) && (FREERTOS_SIM_VIRTUAL_TIME > 0)
+#define pairif_charge(ns) vVirtualTimeCharge(ns)
+#else
+#define pairif_charge(ns)
+#endif
+
+struct pairif_slot {
+  u16_t len;
+  /* sys_now() at which the frame reaches the other end */
+  u32_t due;
+  u8_t data[PAIRIF_FRAME_SIZE];
+};
+
+/* Frames sent by one end, only used with the core locked */
+struct pairif_queue {
+  u32_t head;
+  u32_t tail;
+  struct pairif_slot slots[PAIRIF_QUEUE_LEN];
+};
+
+struct pairif {
+  /* end[0] is the netif given to netif_add(), end[1] the one at the gateway */
+  struct netif *end[2];
+  struct pairif_queue queue[2];
+  u32_t rate_kbps;
+  u32_t delay_ms;
+  sys_sem_t sem;
+};
+
+static struct netif pairif_peer;
+static struct pairif *pairif_link;
+
+static int
+pairif_side(const struct pairif *pair, const struct netif *netif)
+{
+  return (netif == pair->end[1]) ? 1 : 0;
+}
+
+/* Hand the frames of one end that are due to the other end, returns the count */
+static u32_t
+pairif_deliver(struct pairif *pair, int from)
+{
+  struct pairif_queue *queue = &pair->queue[from];
+  struct netif *netif = pair->end[1 - from];
+  u32_t now = sys_now();
+  u32_t n = 0;
+
+  for (; queue->tail != queue->head; queue->tail++, n++) {
+    const struct pairif_slot *slot = &queue->slots[queue->tail % PAIRIF_QUEUE_LEN];
+    struct pbuf *p;
+
+    /* The delay is constant, the frames behind are not due either */
+    if ((s32_t)(slot->due - now) > 0) {
+      break;
+    }
+
+    p = pbuf_alloc(PBUF_RAW, slot->len, PBUF_POOL);
+    if (p == NULL) {
+      LINK_STATS_INC(link.memerr);
+      LINK_STATS_INC(link.drop);
+      MIB2_STATS_NETIF_INC(netif, ifindiscards);
+      continue;
+    }
+    pbuf_take(p, slot->data, slot->len);
+
+    MIB2_STATS_NETIF_ADD(netif, ifinoctets, slot->len);
+    LINK_STATS_INC(link.recv);
+    if (netif->input(p, netif) != ERR_OK) {
+      LWIP_DEBUGF(PAIRIF_DEBUG, ("pairif_deliver: netif input error\n"));
+      LINK_STATS_INC(link.drop);
+      pbuf_free(p);
+    }
+  }
+
+  return n;
+}
+
+/* Time until the next queued frame is due in ms, 0 with both queues empty */
+static u32_t
+pairif_timeout(const struct pairif *pair)
+{
+  u32_t now = sys_now();
+  u32_t timeout = 0;
+  int i;
+
+  for (i = 0; i < 2; i++) {
+    const struct pairif_queue *queue = &pair->queue[i];
+    s32_t left;
+
+    if (queue->tail == queue->head) {
+      continue;
+    }
+    left = (s32_t)(queue->slots[queue->tail % PAIRIF_QUEUE_LEN].due - now);
+    /* 0 would wait for ever, a frame due by now is taken on the next round */
+    left = LWIP_MAX(left, 1);
+    if ((timeout == 0) || ((u32_t)left < timeout)) {
+      timeout = (u32_t)left;
+    }
+  }
+
+  return timeout;
+}
+
+static void
+pairif_thread(void *arg)
+{
+  struct pairif *pair = (struct pairif *)arg;
+  u32_t timeout = 0;
+
+  while (1) {
+    sys_arch_sem_wait(&pair->sem, timeout);
+
+    LOCK_TCPIP_CORE();
+    while ((pairif_deliver(pair, 0) + pairif_deliver(pair, 1)) != 0) {
+      /* Frames answered while delivering are queued in the other direction */
+    }
+    timeout = pairif_timeout(pair);
+    UNLOCK_TCPIP_CORE();
+  }
+}
+
+static err_t
+pairif_linkoutput(struct netif *netif, struct pbuf *p)
+{
+  struct pairif *pair = (struct pairif *)netif->state;
+  struct pairif_queue *queue = &pair->queue[pairif_side(pair, netif)];
+  struct pairif_slot *slot;
+
+  if (p->tot_len > PAIRIF_FRAME_SIZE) {
+    LINK_STATS_INC(link.lenerr);
+    LINK_STATS_INC(link.drop);
+    return ERR_BUF;
+  }
+
+  /* The wire is busy whether or not the other end has room */
+  if (pair->rate_kbps != 0) {
+    pairif_charge((u32_t)(((uint64_t)(p->tot_len + PAIRIF_WIRE_OVERHEAD) * 8U * 1000000U) /
+                          pair->rate_kbps));
+  }
+
+  if (queue->head - queue->tail >= PAIRIF_QUEUE_LEN) {
+    LINK_STATS_INC(link.drop);
+    MIB2_STATS_NETIF_INC(netif, ifoutdiscards);
+    return ERR_OK;
+  }
+
+  slot = &queue->slots[queue->head % PAIRIF_QUEUE_LEN];
+  slot->len = pbuf_copy_partial(p, slot->data, p->tot_len, 0);
+  slot->due = sys_now() + pair->delay_ms;
+  /* The link task empties both queues, or waits for the first frame due,
+     before it waits again */
+  if (queue->head++ == queue->tail) {
+    sys_sem_signal(&pair->sem);
+  }
+
+  MIB2_STATS_NETIF_ADD(netif, ifoutoctets, p->tot_len);
+  LINK_STATS_INC(link.xmit);
+
+  return ERR_OK;
+}
+
+/* Common setup of both ends, the last byte of the MAC address tells them apart */
+static void
+pairif_setup(struct netif *netif, struct pairif *pair, u8_t mac)
+{
+  ethif_setup(netif, pair, "pr", pairif_linkoutput,
+              (u32_t)LWIP_MIN((uint64_t)pair->rate_kbps * 1000U, 0xffffffffUL), mac);
+}
+
+static err_t
+pairif_peer_init(struct netif *netif)
+{
+  pairif_setup(netif, (struct pairif *)netif->state, ETHIF_MAC_TAPIF + 1);
+
+  return ERR_OK;
+}
+
+err_t
+pairif_init(struct netif *netif)
+{
+  const struct pairif_config *config = (const struct pairif_config *)netif->state;
+  struct pairif *pair;
+
+  if ((pairif_link != NULL) || ip4_addr_isany(netif_ip4_gw(netif)) ||
+      ip4_addr_cmp(netif_ip4_gw(netif), netif_ip4_addr(netif))) {
+    LWIP_DEBUGF(PAIRIF_DEBUG, ("pairif_init: the other end needs its own gateway address\n"));
+    return ERR_ARG;
+  }
+
+  pair = (struct pairif *)calloc(1, sizeof(struct pairif));
+  if (pair == NULL) {
+    return ERR_MEM;
+  }
+  if (sys_sem_new(&pair->sem, 0) != ERR_OK) {
+    free(pair);
+    return ERR_MEM;
+  }
+  pair->rate_kbps = (config != NULL) ? config->rate_kbps : PAIRIF_RATE_KBPS;
+  pair->delay_ms = (config != NULL) ? config->delay_ms : 0;
+  pair->end[0] = netif;
+  pair->end[1] = &pairif_peer;
+  /* The address of tapif, and the next one for the other end */
+  pairif_setup(netif, pair, ETHIF_MAC_TAPIF);
+
+  if (netif_add(&pairif_peer, netif_ip4_gw(netif), netif_ip4_netmask(netif),
+                IP4_ADDR_ANY4, pair, pairif_peer_init, netif->input) == NULL) {
+    sys_sem_free(&pair->sem);
+    free(pair);
+    return ERR_IF;
+  }
+  netif_set_up(&pairif_peer);
+  pairif_link = pair;
+
+  sys_thread_new("pairif", pairif_thread, pair,
+                 DEFAULT_THREAD_STACKSIZE, DEFAULT_THREAD_PRIO);
+
+  return ERR_OK;
+}
+
+struct netif *
+pairif_route(const ip4_addr_t *src, const ip4_addr_t *dest)
+{
+  struct pairif *pair = pairif_link;
+  int i;
+
+  LWIP_UNUSED_ARG(src);
+
+  if (pair == NULL) {
+    return NULL;
+  }
+  for (i = 0; i < 2; i++) {
+    if (netif_is_up(pair->end[i]) && ip4_addr_cmp(dest, netif_ip4_addr(pair->end[i]))) {
+      return pair->end[1 - i];
+    }
+  }
+
+  return NULL;
+}
@@ -0,0 +1,533 @@
+/*
+ * Copyright (c) 2023 Oliver Sintaj
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * pcap capture and replay for the simulator.
+ *
+ * pcapif_record() interposes on the input and linkoutput functions of any
+ * netif and appends every frame to a pcap file. Records are collected in a
+ * buffer written with write(), so the capture costs no system call per frame.
+ * A recorder thread, outside of the scheduler, writes the buffer every
+ * second, and on SIGINT or SIGTERM: the signal handler only wakes it, so the
+ * file ends with the last complete record.
+ *
+ * pcapif_init() is a driver which reads a whole pcap file into memory at
+ * init, then feeds its frames to lwIP from a replay task, either with the
+ * captured gaps between them (scaled by the configured speed) or as fast as
+ * the receivers let the replay task run. Frames due at the same time are
+ * delivered under one core lock.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "lwip/opt.h"
+#include "lwip/def.h"
+#include "lwip/etharp.h"
+#include "lwip/pbuf.h"
+#include "lwip/snmp.h"
+#include "lwip/stats.h"
+#include "lwip/sys.h"
+#include "lwip/tcpip.h"
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "netif/ethif.h"
+#include "netif/pcapif.h"
+
+#if !LWIP_TCPIP_CORE_LOCKING
+#error "pcapif delivers frames under the core lock, LWIP_TCPIP_CORE_LOCKING is required"
+#endif
+
+#ifndef PCAPIF_DEBUG
+#define PCAPIF_DEBUG LWIP_DBG_OFF
+#endif
+
+#define PCAP_MAGIC_US      0xa1b2c3d4UL
+#define PCAP_MAGIC_NS      0xa1b23c4dUL
+#define PCAP_LINKTYPE_ETH  1
+#define PCAP_SNAPLEN       65535
+
+/* Recorder buffer, written when full and by the recorder thread every
+   PCAPIF_RECORD_FLUSH_S */
+#define PCAPIF_RECORD_BUFFER   (256 * 1024)
+#define PCAPIF_RECORD_FLUSH_S  1
+#define PCAPIF_RECORD_NETIFS   4
+
+/* Frames delivered between yields when replaying as fast as possible */
+#define PCAPIF_REPLAY_BURST    32
+
+struct pcap_file_header {
+  u32_t magic;
+  u16_t version_major;
+  u16_t version_minor;
+  s32_t thiszone;
+  u32_t sigfigs;
+  u32_t snaplen;
+  u32_t linktype;
+};
+
+struct pcap_record_header {
+  u32_t ts_sec;
+  u32_t ts_frac;
+  u32_t incl_len;
+  u32_t orig_len;
+};
+
+/* ---------- Recording ---------- */
+
+struct pcapif_recorded {
+  struct netif *netif;
+  netif_input_fn input;
+  netif_linkoutput_fn linkoutput;
+};
+
+static int record_fd = -1;
+static u8_t record_buffer[PCAPIF_RECORD_BUFFER];
+static size_t record_length;
+/* Taken by a task appending a record, inside SYS_ARCH_PROTECT, and by the
+   recorder thread while it writes the buffer */
+static pthread_mutex_t record_lock = PTHREAD_MUTEX_INITIALIZER;
+static sem_t record_signal_sem;
+static volatile sig_atomic_t record_signal;
+static struct pcapif_recorded recorded[PCAPIF_RECORD_NETIFS];
+static struct sigaction record_old_sigint;
+static struct sigaction record_old_sigterm;
+
+static uint64_t
+pcapif_realtime_ns(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_REALTIME, &ts);
+
+  return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static void
+pcapif_record_flush(void)
+{
+  size_t offset = 0;
+
+  while (offset < record_length) {
+    ssize_t ret = write(record_fd, &record_buffer[offset], record_length - offset);
+
+    if (ret <= 0) {
+      break;
+    }
+    offset += (size_t)ret;
+  }
+
+  record_length = 0;
+}
+
+static void
+pcapif_record_frame(struct pbuf *p)
+{
+  struct pcap_record_header hdr;
+  uint64_t now = pcapif_realtime_ns();
+  u16_t len = p->tot_len;
+  SYS_ARCH_DECL_PROTECT(lev);
+
+  hdr.ts_sec = (u32_t)(now / 1000000000ULL);
+  hdr.ts_frac = (u32_t)(now % 1000000000ULL);
+  hdr.incl_len = len;
+  hdr.orig_len = p->tot_len;
+
+  SYS_ARCH_PROTECT(lev);
+  pthread_mutex_lock(&record_lock);
+  if (record_length + sizeof(hdr) + len > sizeof(record_buffer)) {
+    pcapif_record_flush();
+  }
+  memcpy(&record_buffer[record_length], &hdr, sizeof(hdr));
+  record_length += sizeof(hdr);
+  record_length += pbuf_copy_partial(p, &record_buffer[record_length], len, 0);
+  pthread_mutex_unlock(&record_lock);
+  SYS_ARCH_UNPROTECT(lev);
+}
+
+static struct pcapif_recorded *
+pcapif_recorded_find(const struct netif *netif)
+{
+  int i;
+
+  for (i = 0; i < PCAPIF_RECORD_NETIFS; i++) {
+    if (recorded[i].netif == netif) {
+      return &recorded[i];
+    }
+  }
+
+  return NULL;
+}
+
+static err_t
+pcapif_record_input(struct pbuf *p, struct netif *inp)
+{
+  struct pcapif_recorded *rec = pcapif_recorded_find(inp);
+
+  pcapif_record_frame(p);
+
+  return rec->input(p, inp);
+}
+
+static err_t
+pcapif_record_linkoutput(struct netif *netif, struct pbuf *p)
+{
+  struct pcapif_recorded *rec = pcapif_recorded_find(netif);
+
+  pcapif_record_frame(p);
+
+  return rec->linkoutput(netif, p);
+}
+
+/* Write what the buffer holds, at exit too */
+static void
+pcapif_record_write(void)
+{
+  pthread_mutex_lock(&record_lock);
+  pcapif_record_flush();
+  pthread_mutex_unlock(&record_lock);
+}
+
+/* Only async-signal-safe calls here, the recorder thread does the rest */
+static void
+pcapif_record_signal(int sig)
+{
+  record_signal = sig;
+  sem_post(&record_signal_sem);
+}
+
+/* Plain thread with every signal blocked, so it runs whatever the state of
+   the scheduler, or a task stopped in the middle of a record, is */
+static void *
+pcapif_record_thread(void *arg)
+{
+  LWIP_UNUSED_ARG(arg);
+
+  while (1) {
+    struct timespec ts;
+    int sig;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += PCAPIF_RECORD_FLUSH_S;
+    if ((sem_timedwait(&record_signal_sem, &ts) != 0) && (errno != EINTR)) {
+      pcapif_record_write();
+      continue;
+    }
+    if (record_signal == 0) {
+      continue;
+    }
+
+    /* The lock waits for a record being appended to be complete */
+    pcapif_record_write();
+    sig = record_signal;
+
+    /* Hand the signal over to the previous handler, e.g. the event trace */
+    sigaction(sig, (sig == SIGINT) ? &record_old_sigint : &record_old_sigterm, NULL);
+    kill(getpid(), sig);
+
+    return NULL;
+  }
+}
+
+int
+pcapif_record(struct netif *netif, const char *path)
+{
+  struct pcapif_recorded *rec;
+
+  rec = pcapif_recorded_find(NULL);
+  if (rec == NULL) {
+    return -1;
+  }
+
+  /* Every netif recorded by the process shares the first file */
+  if (record_fd < 0) {
+    struct pcap_file_header hdr;
+    struct sigaction action;
+    sigset_t all;
+    sigset_t old;
+    pthread_t thread;
+
+    record_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (record_fd < 0) {
+      return -1;
+    }
+
+    hdr.magic = PCAP_MAGIC_NS;
+    hdr.version_major = 2;
+    hdr.version_minor = 4;
+    hdr.thiszone = 0;
+    hdr.sigfigs = 0;
+    hdr.snaplen = PCAP_SNAPLEN;
+    hdr.linktype = PCAP_LINKTYPE_ETH;
+    memcpy(record_buffer, &hdr, sizeof(hdr));
+    record_length = sizeof(hdr);
+
+    atexit(pcapif_record_write);
+    sem_init(&record_signal_sem, 0, 0);
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &old);
+    if (pthread_create(&thread, NULL, pcapif_record_thread, NULL) == 0) {
+      pthread_detach(thread);
+    }
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = pcapif_record_signal;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, &record_old_sigint);
+    sigaction(SIGTERM, &action, &record_old_sigterm);
+  }
+
+  rec->input = netif->input;
+  rec->linkoutput = netif->linkoutput;
+  rec->netif = netif;
+  netif->input = pcapif_record_input;
+  netif->linkoutput = pcapif_record_linkoutput;
+
+  return 0;
+}
+
+/* ---------- Replay ---------- */
+
+struct pcapif {
+  const struct pcapif_config *config;
+  u8_t *data;
+  size_t size;
+  int swapped;
+  int nanoseconds;
+};
+
+static u32_t
+pcapif_u32(const struct pcapif *pcap, u32_t v)
+{
+  return pcap->swapped ? (u32_t)(((v & 0xffUL) << 24) | ((v & 0xff00UL) << 8) |
+                                 ((v >> 8) & 0xff00UL) | (v >> 24)) : v;
+}
+
+static uint64_t
+pcapif_monotonic_ns(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/* Frames sent by this netif, when replaying a capture of the simulator */
+static int
+pcapif_is_own_frame(const struct netif *netif, const u8_t *frame, u32_t len)
+{
+  return (len >= 12) && (memcmp(frame + 6, netif->hwaddr, ETH_HWADDR_LEN) == 0);
+}
+
+static void
+pcapif_replay_thread(void *arg)
+{
+  struct netif *netif = (struct netif *)arg;
+  struct pcapif *pcap = (struct pcapif *)netif->state;
+  size_t offset = sizeof(struct pcap_file_header);
+  u32_t speed = pcap->config->speed;
+  uint64_t first_ts = 0;
+  uint64_t start;
+  u32_t frames = 0;
+  u32_t skipped = 0;
+  u32_t burst = 0;
+  uint64_t elapsed;
+
+  sys_msleep(PCAPIF_START_DELAY_MS);
+  start = pcapif_monotonic_ns();
+
+  while (offset + sizeof(struct pcap_record_header) <= pcap->size) {
+    struct pcap_record_header hdr;
+    const u8_t *frame;
+    struct pbuf *p;
+    uint64_t ts;
+
+    memcpy(&hdr, pcap->data + offset, sizeof(hdr));
+    offset += sizeof(hdr);
+    hdr.incl_len = pcapif_u32(pcap, hdr.incl_len);
+    if ((hdr.incl_len > pcap->size - offset) || (hdr.incl_len > 0xffff)) {
+      LWIP_PLATFORM_DIAG(("pcapif: truncated record at offset %lu\n", (unsigned long)offset));
+      break;
+    }
+    frame = pcap->data + offset;
+    offset += hdr.incl_len;
+
+    ts = (uint64_t)pcapif_u32(pcap, hdr.ts_sec) * 1000000000ULL +
+         (uint64_t)pcapif_u32(pcap, hdr.ts_frac) * (pcap->nanoseconds ? 1U : 1000U);
+    if (frames + skipped == 0) {
+      first_ts = ts;
+    }
+
+    if (pcapif_is_own_frame(netif, frame, hdr.incl_len)) {
+      skipped++;
+      continue;
+    }
+
+    if (speed != 0) {
+      /* Due time of the frame, relative to the start of the replay */
+      uint64_t due = (ts > first_ts) ? (ts - first_ts) * 100U / speed : 0;
+
+      while (1) {
+        uint64_t now = pcapif_monotonic_ns() - start;
+
+        if (now >= due) {
+          break;
+        }
+        if (due - now >= 2000000ULL) {
+          sys_msleep((u32_t)((due - now) / 1000000ULL) - 1);
+        } else {
+          taskYIELD();
+        }
+      }
+    } else if (++burst >= PCAPIF_REPLAY_BURST) {
+      /* Let the receivers empty their mailboxes */
+      burst = 0;
+      taskYIELD();
+    }
+
+    p = pbuf_alloc(PBUF_RAW, (u16_t)hdr.incl_len, PBUF_POOL);
+    if (p == NULL) {
+      LINK_STATS_INC(link.memerr);
+      LINK_STATS_INC(link.drop);
+      MIB2_STATS_NETIF_INC(netif, ifindiscards);
+      frames++;
+      continue;
+    }
+    pbuf_take(p, frame, (u16_t)hdr.incl_len);
+
+    LOCK_TCPIP_CORE();
+    MIB2_STATS_NETIF_ADD(netif, ifinoctets, p->tot_len);
+    LINK_STATS_INC(link.recv);
+    if (netif->input(p, netif) != ERR_OK) {
+      LINK_STATS_INC(link.drop);
+      pbuf_free(p);
+    }
+    UNLOCK_TCPIP_CORE();
+    frames++;
+  }
+
+  elapsed = pcapif_monotonic_ns() - start;
+  LWIP_PLATFORM_DIAG(("pcapif: replayed %lu frames in %lu.%03lu s, %lu own frames skipped\n",
+                      (unsigned long)frames, (unsigned long)(elapsed / 1000000000ULL),
+                      (unsigned long)((elapsed / 1000000ULL) % 1000U),
+                      (unsigned long)skipped));
+
+  while (1) {
+    sys_msleep(1000);
+  }
+}
+
+static err_t
+pcapif_linkoutput(struct netif *netif, struct pbuf *p)
+{
+  LWIP_UNUSED_ARG(netif);
+  LWIP_UNUSED_ARG(p);
+
+  MIB2_STATS_NETIF_ADD(netif, ifoutoctets, p->tot_len);
+  LINK_STATS_INC(link.xmit);
+
+  return ERR_OK;
+}
+
+static err_t
+pcapif_load(struct pcapif *pcap, const char *path)
+{
+  struct pcap_file_header hdr;
+  FILE *file;
+  long size;
+
+  file = fopen(path, "rb");
+  if (file == NULL) {
+    return ERR_ARG;
+  }
+  if ((fseek(file, 0, SEEK_END) != 0) || ((size = ftell(file)) < (long)sizeof(hdr)) ||
+      (fseek(file, 0, SEEK_SET) != 0)) {
+    fclose(file);
+    return ERR_ARG;
+  }
+
+  pcap->size = (size_t)size;
+  pcap->data = (u8_t *)malloc(pcap->size);
+  if (pcap->data == NULL) {
+    fclose(file);
+    return ERR_MEM;
+  }
+  if (fread(pcap->data, 1, pcap->size, file) != pcap->size) {
+    fclose(file);
+    return ERR_ARG;
+  }
+  fclose(file);
+
+  memcpy(&hdr, pcap->data, sizeof(hdr));
+  switch (hdr.magic) {
+    case PCAP_MAGIC_US:
+      break;
+    case PCAP_MAGIC_NS:
+      pcap->nanoseconds = 1;
+      break;
+    case 0xd4c3b2a1UL:
+      pcap->swapped = 1;
+      break;
+    case 0x4d3cb2a1UL:
+      pcap->swapped = 1;
+      pcap->nanoseconds = 1;
+      break;
+    default:
+      LWIP_PLATFORM_DIAG(("pcapif: %s is not a pcap file\n", path));
+      return ERR_ARG;
+  }
+  if (pcapif_u32(pcap, hdr.linktype) != PCAP_LINKTYPE_ETH) {
+    LWIP_PLATFORM_DIAG(("pcapif: %s does not hold Ethernet frames\n", path));
+    return ERR_ARG;
+  }
+
+  return ERR_OK;
+}
+
+err_t
+pcapif_init(struct netif *netif)
+{
+  const struct pcapif_config *config = (const struct pcapif_config *)netif->state;
+  struct pcapif *pcap;
+  err_t err;
+
+  LWIP_ERROR("pcapif_init: no config", (config != NULL) && (config->path != NULL),
+             return ERR_ARG;);
+
+  pcap = (struct pcapif *)calloc(1, sizeof(struct pcapif));
+  if (pcap == NULL) {
+    return ERR_MEM;
+  }
+  pcap->config = config;
+
+  err = pcapif_load(pcap, config->path);
+  if (err != ERR_OK) {
+    LWIP_DEBUGF(PCAPIF_DEBUG, ("pcapif_init: cannot load %s\n", config->path));
+    free(pcap->data);
+    free(pcap);
+    return err;
+  }
+
+  /* Same address as tapif, so that a capture of the simulator is replayed
+     without its own frames */
+  ethif_setup(netif, pcap, "pc", pcapif_linkoutput, 100000000, ETHIF_MAC_TAPIF);
+
+  sys_thread_new("pcapif_replay", pcapif_replay_thread, netif,
+                 DEFAULT_THREAD_STACKSIZE, DEFAULT_THREAD_PRIO);
+
+  return ERR_OK;
+}
@@ -0,0 +1,342 @@
+/*
+ * Copyright (c) 2023 Oliver Sintaj
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Shared memory link between two simulator processes.
+ *
+ * A POSIX shared memory object holds one single producer, single consumer
+ * ring of frames per direction. Indices are published with atomics, so a
+ * busy link needs no system call: the receive task yields while its ring is
+ * empty for SHMIF_SPIN_US, and only then sleeps on a futex doorbell in the
+ * ring, which the sender rings when it finds the receiver asleep.
+ *
+ * Frames received are copied into pool pbufs, all the frames found in the
+ * ring are delivered under one core lock.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#include "lwip/opt.h"
+#include "lwip/def.h"
+#include "lwip/pbuf.h"
+#include "lwip/snmp.h"
+#include "lwip/stats.h"
+#include "lwip/sys.h"
+#include "lwip/tcpip.h"
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "netif/ethif.h"
+#include "netif/shmif.h"
+
+#if !LWIP_TCPIP_CORE_LOCKING
+#error "shmif delivers frames under the core lock, LWIP_TCPIP_CORE_LOCKING is required"
+#endif
+
+#ifndef SHMIF_DEBUG
+#define SHMIF_DEBUG LWIP_DBG_OFF
+#endif
+
+#define SHMIF_MAGIC     0x73686d31UL
+#define SHMIF_CACHELINE 64
+/* Stale or busy links skipped before giving up */
+#define SHMIF_ATTACH_TRIES 10
+
+struct shmif_slot {
+  u32_t len;
+  u8_t data[SHMIF_FRAME_SIZE];
+};
+
+/* Producer and consumer fields on their own cache lines */
+struct shmif_ring {
+  u32_t head;
+  u8_t pad0[SHMIF_CACHELINE - sizeof(u32_t)];
+  u32_t tail;
+  u32_t waiting;
+  u32_t doorbell;
+  u8_t pad1[SHMIF_CACHELINE - 3 * sizeof(u32_t)];
+  struct shmif_slot slots[SHMIF_RING_SLOTS];
+};
+
+struct shmif_shared {
+  u32_t magic;
+  u32_t attached;
+  s32_t creator;
+  u8_t pad[SHMIF_CACHELINE - 3 * sizeof(u32_t)];
+  /* ring[i] carries the frames sent by side i */
+  struct shmif_ring ring[2];
+};
+
+struct shmif {
+  struct shmif_shared *shared;
+  struct shmif_ring *tx;
+  struct shmif_ring *rx;
+  int side;
+};
+
+static int
+shmif_futex(u32_t *addr, int op, u32_t val, const struct timespec *timeout)
+{
+  return (int)syscall(SYS_futex, addr, op, val, timeout, NULL, 0);
+}
+
+static uint64_t
+shmif_now_us(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (uint64_t)ts.tv_sec * 1000000U + (uint64_t)ts.tv_nsec / 1000U;
+}
+
+/* Wait until the receive ring holds a frame, returns its head */
+static u32_t
+shmif_wait_rx(struct shmif_ring *ring, u32_t tail)
+{
+  uint64_t spin_end = shmif_now_us() + SHMIF_SPIN_US;
+  u32_t head;
+
+  while (1) {
+    struct timespec timeout = { 0, 100000000 };
+    u32_t bell;
+
+    head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    if (head != tail) {
+      return head;
+    }
+    if (shmif_now_us() < spin_end) {
+      taskYIELD();
+      continue;
+    }
+
+    /* The sender checks waiting after publishing its head, and rings the
+       bell, so either the head or the bell changes after this point */
+    bell = __atomic_load_n(&ring->doorbell, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&ring->waiting, 1, __ATOMIC_SEQ_CST);
+    head = __atomic_load_n(&ring->head, __ATOMIC_SEQ_CST);
+    if (head == tail) {
+      shmif_futex(&ring->doorbell, FUTEX_WAIT, bell, &timeout);
+    }
+    __atomic_store_n(&ring->waiting, 0, __ATOMIC_SEQ_CST);
+    spin_end = shmif_now_us() + SHMIF_SPIN_US;
+  }
+}
+
+static void
+shmif_rx_thread(void *arg)
+{
+  struct netif *netif = (struct netif *)arg;
+  struct shmif *shm = (struct shmif *)netif->state;
+  struct shmif_ring *ring = shm->rx;
+  u32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_RELAXED);
+
+  while (1) {
+    u32_t head = shmif_wait_rx(ring, tail);
+
+    LOCK_TCPIP_CORE();
+    for (; tail != head; tail++) {
+      const struct shmif_slot *slot = &ring->slots[tail % SHMIF_RING_SLOTS];
+      u16_t len = (u16_t)LWIP_MIN(slot->len, SHMIF_FRAME_SIZE);
+      struct pbuf *p = pbuf_alloc(PBUF_RAW, len, PBUF_POOL);
+
+      if (p == NULL) {
+        LINK_STATS_INC(link.memerr);
+        LINK_STATS_INC(link.drop);
+        MIB2_STATS_NETIF_INC(netif, ifindiscards);
+        continue;
+      }
+      pbuf_take(p, slot->data, len);
+
+      MIB2_STATS_NETIF_ADD(netif, ifinoctets, len);
+      LINK_STATS_INC(link.recv);
+      if (netif->input(p, netif) != ERR_OK) {
+        LWIP_DEBUGF(SHMIF_DEBUG, ("shmif_rx_thread: netif input error\n"));
+        LINK_STATS_INC(link.drop);
+        pbuf_free(p);
+      }
+    }
+    UNLOCK_TCPIP_CORE();
+
+    /* Slots are free once copied */
+    __atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+  }
+}
+
+static err_t
+shmif_linkoutput(struct netif *netif, struct pbuf *p)
+{
+  struct shmif *shm = (struct shmif *)netif->state;
+  struct shmif_ring *ring = shm->tx;
+  u32_t head = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+  struct shmif_slot *slot;
+
+  if (p->tot_len > SHMIF_FRAME_SIZE) {
+    LINK_STATS_INC(link.lenerr);
+    LINK_STATS_INC(link.drop);
+    return ERR_BUF;
+  }
+
+  if (head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) >= SHMIF_RING_SLOTS) {
+    uint64_t end = shmif_now_us() + SHMIF_TX_WAIT_MS * 1000U;
+
+    /* Full, like a NIC with a slow link partner: give the peer some time */
+    while (head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) >= SHMIF_RING_SLOTS) {
+      if (shmif_now_us() >= end) {
+        LINK_STATS_INC(link.drop);
+        MIB2_STATS_NETIF_INC(netif, ifoutdiscards);
+        return ERR_OK;
+      }
+      taskYIELD();
+    }
+  }
+
+  slot = &ring->slots[head % SHMIF_RING_SLOTS];
+  slot->len = pbuf_copy_partial(p, slot->data, p->tot_len, 0);
+  __atomic_store_n(&ring->head, head + 1, __ATOMIC_SEQ_CST);
+
+  if (__atomic_load_n(&ring->waiting, __ATOMIC_SEQ_CST)) {
+    __atomic_add_fetch(&ring->doorbell, 1, __ATOMIC_SEQ_CST);
+    shmif_futex(&ring->doorbell, FUTEX_WAKE, 1, NULL);
+  }
+
+  MIB2_STATS_NETIF_ADD(netif, ifoutoctets, p->tot_len);
+  LINK_STATS_INC(link.xmit);
+
+  return ERR_OK;
+}
+
+/* Create the link as side 0, or attach to a live one as side 1 */
+static struct shmif_shared *
+shmif_attach(const char *name, int *side)
+{
+  int attempt;
+
+  for (attempt = 0; attempt < SHMIF_ATTACH_TRIES; attempt++) {
+    struct shmif_shared *shared;
+    struct stat st;
+    int created = 1;
+    int fd;
+    int i;
+
+    fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if ((fd < 0) && (errno == EEXIST)) {
+      created = 0;
+      fd = shm_open(name, O_RDWR, 0600);
+    }
+    if (fd < 0) {
+      if (errno == ENOENT) {
+        /* Unlinked in between, by the side 1 of that link */
+        continue;
+      }
+      return NULL;
+    }
+    if (created && (ftruncate(fd, sizeof(struct shmif_shared)) != 0)) {
+      close(fd);
+      shm_unlink(name);
+      return NULL;
+    }
+
+    /* The creator may still be initializing, give it a second */
+    for (i = 0; i < 100; i++) {
+      if ((fstat(fd, &st) == 0) && (st.st_size == (off_t)sizeof(struct shmif_shared))) {
+        break;
+      }
+      usleep(10000);
+    }
+    if (i == 100) {
+      close(fd);
+      shm_unlink(name);
+      continue;
+    }
+
+    shared = (struct shmif_shared *)mmap(NULL, sizeof(struct shmif_shared),
+                                         PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (shared == MAP_FAILED) {
+      return NULL;
+    }
+
+    if (created) {
+      /* ftruncate() zeroed the rings */
+      shared->creator = (s32_t)getpid();
+      __atomic_store_n(&shared->magic, SHMIF_MAGIC, __ATOMIC_RELEASE);
+      *side = 0;
+      return shared;
+    }
+
+    for (i = 0; (i < 100) && (__atomic_load_n(&shared->magic, __ATOMIC_ACQUIRE) != SHMIF_MAGIC); i++) {
+      usleep(10000);
+    }
+
+    /* Left over by a creator that is gone, start over */
+    if ((__atomic_load_n(&shared->magic, __ATOMIC_ACQUIRE) != SHMIF_MAGIC) ||
+        ((kill((pid_t)shared->creator, 0) != 0) && (errno == ESRCH))) {
+      munmap(shared, sizeof(struct shmif_shared));
+      shm_unlink(name);
+      continue;
+    }
+
+    /* Only one process may produce into ring[1], the others start a link
+       of their own once the winner has unlinked the name */
+    if (__atomic_exchange_n(&shared->attached, 1, __ATOMIC_ACQ_REL) != 0) {
+      munmap(shared, sizeof(struct shmif_shared));
+      usleep(10000);
+      continue;
+    }
+
+    /* The name is not needed any more, the next pair of runs gets a new link */
+    shm_unlink(name);
+    *side = 1;
+
+    return shared;
+  }
+
+  return NULL;
+}
+
+err_t
+shmif_init(struct netif *netif)
+{
+  const struct shmif_config *config = (const struct shmif_config *)netif->state;
+  const char *name = ((config != NULL) && (config->name != NULL)) ? config->name : SHMIF_DEFAULT_NAME;
+  struct shmif *shm;
+
+  shm = (struct shmif *)calloc(1, sizeof(struct shmif));
+  if (shm == NULL) {
+    return ERR_MEM;
+  }
+
+  shm->shared = shmif_attach(name, &shm->side);
+  if (shm->shared == NULL) {
+    LWIP_DEBUGF(SHMIF_DEBUG, ("shmif_init: cannot attach to %s\n", name));
+    free(shm);
+    return ERR_IF;
+  }
+  shm->tx = &shm->shared->ring[shm->side];
+  shm->rx = &shm->shared->ring[1 - shm->side];
+  LWIP_PLATFORM_DIAG(("shmif: %s side %d\n", name, shm->side));
+
+  /* The address of tapif, and the next one for the second side */
+  ethif_setup(netif, shm, "sm", shmif_linkoutput, 100000000,
+              (u8_t)(ETHIF_MAC_TAPIF + shm->side));
+
+  sys_thread_new("shmif_rx", shmif_rx_thread, netif,
+                 DEFAULT_THREAD_STACKSIZE, DEFAULT_THREAD_PRIO);
+
+  return ERR_OK;
+}
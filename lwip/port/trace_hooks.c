@@ -0,0 +1,125 @@
+/*
+ * Copyright (c) 2023 Oliver Sintaj
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * lwIP hooks for the simulator event trace.
+ *
+ * lwIP has no trace points of its own, so the traced functions are
+ * interposed at link time with -Wl,--wrap=<symbol>, see lwip/CMakeLists.txt.
+ * Calls made from inside the object defining a symbol are not redirected,
+ * e.g. lwip_send() calling lwip_sendto() is recorded once.
+ */
+
+#include "lwip/opt.h"
+#include "lwip/pbuf.h"
+#include "lwip/sockets.h"
+
+#include "FreeRTOSTrace.h"
+
+/** @brief Number of pbufs currently allocated, approximate as the calls made
+ *         from inside pbuf.c are not seen **/
+static u32_t pbufs_in_use;
+
+struct pbuf *__real_pbuf_alloc(pbuf_layer layer, u16_t length, pbuf_type type);
+struct pbuf *__wrap_pbuf_alloc(pbuf_layer layer, u16_t length, pbuf_type type);
+u8_t __real_pbuf_free(struct pbuf *p);
+u8_t __wrap_pbuf_free(struct pbuf *p);
+
+ssize_t __real_lwip_send(int s, const void *dataptr, size_t size, int flags);
+ssize_t __wrap_lwip_send(int s, const void *dataptr, size_t size, int flags);
+ssize_t __real_lwip_sendto(int s, const void *dataptr, size_t size, int flags,
+                           const struct sockaddr *to, socklen_t tolen);
+ssize_t __wrap_lwip_sendto(int s, const void *dataptr, size_t size, int flags,
+                           const struct sockaddr *to, socklen_t tolen);
+ssize_t __real_lwip_recv(int s, void *mem, size_t len, int flags);
+ssize_t __wrap_lwip_recv(int s, void *mem, size_t len, int flags);
+ssize_t __real_lwip_recvfrom(int s, void *mem, size_t len, int flags,
+                             struct sockaddr *from, socklen_t *fromlen);
+ssize_t __wrap_lwip_recvfrom(int s, void *mem, size_t len, int flags,
+                             struct sockaddr *from, socklen_t *fromlen);
+
+struct pbuf *
+__wrap_pbuf_alloc(pbuf_layer layer, u16_t length, pbuf_type type)
+{
+  struct pbuf *p = __real_pbuf_alloc(layer, length, type);
+  struct pbuf *q;
+  u32_t count = 0;
+
+  if (p == NULL) {
+    vTraceInstant("pbuf_alloc failed", length);
+    return NULL;
+  }
+
+  /* PBUF_POOL allocations may return a chain */
+  for (q = p; q != NULL; q = q->next) {
+    count++;
+  }
+
+  vTraceInstant("pbuf_alloc", length);
+  vTraceCounter("pbufs", 0, __atomic_add_fetch(&pbufs_in_use, count, __ATOMIC_RELAXED));
+
+  return p;
+}
+
+u8_t
+__wrap_pbuf_free(struct pbuf *p)
+{
+  u16_t length = (p != NULL) ? p->tot_len : 0;
+  u8_t count = __real_pbuf_free(p);
+
+  vTraceInstant("pbuf_free", length);
+  if (count != 0) {
+    vTraceCounter("pbufs", 0, __atomic_sub_fetch(&pbufs_in_use, count, __ATOMIC_RELAXED));
+  }
+
+  return count;
+}
+
+ssize_t
+__wrap_lwip_send(int s, const void *dataptr, size_t size, int flags)
+{
+  uint64_t start = ullTraceTimestamp();
+  ssize_t ret = __real_lwip_send(s, dataptr, size, flags);
+
+  vTraceSlice("send", start, (uint32_t)ret);
+
+  return ret;
+}
+
+ssize_t
+__wrap_lwip_sendto(int s, const void *dataptr, size_t size, int flags,
+                   const struct sockaddr *to, socklen_t tolen)
+{
+  uint64_t start = ullTraceTimestamp();
+  ssize_t ret = __real_lwip_sendto(s, dataptr, size, flags, to, tolen);
+
+  vTraceSlice("sendto", start, (uint32_t)ret);
+
+  return ret;
+}
+
+ssize_t
+__wrap_lwip_recv(int s, void *mem, size_t len, int flags)
+{
+  uint64_t start = ullTraceTimestamp();
+  ssize_t ret = __real_lwip_recv(s, mem, len, flags);
+
+  vTraceSlice("recv", start, (uint32_t)ret);
+
+  return ret;
+}
+
+ssize_t
+__wrap_lwip_recvfrom(int s, void *mem, size_t len, int flags,
+                     struct sockaddr *from, socklen_t *fromlen)
+{
+  uint64_t start = ullTraceTimestamp();
+  ssize_t ret = __real_lwip_recvfrom(s, mem, len, flags, from, fromlen);
+
+  vTraceSlice("recvfrom", start, (uint32_t)ret);
+
+  return ret;
+}
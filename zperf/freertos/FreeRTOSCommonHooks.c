@@ -108,6 +108,10 @@ __WEAK__ void vApplicationIdleHook(void)
 {
 	/* Best to sleep here until next systick */
 //	__WFI();
+#if defined(FREERTOS_SIM_VIRTUAL_TIME) && (FREERTOS_SIM_VIRTUAL_TIME > 0)
+	/* Nothing else to run, on virtual time the next tick is due now */
+	vVirtualTimeIdle();
+#endif
 }
 
 /* FreeRTOS stack overflow hook */
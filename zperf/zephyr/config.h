@@ -142,9 +142,10 @@
 #define CONFIG_NET_L2_ETHERNET               1
 
 /**
- * @brief Defines maximal size for socket
+ * @brief Defines maximal size for socket, the largest UDP payload of a
+ *        1500 byte IPv4 packet
  * **/
-#define CONFIG_NET_ZPERF_MAX_PACKET_SIZE     (1024)
+#define CONFIG_NET_ZPERF_MAX_PACKET_SIZE     (1472)
 
 /**
  * @brief Enebles POSIX acrhitecture to be able to run app on desktop enviroment
@@ -158,6 +159,14 @@
  * **/
 #define CONFIG_NET_ZPERF_MAX_SESSIONS        (4)
 
+/**
+ * @brief Attach per task CPU usage and context switch counts to the results
+ * @note Requires the kernel to be built with FREERTOS_RUN_TIME_STATS (see freertos/CMakeLists.txt)
+ * **/
+#if defined(FREERTOS_SIM_RUN_TIME_STATS) && (configGENERATE_RUN_TIME_STATS == 1)
+#define CONFIG_ZPERF_CPU_STATS               1
+#endif
+
 /**
  * @brief Defines stack size for work queue
  * **/
@@ -4,6 +4,8 @@
  * SPDX-License-Identifier: Apache-2.0
  */
 
+#include <time.h>
+
 #include "kernel.h"
 
 /** @brief Tick rate in hertz **/
@@ -56,3 +58,25 @@ uint64_t k_ms_to_ticks_ceil64(uint64_t ms)
     uint64_t ticks = (ms * _tick_rate_hz) / (uint64_t)USEC_PER_MSEC;
     return ticks;
 }
+
+/** see header **/
+uint64_t k_cycle_get_64(void)
+{
+    struct timespec now;
+
+#if defined(FREERTOS_SIM_VIRTUAL_TIME) && (FREERTOS_SIM_VIRTUAL_TIME > 0)
+    if (xVirtualTimeIsEnabled())
+    {
+        return ullVirtualTimeNs();
+    }
+#endif
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return ((uint64_t)now.tv_sec * 1000000000ULL) + (uint64_t)now.tv_nsec;
+}
+
+/** see header **/
+uint64_t k_cyc_to_us_floor64(uint64_t cyc)
+{
+    return cyc / 1000ULL;
+}
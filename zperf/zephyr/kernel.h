@@ -140,4 +140,21 @@ static inline uint64_t k_ticks_to_us_floor64(uint64_t ticks)
     return k_ticks_to_us_ceil64(ticks);
 }
 
+/**
+ * @brief Read the 64bit hardware cycle counter
+ * @note In the simulator the counter is the host monotonic clock, counting
+ *       nanoseconds. Unlike k_uptime_ticks() it is not limited to the tick
+ *       resolution, so it is the one to use for timestamping packets. On
+ *       virtual time it is the virtual clock.
+ * @return current cycle count
+ * **/
+uint64_t k_cycle_get_64(void);
+
+/**
+ * @brief Converts cycles to us
+ * @param cyc cycles to convert
+ * @return us as unsigned 64bit value
+ * **/
+uint64_t k_cyc_to_us_floor64(uint64_t cyc);
+
 #endif /* __KERNEL_H */
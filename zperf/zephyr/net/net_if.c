@@ -33,6 +33,14 @@ struct netif * net_if_get_default()
     return &default_net_intrface;
 }
 
+/** see header **/
+int net_if_get_by_iface(struct netif *iface)
+{
+    assert(iface != NULL);
+
+    return netif_get_index(iface);
+}
+
 /** see header **/
 net_if_addr * net_if_ipv6_addr_add(struct netif *iface,
                                    const struct in6_addr *addr,
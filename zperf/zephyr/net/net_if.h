@@ -38,6 +38,13 @@ struct net_if_ipv6_prefix
  * **/
 struct netif * net_if_get_default();
 
+/**
+ * @brief Get the index of a network interface, e.g. for IPV6_JOIN_GROUP
+ * @param iface pointer to the network interface, e.g. netif_default
+ * @return index of the interface
+ * **/
+int net_if_get_by_iface(struct netif *iface);
+
 /**
  * @brief Add IPv6 address to the zperf network interface 
  * @param iface pointer to zperf network interface
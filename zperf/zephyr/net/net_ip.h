@@ -184,5 +184,27 @@ static inline bool net_ipv6_is_addr_unspecified(const struct in6_addr * addr)
 	return (net_ipv6_addr_cmp(addr, net_ipv6_unspecified_address()));
 }
 
+/**
+ * @brief Check if IPv4 address is a multicast address (224.0.0.0/4)
+ * @param addr address to check
+ * @return true - address is multicast
+ *         false - address is not multicast
+ * **/
+static inline bool net_ipv4_is_addr_mcast(const struct in_addr * addr)
+{
+	return ((ntohl(addr->s_addr) & 0xF0000000UL) == 0xE0000000UL);
+}
+
+/**
+ * @brief Check if IPv6 address is a multicast address (ff00::/8)
+ * @param addr address to check
+ * @return true - address is multicast
+ *         false - address is not multicast
+ * **/
+static inline bool net_ipv6_is_addr_mcast(const struct in6_addr * addr)
+{
+	return (addr->s6_addr[0] == 0xFF);
+}
+
 
 #endif /** __NET_IP_H **/
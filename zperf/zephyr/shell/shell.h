@@ -83,5 +83,10 @@ enum shell_vt100_color
  * **/
 void shell_task();
 
+/**
+ * @brief Usage of the shell commands, printed by help
+ * **/
+extern const char *const helpmessage;
+
 
 #endif /* __SHELL_H */
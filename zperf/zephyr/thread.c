@@ -5,6 +5,7 @@
  */
 
 #include <assert.h>
+#include <errno.h>
 #include <stdio.h>
 
 #include "thread.h"
@@ -20,11 +21,11 @@ void k_sem_init(struct k_sem * sem,
 }
 
 /** see header **/
-void k_sem_take(struct k_sem * sem,
-                const TickType_t ticks)
+int k_sem_take(struct k_sem * sem,
+               const TickType_t ticks)
 {
     assert(sem != NULL);
-    xSemaphoreTake(sem->semaphore_handle, ticks);
+    return (xSemaphoreTake(sem->semaphore_handle, ticks) == pdTRUE) ? 0 : -EAGAIN;
 }
 
 /** see header **/
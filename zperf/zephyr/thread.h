@@ -154,10 +154,10 @@ void k_sem_init(struct k_sem * sem,
  * @param sem pointer to semaphores struct
  * @param ticks The time in ticks to wait for the semaphore to become
  *              available
- * @return non
+ * @return 0 if the semaphore was taken, -EAGAIN on timeout
  * **/
-void k_sem_take(struct k_sem * sem,
-                const TickType_t ticks);
+int k_sem_take(struct k_sem * sem,
+               const TickType_t ticks);
 
 /**
  * @brief Semaphore release function
@@ -15,6 +15,7 @@
  */
 
 #include <lwip/sockets.h>
+#include <stdbool.h>
 #include <stdint.h>
 #ifndef __ZPERF_H_
 #define __ZPERF_H_
@@ -29,6 +30,133 @@ enum zperf_status {
 	ZPERF_SESSION_ERROR
 } __attribute__((packed));
 
+/** What the server is asked to send back, with the iperf2 client header */
+enum zperf_dual_mode {
+	/** Nothing, a one way test */
+	ZPERF_DUAL_NONE,
+	/** Send back while receiving (iperf -d) */
+	ZPERF_DUAL_BIDIR,
+	/** Send back once the upload is over (iperf -r) */
+	ZPERF_DUAL_TRADEOFF,
+	/** Send instead of receiving, on the connection of the client, which
+	 *  passes NAT. A zperf extension, not the -R of iperf 2.1, so TCP and
+	 *  zperf servers only.
+	 */
+	ZPERF_DUAL_REVERSE,
+};
+
+/** Entries of a struct zperf_size_schedule */
+#define ZPERF_SIZE_SCHEDULE_LEN 256
+
+/**
+ * @brief Sizes of the packets of a UDP upload with a traffic profile.
+ *
+ * The uploader sends size[0] to size[len - 1] and starts again, so the
+ * profile costs no random draw while sending. Built by the
+ * zperf_size_schedule_*() functions.
+ */
+struct zperf_size_schedule {
+	uint16_t len;
+	/* Largest of the sizes */
+	uint16_t max;
+	uint16_t size[ZPERF_SIZE_SCHEDULE_LEN];
+};
+
+/** What holds back the data in flight of a TCP connection */
+enum zperf_tcp_limit {
+	/** Nothing waits to be sent and the send buffer has room: the
+	 *  application does not write fast enough
+	 */
+	ZPERF_TCP_LIMIT_APP,
+	/** Nothing waits to be sent, the whole send buffer is in flight */
+	ZPERF_TCP_LIMIT_SNDBUF,
+	/** Data waits for the congestion window */
+	ZPERF_TCP_LIMIT_CWND,
+	/** Data waits for the window of the receiver */
+	ZPERF_TCP_LIMIT_RWND,
+	ZPERF_TCP_LIMITS
+};
+
+/**
+ * @brief State of a TCP connection, read from its lwIP control block.
+ *
+ * Windows and buffers are in bytes. lwIP times the round trip in ticks of
+ * its slow timer (TCP_SLOW_INTERVAL, 500 ms), so the times are multiples
+ * of it.
+ */
+struct zperf_tcp_sample {
+	/* Since the start of the upload */
+	uint32_t time_us;
+	uint32_t cwnd;
+	uint32_t ssthresh;
+	/* Window of the receiver */
+	uint32_t snd_wnd;
+	/* Window offered to the peer */
+	uint32_t rcv_wnd;
+	/* Sent and not acknowledged yet */
+	uint32_t in_flight;
+	/* Free space of the send buffer */
+	uint32_t snd_buf;
+	/* Segments queued in the send buffer */
+	uint16_t snd_queuelen;
+	/* Retransmissions of the oldest segment not acknowledged */
+	uint8_t nrtx;
+	bool fast_recovery;
+	/* Smoothed round trip time and its variation (sa and sv) */
+	uint32_t srtt_ms;
+	uint32_t rttvar_ms;
+	uint32_t rto_ms;
+	enum zperf_tcp_limit limit;
+};
+
+/**
+ * @brief Summary of the samples of a TCP upload.
+ *
+ * A sample is taken at the end of every upload, others every sample_ms
+ * of the upload options.
+ */
+struct zperf_tcp_stats {
+	uint32_t samples;
+	uint32_t cwnd_min;
+	uint32_t cwnd_mean;
+	uint32_t cwnd_max;
+	uint32_t ssthresh_min;
+	uint32_t srtt_max_ms;
+	uint32_t rto_max_ms;
+	uint8_t nrtx_max;
+	/* Samples with a congestion window lower than in the one before,
+	 * after a loss or a timeout
+	 */
+	uint32_t cwnd_drops;
+	/* Samples by what held back the data in flight */
+	uint32_t limit[ZPERF_TCP_LIMITS];
+	struct zperf_tcp_sample last;
+};
+
+/**
+ * @brief Callback of a sampled TCP upload, called for every sample.
+ *
+ * @param sample State of the connection.
+ * @param user_data A pointer to the user provided data.
+ */
+typedef void (*zperf_tcp_sample_callback)(const struct zperf_tcp_sample *sample,
+					  void *user_data);
+
+struct zperf_results;
+
+/**
+ * @brief Callback of a multicast UDP upload, called with the report of
+ *        every receiver of the group.
+ *
+ * @param addr Address the receiver answered from.
+ * @param results Statistics of the receiver, the same as the server
+ *        side of a unicast upload.
+ * @param user_data A pointer to the user provided data.
+ */
+typedef void (*zperf_receiver_callback)(const struct sockaddr *addr,
+					const struct zperf_results *results,
+					void *user_data);
+
 struct zperf_upload_params {
 	struct sockaddr_storage peer_addr;
 	uint32_t duration_ms;
@@ -38,12 +166,181 @@ struct zperf_upload_params {
 		uint8_t tos;
 		int tcp_nodelay;
 		int priority;
+		/* Seed of the payload pattern, 0 sends the legacy 'z' fill */
+		uint32_t pattern_seed;
+		/* Multicast destination only: TTL (IPv4) or hop limit (IPv6),
+		 * 0 keeps the default of the stack, and whether the sending
+		 * host gets a copy
+		 */
+		uint8_t mcast_ttl;
+		bool mcast_loop;
+		/* Multicast destination only: the report of every receiver
+		 * is passed to receiver_cb if not NULL, the results hold
+		 * the first one
+		 */
+		zperf_receiver_callback receiver_cb;
+		void *receiver_user_data;
+		/* Asks the server to send back to dual_port, the same
+		 * duration, packet size and rate, see zperf_dual_upload()
+		 */
+		enum zperf_dual_mode dual;
+		uint16_t dual_port;
+		/* UDP only: sizes of the packets sent, instead of
+		 * packet_size, NULL for a fixed size
+		 */
+		const struct zperf_size_schedule *sizes;
+		/* UDP only: bursts of burst_packets packets, one starting
+		 * every burst_period_ms, sent at rate_kbps (0 back to back).
+		 * 0 sends a steady stream.
+		 */
+		uint32_t burst_packets;
+		uint32_t burst_period_ms;
+		/* UDP only: exponential times between bursts, or between
+		 * packets without bursts, of the same mean (Poisson arrivals)
+		 */
+		bool poisson;
+		/* TCP only: send buffer of the connection in bytes, which
+		 * bounds the data in flight like a window. 0 for the
+		 * TCP_SND_BUF of the stack, the most it can be.
+		 */
+		uint32_t sndbuf;
+		/* TCP only: sample the connection every sample_ms, 0 only
+		 * at the end, and pass the samples to sample_cb if not NULL
+		 */
+		uint32_t sample_ms;
+		zperf_tcp_sample_callback sample_cb;
+		void *sample_user_data;
 	} options;
 };
 
+/** Maximum number of ports a UDP server listens on */
+#define ZPERF_MAX_PORTS 8
+
 struct zperf_download_params {
 	uint16_t port;
+	/* UDP only: ports to listen on, port is the first one. With 0 the
+	 * server listens on port alone.
+	 */
+	uint16_t num_ports;
+	uint16_t ports[ZPERF_MAX_PORTS];
 	struct sockaddr_storage addr;
+	/* Seed of the payload pattern to verify, 0 disables verification */
+	uint32_t pattern_seed;
+	/* UDP only: packets in a burst of the sender, for the loss of every
+	 * burst, 0 if it sends a steady stream
+	 */
+	uint32_t burst_packets;
+	/* Receive buffer in bytes, 0 for the default of the stack: the
+	 * receive window of a TCP connection, at most TCP_WND, or the
+	 * datagrams queued on a UDP socket (SO_RCVBUF)
+	 */
+	uint32_t rcvbuf;
+};
+
+/** Maximum number of tasks reported in struct zperf_cpu_stats */
+#define ZPERF_CPU_STATS_MAX_TASKS 24
+
+/** Maximum length of a task name in struct zperf_task_stats */
+#define ZPERF_CPU_STATS_NAME_LEN 16
+
+struct zperf_task_stats {
+	char name[ZPERF_CPU_STATS_NAME_LEN];
+	uint32_t run_time_us;
+	uint32_t switches;
+	uint16_t cpu_permille;
+};
+
+/**
+ * @brief Scheduler statistics collected between two interval boundaries.
+ *
+ * nb_tasks is 0 when the kernel is built without run time statistics.
+ */
+struct zperf_cpu_stats {
+	uint32_t interval_us;
+	uint32_t nb_tasks;
+	struct zperf_task_stats task[ZPERF_CPU_STATS_MAX_TASKS];
+};
+
+/**
+ * @brief Summary of a latency distribution, all values in microseconds.
+ *
+ * Percentiles are read from a log-linear histogram and are accurate to
+ * about 2%.
+ */
+struct zperf_latency {
+	uint32_t count;
+	uint32_t min_us;
+	uint32_t mean_us;
+	uint32_t p50_us;
+	uint32_t p90_us;
+	uint32_t p99_us;
+	uint32_t p999_us;
+	uint32_t max_us;
+};
+
+/** Number of power of two buckets in the struct zperf_seq_stats histograms */
+#define ZPERF_SEQ_HIST_BUCKETS 12
+
+/**
+ * @brief Packet sequence analysis of a UDP session.
+ *
+ * Bucket n of the histograms counts the values in [2^n, 2^(n+1)), the last
+ * one everything above.
+ */
+struct zperf_seq_stats {
+	/* Distinct packets received */
+	uint32_t received;
+	/* Packets still missing once out of the reorder window */
+	uint32_t lost;
+	/* Packets received after having been declared lost */
+	uint32_t late;
+	uint32_t duplicates;
+	/* Packets received after a packet with a higher id */
+	uint32_t reordered;
+	/* Largest distance to the highest id seen of a reordered packet */
+	uint32_t max_reorder;
+	uint32_t reorder_hist[ZPERF_SEQ_HIST_BUCKETS];
+	/* Runs of consecutive lost packets */
+	uint32_t loss_bursts;
+	uint32_t max_loss_burst;
+	uint32_t loss_burst_hist[ZPERF_SEQ_HIST_BUCKETS];
+	/* Bursts of the sender, when their length is known: bursts losing
+	 * packets and the packets lost by each of them
+	 */
+	uint32_t tx_bursts;
+	uint32_t tx_lossy_bursts;
+	uint32_t tx_max_burst_loss;
+	uint32_t tx_burst_loss_hist[ZPERF_SEQ_HIST_BUCKETS];
+};
+
+/**
+ * @brief Payload verification of a session.
+ *
+ * bytes_checked is 0 when verification is disabled.
+ */
+struct zperf_integrity {
+	uint64_t bytes_checked;
+	uint64_t corrupt_bytes;
+	/* UDP packets or TCP reads holding corrupt bytes */
+	uint32_t corrupt_chunks;
+	/* First corrupt byte, offset in the TCP stream or in the UDP packet
+	 * first_mismatch_id
+	 */
+	uint64_t first_mismatch;
+	uint32_t first_mismatch_id;
+};
+
+/** Number of buckets of struct zperf_size_stats */
+#define ZPERF_SIZE_BUCKETS 6
+
+/**
+ * @brief UDP packets received by size.
+ *
+ * Bucket 0 counts the payloads below 64 bytes, bucket n those in
+ * [32 << n, 64 << n), the last one everything from 1024 bytes.
+ */
+struct zperf_size_stats {
+	uint32_t count[ZPERF_SIZE_BUCKETS];
 };
 
 struct zperf_results {
@@ -57,8 +354,176 @@ struct zperf_results {
 	uint32_t client_time_in_us;
 	uint32_t packet_size;
 	uint32_t nb_packets_errors;
+	struct zperf_cpu_stats cpu;
+	/* One way transit time above the lowest one of the first packets of
+	 * the session, which are left out. The client and server clocks are
+	 * not synchronized, so this is the packet delay variation rather than
+	 * the absolute transit time.
+	 */
+	struct zperf_latency transit;
+	/* Time between the arrival of consecutive packets */
+	struct zperf_latency gap;
+	struct zperf_seq_stats seq;
+	struct zperf_integrity integrity;
+	/* UDP server only */
+	struct zperf_size_stats sizes;
+	/* TCP upload only */
+	struct zperf_tcp_stats tcp;
+	/* Port a UDP server session was received on */
+	uint16_t port;
+	/* Multicast UDP upload only: receivers which sent a report */
+	uint16_t nb_receivers;
+};
+
+/** Parameters of a search of the UDP throughput, see zperf_udp_search() */
+struct zperf_search_params {
+	/* Test parameters, rate_kbps is the highest rate tried */
+	struct zperf_upload_params upload;
+	/* Highest share of the packets sent that may be lost, in parts per
+	 * million, 0 for the RFC 2544 throughput
+	 */
+	uint32_t loss_ppm;
+	/* Trials run at every rate, all of them have to pass */
+	uint8_t trials;
+	/* The search ends once the highest rate passing and the lowest one
+	 * failing are this close
+	 */
+	uint32_t resolution_kbps;
+};
+
+/** A trial of the search, passed to the callback of zperf_udp_search() */
+struct zperf_search_probe {
+	uint32_t rate_kbps;
+	uint8_t trial;
+	/* Return value of zperf_udp_upload() */
+	int ret;
+	uint32_t loss_ppm;
+	bool passed;
+	const struct zperf_results *results;
+};
+
+struct zperf_search_results {
+	/* Highest rate passing all its trials, 0 if none did */
+	uint32_t rate_kbps;
+	/* Received by the server in the last trial of that rate */
+	uint32_t throughput_kbps;
+	uint32_t frames_per_sec;
+	/* Highest loss of the trials of that rate */
+	uint32_t loss_ppm;
+	/* Uploads run by the search */
+	uint32_t probes;
+};
+
+/** Parameters of a UDP rate ramp, see zperf_udp_ramp() */
+struct zperf_ramp_params {
+	/* Test of every step: rate_kbps is the rate of the first step,
+	 * duration_ms the duration of each
+	 */
+	struct zperf_upload_params upload;
+	/* Rate of the last step, the others are spread evenly in between */
+	uint32_t end_kbps;
+	uint16_t steps;
+	/* Pause between two steps, 0 for a continuous ramp */
+	uint32_t settle_ms;
+	/* Loss above which a step is saturated, in parts per million */
+	uint32_t loss_ppm;
+};
+
+/** A step of the ramp, passed to the callback of zperf_udp_ramp() */
+struct zperf_ramp_step {
+	uint16_t step;
+	/* Offered rate */
+	uint32_t rate_kbps;
+	/* Return value of zperf_udp_upload() */
+	int ret;
+	/* Received by the server */
+	uint32_t throughput_kbps;
+	uint32_t loss_ppm;
+	uint32_t jitter_us;
+	/* Lost more than allowed, or received less than half of the rate
+	 * added since the previous step
+	 */
+	bool saturated;
+	const struct zperf_results *results;
+};
+
+struct zperf_ramp_results {
+	/* Whether a step saturated, the knee is the step before the first
+	 * one that did, the last step otherwise
+	 */
+	bool saturated;
+	/* Index of the knee, -1 if the first step saturated */
+	int knee_step;
+	uint32_t knee_kbps;
+	uint32_t knee_throughput_kbps;
+	/* Highest rate received by the server over all steps */
+	uint32_t max_throughput_kbps;
+};
+
+/** Parameters of a TCP window sweep, see zperf_tcp_sweep() */
+struct zperf_sweep_params {
+	/* Test of every step, options.sndbuf is set by the sweep */
+	struct zperf_upload_params upload;
+	/* Send buffer of the first and of the last step in bytes, it is
+	 * doubled from one step to the next
+	 */
+	uint32_t start_bytes;
+	uint32_t end_bytes;
+	/* Pause between two steps */
+	uint32_t settle_ms;
+};
+
+/** A step of the sweep, passed to the callback of zperf_tcp_sweep() */
+struct zperf_sweep_step {
+	uint16_t step;
+	/* Send buffer of the step */
+	uint32_t bytes;
+	/* Return value of zperf_tcp_upload() */
+	int ret;
+	/* Sent by the client */
+	uint32_t throughput_kbps;
+	/* Buffer for every Mbit/s of throughput, 0 without throughput */
+	uint32_t bytes_per_mbps;
+	const struct zperf_results *results;
+};
+
+struct zperf_sweep_results {
+	uint16_t steps;
+	uint32_t max_throughput_kbps;
+	/* Smallest buffer reaching 90% of the highest throughput, where
+	 * more memory stops paying off
+	 */
+	uint32_t knee_bytes;
+	uint32_t knee_throughput_kbps;
 };
 
+/**
+ * @brief Callback of zperf_udp_search(), called after every trial.
+ *
+ * @param probe Rate, trial and its results.
+ * @param user_data A pointer to the user provided data.
+ */
+typedef void (*zperf_search_callback)(const struct zperf_search_probe *probe,
+				      void *user_data);
+
+/**
+ * @brief Callback of zperf_udp_ramp(), called after every step.
+ *
+ * @param step Rate of the step and its results.
+ * @param user_data A pointer to the user provided data.
+ */
+typedef void (*zperf_ramp_callback)(const struct zperf_ramp_step *step,
+				    void *user_data);
+
+/**
+ * @brief Callback of zperf_tcp_sweep(), called after every step.
+ *
+ * @param step Send buffer of the step and its results.
+ * @param user_data A pointer to the user provided data.
+ */
+typedef void (*zperf_sweep_callback)(const struct zperf_sweep_step *step,
+				     void *user_data);
+
 /**
  * @brief Zperf callback function used for asynchronous operations.
  *
@@ -70,6 +535,48 @@ typedef void (*zperf_callback)(enum zperf_status status,
 			       struct zperf_results *result,
 			       void *user_data);
 
+/**
+ * @brief Build a schedule of the simple IMIX: 64, 594 and 1518 byte
+ *        Ethernet frames in the ratio 7:4:1.
+ *
+ * @param sched Schedule to fill.
+ * @param family AF_INET or AF_INET6, whose headers are taken off the frame
+ *               sizes to get the UDP payloads.
+ *
+ * @return 0 on success, -EINVAL for an unknown family.
+ */
+int zperf_size_schedule_imix(struct zperf_size_schedule *sched, int family);
+
+/**
+ * @brief Build a schedule of sizes spread evenly over a range.
+ *
+ * @param sched Schedule to fill.
+ * @param min Smallest UDP payload.
+ * @param max Largest UDP payload.
+ *
+ * @return 0 on success, -EINVAL if min is above max.
+ */
+int zperf_size_schedule_uniform(struct zperf_size_schedule *sched,
+				uint16_t min, uint16_t max);
+
+/**
+ * @brief Build a schedule of sizes in given proportions, e.g. an empirical
+ *        distribution.
+ *
+ * @note Sizes are clamped to the range the uploader can send. A size whose
+ *       weight is too small for a schedule entry is left out.
+ *
+ * @param sched Schedule to fill.
+ * @param sizes UDP payloads.
+ * @param weights Share of each size, in any unit.
+ * @param count Number of sizes.
+ *
+ * @return 0 on success, -EINVAL without any weight.
+ */
+int zperf_size_schedule_mix(struct zperf_size_schedule *sched,
+			    const uint16_t *sizes, const uint32_t *weights,
+			    size_t count);
+
 /**
  * @brief Synchronous UDP upload operation. The function blocks until the upload
  *        is complete.
@@ -94,6 +601,94 @@ int zperf_udp_upload(const struct zperf_upload_params *param,
 int zperf_tcp_upload(const struct zperf_upload_params *param,
 		     struct zperf_results *result);
 
+/**
+ * @brief Synchronous upload with the server sending back, e.g. a
+ *        bidirectional test. The function blocks until both directions are
+ *        complete.
+ *
+ * @note Except for ZPERF_DUAL_REVERSE, a receiver is started on
+ *       param->options.dual_port for the data of the server, an iperf2
+ *       server or a zperf receiver, and stopped at the end. If a receiver
+ *       of the protocol already runs, its callback gets the sessions of the
+ *       other ports while the test lasts. With ZPERF_DUAL_REVERSE nothing
+ *       is uploaded, the data comes back on the connection to the server.
+ *
+ * @param param Upload parameters, with options.dual set.
+ * @param proto IPPROTO_UDP or IPPROTO_TCP.
+ * @param tx Results of the upload, zeroed for ZPERF_DUAL_REVERSE.
+ * @param rx Results of the data sent back by the server.
+ *
+ * @return 0 if both directions completed, -EBUSY if the receiver could not
+ *         be started, -ETIMEDOUT if nothing came back, -ENOTSUP for a UDP
+ *         reverse test, a negative error code of the upload otherwise.
+ */
+int zperf_dual_upload(const struct zperf_upload_params *param, int proto,
+		      struct zperf_results *tx, struct zperf_results *rx);
+
+/**
+ * @brief Search of the highest UDP rate with a loss below a threshold
+ *        (RFC 2544 throughput). The function blocks until the search is
+ *        complete.
+ *
+ * @note The highest rate is tried first, then a binary search runs between
+ *       the highest rate passing and the lowest one failing. Every trial is
+ *       a synchronous UDP upload, with the packet size of param->upload.
+ *       A trial without a report of the server loses every packet.
+ *
+ * @param param Search parameters.
+ * @param result Search results.
+ * @param callback Called after every trial, may be NULL.
+ * @param user_data A pointer to the user data to be provided with the callback.
+ *
+ * @return 0 if the search ran, -EINVAL for invalid parameters.
+ */
+int zperf_udp_search(const struct zperf_search_params *param,
+		     struct zperf_search_results *result,
+		     zperf_search_callback callback, void *user_data);
+
+/**
+ * @brief UDP uploads at rates rising step by step, to find the knee of the
+ *        throughput curve, where the stack stops keeping up. The function
+ *        blocks until the last step is over.
+ *
+ * @note Every step is a synchronous UDP upload, whose report from the
+ *       server gives the rate received, the loss and the jitter of the
+ *       step. A step without a report of the server loses every packet.
+ *
+ * @param param Ramp parameters.
+ * @param result Knee of the ramp.
+ * @param callback Called after every step, may be NULL.
+ * @param user_data A pointer to the user data to be provided with the callback.
+ *
+ * @return 0 if the ramp ran, -EINVAL for invalid parameters.
+ */
+int zperf_udp_ramp(const struct zperf_ramp_params *param,
+		   struct zperf_ramp_results *result,
+		   zperf_ramp_callback callback, void *user_data);
+
+/**
+ * @brief TCP uploads with a send buffer doubling step by step, for the
+ *        throughput reached with every window size. The function blocks
+ *        until the last step is over.
+ *
+ * @note The send buffer bounds the data in flight, so a step runs at
+ *       most one buffer per round trip, unless the receive window of the
+ *       server is smaller. On a link with a delay, the knee of the sweep
+ *       is the bandwidth-delay product. Every step is a synchronous TCP
+ *       upload, its throughput is what the client got to send.
+ *
+ * @param param Sweep parameters.
+ * @param result Highest throughput and knee of the sweep.
+ * @param callback Called after every step, may be NULL.
+ * @param user_data A pointer to the user data to be provided with the callback.
+ *
+ * @return 0 if the sweep ran, -EINVAL for invalid parameters, e.g. a
+ *         buffer above TCP_SND_BUF.
+ */
+int zperf_tcp_sweep(const struct zperf_sweep_params *param,
+		    struct zperf_sweep_results *result,
+		    zperf_sweep_callback callback, void *user_data);
+
 /**
  * @brief Asynchronous UDP upload operation.
  *
@@ -125,15 +720,20 @@ int zperf_tcp_upload_async(const struct zperf_upload_params *param,
 			   zperf_callback callback, void *user_data);
 
 /**
- * @brief Start UDP server.
+ * @brief Start UDP server, or add ports to the running one.
  *
- * @note Only one UDP server instance can run at a time.
+ * @note There is a single UDP server, it listens on up to ZPERF_MAX_PORTS
+ *       ports, over IPv4 and IPv6, and keeps the sessions of every port
+ *       apart. Calling it while the server runs adds the ports not served
+ *       yet, and then replaces the callback and the payload pattern. The
+ *       address applies to the ports added.
  *
  * @param param Download parameters.
  * @param callback Session results callback.
  * @param user_data A pointer to the user data to be provided with the callback.
  *
- * @return 0 if server was started, a negative error code otherwise.
+ * @return 0 if server was started or ports were added, -EALREADY if all the
+ *         ports are served already, a negative error code otherwise.
  */
 int zperf_udp_download(const struct zperf_download_params *param,
 		       zperf_callback callback, void *user_data);
@@ -159,6 +759,16 @@ int zperf_tcp_download(const struct zperf_download_params *param,
  */
 int zperf_udp_download_stop(void);
 
+/**
+ * @brief Stop listening on a port of the UDP server. The server stops with
+ *        its last port.
+ *
+ * @param port Port to close.
+ *
+ * @return 0 if the port was served, a negative error code otherwise.
+ */
+int zperf_udp_download_stop_port(uint16_t port);
+
 /**
  * @brief Stop TCP server.
  *
@@ -166,6 +776,50 @@ int zperf_udp_download_stop(void);
  */
 int zperf_tcp_download_stop(void);
 
+/**
+ * @brief Synchronous upload to an iperf3 server. The function blocks until
+ *        the results have been exchanged.
+ *
+ * @note The test runs over a control connection to the port of
+ *       param->peer_addr, with a single data stream. The results of the
+ *       server fill total_len, time_in_us and, for UDP, nb_packets_rcvd,
+ *       nb_packets_lost and jitter_in_us.
+ *
+ * @param param Upload parameters, without options.dual or a multicast
+ *              address.
+ * @param proto IPPROTO_UDP or IPPROTO_TCP.
+ * @param result Session results.
+ *
+ * @return 0 if the test completed, -ENOTSUP for options iperf3 can not
+ *         carry, -EBUSY if the server runs another test, -EIO if it
+ *         refused the test, a negative error code otherwise.
+ */
+int zperf_iperf3_upload(const struct zperf_upload_params *param, int proto,
+			struct zperf_results *result);
+
+/**
+ * @brief Start iperf3 server.
+ *
+ * @note Only one iperf3 server instance can run at a time, it serves one
+ *       test after the other, TCP or UDP, with a single stream sent by
+ *       the client. The results of a UDP test have nb_packets_rcvd set.
+ *
+ * @param param Download parameters, port and optionally addr.
+ * @param callback Session results callback.
+ * @param user_data A pointer to the user data to be provided with the callback.
+ *
+ * @return 0 if server was started, a negative error code otherwise.
+ */
+int zperf_iperf3_download(const struct zperf_download_params *param,
+			  zperf_callback callback, void *user_data);
+
+/**
+ * @brief Stop iperf3 server.
+ *
+ * @return 0 if server was stopped successfully, a negative error code otherwise.
+ */
+int zperf_iperf3_download_stop(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -11,6 +11,10 @@
 /* #include <zephyr/shell/shell.h> */
 
 #include "lwip/sockets.h"
+#include "lwip/priv/sockets_priv.h"
+#include "lwip/tcp.h"
+#include "lwip/priv/tcp_priv.h"
+#include "lwip/tcpip.h"
 #include "zperf_internal.h"
 #include "zperf_session.h"
 
@@ -202,6 +206,20 @@ int zperf_prepare_upload_sock(const struct sockaddr *peer_addr, int tos, int pri
         }
     }
 
+    /* A group is sent to with sendto(), the receivers answer from their
+       own addresses, which a socket connected to the group would drop */
+    if (zperf_is_mcast_addr(peer_addr))
+    {
+        if (proto != IPPROTO_UDP)
+        {
+            NET_ERR("Multicast needs UDP");
+            zsock_close(sock);
+            return -EINVAL;
+        }
+
+        return sock;
+    }
+
     ret = zsock_connect(sock, peer_addr, addrlen);
     if (ret < 0)
     {
@@ -214,11 +232,222 @@ int zperf_prepare_upload_sock(const struct sockaddr *peer_addr, int tos, int pri
     return sock;
 }
 
+bool zperf_is_mcast_addr(const struct sockaddr *addr)
+{
+    if (addr->sa_family == AF_INET)
+    {
+        return net_ipv4_is_addr_mcast(&net_sin(addr)->sin_addr);
+    }
+    if (addr->sa_family == AF_INET6)
+    {
+        return net_ipv6_is_addr_mcast(&net_sin6(addr)->sin6_addr);
+    }
+
+    return false;
+}
+
+int zperf_set_mcast_tx_opts(int sock, int ttl, bool loop)
+{
+    /* lwip keeps one multicast TTL per UDP pcb, used for IPv6 hops too */
+    uint8_t ttl8 = (uint8_t)ttl;
+    uint8_t loop8 = loop ? 1U : 0U;
+
+    if ((ttl > 0) && (zsock_setsockopt(sock, IPPROTO_IP, IP_MULTICAST_TTL, &ttl8, sizeof(ttl8)) != 0))
+    {
+        NET_ERR("Failed to set IP_MULTICAST_TTL (%d)", errno);
+        return -errno;
+    }
+
+    /* Looped back through the netif, see LWIP_NETIF_LOOPBACK in lwipopts.h */
+    if (zsock_setsockopt(sock, IPPROTO_IP, IP_MULTICAST_LOOP, &loop8, sizeof(loop8)) != 0)
+    {
+        NET_ERR("Failed to set IP_MULTICAST_LOOP (%d)", errno);
+        return -errno;
+    }
+
+    return 0;
+}
+
+int zperf_join_mcast_group(int sock, const struct sockaddr *group)
+{
+    if (group->sa_family == AF_INET)
+    {
+        struct ip_mreq mreq;
+
+        memset(&mreq, 0, sizeof(mreq));
+        mreq.imr_multiaddr = net_sin(group)->sin_addr;
+        /* Any address joins on every interface */
+        mreq.imr_interface.s_addr = INADDR_ANY;
+        if (zsock_setsockopt(sock, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) != 0)
+        {
+            NET_ERR("Failed to join the IPv4 group (%d)", errno);
+            return -errno;
+        }
+    }
+    else
+    {
+        struct ipv6_mreq mreq;
+
+        memset(&mreq, 0, sizeof(mreq));
+        mreq.ipv6mr_multiaddr = net_sin6(group)->sin6_addr;
+        /* lwip wants an interface, there is no "any" for MLD */
+        mreq.ipv6mr_interface = net_if_get_by_iface(netif_default);
+        if (zsock_setsockopt(sock, IPPROTO_IPV6, IPV6_JOIN_GROUP, &mreq, sizeof(mreq)) != 0)
+        {
+            NET_ERR("Failed to join the IPv6 group (%d)", errno);
+            return -errno;
+        }
+    }
+
+    return 0;
+}
+
+struct netconn *zperf_tcp_conn(int sock)
+{
+    struct lwip_sock *lsock = lwip_socket_dbg_get_socket(sock);
+
+    if ((lsock == NULL) || (lsock->conn == NULL) || (NETCONNTYPE_GROUP(netconn_type(lsock->conn)) != NETCONN_TCP))
+    {
+        return NULL;
+    }
+
+    return lsock->conn;
+}
+
+int zperf_set_tcp_buffers(int sock, uint32_t sndbuf, uint32_t rcvbuf)
+{
+    /* lwip has no SO_SNDBUF and its SO_RCVBUF only holds back UDP, the
+       pcb of the connection takes the limits instead */
+    struct netconn *conn = zperf_tcp_conn(sock);
+    struct tcp_pcb *pcb;
+    int ret = 0;
+
+    if (conn == NULL)
+    {
+        return -EINVAL;
+    }
+
+    LOCK_TCPIP_CORE();
+    pcb = conn->pcb.tcp;
+    if ((pcb == NULL) || (pcb->state != ESTABLISHED))
+    {
+        ret = -ENOTCONN;
+    }
+    else
+    {
+        /* Data acknowledged gives its space back, so the buffer stays
+           short of what it is cut by */
+        if ((sndbuf != 0U) && (sndbuf < TCP_SND_BUF))
+        {
+            tcpwnd_size_t cut = (tcpwnd_size_t)(TCP_SND_BUF - sndbuf);
+
+            pcb->snd_buf = (pcb->snd_buf > cut) ? (tcpwnd_size_t)(pcb->snd_buf - cut) : 0U;
+        }
+        /* Same for the window, which reopens by what is read. The window
+           announced already is not taken back, it closes as data comes in */
+        if ((rcvbuf != 0U) && (rcvbuf < TCP_WND_MAX(pcb)))
+        {
+            tcpwnd_size_t cut = (tcpwnd_size_t)(TCP_WND_MAX(pcb) - rcvbuf);
+
+            pcb->rcv_wnd = (pcb->rcv_wnd > cut) ? (tcpwnd_size_t)(pcb->rcv_wnd - cut) : 0U;
+        }
+    }
+    UNLOCK_TCPIP_CORE();
+
+    return ret;
+}
+
+int zperf_tcp_sample(int sock, struct zperf_tcp_sample *sample)
+{
+    struct netconn *conn = zperf_tcp_conn(sock);
+    struct tcp_pcb *pcb;
+    int ret = 0;
+
+    if (conn == NULL)
+    {
+        return -EINVAL;
+    }
+
+    LOCK_TCPIP_CORE();
+    pcb = conn->pcb.tcp;
+    if ((pcb == NULL) || (pcb->state < ESTABLISHED))
+    {
+        ret = -ENOTCONN;
+    }
+    else
+    {
+        sample->cwnd = pcb->cwnd;
+        sample->ssthresh = pcb->ssthresh;
+        sample->snd_wnd = pcb->snd_wnd;
+        sample->rcv_wnd = pcb->rcv_wnd;
+        sample->in_flight = pcb->snd_nxt - pcb->lastack;
+        sample->snd_buf = tcp_sndbuf(pcb);
+        sample->snd_queuelen = tcp_sndqueuelen(pcb);
+        sample->nrtx = pcb->nrtx;
+        sample->fast_recovery = ((pcb->flags & TF_INFR) != 0);
+        /* sa holds 8 times the mean round trip, sv 4 times its deviation */
+        sample->srtt_ms = (uint32_t)LWIP_MAX(pcb->sa >> 3, 0) * TCP_SLOW_INTERVAL;
+        sample->rttvar_ms = (uint32_t)LWIP_MAX(pcb->sv >> 2, 0) * TCP_SLOW_INTERVAL;
+        sample->rto_ms = (uint32_t)LWIP_MAX(pcb->rto, 0) * TCP_SLOW_INTERVAL;
+
+        /* Data waiting is held back by the smaller window, without any
+           the sender is, by a full buffer or by writing too little */
+        if (pcb->unsent != NULL)
+        {
+            sample->limit = (pcb->cwnd < pcb->snd_wnd) ? ZPERF_TCP_LIMIT_CWND : ZPERF_TCP_LIMIT_RWND;
+        }
+        else if ((tcp_sndbuf(pcb) < pcb->mss) || (tcp_sndqueuelen(pcb) >= TCP_SND_QUEUELEN))
+        {
+            sample->limit = ZPERF_TCP_LIMIT_SNDBUF;
+        }
+        else
+        {
+            sample->limit = ZPERF_TCP_LIMIT_APP;
+        }
+    }
+    UNLOCK_TCPIP_CORE();
+
+    return ret;
+}
+
 uint32_t zperf_packet_duration(uint32_t packet_size, uint32_t rate_in_kbps)
 {
     return (uint32_t)(((uint64_t)packet_size * 8U * USEC_PER_SEC) / (rate_in_kbps * 1024U));
 }
 
+void zperf_client_hdr_fill(struct zperf_client_hdr_v1 *hdr, int proto, enum zperf_dual_mode dual,
+                           uint16_t dual_port, uint32_t packet_size, uint32_t rate_kbps, uint32_t duration_ms)
+{
+    uint32_t flags = 0U;
+
+    switch (dual)
+    {
+    case ZPERF_DUAL_BIDIR:
+        flags = ZPERF_FLAGS_VERSION1 | ZPERF_FLAGS_RUN_NOW;
+        break;
+
+    case ZPERF_DUAL_TRADEOFF:
+        flags = ZPERF_FLAGS_VERSION1;
+        break;
+
+    case ZPERF_DUAL_REVERSE:
+        flags = ZPERF_FLAGS_REVERSE;
+        break;
+
+    default:
+        break;
+    }
+
+    hdr->flags = htonl(flags);
+    hdr->num_of_threads = htonl(1);
+    hdr->port = htonl(dual_port);
+    hdr->buffer_len = htonl(packet_size);
+    /* UDP rate in bit/s, for TCP iperf reads a window size, 0 is its default */
+    hdr->bandwidth = (proto == IPPROTO_UDP) ? htonl((uint32_t)MIN((uint64_t)rate_kbps * 1024U, INT32_MAX)) : 0;
+    /* A negative amount is a duration, in 10 ms units */
+    hdr->num_of_bytes = htonl((uint32_t)(-(int32_t)(duration_ms / 10U)));
+}
+
 void zperf_async_work_submit(struct k_work *work)
 {
     k_work_submit_to_queue(&zperf_work_q, work);
@@ -257,8 +486,10 @@ int zperf_init(void)
     zperf_tcp_uploader_init();
     zperf_udp_receiver_init();
     zperf_tcp_receiver_init();
+    zperf_iperf3_init();
 
     zperf_session_init();
+    zperf_dual_init();
 
     if (IS_ENABLED(CONFIG_NET_SHELL))
     {
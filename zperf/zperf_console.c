@@ -0,0 +1,131 @@
+/*
+ * Copyright (c) 2023 Oliver Sintaj
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/* Host side of the interactive shell. lwip/sockets.h maps read() and poll()
+ * to the lwIP sockets, so it is kept out of this file. */
+
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "zperf_console.h"
+
+/* Time between two polls of the input, short enough not to be noticed */
+#define CONSOLE_POLL_MS 50
+
+/* Input read past the line returned last */
+static char console_buf[ZPERF_CONSOLE_LINE_MAX];
+static size_t console_len;
+static int console_eof;
+
+static int console_wait(void)
+{
+	struct pollfd pfd = {
+		.fd = STDIN_FILENO,
+		.events = POLLIN,
+	};
+	int timeout = 0;
+	int ret;
+
+#if defined(FREERTOS_SIM_VIRTUAL_TIME) && (FREERTOS_SIM_VIRTUAL_TIME > 0)
+	/* Sleeping would only let the clock race ahead of the user */
+	if (xVirtualTimeIsEnabled()) {
+		timeout = -1;
+	}
+#endif
+
+	while (1) {
+		ret = poll(&pfd, 1, timeout);
+		if (ret > 0) {
+			return 0;
+		}
+		if ((ret < 0) && (errno != EINTR)) {
+			return -1;
+		}
+		if (ret == 0) {
+			vTaskDelay(pdMS_TO_TICKS(CONSOLE_POLL_MS));
+		}
+	}
+}
+
+/* Move the first line of the buffer, or what is left of it at the end of
+ * the input, into buf. Returns its length, -1 without a complete line. */
+static int console_take_line(char *buf, size_t size)
+{
+	char *end = memchr(console_buf, '\n', console_len);
+	size_t len, used;
+
+	if (end != NULL) {
+		len = end - console_buf;
+		used = len + 1;
+	} else if ((console_eof && (console_len > 0)) ||
+		   (console_len == sizeof(console_buf))) {
+		len = console_len;
+		used = len;
+	} else {
+		return -1;
+	}
+
+	if ((len > 0) && (console_buf[len - 1] == '\r')) {
+		len--;
+	}
+	if (len >= size) {
+		len = size - 1;
+	}
+	memcpy(buf, console_buf, len);
+	buf[len] = '\0';
+
+	console_len -= used;
+	memmove(console_buf, console_buf + used, console_len);
+
+	return len;
+}
+
+int zperf_console_read_line(const char *prompt, char *buf, size_t size)
+{
+	ssize_t ret;
+	int len;
+
+	if (size == 0) {
+		return -1;
+	}
+
+	if (isatty(STDIN_FILENO)) {
+		fputs(prompt, stdout);
+		fflush(stdout);
+	}
+
+	while (1) {
+		len = console_take_line(buf, size);
+		if (len >= 0) {
+			return len;
+		}
+		if (console_eof) {
+			return -1;
+		}
+
+		if (console_wait() < 0) {
+			return -1;
+		}
+		ret = read(STDIN_FILENO, console_buf + console_len,
+			   sizeof(console_buf) - console_len);
+		if (ret < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return -1;
+		}
+		if (ret == 0) {
+			console_eof = 1;
+		}
+		console_len += ret;
+	}
+}
@@ -0,0 +1,33 @@
+/*
+ * Copyright (c) 2023 Oliver Sintaj
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef __ZPERF_CONSOLE_H
+#define __ZPERF_CONSOLE_H
+
+#include <stddef.h>
+
+/**
+ * @brief Longest command line read by zperf_console_read_line(), longer
+ *        lines are cut
+ * **/
+#define ZPERF_CONSOLE_LINE_MAX 256
+
+/**
+ * @brief Read a line from the standard input of the simulator
+ * @note The calling task sleeps between polls of the input, so the other
+ *       tasks and the idle task keep running while it waits. On virtual
+ *       time it waits in the host instead, the clock then stands still
+ *       until the line comes in.
+ * @param prompt printed before waiting, only when the input is a terminal,
+ *               so that the output of a script fed to the shell stays clean
+ * @param buf where the line is stored, NUL terminated and without its end
+ *            of line
+ * @param size size of @p buf
+ * @return length of the line, -1 at the end of the input or on error
+ * **/
+int zperf_console_read_line(const char *prompt, char *buf, size_t size);
+
+#endif /* __ZPERF_CONSOLE_H */
@@ -0,0 +1,110 @@
+/*
+ * Copyright (c) 2023 Oliver Sintaj
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <string.h>
+
+#include <zephyr/kernel.h>
+
+#include "zperf_cpu_stats.h"
+
+#if defined(CONFIG_ZPERF_CPU_STATS)
+
+#include "FreeRTOSRunTimeStats.h"
+
+#ifndef configRUN_TIME_COUNTER_TYPE
+/* Kernels older than V10.4.4 hard code the run time counter to 32 bits */
+#define configRUN_TIME_COUNTER_TYPE uint32_t
+#endif
+
+static uint32_t cpu_stats_snapshot(struct zperf_cpu_sample *sample,
+				   TaskStatus_t *status, UBaseType_t size)
+{
+	configRUN_TIME_COUNTER_TYPE total_time = 0;
+	UBaseType_t count;
+
+	count = uxTaskGetSystemState(status, size, &total_time);
+
+	/* uxTaskGetSystemState() returns nothing at all when there are more
+	 * tasks than slots.
+	 */
+	sample->total_time = total_time;
+	sample->nb_tasks = count;
+
+	for (UBaseType_t i = 0; i < count; i++) {
+		sample->task[i].number = status[i].xTaskNumber;
+		sample->task[i].run_time = status[i].ulRunTimeCounter;
+		sample->task[i].switches =
+			ulRunTimeStatsGetSwitchCount(status[i].xTaskNumber);
+	}
+
+	return count;
+}
+
+void zperf_cpu_stats_begin(struct zperf_cpu_sample *sample)
+{
+	TaskStatus_t status[ZPERF_CPU_STATS_MAX_TASKS];
+
+	(void)cpu_stats_snapshot(sample, status, ARRAY_SIZE(status));
+}
+
+void zperf_cpu_stats_end(struct zperf_cpu_sample *sample,
+			 struct zperf_cpu_stats *stats)
+{
+	TaskStatus_t status[ZPERF_CPU_STATS_MAX_TASKS];
+	struct zperf_cpu_sample start;
+	uint32_t interval;
+
+	memcpy(&start, sample, sizeof(start));
+	memset(stats, 0, sizeof(*stats));
+
+	stats->nb_tasks = cpu_stats_snapshot(sample, status,
+					     ARRAY_SIZE(status));
+	interval = sample->total_time - start.total_time;
+	stats->interval_us = interval;
+
+	for (uint32_t i = 0; i < stats->nb_tasks; i++) {
+		struct zperf_task_stats *task = &stats->task[i];
+		uint32_t run_time = sample->task[i].run_time;
+		uint32_t switches = sample->task[i].switches;
+
+		/* Tasks created during the interval have no start sample
+		 * and are accounted from zero.
+		 */
+		for (uint32_t j = 0; j < start.nb_tasks; j++) {
+			if (start.task[j].number == sample->task[i].number) {
+				run_time -= start.task[j].run_time;
+				switches -= start.task[j].switches;
+				break;
+			}
+		}
+
+		strncpy(task->name, status[i].pcTaskName,
+			sizeof(task->name) - 1);
+		task->run_time_us = run_time;
+		task->switches = switches;
+		task->cpu_permille = (interval != 0U) ?
+			(uint16_t)MIN(((uint64_t)run_time * 1000U) / interval,
+				      1000U) : 0U;
+	}
+}
+
+#else
+
+void zperf_cpu_stats_begin(struct zperf_cpu_sample *sample)
+{
+	sample->nb_tasks = 0;
+}
+
+void zperf_cpu_stats_end(struct zperf_cpu_sample *sample,
+			 struct zperf_cpu_stats *stats)
+{
+	ARG_UNUSED(sample);
+
+	stats->interval_us = 0;
+	stats->nb_tasks = 0;
+}
+
+#endif /* CONFIG_ZPERF_CPU_STATS */
@@ -0,0 +1,46 @@
+/*
+ * Copyright (c) 2023 Oliver Sintaj
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef __ZPERF_CPU_STATS_H
+#define __ZPERF_CPU_STATS_H
+
+#include <stdint.h>
+
+#include "zperf.h"
+
+/**
+ * @brief Snapshot of the scheduler counters taken at an interval boundary
+ * **/
+struct zperf_cpu_sample {
+	uint32_t total_time;
+	uint32_t nb_tasks;
+	struct {
+		uint32_t number;
+		uint32_t run_time;
+		uint32_t switches;
+	} task[ZPERF_CPU_STATS_MAX_TASKS];
+};
+
+/**
+ * @brief Open a measurement interval
+ * @param sample snapshot to be passed to zperf_cpu_stats_end()
+ * @return non
+ * **/
+void zperf_cpu_stats_begin(struct zperf_cpu_sample *sample);
+
+/**
+ * @brief Close the interval opened by @p sample and report the per task
+ *        CPU share and context switches it contained
+ * @param sample snapshot taken at the start of the interval. It is replaced
+ *               by the current snapshot, so consecutive calls report
+ *               back-to-back intervals.
+ * @param stats where the interval statistics will be stored
+ * @return non
+ * **/
+void zperf_cpu_stats_end(struct zperf_cpu_sample *sample,
+			 struct zperf_cpu_stats *stats);
+
+#endif /* __ZPERF_CPU_STATS_H */
@@ -0,0 +1,338 @@
+/*
+ * Copyright (c) 2023 Oliver Sintaj
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Tests where the server sends back, driven by the iperf2 client header.
+ *
+ * The client starts a receiver on the port it puts in the header, then
+ * uploads with the header flags set, the server connects back to that port
+ * and sends with the duration, packet size and rate of the header, at once
+ * for a bidirectional test, after the upload for a tradeoff test. A reverse
+ * test needs no connection back: the server sends on the TCP connection of
+ * the client, which only sends the header, so it also works from behind a
+ * NAT. Both sides are implemented here, so zperf can test against itself as
+ * well as against iperf2, which knows the first two.
+ */
+
+#include <errno.h>
+#include <string.h>
+
+#include <zephyr/logging/log.h>
+LOG_MODULE_DECLARE(net_zperf, CONFIG_NET_ZPERF_LOG_LEVEL);
+
+#include <zephyr/kernel.h>
+
+#include <zephyr/net/socket.h>
+#include <zperf.h>
+
+#include "zperf_internal.h"
+#include "zperf_cpu_stats.h"
+
+/* Time the data of the server may take after the upload, on top of the
+ * duration, as its sender starts late and its reports take a while
+ */
+#define DUAL_RX_GRACE_MS 3000
+
+/* Duration used when an iperf client asks for an amount of bytes */
+#define DUAL_REPLY_DURATION_MS 10000
+
+/* Rate of a UDP reply when the header has none, the iperf2 default */
+#define DUAL_REPLY_RATE_KBPS 1024
+
+static K_SEM_DEFINE(dual_rx_done, 0, 1);
+static struct zperf_results dual_rx;
+static uint16_t dual_rx_port;
+static int dual_rx_status;
+
+static uint8_t dual_reverse_buf[PACKET_SIZE_MAX];
+
+static void dual_rx_cb(enum zperf_status status, struct zperf_results *result,
+		       void *user_data)
+{
+	ARG_UNUSED(user_data);
+
+	/* Sessions on other ports of a running UDP server are not ours */
+	if (result != NULL && result->port != 0U &&
+	    result->port != dual_rx_port) {
+		return;
+	}
+
+	switch (status) {
+	case ZPERF_SESSION_STARTED:
+		break;
+
+	case ZPERF_SESSION_FINISHED:
+		memcpy(&dual_rx, result, sizeof(dual_rx));
+		dual_rx_status = 0;
+		k_sem_give(&dual_rx_done);
+		break;
+
+	case ZPERF_SESSION_ERROR:
+		dual_rx_status = -EIO;
+		k_sem_give(&dual_rx_done);
+		break;
+	}
+}
+
+/* Send the header on a new connection and count what comes back until the
+ * server closes it
+ */
+static int dual_reverse(const struct zperf_upload_params *param,
+			struct zperf_results *rx)
+{
+	struct zperf_client_hdr_v1 hdr;
+	struct timeval rcvtimeo = {
+		.tv_sec = (param->duration_ms + DUAL_RX_GRACE_MS) /
+			  MSEC_PER_SEC,
+		.tv_usec = ((param->duration_ms + DUAL_RX_GRACE_MS) %
+			    MSEC_PER_SEC) * USEC_PER_MSEC,
+	};
+	struct zperf_cpu_sample cpu;
+	int64_t start_time;
+	uint64_t total = 0U;
+	int sock;
+	int ret;
+
+	sock = zperf_prepare_upload_sock(
+			(struct sockaddr *)(&param->peer_addr),
+			param->options.tos, param->options.priority,
+			IPPROTO_TCP);
+	if (sock < 0) {
+		return sock;
+	}
+
+	ret = zsock_setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &rcvtimeo,
+			       sizeof(rcvtimeo));
+	if (ret < 0) {
+		NET_ERR("setsockopt error (%d)", errno);
+		ret = -errno;
+		goto out;
+	}
+
+	zperf_client_hdr_fill(&hdr, IPPROTO_TCP, ZPERF_DUAL_REVERSE, 0U,
+			      param->packet_size, 0U, param->duration_ms);
+
+	zperf_cpu_stats_begin(&cpu);
+	start_time = k_uptime_ticks();
+
+	ret = zsock_send(sock, &hdr, sizeof(hdr), 0);
+	if (ret != sizeof(hdr)) {
+		NET_ERR("Failed to send the header (%d)", errno);
+		ret = -EIO;
+		goto out;
+	}
+
+	do {
+		ret = zsock_recv(sock, dual_reverse_buf,
+				 sizeof(dual_reverse_buf), 0);
+		if (ret > 0) {
+			total += ret;
+		}
+	} while (ret > 0);
+
+	if (ret < 0) {
+		NET_ERR("Nothing more came from the server (%d)", errno);
+		ret = -ETIMEDOUT;
+		goto out;
+	}
+
+	rx->total_len = total;
+	rx->time_in_us = k_ticks_to_us_ceil32(k_uptime_ticks() - start_time);
+	zperf_cpu_stats_end(&cpu, &rx->cpu);
+
+out:
+	zsock_close(sock);
+
+	return ret;
+}
+
+int zperf_dual_upload(const struct zperf_upload_params *param, int proto,
+		      struct zperf_results *tx, struct zperf_results *rx)
+{
+	struct zperf_download_params download = { 0 };
+	int ret;
+
+	if (param == NULL || tx == NULL || rx == NULL ||
+	    param->options.dual == ZPERF_DUAL_NONE) {
+		return -EINVAL;
+	}
+
+	if (param->options.dual == ZPERF_DUAL_REVERSE) {
+		if (proto != IPPROTO_TCP) {
+			return -ENOTSUP;
+		}
+
+		memset(tx, 0, sizeof(*tx));
+		memset(rx, 0, sizeof(*rx));
+
+		return dual_reverse(param, rx);
+	}
+
+	if (param->options.dual_port == 0U) {
+		return -EINVAL;
+	}
+
+	/* A result left from an earlier test */
+	(void)k_sem_take(&dual_rx_done, K_NO_WAIT);
+
+	download.port = param->options.dual_port;
+	download.addr.ss_family = param->peer_addr.ss_family;
+	dual_rx_port = download.port;
+	dual_rx_status = -ETIMEDOUT;
+
+	if (proto == IPPROTO_UDP) {
+		ret = zperf_udp_download(&download, dual_rx_cb, NULL);
+	} else {
+		ret = zperf_tcp_download(&download, dual_rx_cb, NULL);
+	}
+
+	if (ret < 0) {
+		NET_ERR("Cannot receive on port %d (%d)", download.port, ret);
+		return -EBUSY;
+	}
+
+	if (proto == IPPROTO_UDP) {
+		ret = zperf_udp_upload(param, tx);
+	} else {
+		ret = zperf_tcp_upload(param, tx);
+	}
+
+	if (ret == 0) {
+		(void)k_sem_take(&dual_rx_done,
+				 K_MSEC(param->duration_ms + DUAL_RX_GRACE_MS));
+		ret = dual_rx_status;
+		if (ret == 0) {
+			memcpy(rx, &dual_rx, sizeof(*rx));
+		} else {
+			NET_ERR("Nothing came back from the server (%d)", ret);
+		}
+	}
+
+	if (proto == IPPROTO_UDP) {
+		(void)zperf_udp_download_stop_port(download.port);
+	} else {
+		(void)zperf_tcp_download_stop();
+	}
+
+	return ret;
+}
+
+static void dual_reply_cb(enum zperf_status status,
+			  struct zperf_results *result, void *user_data)
+{
+	ARG_UNUSED(user_data);
+
+	switch (status) {
+	case ZPERF_SESSION_STARTED:
+		break;
+
+	case ZPERF_SESSION_FINISHED:
+		NET_INFO("Sent back %u packets of %u bytes in %u ms",
+			 result->nb_packets_sent, result->packet_size,
+			 result->client_time_in_us / USEC_PER_MSEC);
+		break;
+
+	case ZPERF_SESSION_ERROR:
+		NET_ERR("Sending back failed");
+		break;
+	}
+}
+
+/* Duration, packet size and rate the client asks for */
+static void dual_reply_params(const struct zperf_client_hdr_v1 *hdr,
+			      struct zperf_upload_params *param)
+{
+	int32_t amount = (int32_t)ntohl(hdr->num_of_bytes);
+	uint32_t rate = ntohl(hdr->bandwidth);
+
+	memset(param, 0, sizeof(*param));
+
+	if (amount < 0) {
+		param->duration_ms = (uint32_t)(-amount) * 10U;
+	} else {
+		NET_WARN("Client asks for %d bytes, sending for %u ms instead",
+			 amount, DUAL_REPLY_DURATION_MS);
+		param->duration_ms = DUAL_REPLY_DURATION_MS;
+	}
+
+	param->packet_size = MIN(ntohl(hdr->buffer_len), PACKET_SIZE_MAX);
+	param->rate_kbps = (rate >= 1024U) ? rate / 1024U :
+					     DUAL_REPLY_RATE_KBPS;
+	param->options.priority = -1;
+}
+
+void zperf_dual_reply(const struct sockaddr *addr,
+		      const struct zperf_client_hdr_v1 *hdr, int proto,
+		      bool finished)
+{
+	struct zperf_upload_params param;
+	uint32_t flags = ntohl(hdr->flags);
+	uint16_t port = (uint16_t)ntohl(hdr->port);
+	int ret;
+
+	if (!(flags & ZPERF_FLAGS_VERSION1)) {
+		return;
+	}
+
+	/* Bidirectional at the start, tradeoff at the end */
+	if (!!(flags & ZPERF_FLAGS_RUN_NOW) == finished) {
+		return;
+	}
+
+	dual_reply_params(hdr, &param);
+	if (addr->sa_family == AF_INET6) {
+		memcpy(&param.peer_addr, addr, sizeof(struct sockaddr_in6));
+		net_sin6((struct sockaddr *)&param.peer_addr)->sin6_port =
+			htons(port);
+	} else {
+		memcpy(&param.peer_addr, addr, sizeof(struct sockaddr_in));
+		net_sin((struct sockaddr *)&param.peer_addr)->sin_port =
+			htons(port);
+	}
+
+	NET_INFO("Sending back to port %d for %u ms", port, param.duration_ms);
+
+	if (proto == IPPROTO_UDP) {
+		ret = zperf_udp_upload_async(&param, dual_reply_cb, NULL);
+	} else {
+		ret = zperf_tcp_upload_async(&param, dual_reply_cb, NULL);
+	}
+
+	if (ret < 0) {
+		NET_ERR("Cannot send back (%d)", ret);
+	}
+}
+
+bool zperf_dual_reverse(int sock, const struct zperf_client_hdr_v1 *hdr)
+{
+	struct zperf_upload_params param;
+	int ret;
+
+	if (!(ntohl(hdr->flags) & ZPERF_FLAGS_REVERSE)) {
+		return false;
+	}
+
+	dual_reply_params(hdr, &param);
+
+	NET_INFO("Sending on the connection of the client for %u ms",
+		 param.duration_ms);
+
+	ret = zperf_tcp_upload_sock_async(sock, &param, dual_reply_cb, NULL);
+	if (ret < 0) {
+		/* Closing tells the client at once */
+		NET_ERR("Cannot send back (%d)", ret);
+		zsock_close(sock);
+	}
+
+	return true;
+}
+
+void zperf_dual_init(void)
+{
+	k_sem_init(&dual_rx_done,
+		   dual_rx_done.initial_count,
+		   dual_rx_done.max_count);
+}
@@ -0,0 +1,110 @@
+/*
+ * Copyright (c) 2023 Oliver Sintaj
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <string.h>
+
+#include <zephyr/kernel.h>
+
+#include "zperf_histogram.h"
+
+static inline uint32_t bucket_index(uint32_t value)
+{
+	uint32_t shift;
+
+	if (value < ZPERF_HISTOGRAM_SUB_COUNT) {
+		return value;
+	}
+
+	/* Position of the range above the linear part, starting at 1 */
+	shift = 32U - __builtin_clz(value) - ZPERF_HISTOGRAM_SUB_BITS;
+
+	return ZPERF_HISTOGRAM_SUB_COUNT +
+	       (shift - 1U) * ZPERF_HISTOGRAM_HALF_COUNT +
+	       ((value >> shift) - ZPERF_HISTOGRAM_HALF_COUNT);
+}
+
+static inline uint32_t bucket_highest_value(uint32_t index)
+{
+	uint32_t shift;
+	uint32_t sub;
+
+	if (index < ZPERF_HISTOGRAM_SUB_COUNT) {
+		return index;
+	}
+
+	index -= ZPERF_HISTOGRAM_SUB_COUNT;
+	shift = index / ZPERF_HISTOGRAM_HALF_COUNT + 1U;
+	sub = index % ZPERF_HISTOGRAM_HALF_COUNT + ZPERF_HISTOGRAM_HALF_COUNT;
+
+	/* Computed in 64 bits, the last bucket ends at UINT32_MAX */
+	return (uint32_t)((((uint64_t)sub + 1U) << shift) - 1U);
+}
+
+void zperf_histogram_reset(struct zperf_histogram *hist)
+{
+	memset(hist, 0, sizeof(*hist));
+	hist->min = UINT32_MAX;
+}
+
+void zperf_histogram_record(struct zperf_histogram *hist, uint32_t value)
+{
+	hist->bucket[bucket_index(value)]++;
+	hist->count++;
+	hist->sum += value;
+
+	if (value < hist->min) {
+		hist->min = value;
+	}
+
+	if (value > hist->max) {
+		hist->max = value;
+	}
+}
+
+uint32_t zperf_histogram_quantile(const struct zperf_histogram *hist,
+				  uint32_t ppm)
+{
+	uint64_t rank;
+	uint64_t seen = 0U;
+
+	if (hist->count == 0U) {
+		return 0U;
+	}
+
+	/* Number of samples at or below the quantile, at least one */
+	rank = ((uint64_t)hist->count * ppm + 999999U) / 1000000U;
+	if (rank == 0U) {
+		rank = 1U;
+	}
+
+	for (uint32_t i = 0; i < ZPERF_HISTOGRAM_BUCKETS; i++) {
+		seen += hist->bucket[i];
+		if (seen >= rank) {
+			return MIN(bucket_highest_value(i), hist->max);
+		}
+	}
+
+	return hist->max;
+}
+
+void zperf_histogram_summarize(const struct zperf_histogram *hist,
+			       struct zperf_latency *latency)
+{
+	memset(latency, 0, sizeof(*latency));
+
+	if (hist->count == 0U) {
+		return;
+	}
+
+	latency->count = hist->count;
+	latency->min_us = hist->min;
+	latency->mean_us = (uint32_t)(hist->sum / hist->count);
+	latency->p50_us = zperf_histogram_quantile(hist, 500000U);
+	latency->p90_us = zperf_histogram_quantile(hist, 900000U);
+	latency->p99_us = zperf_histogram_quantile(hist, 990000U);
+	latency->p999_us = zperf_histogram_quantile(hist, 999000U);
+	latency->max_us = hist->max;
+}
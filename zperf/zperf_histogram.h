@@ -0,0 +1,72 @@
+/*
+ * Copyright (c) 2023 Oliver Sintaj
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef __ZPERF_HISTOGRAM_H
+#define __ZPERF_HISTOGRAM_H
+
+#include <stdint.h>
+
+#include "zperf.h"
+
+/*
+ * Log-linear histogram of 32bit values, in the spirit of HdrHistogram.
+ *
+ * Values below 2^ZPERF_HISTOGRAM_SUB_BITS have a bucket each. Above that
+ * every power of two range is split into 2^(ZPERF_HISTOGRAM_SUB_BITS - 1)
+ * linear buckets, so the bucket width is always below 2^-(SUB_BITS - 1) of
+ * the value: about 1.6% with 7 bits. Memory is fixed and recording a value
+ * is a couple of shifts.
+ */
+#define ZPERF_HISTOGRAM_SUB_BITS 7
+#define ZPERF_HISTOGRAM_SUB_COUNT (1U << ZPERF_HISTOGRAM_SUB_BITS)
+#define ZPERF_HISTOGRAM_HALF_COUNT (ZPERF_HISTOGRAM_SUB_COUNT / 2U)
+#define ZPERF_HISTOGRAM_BUCKETS \
+	(ZPERF_HISTOGRAM_SUB_COUNT + \
+	 (32U - ZPERF_HISTOGRAM_SUB_BITS) * ZPERF_HISTOGRAM_HALF_COUNT)
+
+struct zperf_histogram {
+	uint32_t count;
+	uint32_t min;
+	uint32_t max;
+	uint64_t sum;
+	uint32_t bucket[ZPERF_HISTOGRAM_BUCKETS];
+};
+
+/**
+ * @brief Empty a histogram
+ * @param hist histogram to reset
+ * @return non
+ * **/
+void zperf_histogram_reset(struct zperf_histogram *hist);
+
+/**
+ * @brief Add one sample to a histogram
+ * @param hist histogram to update
+ * @param value sample value
+ * @return non
+ * **/
+void zperf_histogram_record(struct zperf_histogram *hist, uint32_t value);
+
+/**
+ * @brief Get the value below which a given fraction of the samples falls
+ * @param hist histogram to query
+ * @param ppm fraction of the samples, in parts per million
+ * @return highest value equivalent to the bucket holding the quantile,
+ *         0 if the histogram is empty
+ * **/
+uint32_t zperf_histogram_quantile(const struct zperf_histogram *hist,
+				  uint32_t ppm);
+
+/**
+ * @brief Fill the percentiles reported in the results
+ * @param hist histogram to summarize
+ * @param latency where the summary will be stored
+ * @return non
+ * **/
+void zperf_histogram_summarize(const struct zperf_histogram *hist,
+			       struct zperf_latency *latency);
+
+#endif /* __ZPERF_HISTOGRAM_H */
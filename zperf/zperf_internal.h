@@ -42,6 +42,7 @@
 #define MY_SRC_PORT 50000
 #define DEF_PORT 5001
 #define DEF_PORT_STR STRINGIFY(DEF_PORT)
+#define IPERF3_DEF_PORT 5201
 
 #define ZPERF_VERSION "1.1"
 
@@ -60,6 +61,41 @@ struct zperf_client_hdr_v1 {
 	int32_t num_of_bytes;
 };
 
+/* Flags of struct zperf_client_hdr_v1, as iperf2 defines them. Without
+ * VERSION1 the other fields are ignored, with it the server sends back to
+ * port, at once with RUN_NOW, after the test of the client otherwise.
+ */
+#define ZPERF_FLAGS_VERSION1 0x80000000
+#define ZPERF_FLAGS_RUN_NOW  0x00000001
+
+/* zperf only, without VERSION1 so iperf2 ignores it: the server sends on
+ * the connection of the client instead of receiving
+ */
+#define ZPERF_FLAGS_REVERSE  0x00000004
+
+/* Payload of the UDP packets, following both headers */
+#define UDP_PAYLOAD_OFFSET (sizeof(struct zperf_udp_datagram) + \
+			    sizeof(struct zperf_client_hdr_v1))
+
+/* Header of the UDP packets of an iperf3 test, pcount counts from 1 */
+struct zperf_iperf3_datagram {
+	uint32_t tv_sec;
+	uint32_t tv_usec;
+	uint32_t pcount;
+} __attribute__((packed));
+
+/* Framing of the data of a test */
+enum zperf_wire {
+	/* struct zperf_udp_datagram and the client header, a UDP test ends
+	 * with a FIN packet answered by the report of the server
+	 */
+	ZPERF_WIRE_IPERF2,
+	/* struct zperf_iperf3_datagram, the rest of the packet or of the TCP
+	 * stream is payload, the results go over the control connection
+	 */
+	ZPERF_WIRE_IPERF3,
+};
+
 struct zperf_server_hdr {
 	int32_t flags;
 	int32_t total_len1;
@@ -76,6 +112,8 @@ struct zperf_server_hdr {
 struct zperf_async_upload_context {
 	struct k_work work;
 	struct zperf_upload_params param;
+	/* TCP only, connected socket to send on and close, -1 to open one */
+	int sock;
 	zperf_callback callback;
 	void *user_data;
 };
@@ -83,6 +121,8 @@ struct zperf_async_upload_context {
 struct args {
     int argc;
     char ** argv;
+    /* read commands from stdin after those of argv */
+    int interactive;
 };
 
 static inline uint32_t time_delta(uint32_t ts, uint32_t t)
@@ -90,6 +130,19 @@ static inline uint32_t time_delta(uint32_t ts, uint32_t t)
 	return (t >= ts) ? (t - ts) : (ULONG_MAX - ts + t);
 }
 
+/* Bucket of struct zperf_size_stats counting a packet of size bytes */
+static inline unsigned int zperf_size_bucket(uint32_t size)
+{
+	unsigned int bucket = 0U;
+
+	for (size >>= 6; size != 0U && bucket < ZPERF_SIZE_BUCKETS - 1U;
+	     size >>= 1) {
+		bucket++;
+	}
+
+	return bucket;
+}
+
 int zperf_get_ipv6_addr(char *host, char *prefix_str, struct in6_addr *addr);
 struct sockaddr_in6 *zperf_get_sin6(void);
 
@@ -101,13 +154,66 @@ extern void connect_ap(char *ssid);
 int zperf_prepare_upload_sock(const struct sockaddr *peer_addr, int tos,
 			      int priority, int proto);
 
+bool zperf_is_mcast_addr(const struct sockaddr *addr);
+/* ttl <= 0 keeps the default of the stack */
+int zperf_set_mcast_tx_opts(int sock, int ttl, bool loop);
+/* Join group on the socket, it is left when the socket is closed */
+int zperf_join_mcast_group(int sock, const struct sockaddr *group);
+struct netconn;
+/* netconn of a TCP socket, NULL for any other socket. Its pcb is only to
+ * be used with the core locked.
+ */
+struct netconn *zperf_tcp_conn(int sock);
+/* Shrink the send buffer and the receive window of a connected TCP
+ * socket, 0 leaves one as it is. Best called before any data is sent.
+ */
+int zperf_set_tcp_buffers(int sock, uint32_t sndbuf, uint32_t rcvbuf);
+/* Read the state of a TCP connection, all but sample->time_us */
+int zperf_tcp_sample(int sock, struct zperf_tcp_sample *sample);
+
 uint32_t zperf_packet_duration(uint32_t packet_size, uint32_t rate_in_kbps);
 
+/* Exponential gaps of Poisson arrivals: ZPERF_EXP_SCHEDULE_LEN factors of
+ * mean 256 (1/256 units), shuffled, to scale the mean gap with
+ */
+#define ZPERF_EXP_SCHEDULE_LEN 256
+void zperf_exp_schedule(uint16_t *scale);
+
+/* Fill hdr in network order, like an iperf2 client with the same settings */
+void zperf_client_hdr_fill(struct zperf_client_hdr_v1 *hdr, int proto,
+			   enum zperf_dual_mode dual, uint16_t dual_port,
+			   uint32_t packet_size, uint32_t rate_kbps,
+			   uint32_t duration_ms);
+
+/* Start sending back to a client if hdr asks for it, from a receiver, when
+ * a session starts and when it is finished
+ */
+void zperf_dual_reply(const struct sockaddr *addr,
+		      const struct zperf_client_hdr_v1 *hdr, int proto,
+		      bool finished);
+/* Take over sock of a TCP receiver to send on it if hdr asks for a reverse
+ * test, returns true if it did, the receiver must then forget sock
+ */
+bool zperf_dual_reverse(int sock, const struct zperf_client_hdr_v1 *hdr);
+void zperf_dual_init(void);
+
+/* Upload on a connected socket, left open */
+int zperf_udp_upload_sock(int sock, const struct zperf_upload_params *param,
+			  enum zperf_wire wire, struct zperf_results *result);
+int zperf_tcp_upload_sock(int sock, const struct zperf_upload_params *param,
+			  enum zperf_wire wire, struct zperf_results *result);
+
+/* Asynchronous TCP upload on a connected socket, closed at the end */
+int zperf_tcp_upload_sock_async(int sock,
+				const struct zperf_upload_params *param,
+				zperf_callback callback, void *user_data);
+
 void zperf_async_work_submit(struct k_work *work);
 void zperf_udp_uploader_init(void);
 void zperf_tcp_uploader_init(void);
 void zperf_udp_receiver_init(void);
 void zperf_tcp_receiver_init(void);
+void zperf_iperf3_init(void);
 
 void zperf_shell_init(void);
 
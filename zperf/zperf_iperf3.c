@@ -0,0 +1,1146 @@
+/*
+ * Copyright (c) 2023 Oliver Sintaj
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * iperf3 client and server.
+ *
+ * An iperf3 test runs over a TCP control connection to the server port.
+ * The client opens it with a random cookie, then follows the states the
+ * server sends, one signed byte each: it sends its parameters as JSON,
+ * opens the data stream to the same port, TCP starting with the cookie or
+ * UDP announced by a connect datagram, sends for the duration of the test
+ * and tells the server with TEST_END. Both sides then exchange their
+ * results as JSON, the client printing what the server received. JSON
+ * messages are preceded by their length, 32 bits in network order.
+ *
+ * The data is sent by the upload loops of zperf, with the iperf3 framing.
+ * A single stream is supported, in the direction of the server.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <zephyr/logging/log.h>
+LOG_MODULE_DECLARE(net_zperf, CONFIG_NET_ZPERF_LOG_LEVEL);
+
+#include <zephyr/kernel.h>
+
+#include <zephyr/net/socket.h>
+#include <zperf.h>
+
+#include "zperf_internal.h"
+#include "zperf_session.h"
+#include "zperf_cpu_stats.h"
+
+#if defined(CONFIG_NET_TC_THREAD_COOPERATIVE)
+#define IPERF3_SERVER_THREAD_PRIORITY K_PRIO_COOP(8)
+#else
+#define IPERF3_SERVER_THREAD_PRIORITY K_PRIO_PREEMPT(8)
+#endif
+
+#define IPERF3_SERVER_STACK_SIZE 2048
+
+/* 36 characters and the terminating NUL, sent as is */
+#define IPERF3_COOKIE_SIZE 37
+
+/* Largest JSON message, the parameters of an iperf3 client are about 300
+ * bytes, results with a single stream about 250
+ */
+#define IPERF3_JSON_MAX 1024
+
+/* Longest wait for the other side outside of the test itself */
+#define IPERF3_TIMEOUT_MS 10000
+
+#define IPERF3_BUF_SIZE 1500
+#define POLL_TIMEOUT_MS 100
+
+/* Datagram opening a UDP stream and its answer, sent in host order like
+ * iperf3 does. Older versions use the legacy values.
+ */
+#define IPERF3_UDP_CONNECT_MSG          0x36373839
+#define IPERF3_UDP_CONNECT_REPLY        0x39383736
+#define IPERF3_LEGACY_UDP_CONNECT_MSG   123456789
+#define IPERF3_LEGACY_UDP_CONNECT_REPLY 987654321
+
+/* States of a test, as iperf3 numbers them */
+enum iperf3_state {
+	IPERF3_TEST_START = 1,
+	IPERF3_TEST_RUNNING = 2,
+	IPERF3_TEST_END = 4,
+	IPERF3_PARAM_EXCHANGE = 9,
+	IPERF3_CREATE_STREAMS = 10,
+	IPERF3_SERVER_TERMINATE = 11,
+	IPERF3_CLIENT_TERMINATE = 12,
+	IPERF3_EXCHANGE_RESULTS = 13,
+	IPERF3_DISPLAY_RESULTS = 14,
+	IPERF3_IPERF_DONE = 16,
+	IPERF3_ACCESS_DENIED = -1,
+	IPERF3_SERVER_ERROR = -2,
+};
+
+/* Errors sent with SERVER_ERROR, as iperf3 numbers them */
+#define IPERF3_IENUMSTREAMS 6
+#define IPERF3_IEBLOCKSIZE  7
+#define IPERF3_IEUNIMP      13
+
+/* Parameters of a client the server cares about */
+struct iperf3_test {
+	int proto;
+	uint32_t time_s;
+	uint32_t blksize;
+	int parallel;
+	bool reverse;
+	bool bidirectional;
+	bool udp_counters_64bit;
+};
+
+static K_THREAD_STACK_DEFINE(iperf3_server_stack_area,
+			     IPERF3_SERVER_STACK_SIZE);
+static struct k_thread iperf3_server_thread_data;
+
+static zperf_callback iperf3_session_cb;
+static void *iperf3_user_data;
+static bool iperf3_server_running;
+static bool iperf3_server_stop;
+static uint16_t iperf3_server_port;
+static struct sockaddr_storage iperf3_server_addr;
+static K_SEM_DEFINE(iperf3_server_run, 0, 1);
+
+/* A client and the server can run at the same time, e.g. over the pair
+ * link, each has its own buffer
+ */
+static char iperf3_client_json[IPERF3_JSON_MAX];
+static char iperf3_server_json[IPERF3_JSON_MAX];
+static uint8_t iperf3_server_buf[IPERF3_BUF_SIZE];
+static struct session iperf3_session;
+
+static int iperf3_set_timeout(int sock, uint32_t timeout_ms)
+{
+	struct timeval timeo = {
+		.tv_sec = timeout_ms / MSEC_PER_SEC,
+		.tv_usec = (timeout_ms % MSEC_PER_SEC) * USEC_PER_MSEC,
+	};
+
+	if (zsock_setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeo,
+			     sizeof(timeo)) < 0) {
+		NET_ERR("setsockopt error (%d)", errno);
+		return -errno;
+	}
+
+	return 0;
+}
+
+static int iperf3_send_all(int sock, const void *buf, size_t len)
+{
+	while (len > 0) {
+		ssize_t ret = zsock_send(sock, buf, len, 0);
+
+		if (ret < 0) {
+			return -errno;
+		}
+
+		buf = (const uint8_t *)buf + ret;
+		len -= ret;
+	}
+
+	return 0;
+}
+
+/* The peer closing the connection or a timeout are errors */
+static int iperf3_recv_all(int sock, void *buf, size_t len)
+{
+	while (len > 0) {
+		ssize_t ret = zsock_recv(sock, buf, len, 0);
+
+		if (ret == 0) {
+			return -ECONNRESET;
+		} else if (ret < 0) {
+			return (errno == EAGAIN) ? -ETIMEDOUT : -errno;
+		}
+
+		buf = (uint8_t *)buf + ret;
+		len -= ret;
+	}
+
+	return 0;
+}
+
+static int iperf3_send_state(int sock, int8_t state)
+{
+	return iperf3_send_all(sock, &state, sizeof(state));
+}
+
+static int iperf3_recv_state(int sock, int8_t *state)
+{
+	return iperf3_recv_all(sock, state, sizeof(*state));
+}
+
+static int iperf3_send_json(int sock, const char *json)
+{
+	uint32_t len = htonl(strlen(json));
+	int ret;
+
+	ret = iperf3_send_all(sock, &len, sizeof(len));
+	if (ret < 0) {
+		return ret;
+	}
+
+	return iperf3_send_all(sock, json, strlen(json));
+}
+
+static int iperf3_recv_json(int sock, char *json, size_t size)
+{
+	uint32_t len;
+	int ret;
+
+	ret = iperf3_recv_all(sock, &len, sizeof(len));
+	if (ret < 0) {
+		return ret;
+	}
+
+	len = ntohl(len);
+	if (len >= size) {
+		NET_ERR("iperf3 message of %u bytes, %zu at most", len,
+			size - 1);
+		return -EMSGSIZE;
+	}
+
+	ret = iperf3_recv_all(sock, json, len);
+	if (ret < 0) {
+		return ret;
+	}
+
+	json[len] = '\0';
+
+	return 0;
+}
+
+/* Just enough JSON for what iperf3 exchanges: the number, true or false of
+ * the first member named key, at any depth. Results carry a single stream,
+ * whose members have names of their own.
+ */
+static bool iperf3_json_get(const char *json, const char *key, double *value)
+{
+	char name[32];
+	const char *p = json;
+	char *end;
+
+	snprintf(name, sizeof(name), "\"%s\"", key);
+
+	while ((p = strstr(p, name)) != NULL) {
+		p += strlen(name);
+		while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n') {
+			p++;
+		}
+
+		/* The same text in a string value */
+		if (*p != ':') {
+			continue;
+		}
+
+		p++;
+		while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n') {
+			p++;
+		}
+
+		if (strncmp(p, "true", 4) == 0) {
+			*value = 1;
+			return true;
+		} else if (strncmp(p, "false", 5) == 0) {
+			*value = 0;
+			return true;
+		}
+
+		*value = strtod(p, &end);
+
+		return end != p;
+	}
+
+	return false;
+}
+
+static bool iperf3_json_bool(const char *json, const char *key)
+{
+	double value;
+
+	return iperf3_json_get(json, key, &value) && value != 0;
+}
+
+/* Results of a single stream, the same on both sides */
+static void iperf3_results_json(char *json, size_t size, bool sender,
+				uint64_t bytes, uint32_t packets,
+				uint32_t errors, uint32_t jitter_us,
+				uint32_t time_us)
+{
+	snprintf(json, size,
+		 "{\"cpu_util_total\":0,\"cpu_util_user\":0,"
+		 "\"cpu_util_system\":0,\"sender_has_retransmits\":%d,"
+		 "\"streams\":[{\"id\":1,\"bytes\":%llu,\"retransmits\":-1,"
+		 "\"jitter\":%u.%06u,\"errors\":%u,\"packets\":%u,"
+		 "\"start_time\":0,\"end_time\":%u.%06u}]}",
+		 sender ? 0 : -1, (unsigned long long)bytes,
+		 jitter_us / USEC_PER_SEC, jitter_us % USEC_PER_SEC, errors,
+		 packets, time_us / USEC_PER_SEC, time_us % USEC_PER_SEC);
+}
+
+static void iperf3_make_cookie(char *cookie)
+{
+	static const char chars[] = "abcdefghijklmnopqrstuvwxyz234567";
+
+	for (int i = 0; i < IPERF3_COOKIE_SIZE - 1; i++) {
+		cookie[i] = chars[rand() % (sizeof(chars) - 1)];
+	}
+
+	cookie[IPERF3_COOKIE_SIZE - 1] = '\0';
+}
+
+static int iperf3_send_params(int ctrl, const struct zperf_upload_params *param,
+			      int proto)
+{
+	char rate[40] = "";
+	char extra[40] = "";
+
+	if (proto == IPPROTO_UDP) {
+		snprintf(rate, sizeof(rate), "\"bandwidth\":%llu,",
+			 (unsigned long long)param->rate_kbps * 1024U);
+	} else if (param->options.tcp_nodelay) {
+		snprintf(extra, sizeof(extra), "\"nodelay\":true,");
+	}
+
+	if (param->options.tos > 0) {
+		snprintf(extra + strlen(extra), sizeof(extra) - strlen(extra),
+			 "\"TOS\":%u,", param->options.tos);
+	}
+
+	snprintf(iperf3_client_json, sizeof(iperf3_client_json),
+		 "{\"%s\":true,\"omit\":0,\"time\":%u,\"num\":0,"
+		 "\"blockcount\":0,\"parallel\":1,\"len\":%u,%s%s"
+		 "\"pacing_timer\":1000,"
+		 "\"client_version\":\"zperf " ZPERF_VERSION "\"}",
+		 (proto == IPPROTO_UDP) ? "udp" : "tcp",
+		 (param->duration_ms + MSEC_PER_SEC - 1U) / MSEC_PER_SEC,
+		 param->packet_size, rate, extra);
+
+	return iperf3_send_json(ctrl, iperf3_client_json);
+}
+
+/* Open the data stream, returns its socket */
+static int iperf3_connect_stream(const struct zperf_upload_params *param,
+				 int proto, const char *cookie)
+{
+	uint32_t msg = IPERF3_UDP_CONNECT_MSG;
+	int sock;
+	int ret;
+
+	sock = zperf_prepare_upload_sock((struct sockaddr *)(&param->peer_addr),
+					 param->options.tos,
+					 param->options.priority, proto);
+	if (sock < 0) {
+		return sock;
+	}
+
+	if (proto == IPPROTO_TCP) {
+		ret = iperf3_send_all(sock, cookie, IPERF3_COOKIE_SIZE);
+	} else {
+		/* The server learns the address of the stream from it */
+		ret = iperf3_set_timeout(sock, IPERF3_TIMEOUT_MS);
+		if (ret == 0) {
+			ret = iperf3_send_all(sock, &msg, sizeof(msg));
+		}
+
+		if (ret == 0) {
+			ret = iperf3_recv_all(sock, &msg, sizeof(msg));
+		}
+
+		if (ret == 0 && msg != IPERF3_UDP_CONNECT_REPLY &&
+		    msg != IPERF3_LEGACY_UDP_CONNECT_REPLY) {
+			NET_ERR("Unexpected iperf3 UDP connect reply 0x%08x",
+				msg);
+			ret = -EPROTO;
+		}
+	}
+
+	if (ret < 0) {
+		NET_ERR("Cannot open the iperf3 data stream (%d)", ret);
+		zsock_close(sock);
+		return ret;
+	}
+
+	return sock;
+}
+
+/* Send what was sent, read what the server received into result */
+static int iperf3_client_results(int ctrl, int proto,
+				 struct zperf_results *result)
+{
+	uint64_t bytes = (uint64_t)result->nb_packets_sent *
+			 result->packet_size;
+	double value;
+	int ret;
+
+	iperf3_results_json(iperf3_client_json, sizeof(iperf3_client_json),
+			    true, bytes,
+			    (proto == IPPROTO_UDP) ? result->nb_packets_sent :
+						     0U,
+			    0U, 0U, result->client_time_in_us);
+
+	ret = iperf3_send_json(ctrl, iperf3_client_json);
+	if (ret < 0) {
+		return ret;
+	}
+
+	ret = iperf3_recv_json(ctrl, iperf3_client_json,
+			       sizeof(iperf3_client_json));
+	if (ret < 0) {
+		return ret;
+	}
+
+	if (!iperf3_json_get(iperf3_client_json, "bytes", &value)) {
+		NET_ERR("No stream in the iperf3 results");
+		return -EPROTO;
+	}
+
+	result->total_len = (uint32_t)value;
+
+	if (iperf3_json_get(iperf3_client_json, "end_time", &value)) {
+		result->time_in_us = (uint32_t)(value * USEC_PER_SEC);
+	}
+
+	if (proto == IPPROTO_UDP) {
+		uint32_t packets = 0U;
+
+		/* packets is the highest count seen, errors the lost ones */
+		if (iperf3_json_get(iperf3_client_json, "packets", &value)) {
+			packets = (uint32_t)value;
+		}
+
+		if (iperf3_json_get(iperf3_client_json, "errors", &value)) {
+			result->nb_packets_lost = (uint32_t)value;
+		}
+
+		if (iperf3_json_get(iperf3_client_json, "jitter", &value)) {
+			result->jitter_in_us = (uint32_t)(value * USEC_PER_SEC);
+		}
+
+		result->nb_packets_rcvd = (packets > result->nb_packets_lost) ?
+			packets - result->nb_packets_lost : 0U;
+	}
+
+	return 0;
+}
+
+static void iperf3_server_error(int ctrl)
+{
+	int32_t err[2];
+
+	if (iperf3_recv_all(ctrl, err, sizeof(err)) == 0) {
+		NET_ERR("iperf3 server error %d (errno %d)", ntohl(err[0]),
+			ntohl(err[1]));
+	} else {
+		NET_ERR("iperf3 server error");
+	}
+}
+
+int zperf_iperf3_upload(const struct zperf_upload_params *param, int proto,
+			struct zperf_results *result)
+{
+	char cookie[IPERF3_COOKIE_SIZE];
+	bool done = false;
+	int data = -1;
+	int8_t state;
+	int ctrl;
+	int ret;
+
+	if (param == NULL || result == NULL ||
+	    (proto != IPPROTO_UDP && proto != IPPROTO_TCP)) {
+		return -EINVAL;
+	}
+
+	if (param->options.dual != ZPERF_DUAL_NONE ||
+	    zperf_is_mcast_addr((struct sockaddr *)(&param->peer_addr))) {
+		return -ENOTSUP;
+	}
+
+	memset(result, 0, sizeof(*result));
+
+	ctrl = zperf_prepare_upload_sock((struct sockaddr *)(&param->peer_addr),
+					 param->options.tos,
+					 param->options.priority, IPPROTO_TCP);
+	if (ctrl < 0) {
+		return ctrl;
+	}
+
+	ret = iperf3_set_timeout(ctrl, IPERF3_TIMEOUT_MS);
+	if (ret == 0) {
+		iperf3_make_cookie(cookie);
+		ret = iperf3_send_all(ctrl, cookie, sizeof(cookie));
+	}
+
+	while (ret == 0 && !done) {
+		ret = iperf3_recv_state(ctrl, &state);
+		if (ret < 0) {
+			NET_ERR("No state from the iperf3 server (%d)", ret);
+			break;
+		}
+
+		switch (state) {
+		case IPERF3_PARAM_EXCHANGE:
+			ret = iperf3_send_params(ctrl, param, proto);
+			break;
+
+		case IPERF3_CREATE_STREAMS:
+			data = iperf3_connect_stream(param, proto, cookie);
+			ret = (data < 0) ? data : 0;
+			break;
+
+		case IPERF3_TEST_START:
+			break;
+
+		case IPERF3_TEST_RUNNING:
+			if (proto == IPPROTO_UDP) {
+				ret = zperf_udp_upload_sock(data, param,
+							    ZPERF_WIRE_IPERF3,
+							    result);
+			} else {
+				ret = zperf_tcp_upload_sock(data, param,
+							    ZPERF_WIRE_IPERF3,
+							    result);
+			}
+
+			(void)iperf3_send_state(ctrl, (ret < 0) ?
+						IPERF3_CLIENT_TERMINATE :
+						IPERF3_TEST_END);
+			break;
+
+		case IPERF3_EXCHANGE_RESULTS:
+			ret = iperf3_client_results(ctrl, proto, result);
+			break;
+
+		case IPERF3_DISPLAY_RESULTS:
+			ret = iperf3_send_state(ctrl, IPERF3_IPERF_DONE);
+			done = true;
+			break;
+
+		case IPERF3_ACCESS_DENIED:
+			NET_ERR("The iperf3 server is busy");
+			ret = -EBUSY;
+			break;
+
+		case IPERF3_SERVER_ERROR:
+			iperf3_server_error(ctrl);
+			ret = -EIO;
+			break;
+
+		case IPERF3_SERVER_TERMINATE:
+			NET_ERR("The iperf3 server ended the test");
+			ret = -ECONNABORTED;
+			break;
+
+		default:
+			NET_ERR("Unexpected iperf3 state %d", state);
+			ret = -EPROTO;
+			break;
+		}
+	}
+
+	if (data >= 0) {
+		zsock_close(data);
+	}
+
+	zsock_close(ctrl);
+
+	return ret;
+}
+
+static void iperf3_deny(int ctrl, int32_t code)
+{
+	int32_t err[2] = { htonl(code), 0 };
+
+	if (iperf3_send_state(ctrl, IPERF3_SERVER_ERROR) == 0) {
+		(void)iperf3_send_all(ctrl, err, sizeof(err));
+	}
+}
+
+static int iperf3_recv_params(int ctrl, struct iperf3_test *test)
+{
+	double value;
+	int ret;
+
+	ret = iperf3_recv_json(ctrl, iperf3_server_json,
+			       sizeof(iperf3_server_json));
+	if (ret < 0) {
+		return ret;
+	}
+
+	memset(test, 0, sizeof(*test));
+	test->proto = iperf3_json_bool(iperf3_server_json, "udp") ?
+		      IPPROTO_UDP : IPPROTO_TCP;
+	test->parallel = 1;
+
+	if (iperf3_json_get(iperf3_server_json, "time", &value)) {
+		test->time_s = (uint32_t)value;
+	}
+
+	if (iperf3_json_get(iperf3_server_json, "len", &value)) {
+		test->blksize = (uint32_t)value;
+	}
+
+	if (iperf3_json_get(iperf3_server_json, "parallel", &value)) {
+		test->parallel = (int)value;
+	}
+
+	test->reverse = iperf3_json_bool(iperf3_server_json, "reverse");
+	test->bidirectional = iperf3_json_bool(iperf3_server_json,
+					       "bidirectional");
+	test->udp_counters_64bit = iperf3_json_bool(iperf3_server_json,
+						    "udp_counters_64bit");
+
+	if (test->parallel != 1) {
+		NET_ERR("iperf3 client asks for %d streams, 1 is supported",
+			test->parallel);
+		iperf3_deny(ctrl, IPERF3_IENUMSTREAMS);
+		return -ENOTSUP;
+	}
+
+	if (test->reverse || test->bidirectional) {
+		NET_ERR("iperf3 client asks the server to send, not supported");
+		iperf3_deny(ctrl, IPERF3_IEUNIMP);
+		return -ENOTSUP;
+	}
+
+	if (test->proto == IPPROTO_UDP && test->blksize > IPERF3_BUF_SIZE) {
+		NET_ERR("iperf3 datagrams of %u bytes, %u at most",
+			test->blksize, IPERF3_BUF_SIZE);
+		iperf3_deny(ctrl, IPERF3_IEBLOCKSIZE);
+		return -ENOTSUP;
+	}
+
+	return 0;
+}
+
+static socklen_t iperf3_addrlen(const struct sockaddr *addr)
+{
+	return (addr->sa_family == AF_INET6) ? sizeof(struct sockaddr_in6) :
+					       sizeof(struct sockaddr_in);
+}
+
+/* Socket of proto bound to the address and port of the server */
+static int iperf3_bind(int proto)
+{
+	struct sockaddr *addr = (struct sockaddr *)&iperf3_server_addr;
+	int type = (proto == IPPROTO_UDP) ? SOCK_DGRAM : SOCK_STREAM;
+	int sock;
+
+	sock = zsock_socket(addr->sa_family, type, proto);
+	if (sock < 0) {
+		NET_ERR("Cannot create iperf3 socket (%d)", errno);
+		return -errno;
+	}
+
+	if (zsock_bind(sock, addr, iperf3_addrlen(addr)) < 0) {
+		NET_ERR("Cannot bind iperf3 %s port %d (%d)",
+			(proto == IPPROTO_UDP) ? "UDP" : "TCP",
+			iperf3_server_port, errno);
+		zsock_close(sock);
+		return -errno;
+	}
+
+	return sock;
+}
+
+/* Accept the TCP data stream, it starts with the cookie of the test */
+static int iperf3_accept_stream(int listener, const char *cookie)
+{
+	char stream_cookie[IPERF3_COOKIE_SIZE];
+	zsock_pollfd pollfd = {
+		.fd = listener,
+		.events = ZSOCK_POLLIN,
+	};
+	int sock;
+	int ret;
+
+	ret = zsock_poll(&pollfd, 1, IPERF3_TIMEOUT_MS);
+	if (ret <= 0) {
+		return (ret == 0) ? -ETIMEDOUT : -errno;
+	}
+
+	sock = zsock_accept(listener, NULL, NULL);
+	if (sock < 0) {
+		return -errno;
+	}
+
+	ret = iperf3_set_timeout(sock, IPERF3_TIMEOUT_MS);
+	if (ret == 0) {
+		ret = iperf3_recv_all(sock, stream_cookie,
+				      sizeof(stream_cookie));
+	}
+
+	if (ret == 0 &&
+	    memcmp(stream_cookie, cookie, sizeof(stream_cookie)) != 0) {
+		NET_ERR("iperf3 data stream of another test");
+		(void)iperf3_send_state(sock, IPERF3_ACCESS_DENIED);
+		ret = -EACCES;
+	}
+
+	if (ret < 0) {
+		zsock_close(sock);
+		return ret;
+	}
+
+	return sock;
+}
+
+/* Connect the UDP socket to the stream announced by the client */
+static int iperf3_accept_udp_stream(int sock)
+{
+	struct sockaddr_storage from;
+	socklen_t fromlen = sizeof(from);
+	uint32_t msg;
+	int ret;
+
+	ret = iperf3_set_timeout(sock, IPERF3_TIMEOUT_MS);
+	if (ret < 0) {
+		return ret;
+	}
+
+	ret = zsock_recvfrom(sock, &msg, sizeof(msg), 0,
+			     (struct sockaddr *)&from, &fromlen);
+	if (ret < 0) {
+		return (errno == EAGAIN) ? -ETIMEDOUT : -errno;
+	}
+
+	if (ret != sizeof(msg) || (msg != IPERF3_UDP_CONNECT_MSG &&
+				   msg != IPERF3_LEGACY_UDP_CONNECT_MSG)) {
+		NET_ERR("Unexpected iperf3 UDP connect message");
+		return -EPROTO;
+	}
+
+	if (zsock_connect(sock, (struct sockaddr *)&from,
+			  iperf3_addrlen((struct sockaddr *)&from)) < 0) {
+		return -errno;
+	}
+
+	msg = (msg == IPERF3_UDP_CONNECT_MSG) ?
+	      IPERF3_UDP_CONNECT_REPLY : IPERF3_LEGACY_UDP_CONNECT_REPLY;
+
+	return iperf3_send_all(sock, &msg, sizeof(msg));
+}
+
+static void iperf3_udp_received(struct session *session, const uint8_t *data,
+				size_t datalen, bool counters_64bit,
+				uint64_t arrival_us)
+{
+	const struct zperf_iperf3_datagram *hdr =
+		(const struct zperf_iperf3_datagram *)data;
+	size_t hdrlen = sizeof(*hdr) + (counters_64bit ? 4U : 0U);
+	int32_t transit_time;
+	uint32_t pcount;
+
+	if (datalen < hdrlen) {
+		NET_WARN("Short iperf3 packet!");
+		return;
+	}
+
+	/* A 64 bit count follows the timestamp, its low half last */
+	if (counters_64bit) {
+		pcount = ntohl(UNALIGNED_GET((const uint32_t *)
+					     (data + sizeof(*hdr))));
+	} else {
+		pcount = ntohl(UNALIGNED_GET(&hdr->pcount));
+	}
+
+	session->counter++;
+	session->length += datalen;
+
+	/* Compute jitter, the same as the UDP receiver */
+	transit_time = time_delta((uint32_t)arrival_us,
+				  ntohl(UNALIGNED_GET(&hdr->tv_sec)) *
+				  USEC_PER_SEC +
+				  ntohl(UNALIGNED_GET(&hdr->tv_usec)));
+	if (session->last_transit_time != 0) {
+		int32_t delta_transit = transit_time -
+					session->last_transit_time;
+
+		delta_transit = (delta_transit < 0) ?
+				-delta_transit : delta_transit;
+
+		session->jitter += (delta_transit - session->jitter) / 16;
+	}
+
+	session->last_transit_time = transit_time;
+
+	zperf_seq_tracker_update(&session->seq, pcount);
+}
+
+/* Count the data until the client ends the test */
+static int iperf3_server_receive(int ctrl, int data,
+				 const struct iperf3_test *test,
+				 struct session *session)
+{
+	zsock_pollfd fds[2] = {
+		{ .fd = ctrl, .events = ZSOCK_POLLIN },
+		{ .fd = data, .events = ZSOCK_POLLIN },
+	};
+	int8_t state;
+	int ret;
+
+	while (true) {
+		ret = zsock_poll(fds, ARRAY_SIZE(fds), POLL_TIMEOUT_MS);
+		if (ret < 0) {
+			NET_ERR("iperf3 server poll error (%d)", errno);
+			return -errno;
+		}
+
+		if (iperf3_server_stop) {
+			(void)iperf3_send_state(ctrl,
+						IPERF3_SERVER_TERMINATE);
+			return -ECANCELED;
+		}
+
+		if (fds[1].revents & ZSOCK_POLLIN) {
+			ret = zsock_recv(data, iperf3_server_buf,
+					 sizeof(iperf3_server_buf), 0);
+			if (ret <= 0) {
+				/* Closed early, the client still ends it */
+				fds[1].fd = -1;
+			} else if (test->proto == IPPROTO_UDP) {
+				iperf3_udp_received(session,
+						    iperf3_server_buf, ret,
+						    test->udp_counters_64bit,
+						    k_cyc_to_us_floor64(
+							    k_cycle_get_64()));
+			} else {
+				session->counter++;
+				session->length += ret;
+			}
+		}
+
+		if (fds[0].revents & (ZSOCK_POLLIN | ZSOCK_POLLERR)) {
+			ret = iperf3_recv_state(ctrl, &state);
+			if (ret < 0) {
+				return ret;
+			}
+
+			if (state == IPERF3_TEST_END) {
+				break;
+			}
+
+			NET_ERR("iperf3 client ended the test (%d)", state);
+			return -ECONNABORTED;
+		}
+	}
+
+	/* TCP data sent before TEST_END may still be queued */
+	while (test->proto == IPPROTO_TCP && fds[1].fd >= 0) {
+		ret = zsock_recv(data, iperf3_server_buf,
+				 sizeof(iperf3_server_buf),
+				 ZSOCK_MSG_DONTWAIT);
+		if (ret <= 0) {
+			break;
+		}
+
+		session->length += ret;
+	}
+
+	return 0;
+}
+
+/* Serve one test on the control connection ctrl */
+static int iperf3_serve(int listener, int ctrl)
+{
+	struct session *session = &iperf3_session;
+	struct zperf_results results = { 0 };
+	char cookie[IPERF3_COOKIE_SIZE];
+	struct iperf3_test test;
+	int8_t state;
+	double sent;
+	int data = -1;
+	int ret;
+
+	ret = iperf3_set_timeout(ctrl, IPERF3_TIMEOUT_MS);
+	if (ret == 0) {
+		ret = iperf3_recv_all(ctrl, cookie, sizeof(cookie));
+	}
+
+	if (ret == 0) {
+		ret = iperf3_send_state(ctrl, IPERF3_PARAM_EXCHANGE);
+	}
+
+	if (ret == 0) {
+		ret = iperf3_recv_params(ctrl, &test);
+	}
+
+	if (ret < 0) {
+		return ret;
+	}
+
+	/* UDP streams come to the port of the server, bound before the
+	 * client is asked for them
+	 */
+	if (test.proto == IPPROTO_UDP) {
+		data = iperf3_bind(IPPROTO_UDP);
+		if (data < 0) {
+			(void)iperf3_send_state(ctrl,
+						IPERF3_SERVER_TERMINATE);
+			return data;
+		}
+	}
+
+	NET_INFO("iperf3 %s test of %u s, %u byte blocks",
+		 (test.proto == IPPROTO_UDP) ? "UDP" : "TCP", test.time_s,
+		 test.blksize);
+
+	ret = iperf3_send_state(ctrl, IPERF3_CREATE_STREAMS);
+	if (ret < 0) {
+		goto out;
+	}
+
+	if (test.proto == IPPROTO_UDP) {
+		ret = iperf3_accept_udp_stream(data);
+	} else {
+		data = iperf3_accept_stream(listener, cookie);
+		ret = (data < 0) ? data : 0;
+	}
+
+	if (ret < 0) {
+		NET_ERR("No iperf3 data stream (%d)", ret);
+		goto out;
+	}
+
+	zperf_reset_session_stats(session);
+	session->state = STATE_ONGOING;
+	zperf_cpu_stats_begin(&session->cpu);
+
+	ret = iperf3_send_state(ctrl, IPERF3_TEST_START);
+	if (ret == 0) {
+		ret = iperf3_send_state(ctrl, IPERF3_TEST_RUNNING);
+	}
+
+	if (ret < 0) {
+		goto out;
+	}
+
+	session->start_time = k_uptime_ticks();
+
+	if (iperf3_session_cb != NULL) {
+		results.port = iperf3_server_port;
+		iperf3_session_cb(ZPERF_SESSION_STARTED, &results,
+				  iperf3_user_data);
+	}
+
+	ret = iperf3_server_receive(ctrl, data, &test, session);
+	if (ret < 0) {
+		goto out;
+	}
+
+	session->state = STATE_COMPLETED;
+	results.time_in_us = k_ticks_to_us_ceil32(k_uptime_ticks() -
+						  session->start_time);
+	results.total_len = session->length;
+	zperf_cpu_stats_end(&session->cpu, &results.cpu);
+
+	if (test.proto == IPPROTO_UDP) {
+		zperf_seq_tracker_finish(&session->seq, session->seq.next,
+					 &results.seq);
+		results.nb_packets_rcvd = session->counter;
+		results.nb_packets_lost = results.seq.lost;
+		results.nb_packets_outorder = results.seq.reordered;
+		results.jitter_in_us = session->jitter;
+		results.packet_size = (session->counter != 0U) ?
+			session->length / session->counter : 0U;
+	}
+
+	ret = iperf3_send_state(ctrl, IPERF3_EXCHANGE_RESULTS);
+	if (ret == 0) {
+		ret = iperf3_recv_json(ctrl, iperf3_server_json,
+				       sizeof(iperf3_server_json));
+	}
+
+	if (ret < 0) {
+		goto out;
+	}
+
+	if (iperf3_json_get(iperf3_server_json, "bytes", &sent)) {
+		NET_INFO("iperf3 client sent %llu bytes",
+			 (unsigned long long)sent);
+	}
+
+	/* packets is the highest count seen, as iperf3 reports it */
+	iperf3_results_json(iperf3_server_json, sizeof(iperf3_server_json),
+			    false, session->length,
+			    results.seq.received + results.seq.lost,
+			    results.seq.lost, results.jitter_in_us,
+			    results.time_in_us);
+
+	ret = iperf3_send_json(ctrl, iperf3_server_json);
+	if (ret == 0) {
+		ret = iperf3_send_state(ctrl, IPERF3_DISPLAY_RESULTS);
+	}
+
+	if (ret < 0) {
+		goto out;
+	}
+
+	/* IPERF_DONE, the client may as well just close */
+	(void)iperf3_recv_state(ctrl, &state);
+
+	if (iperf3_session_cb != NULL) {
+		iperf3_session_cb(ZPERF_SESSION_FINISHED, &results,
+				  iperf3_user_data);
+	}
+
+out:
+	if (data >= 0) {
+		zsock_close(data);
+	}
+
+	session->state = STATE_NULL;
+
+	return ret;
+}
+
+static void iperf3_server_session(void)
+{
+	zsock_pollfd pollfd;
+	int listener;
+	int ret;
+
+	listener = iperf3_bind(IPPROTO_TCP);
+	if (listener < 0) {
+		goto error;
+	}
+
+	if (zsock_listen(listener, 1) < 0) {
+		NET_ERR("Cannot listen iperf3 TCP (%d)", errno);
+		goto error;
+	}
+
+	NET_INFO("iperf3 server listening on port %d", iperf3_server_port);
+
+	while (!iperf3_server_stop) {
+		int ctrl;
+
+		pollfd.fd = listener;
+		pollfd.events = ZSOCK_POLLIN;
+
+		ret = zsock_poll(&pollfd, 1, POLL_TIMEOUT_MS);
+		if (ret < 0) {
+			NET_ERR("iperf3 server poll error (%d)", errno);
+			goto error;
+		}
+
+		if (ret == 0) {
+			continue;
+		}
+
+		ctrl = zsock_accept(listener, NULL, NULL);
+		if (ctrl < 0) {
+			NET_ERR("iperf3 server accept error (%d)", errno);
+			goto error;
+		}
+
+		/* A failed test does not stop the server */
+		ret = iperf3_serve(listener, ctrl);
+		if (ret < 0 && iperf3_session_cb != NULL) {
+			iperf3_session_cb(ZPERF_SESSION_ERROR, NULL,
+					  iperf3_user_data);
+		}
+
+		zsock_close(ctrl);
+	}
+
+	goto cleanup;
+
+error:
+	if (iperf3_session_cb != NULL) {
+		iperf3_session_cb(ZPERF_SESSION_ERROR, NULL, iperf3_user_data);
+	}
+
+cleanup:
+	if (listener >= 0) {
+		zsock_close(listener);
+	}
+}
+
+void iperf3_server_thread(void *ptr1)
+{
+	ARG_UNUSED(ptr1);
+
+	while (true) {
+		k_sem_take(&iperf3_server_run, K_FOREVER);
+
+		iperf3_server_session();
+
+		iperf3_server_running = false;
+	}
+}
+
+void zperf_iperf3_init(void)
+{
+	k_sem_init(&iperf3_server_run,
+		   iperf3_server_run.initial_count,
+		   iperf3_server_run.max_count);
+
+	iperf3_server_thread_data.name = "iperf3";
+	iperf3_server_thread_data.task_hanble = handle;
+	k_thread_create(&iperf3_server_thread_data,
+			iperf3_server_stack_area,
+			K_THREAD_STACK_SIZEOF(iperf3_server_stack_area),
+			iperf3_server_thread,
+			NULL, NULL, NULL,
+			IPERF3_SERVER_THREAD_PRIORITY,
+			IS_ENABLED(CONFIG_USERSPACE) ? K_USER |
+						       K_INHERIT_PERMS : 0,
+			K_NO_WAIT);
+}
+
+int zperf_iperf3_download(const struct zperf_download_params *param,
+			  zperf_callback callback, void *user_data)
+{
+	struct sockaddr *addr = (struct sockaddr *)&iperf3_server_addr;
+
+	if (param == NULL || callback == NULL) {
+		return -EINVAL;
+	}
+
+	if (iperf3_server_running) {
+		return -EALREADY;
+	}
+
+	iperf3_session_cb = callback;
+	iperf3_user_data = user_data;
+	iperf3_server_port = param->port;
+
+	/* Any IPv4 address unless one is given */
+	memcpy(&iperf3_server_addr, &param->addr, sizeof(iperf3_server_addr));
+	if (addr->sa_family == AF_INET6) {
+		net_sin6(addr)->sin6_port = htons(param->port);
+	} else {
+		addr->sa_family = AF_INET;
+		net_sin(addr)->sin_port = htons(param->port);
+	}
+
+	iperf3_server_running = true;
+	iperf3_server_stop = false;
+
+	k_sem_give(&iperf3_server_run);
+
+	return 0;
+}
+
+int zperf_iperf3_download_stop(void)
+{
+	if (!iperf3_server_running) {
+		return -EALREADY;
+	}
+
+	iperf3_server_stop = true;
+	iperf3_session_cb = NULL;
+
+	return 0;
+}
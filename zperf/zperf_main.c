@@ -31,6 +31,8 @@
 
 #include <getopt.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "lwip/err.h"
 #include "lwip/init.h"
@@ -42,7 +44,11 @@
 #include "lwip/sys.h"
 #include "lwip/tcpip.h"
 #include "lwip/timeouts.h"
+#include "netif/batchif.h"
 #include "netif/etharp.h"
+#include "netif/pairif.h"
+#include "netif/pcapif.h"
+#include "netif/shmif.h"
 #include "netif/tapif.h"
 
 #include "apps/tcpecho_raw/tcpecho_raw.h"
@@ -50,6 +56,7 @@
 #include "arch/sys_arch.h"
 
 #include "FreeRTOS.h"
+#include "FreeRTOSTrace.h"
 #include "task.h"
 #include "zperf_internal.h"
 #include <zephyr/shell/shell.h>
@@ -67,6 +74,9 @@ static ip4_addr_t ipaddr, netmask, gw;
 /* static ip_addr_t ipaddr, netmask, gw; */
 ip6_addr_t ipaddr6;
 
+/* Chrome trace written on exit when built with FREERTOS_TRACE */
+#define TRACE_FILE_NAME "zperf_trace.json"
+
 /* nonstatic debug cmd option, exported in lwipopts.h */
 unsigned char debug_flags;
 
@@ -171,10 +181,42 @@ static struct option longopts[] = {
     {"ipaddr", required_argument, NULL, 'i'},
     /* netmask */
     {"netmask", required_argument, NULL, 'm'},
+    /* network interface driver */
+    {"netif", required_argument, NULL, 'n'},
+    /* record the frames of the interface into a pcap file */
+    {"pcap-record", required_argument, NULL, 'w'},
+    /* receive the frames of a pcap file instead of using a device */
+    {"pcap-replay", required_argument, NULL, 'r'},
+    /* replay speed in percent, 0 for as fast as possible */
+    {"replay-speed", required_argument, NULL, 's'},
+    /* run on a discrete event clock instead of the host clock */
+    {"virtual-time", no_argument, NULL, 'v'},
+    /* rate of the --netif pair link in kbit/s */
+    {"link-rate", required_argument, NULL, 'L'},
+    /* one way delay of the --netif pair link in ms */
+    {"link-delay", required_argument, NULL, 'D'},
+    /* read commands from stdin after those of the command line */
+    {"interactive", no_argument, NULL, 'I'},
     /* new command line options go here! */
     {NULL, 0, NULL, 0}};
 #define NUM_OPTS ((sizeof(longopts) / sizeof(struct option)) - 1)
 
+/* Drivers selectable with --netif, the first one is the default */
+static const struct
+{
+    const char *name;
+    netif_init_fn init;
+} netif_drivers[] = {
+    /* lwip-contrib tapif, a read() or write() per frame */
+    {"tap", tapif_init},
+    /* batched tap driver, see lwip/port/netif/batchif.c */
+    {"batch", batchif_init},
+    /* link to a second zperf process, see lwip/port/netif/shmif.c */
+    {"shm", shmif_init},
+    /* link to a second netif of this process, see lwip/port/netif/pairif.c */
+    {"pair", pairif_init},
+};
+
 static void usage(void)
 {
     unsigned char i;
@@ -184,11 +226,43 @@ static void usage(void)
     {
         printf("-%c --%s\n", longopts[i].val, longopts[i].name);
     }
+    printf("netif drivers:");
+    for (i = 0; i < ARRAY_SIZE(netif_drivers); i++)
+    {
+        printf(" %s", netif_drivers[i].name);
+    }
+    printf("\n");
+}
+
+static netif_init_fn find_netif_driver(const char *name)
+{
+    size_t i;
+
+    for (i = 0; i < ARRAY_SIZE(netif_drivers); i++)
+    {
+        if (!strcmp(netif_drivers[i].name, name))
+        {
+            return netif_drivers[i].init;
+        }
+    }
+
+    return NULL;
 }
 
 int main(int argc, char *argv[])
 {
+    netif_init_fn netif_init = netif_drivers[0].init;
+    void *netif_state = NULL;
+    const char *pcap_record = NULL;
+    static struct pcapif_config pcap_replay = {NULL, 100};
+    static struct pairif_config pair_link = {PAIRIF_RATE_KBPS, 0};
+    int link_set = 0;
+    int virtual_time = 0;
+    int interactive = 0;
+    int opt;
+
     prvSetupHardware();
+    vTraceStart(TRACE_FILE_NAME);
 
     IP4_ADDR(&gw, 192, 168, 0, 1);
     IP4_ADDR(&ipaddr, 192, 168, 0, 2);
@@ -202,13 +276,109 @@ int main(int argc, char *argv[])
 
     debug_flags = LWIP_DBG_OFF;
 
+    /* Options come before the shell command, whose own options are left
+       alone by the leading '+' */
+    while ((opt = getopt_long(argc, argv, "+dhg:i:m:n:w:r:s:vL:D:I", longopts, NULL)) != -1)
+    {
+        switch (opt)
+        {
+        case 'd':
+            debug_flags = LWIP_DBG_ON;
+            break;
+        case 'h':
+            usage();
+            printf("\n%s", helpmessage);
+            return 0;
+        case 'g':
+        case 'i':
+        case 'm':
+            if (!ip4addr_aton(optarg, (opt == 'g') ? &gw : (opt == 'i') ? &ipaddr : &netmask))
+            {
+                printf("Invalid address: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'n':
+            netif_init = find_netif_driver(optarg);
+            if (netif_init == NULL)
+            {
+                printf("Unknown netif driver: %s\n", optarg);
+                usage();
+                return 1;
+            }
+            break;
+        case 'w':
+            pcap_record = optarg;
+            break;
+        case 'r':
+            pcap_replay.path = optarg;
+            break;
+        case 's':
+            pcap_replay.speed = strtoul(optarg, NULL, 10);
+            break;
+        case 'v':
+            virtual_time = 1;
+            break;
+        case 'L':
+            pair_link.rate_kbps = strtoul(optarg, NULL, 10);
+            link_set = 1;
+            break;
+        case 'D':
+            pair_link.delay_ms = strtoul(optarg, NULL, 10);
+            link_set = 1;
+            break;
+        case 'I':
+            interactive = 1;
+            break;
+        default:
+            usage();
+            return 1;
+        }
+    }
+
+    if (pcap_replay.path != NULL)
+    {
+        netif_init = pcapif_init;
+        netif_state = &pcap_replay;
+    }
+    else if (netif_init == pairif_init)
+    {
+        netif_state = &pair_link;
+    }
+    else if (link_set)
+    {
+        printf("--link-rate and --link-delay need --netif pair\n");
+        return 1;
+    }
+
+    if (virtual_time)
+    {
+#if defined(FREERTOS_SIM_VIRTUAL_TIME) && (FREERTOS_SIM_VIRTUAL_TIME > 0)
+        /* The other drivers wait for the host, which virtual time does not
+           wait for */
+        if (netif_init != pairif_init)
+        {
+            printf("--virtual-time needs --netif pair\n");
+            return 1;
+        }
+        vVirtualTimeEnable();
+#else
+        printf("Built without FREERTOS_VIRTUAL_TIME\n");
+        return 1;
+#endif
+    }
+
     lwip_init();
     s8_t idx;
     /* Add netif interface for lpc17xx_8x */
-    if (!netif_add(&lpc_netif, &ipaddr, &netmask, &gw, NULL, tapif_init, ethernet_input))
+    if (!netif_add(&lpc_netif, &ipaddr, &netmask, &gw, netif_state, netif_init, ethernet_input))
     {
         LWIP_ASSERT("Net interface failed to initialize\n", 0);
     }
+    if ((pcap_record != NULL) && (pcapif_record(&lpc_netif, pcap_record) != 0))
+    {
+        printf("Can't create %s\n", pcap_record);
+    }
     netif_create_ip6_linklocal_address(&lpc_netif, 1);
     err_t err = netif_add_ip6_address(&lpc_netif, &ipaddr6, &idx);
     if (err != ERR_OK)
@@ -230,8 +400,10 @@ int main(int argc, char *argv[])
 #endif /* LWIP_TCPIP_CORE_LOCKING */
     zperf_init();
     struct args args;
-    args.argc = argc;
-    args.argv = argv;
+    /* The shell skips argv[0], point it just before the command */
+    args.argc = argc - optind + 1;
+    args.argv = argv + optind - 1;
+    args.interactive = interactive;
     sys_thread_new("shell", shell_task, (void *)&args, configMINIMAL_STACK_SIZE, (tskIDLE_PRIORITY + 1UL));
 
     /* Start the scheduler */
@@ -0,0 +1,150 @@
+/*
+ * Copyright (c) 2023 Oliver Sintaj
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <string.h>
+
+#include <zephyr/kernel.h>
+
+#include "zperf_pattern.h"
+
+/* Bytes compared before testing for a difference, kept small enough for
+ * the compiler to unroll the loop into vector loads.
+ */
+#define BLOCK_SIZE 64U
+
+#define BYTES_LSB 0x0101010101010101ULL
+
+static inline uint64_t load64(const uint8_t *p)
+{
+	uint64_t v;
+
+	memcpy(&v, p, sizeof(v));
+
+	return v;
+}
+
+/* Number of non zero bytes of a word */
+static inline uint32_t nonzero_bytes(uint64_t x)
+{
+	x |= x >> 4;
+	x |= x >> 2;
+	x |= x >> 1;
+
+	return __builtin_popcountll(x & BYTES_LSB);
+}
+
+/* Count the bytes differing between buf and ref, and the position of the
+ * first one in *first. Blocks are compared as a single or of word xors,
+ * only a block with a difference is looked at in detail.
+ */
+static uint32_t compare(const uint8_t *buf, const uint8_t *ref, size_t len,
+			size_t *first)
+{
+	uint32_t corrupt = 0U;
+	size_t i = 0;
+
+	for (; i + BLOCK_SIZE <= len; i += BLOCK_SIZE) {
+		uint64_t diff = 0U;
+
+		for (size_t j = 0; j < BLOCK_SIZE; j += sizeof(uint64_t)) {
+			diff |= load64(&buf[i + j]) ^ load64(&ref[i + j]);
+		}
+
+		if (diff == 0U) {
+			continue;
+		}
+
+		for (size_t j = 0; j < BLOCK_SIZE; j += sizeof(uint64_t)) {
+			uint64_t x = load64(&buf[i + j]) ^ load64(&ref[i + j]);
+
+			if (x != 0U && corrupt == 0U) {
+				size_t k = i + j;
+
+				while (buf[k] == ref[k]) {
+					k++;
+				}
+
+				*first = k;
+			}
+
+			corrupt += nonzero_bytes(x);
+		}
+	}
+
+	for (; i < len; i++) {
+		if (buf[i] != ref[i]) {
+			if (corrupt == 0U) {
+				*first = i;
+			}
+
+			corrupt++;
+		}
+	}
+
+	return corrupt;
+}
+
+void zperf_pattern_init(struct zperf_pattern *pattern, uint32_t seed)
+{
+	uint32_t x = (seed != 0U) ? seed : 1U;
+
+	pattern->seed = seed;
+
+	for (uint32_t i = 0; i < ZPERF_PATTERN_PERIOD; i++) {
+		if ((i % sizeof(x)) == 0U) {
+			x ^= x << 13;
+			x ^= x >> 17;
+			x ^= x << 5;
+		}
+
+		pattern->ref[i] = (uint8_t)(x >> (8U * (i % sizeof(x))));
+	}
+
+	memcpy(&pattern->ref[ZPERF_PATTERN_PERIOD], pattern->ref,
+	       ZPERF_PATTERN_SPAN);
+}
+
+void zperf_pattern_fill(const struct zperf_pattern *pattern, uint64_t offset,
+			uint8_t *buf, size_t len)
+{
+	uint32_t pos = offset % ZPERF_PATTERN_PERIOD;
+
+	while (len > 0) {
+		size_t n = MIN(len, ZPERF_PATTERN_SPAN);
+
+		memcpy(buf, &pattern->ref[pos], n);
+
+		buf += n;
+		len -= n;
+		pos = (pos + n) % ZPERF_PATTERN_PERIOD;
+	}
+}
+
+uint32_t zperf_pattern_check(const struct zperf_pattern *pattern,
+			     uint64_t offset, const uint8_t *buf, size_t len,
+			     size_t *first)
+{
+	uint32_t pos = offset % ZPERF_PATTERN_PERIOD;
+	uint32_t corrupt = 0U;
+	size_t done = 0;
+
+	while (done < len) {
+		size_t n = MIN(len - done, ZPERF_PATTERN_SPAN);
+		size_t at = 0;
+		uint32_t count;
+
+		count = compare(&buf[done], &pattern->ref[pos], n, &at);
+		if (count != 0U && corrupt == 0U) {
+			*first = done + at;
+		}
+
+		corrupt += count;
+		done += n;
+		pos = (pos + n) % ZPERF_PATTERN_PERIOD;
+	}
+
+	return corrupt;
+}
@@ -0,0 +1,79 @@
+/*
+ * Copyright (c) 2023 Oliver Sintaj
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef __ZPERF_PATTERN_H
+#define __ZPERF_PATTERN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Payload pattern of the integrity verification mode.
+ *
+ * The byte at stream offset n is ref[n % ZPERF_PATTERN_PERIOD], where ref
+ * is generated once per seed by a xorshift LFSR. The reference is followed
+ * by a copy of its first ZPERF_PATTERN_SPAN bytes, so any span starting in
+ * the period is contiguous and both filling and checking reduce to plain
+ * buffer copies and word compares.
+ *
+ * The period is prime so that it never lines up with the power of two
+ * sizes of buffers and windows, a stream shifted by such a size is caught.
+ */
+#define ZPERF_PATTERN_PERIOD 65521U
+#define ZPERF_PATTERN_SPAN 2048U
+
+struct zperf_pattern {
+	uint32_t seed;
+	uint8_t ref[ZPERF_PATTERN_PERIOD + ZPERF_PATTERN_SPAN];
+};
+
+/**
+ * @brief Stream offset of the payload of a UDP packet
+ * @note UDP packets are independent, so every id gets its own place in
+ *       the pattern. The stride is not related to the packet size, which
+ *       may change from one packet to the next.
+ * @param id packet id
+ * @return Offset in the pattern of the first byte following the headers
+ * **/
+static inline uint64_t zperf_pattern_udp_offset(uint32_t id)
+{
+	return (uint64_t)id * 1009U;
+}
+
+/**
+ * @brief Generate the reference of a seed
+ * @param pattern pattern to initialize
+ * @param seed non zero seed, shared by the sender and the receiver
+ * @return non
+ * **/
+void zperf_pattern_init(struct zperf_pattern *pattern, uint32_t seed);
+
+/**
+ * @brief Write the pattern of a part of the stream
+ * @param pattern initialized pattern
+ * @param offset stream offset of the first byte of @p buf
+ * @param buf buffer to fill
+ * @param len number of bytes to write
+ * @return non
+ * **/
+void zperf_pattern_fill(const struct zperf_pattern *pattern, uint64_t offset,
+			uint8_t *buf, size_t len);
+
+/**
+ * @brief Verify a part of the stream against the pattern
+ * @param pattern initialized pattern
+ * @param offset stream offset of the first byte of @p buf
+ * @param buf received data
+ * @param len number of bytes to verify
+ * @param first where the position in @p buf of the first corrupt byte is
+ *              stored, left untouched when there is none
+ * @return Number of corrupt bytes in @p buf
+ * **/
+uint32_t zperf_pattern_check(const struct zperf_pattern *pattern,
+			     uint64_t offset, const uint8_t *buf, size_t len,
+			     size_t *first);
+
+#endif /* __ZPERF_PATTERN_H */
@@ -0,0 +1,245 @@
+/*
+ * Copyright (c) 2023 Oliver Sintaj
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Packet size and gap schedules of the UDP uploader.
+ *
+ * A schedule holds the proportions of a profile in at most
+ * ZPERF_SIZE_SCHEDULE_LEN entries, shuffled once when it is built so that
+ * sizes alternate the way they do on a real link. The uploader only walks
+ * through it, drawing nothing while it sends. Gaps of Poisson arrivals are
+ * built the same way, from equally likely quantiles of the exponential
+ * distribution.
+ */
+
+#include <errno.h>
+#include <string.h>
+
+#include <zephyr/kernel.h>
+
+#include <zephyr/net/socket.h>
+#include <zperf.h>
+
+#include "zperf_internal.h"
+
+/* Ethernet header and FCS, IP and UDP headers of a frame */
+#define PROFILE_HDR_IPV4 (14 + 4 + 20 + 8)
+#define PROFILE_HDR_IPV6 (14 + 4 + 40 + 8)
+
+/* Same shuffle on every build of a profile, so runs can be compared */
+#define PROFILE_SHUFFLE_SEED 0x2545f491U
+
+/* ln(2) in 1/65536 */
+#define PROFILE_LN2 45426U
+
+static uint16_t profile_clamp(uint32_t size)
+{
+	if (size < sizeof(struct zperf_udp_datagram)) {
+		return sizeof(struct zperf_udp_datagram);
+	}
+
+	if (size > PACKET_SIZE_MAX) {
+		return PACKET_SIZE_MAX;
+	}
+
+	return size;
+}
+
+static void profile_shuffle(uint16_t *values, uint16_t len)
+{
+	uint32_t state = PROFILE_SHUFFLE_SEED;
+	uint16_t i;
+
+	for (i = len; i > 1U; i--) {
+		uint16_t j, tmp;
+
+		/* xorshift32 */
+		state ^= state << 13;
+		state ^= state >> 17;
+		state ^= state << 5;
+
+		j = state % i;
+		tmp = values[i - 1U];
+		values[i - 1U] = values[j];
+		values[j] = tmp;
+	}
+}
+
+static void profile_finish(struct zperf_size_schedule *sched)
+{
+	uint16_t i;
+
+	profile_shuffle(sched->size, sched->len);
+
+	sched->max = 0U;
+	for (i = 0U; i < sched->len; i++) {
+		sched->max = MAX(sched->max, sched->size[i]);
+	}
+}
+
+int zperf_size_schedule_mix(struct zperf_size_schedule *sched,
+			    const uint16_t *sizes, const uint32_t *weights,
+			    size_t count)
+{
+	uint64_t total = 0U;
+	uint32_t len, assigned;
+	uint64_t last_rem = UINT64_MAX;
+	size_t last = 0U;
+	size_t i;
+
+	for (i = 0U; i < count; i++) {
+		total += weights[i];
+	}
+
+	if (total == 0U) {
+		return -EINVAL;
+	}
+
+	/* Exact proportions when they fit, the closest ones otherwise */
+	if (total <= ZPERF_SIZE_SCHEDULE_LEN) {
+		len = total * (ZPERF_SIZE_SCHEDULE_LEN / total);
+	} else {
+		len = ZPERF_SIZE_SCHEDULE_LEN;
+	}
+
+	sched->len = 0U;
+
+	for (i = 0U; i < count; i++) {
+		uint32_t n = ((uint64_t)weights[i] * len) / total;
+
+		while (n-- > 0U) {
+			sched->size[sched->len++] = profile_clamp(sizes[i]);
+		}
+	}
+
+	/* Largest remainders first, ties to the first size */
+	assigned = sched->len;
+	while (assigned < len) {
+		uint64_t best_rem = 0U;
+		size_t best = count;
+
+		for (i = 0U; i < count; i++) {
+			uint64_t rem = ((uint64_t)weights[i] * len) % total;
+
+			if (rem > last_rem ||
+			    (rem == last_rem && i <= last)) {
+				continue;
+			}
+
+			if (best == count || rem > best_rem) {
+				best_rem = rem;
+				best = i;
+			}
+		}
+
+		if (best == count || best_rem == 0U) {
+			break;
+		}
+
+		sched->size[sched->len++] = profile_clamp(sizes[best]);
+		last_rem = best_rem;
+		last = best;
+		assigned++;
+	}
+
+	profile_finish(sched);
+
+	return 0;
+}
+
+int zperf_size_schedule_uniform(struct zperf_size_schedule *sched,
+				uint16_t min, uint16_t max)
+{
+	uint32_t span;
+	uint16_t i;
+
+	if (min > max) {
+		return -EINVAL;
+	}
+
+	min = profile_clamp(min);
+	max = profile_clamp(max);
+	span = max - min;
+
+	sched->len = MIN(span + 1U, ZPERF_SIZE_SCHEDULE_LEN);
+	for (i = 0U; i < sched->len; i++) {
+		sched->size[i] = (sched->len == 1U) ? min :
+				 min + (span * i) / (sched->len - 1U);
+	}
+
+	profile_finish(sched);
+
+	return 0;
+}
+
+int zperf_size_schedule_imix(struct zperf_size_schedule *sched, int family)
+{
+	static const uint16_t frames[] = { 64, 594, 1518 };
+	static const uint32_t weights[] = { 7, 4, 1 };
+	uint16_t sizes[ARRAY_SIZE(frames)];
+	uint16_t hdr;
+	size_t i;
+
+	if (family == AF_INET) {
+		hdr = PROFILE_HDR_IPV4;
+	} else if (family == AF_INET6) {
+		hdr = PROFILE_HDR_IPV6;
+	} else {
+		return -EINVAL;
+	}
+
+	for (i = 0U; i < ARRAY_SIZE(frames); i++) {
+		/* A minimum frame has no room for a UDP payload over IPv6 */
+		sizes[i] = (frames[i] > hdr) ? frames[i] - hdr : 0;
+	}
+
+	return zperf_size_schedule_mix(sched, sizes, weights,
+				       ARRAY_SIZE(frames));
+}
+
+/* log2(x) in 1/65536, one bit at a time by squaring the mantissa */
+static uint32_t profile_log2(uint32_t x)
+{
+	uint32_t exp = 31U - __builtin_clz(x);
+	/* In [1, 2), in 1/2^30 */
+	uint64_t mant = ((uint64_t)x << 30) >> exp;
+	uint32_t result = exp << 16;
+	uint32_t bit;
+
+	for (bit = 1U << 15; bit != 0U; bit >>= 1) {
+		mant = (mant * mant) >> 30;
+		if (mant >= (2ULL << 30)) {
+			mant >>= 1;
+			result |= bit;
+		}
+	}
+
+	return result;
+}
+
+void zperf_exp_schedule(uint16_t *scale)
+{
+	uint32_t top = profile_log2(2U * ZPERF_EXP_SCHEDULE_LEN);
+	uint32_t sum = 0U;
+	uint16_t i;
+
+	/* -ln(1 - p) at the middle p of LEN equally likely ranges */
+	for (i = 0U; i < ZPERF_EXP_SCHEDULE_LEN; i++) {
+		uint32_t log2 = top -
+			profile_log2(2U * (ZPERF_EXP_SCHEDULE_LEN - i) - 1U);
+
+		scale[i] = ((uint64_t)log2 * PROFILE_LN2) >> 24;
+		sum += scale[i];
+	}
+
+	/* The tail left out makes the mean a little short of 1 */
+	for (i = 0U; i < ZPERF_EXP_SCHEDULE_LEN; i++) {
+		scale[i] = ((uint32_t)scale[i] * 256U *
+			    ZPERF_EXP_SCHEDULE_LEN) / sum;
+	}
+
+	profile_shuffle(scale, ZPERF_EXP_SCHEDULE_LEN);
+}
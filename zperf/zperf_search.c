@@ -0,0 +1,317 @@
+/*
+ * Copyright (c) 2023 Oliver Sintaj
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+/*
+ * Search of the UDP throughput, the highest rate sent without losing more
+ * than a given share of the packets (RFC 2544, section 26.1).
+ *
+ * The highest rate is tried first, then the rate is halved between the
+ * highest one passing and the lowest one failing, until they are closer
+ * than the resolution. A rate passes when every one of its trials does,
+ * an upload that gets no report from the server fails.
+ *
+ * A ramp runs an upload at every rate of a range instead, from the lowest
+ * one up, and marks the knee: the last step before the server stops
+ * receiving what is added to the rate, or loses too much.
+ *
+ * A sweep runs TCP uploads with a send buffer doubling from one step to
+ * the next. The buffer bounds the data in flight, so the throughput grows
+ * with it up to the bandwidth-delay product of the path, the knee is the
+ * smallest buffer getting close to the highest throughput.
+ */
+
+#include <errno.h>
+#include <string.h>
+
+#include <zephyr/logging/log.h>
+LOG_MODULE_DECLARE(net_zperf, CONFIG_NET_ZPERF_LOG_LEVEL);
+
+#include <zephyr/kernel.h>
+
+#include <zperf.h>
+
+#include "zperf_internal.h"
+
+/* Pause between two trials, so that the queues filled by a trial lost in
+ * the stack or on the link do not count against the next one
+ */
+#define SEARCH_SETTLE_MS 500
+
+/* Enough to double a buffer of one byte up to any size */
+#define SWEEP_STEPS_MAX 32
+
+static uint32_t search_loss_ppm(int ret, const struct zperf_results *results)
+{
+	uint32_t lost;
+
+	if (ret < 0 || results->nb_packets_sent == 0U) {
+		return 1000000U;
+	}
+
+	/* Packets missing at the end of the test have no gap behind them */
+	lost = (results->nb_packets_rcvd < results->nb_packets_sent) ?
+		results->nb_packets_sent - results->nb_packets_rcvd : 0U;
+	lost = MAX(lost, results->nb_packets_lost);
+	lost = MIN(lost, results->nb_packets_sent);
+
+	return (uint32_t)(((uint64_t)lost * 1000000U) /
+			  results->nb_packets_sent);
+}
+
+/* Rate received by the server */
+static uint32_t search_throughput_kbps(const struct zperf_results *results)
+{
+	if (results->time_in_us == 0U) {
+		return 0U;
+	}
+
+	return (uint32_t)(((uint64_t)results->total_len * 8U * USEC_PER_SEC) /
+			  ((uint64_t)results->time_in_us * 1024U));
+}
+
+/* Rate the client got to send, a TCP server sends no report */
+static uint32_t sweep_throughput_kbps(const struct zperf_results *results)
+{
+	if (results->client_time_in_us == 0U) {
+		return 0U;
+	}
+
+	return (uint32_t)(((uint64_t)results->nb_packets_sent *
+			   results->packet_size * 8U * USEC_PER_SEC) /
+			  ((uint64_t)results->client_time_in_us * 1024U));
+}
+
+/* Run the trials of rate, returns true when they all pass. The results of
+ * the search are updated with a passing rate.
+ */
+static bool search_rate(const struct zperf_search_params *param,
+			uint32_t rate_kbps, struct zperf_search_results *result,
+			zperf_search_callback callback, void *user_data)
+{
+	struct zperf_upload_params upload = param->upload;
+	struct zperf_search_probe probe = { 0 };
+	struct zperf_results results;
+	uint32_t worst_ppm = 0U;
+
+	upload.rate_kbps = rate_kbps;
+	probe.rate_kbps = rate_kbps;
+	probe.results = &results;
+
+	for (probe.trial = 0; probe.trial < param->trials; probe.trial++) {
+		if (result->probes != 0U) {
+			k_sleep(K_MSEC(SEARCH_SETTLE_MS));
+		}
+
+		memset(&results, 0, sizeof(results));
+		probe.ret = zperf_udp_upload(&upload, &results);
+		probe.loss_ppm = search_loss_ppm(probe.ret, &results);
+		probe.passed = (probe.loss_ppm <= param->loss_ppm);
+		result->probes++;
+
+		if (callback != NULL) {
+			callback(&probe, user_data);
+		}
+		if (!probe.passed) {
+			return false;
+		}
+		worst_ppm = MAX(worst_ppm, probe.loss_ppm);
+	}
+
+	result->rate_kbps = rate_kbps;
+	result->loss_ppm = worst_ppm;
+	result->throughput_kbps = search_throughput_kbps(&results);
+	if (results.time_in_us != 0U) {
+		result->frames_per_sec = (uint32_t)(((uint64_t)results.nb_packets_rcvd *
+						     USEC_PER_SEC) / results.time_in_us);
+	} else {
+		result->frames_per_sec = 0U;
+	}
+
+	return true;
+}
+
+int zperf_udp_search(const struct zperf_search_params *param,
+		     struct zperf_search_results *result,
+		     zperf_search_callback callback, void *user_data)
+{
+	uint32_t resolution;
+	uint32_t lo = 0U;
+	uint32_t hi;
+	uint32_t rate;
+
+	if (param == NULL || result == NULL) {
+		return -EINVAL;
+	}
+
+	if (param->upload.rate_kbps == 0U || param->trials == 0U ||
+	    param->upload.options.dual != ZPERF_DUAL_NONE) {
+		return -EINVAL;
+	}
+
+	memset(result, 0, sizeof(*result));
+	resolution = MAX(param->resolution_kbps, 1U);
+	hi = param->upload.rate_kbps;
+
+	/* The highest rate may do, there is nothing to search then */
+	rate = hi;
+	while (true) {
+		if (search_rate(param, rate, result, callback, user_data)) {
+			lo = rate;
+		} else {
+			hi = rate;
+		}
+
+		if (lo == hi || hi - lo <= resolution) {
+			break;
+		}
+		rate = lo + (hi - lo) / 2U;
+	}
+
+	return 0;
+}
+
+int zperf_udp_ramp(const struct zperf_ramp_params *param,
+		   struct zperf_ramp_results *result,
+		   zperf_ramp_callback callback, void *user_data)
+{
+	struct zperf_upload_params upload;
+	struct zperf_ramp_step step = { 0 };
+	struct zperf_results results;
+	uint32_t prev_rate = 0U;
+	uint32_t prev_throughput = 0U;
+	uint32_t start;
+
+	if (param == NULL || result == NULL) {
+		return -EINVAL;
+	}
+
+	start = param->upload.rate_kbps;
+	if (start == 0U || param->end_kbps < start || param->steps < 2U ||
+	    param->upload.options.dual != ZPERF_DUAL_NONE) {
+		return -EINVAL;
+	}
+
+	memset(result, 0, sizeof(*result));
+	result->knee_step = -1;
+	upload = param->upload;
+	step.results = &results;
+
+	for (step.step = 0U; step.step < param->steps; step.step++) {
+		if (step.step != 0U && param->settle_ms != 0U) {
+			k_sleep(K_MSEC(param->settle_ms));
+		}
+
+		step.rate_kbps = start + (uint32_t)(((uint64_t)(param->end_kbps - start) *
+						     step.step) / (param->steps - 1U));
+		upload.rate_kbps = step.rate_kbps;
+
+		memset(&results, 0, sizeof(results));
+		step.ret = zperf_udp_upload(&upload, &results);
+		step.loss_ppm = search_loss_ppm(step.ret, &results);
+		step.throughput_kbps = (step.ret < 0) ? 0U :
+				       search_throughput_kbps(&results);
+		step.jitter_us = results.jitter_in_us;
+
+		/* Half of the added rate has to get through */
+		step.saturated = (step.loss_ppm > param->loss_ppm) ||
+			((uint64_t)step.throughput_kbps * 2U <
+			 (uint64_t)prev_throughput * 2U + step.rate_kbps - prev_rate);
+
+		if (!result->saturated) {
+			if (step.saturated) {
+				result->saturated = true;
+			} else {
+				result->knee_step = step.step;
+				result->knee_kbps = step.rate_kbps;
+				result->knee_throughput_kbps = step.throughput_kbps;
+			}
+		}
+		result->max_throughput_kbps = MAX(result->max_throughput_kbps,
+						  step.throughput_kbps);
+
+		if (callback != NULL) {
+			callback(&step, user_data);
+		}
+
+		prev_rate = step.rate_kbps;
+		prev_throughput = step.throughput_kbps;
+	}
+
+	return 0;
+}
+
+int zperf_tcp_sweep(const struct zperf_sweep_params *param,
+		    struct zperf_sweep_results *result,
+		    zperf_sweep_callback callback, void *user_data)
+{
+	struct zperf_upload_params upload;
+	struct zperf_sweep_step step = { 0 };
+	struct zperf_results results;
+	uint32_t bytes[SWEEP_STEPS_MAX];
+	uint32_t throughput[SWEEP_STEPS_MAX];
+	uint16_t i;
+
+	if (param == NULL || result == NULL) {
+		return -EINVAL;
+	}
+
+	/* A connection can only be given less than the stack has */
+	if (param->start_bytes == 0U || param->end_bytes < param->start_bytes ||
+	    param->end_bytes > TCP_SND_BUF ||
+	    param->upload.options.dual != ZPERF_DUAL_NONE) {
+		return -EINVAL;
+	}
+
+	memset(result, 0, sizeof(*result));
+	upload = param->upload;
+	step.results = &results;
+	step.bytes = param->start_bytes;
+
+	for (step.step = 0U; ; step.step++) {
+		if (step.step != 0U && param->settle_ms != 0U) {
+			k_sleep(K_MSEC(param->settle_ms));
+		}
+
+		upload.options.sndbuf = step.bytes;
+
+		memset(&results, 0, sizeof(results));
+		step.ret = zperf_tcp_upload(&upload, &results);
+		step.throughput_kbps = (step.ret < 0) ? 0U :
+				       sweep_throughput_kbps(&results);
+		step.bytes_per_mbps = (step.throughput_kbps == 0U) ? 0U :
+			(uint32_t)(((uint64_t)step.bytes * 1024U) /
+				   step.throughput_kbps);
+
+		bytes[step.step] = step.bytes;
+		throughput[step.step] = step.throughput_kbps;
+		result->max_throughput_kbps = MAX(result->max_throughput_kbps,
+						  step.throughput_kbps);
+
+		if (callback != NULL) {
+			callback(&step, user_data);
+		}
+
+		if (step.bytes == param->end_bytes) {
+			break;
+		}
+		/* The last step runs end_bytes, which doubling may step over */
+		step.bytes = (step.bytes > param->end_bytes / 2U) ?
+			     param->end_bytes : step.bytes * 2U;
+	}
+
+	result->steps = step.step + 1U;
+	/* No knee when nothing got through */
+	for (i = 0U; i < result->steps && result->max_throughput_kbps != 0U; i++) {
+		if ((uint64_t)throughput[i] * 10U >=
+		    (uint64_t)result->max_throughput_kbps * 9U) {
+			result->knee_bytes = bytes[i];
+			result->knee_throughput_kbps = throughput[i];
+			break;
+		}
+	}
+
+	return 0;
+}
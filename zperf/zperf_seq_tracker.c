@@ -0,0 +1,189 @@
+/*
+ * Copyright (c) 2023 Oliver Sintaj
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <string.h>
+
+#include <zephyr/kernel.h>
+
+#include "zperf_seq_tracker.h"
+
+#define WORD(id) (((id) % ZPERF_SEQ_WINDOW) / 32U)
+#define MASK(id) (1U << ((id) % 32U))
+
+static inline uint32_t hist_bucket(uint32_t value)
+{
+	uint32_t bucket = 31U - __builtin_clz(value);
+
+	return MIN(bucket, ZPERF_SEQ_HIST_BUCKETS - 1U);
+}
+
+static void end_burst(struct zperf_seq_tracker *tracker)
+{
+	struct zperf_seq_stats *stats = &tracker->stats;
+
+	if (tracker->burst == 0U) {
+		return;
+	}
+
+	stats->loss_bursts++;
+	stats->loss_burst_hist[hist_bucket(tracker->burst)]++;
+	stats->max_loss_burst = MAX(stats->max_loss_burst, tracker->burst);
+	tracker->burst = 0U;
+}
+
+static void end_tx_burst(struct zperf_seq_tracker *tracker)
+{
+	struct zperf_seq_stats *stats = &tracker->stats;
+
+	if (tracker->tx_burst_ids == 0U) {
+		return;
+	}
+
+	stats->tx_bursts++;
+	if (tracker->tx_burst_lost != 0U) {
+		stats->tx_lossy_bursts++;
+		stats->tx_burst_loss_hist[hist_bucket(tracker->tx_burst_lost)]++;
+		stats->tx_max_burst_loss = MAX(stats->tx_max_burst_loss,
+					       tracker->tx_burst_lost);
+	}
+	tracker->tx_burst_ids = 0U;
+	tracker->tx_burst_lost = 0U;
+}
+
+/* Account n finalized ids from id on to the bursts of the sender. A
+ * jump of the ids may span many bursts, the whole ones in between are
+ * counted at once.
+ */
+static void tx_burst_add(struct zperf_seq_tracker *tracker, uint32_t id,
+			 uint32_t n, bool lost)
+{
+	struct zperf_seq_stats *stats = &tracker->stats;
+	uint32_t len = tracker->tx_burst_len;
+	uint32_t head, whole;
+
+	if (len == 0U || n == 0U) {
+		return;
+	}
+
+	/* Up to the end of the burst of id */
+	head = MIN(n, len - id % len);
+	tracker->tx_burst_ids += head;
+	if (lost) {
+		tracker->tx_burst_lost += head;
+	}
+	if (id % len + head < len) {
+		return;
+	}
+	end_tx_burst(tracker);
+	n -= head;
+
+	whole = n / len;
+	if (whole != 0U) {
+		stats->tx_bursts += whole;
+		if (lost) {
+			stats->tx_lossy_bursts += whole;
+			stats->tx_burst_loss_hist[hist_bucket(len)] += whole;
+			stats->tx_max_burst_loss = MAX(stats->tx_max_burst_loss,
+						       len);
+		}
+		n -= whole * len;
+	}
+
+	/* Start of the next burst */
+	tracker->tx_burst_ids += n;
+	if (lost) {
+		tracker->tx_burst_lost += n;
+	}
+}
+
+/* Finalize all ids below new_base */
+static void advance(struct zperf_seq_tracker *tracker, uint32_t new_base)
+{
+	struct zperf_seq_stats *stats = &tracker->stats;
+
+	while (tracker->base != new_base && tracker->base != tracker->next) {
+		uint32_t id = tracker->base++;
+
+		if (tracker->bitmap[WORD(id)] & MASK(id)) {
+			tracker->bitmap[WORD(id)] &= ~MASK(id);
+			end_burst(tracker);
+			tx_burst_add(tracker, id, 1U, false);
+		} else {
+			stats->lost++;
+			tracker->burst++;
+			tx_burst_add(tracker, id, 1U, true);
+		}
+	}
+
+	/* Ids above everything seen so far have no bit to look at */
+	if (tracker->base != new_base) {
+		tx_burst_add(tracker, tracker->base, new_base - tracker->base,
+			     true);
+		stats->lost += new_base - tracker->base;
+		tracker->burst += new_base - tracker->base;
+		tracker->base = new_base;
+		tracker->next = new_base;
+	}
+}
+
+void zperf_seq_tracker_init(struct zperf_seq_tracker *tracker,
+			    uint32_t first_id)
+{
+	memset(tracker, 0, sizeof(*tracker));
+	tracker->base = first_id;
+	tracker->next = first_id;
+}
+
+void zperf_seq_tracker_update(struct zperf_seq_tracker *tracker, uint32_t id)
+{
+	struct zperf_seq_stats *stats = &tracker->stats;
+
+	if ((int32_t)(id - tracker->base) < 0) {
+		/* Already declared lost */
+		stats->late++;
+		return;
+	}
+
+	if (id - tracker->base >= ZPERF_SEQ_WINDOW) {
+		advance(tracker, id - ZPERF_SEQ_WINDOW + 1U);
+	}
+
+	if (tracker->bitmap[WORD(id)] & MASK(id)) {
+		stats->duplicates++;
+		return;
+	}
+
+	tracker->bitmap[WORD(id)] |= MASK(id);
+	stats->received++;
+
+	if ((int32_t)(id - tracker->next) < 0) {
+		/* Distance to the highest id seen, at least 1 as that one
+		 * has its bit set already.
+		 */
+		uint32_t extent = tracker->next - 1U - id;
+
+		stats->reordered++;
+		stats->reorder_hist[hist_bucket(extent)]++;
+		stats->max_reorder = MAX(stats->max_reorder, extent);
+	} else {
+		tracker->next = id + 1U;
+	}
+}
+
+void zperf_seq_tracker_finish(struct zperf_seq_tracker *tracker,
+			      uint32_t end_id, struct zperf_seq_stats *stats)
+{
+	if ((int32_t)(end_id - tracker->base) > 0) {
+		advance(tracker, end_id);
+	}
+
+	/* Whatever is left in the window has been received */
+	advance(tracker, tracker->next);
+	end_burst(tracker);
+	end_tx_burst(tracker);
+
+	memcpy(stats, &tracker->stats, sizeof(*stats));
+}
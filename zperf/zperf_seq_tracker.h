@@ -0,0 +1,71 @@
+/*
+ * Copyright (c) 2023 Oliver Sintaj
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#ifndef __ZPERF_SEQ_TRACKER_H
+#define __ZPERF_SEQ_TRACKER_H
+
+#include <stdint.h>
+
+#include "zperf.h"
+
+/*
+ * Sequence number tracker of the UDP receiver.
+ *
+ * Every packet id within ZPERF_SEQ_WINDOW of the highest id seen is kept in
+ * a bitmap. An id is only declared lost once it falls out of the window,
+ * so a packet arriving late but within the window counts as reordered
+ * instead of lost. Ids are finalized in order, which also gives the length
+ * of every run of consecutive losses, and the losses of every burst when the
+ * sender sends bursts of a known length.
+ */
+#define ZPERF_SEQ_WINDOW 1024U
+
+struct zperf_seq_tracker {
+	/* Lowest id not finalized yet */
+	uint32_t base;
+	/* Highest id seen + 1 */
+	uint32_t next;
+	/* Length of the loss run being finalized */
+	uint32_t burst;
+	/* Packets per burst of the sender, 0 if it sends none. Set after
+	 * zperf_seq_tracker_init(), burst n holds the ids from n * tx_burst_len.
+	 */
+	uint32_t tx_burst_len;
+	/* Ids of the burst of the sender being finalized, and lost ones */
+	uint32_t tx_burst_ids;
+	uint32_t tx_burst_lost;
+	uint32_t bitmap[ZPERF_SEQ_WINDOW / 32U];
+	struct zperf_seq_stats stats;
+};
+
+/**
+ * @brief Reset a tracker
+ * @param tracker tracker to reset
+ * @param first_id id of the first packet expected
+ * @return non
+ * **/
+void zperf_seq_tracker_init(struct zperf_seq_tracker *tracker,
+			    uint32_t first_id);
+
+/**
+ * @brief Account a received packet
+ * @param tracker tracker to update
+ * @param id packet id
+ * @return non
+ * **/
+void zperf_seq_tracker_update(struct zperf_seq_tracker *tracker, uint32_t id);
+
+/**
+ * @brief Finalize all ids and report the statistics
+ * @param tracker tracker to finalize
+ * @param end_id id following the last packet sent
+ * @param stats where the statistics will be stored
+ * @return non
+ * **/
+void zperf_seq_tracker_finish(struct zperf_seq_tracker *tracker,
+			      uint32_t end_id, struct zperf_seq_stats *stats);
+
+#endif /* __ZPERF_SEQ_TRACKER_H */
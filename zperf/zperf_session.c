@@ -5,6 +5,8 @@
  * SPDX-License-Identifier: Apache-2.0
  */
 
+#include <string.h>
+
 #include <zephyr/logging/log.h>
 LOG_MODULE_DECLARE(net_zperf, CONFIG_NET_ZPERF_LOG_LEVEL);
 
@@ -16,28 +18,32 @@ LOG_MODULE_DECLARE(net_zperf, CONFIG_NET_ZPERF_LOG_LEVEL);
 #include "zperf_session.h"
 // #include "middleware/zperf_netif_api.h"
 
-#define SESSION_MAX CONFIG_NET_ZPERF_MAX_SESSIONS
-
 static struct session sessions[SESSION_PROTO_END][SESSION_MAX];
 
 /* Get session from a given packet */
 struct session *get_session(const struct sockaddr *addr,
 			    enum session_proto proto)
 {
-	struct session *active = NULL;
-	struct session *free = NULL;
-	int i = 0;
-	const struct sockaddr_in *addr4 = (const struct sockaddr_in *)addr;
-	const struct sockaddr_in6 *addr6 = (const struct sockaddr_in6 *)addr;
-
 	if (proto != SESSION_TCP && proto != SESSION_UDP) {
 		NET_ERR("Error! unsupported proto.\n");
 		return NULL;
 	}
 
+	return get_session_in(sessions[proto], SESSION_MAX, addr);
+}
+
+struct session *get_session_in(struct session *table, size_t count,
+			       const struct sockaddr *addr)
+{
+	struct session *active = NULL;
+	struct session *free = NULL;
+	size_t i = 0;
+	const struct sockaddr_in *addr4 = (const struct sockaddr_in *)addr;
+	const struct sockaddr_in6 *addr6 = (const struct sockaddr_in6 *)addr;
+
 	/* Check whether we already have an active session */
-	while (!active && i < SESSION_MAX) {
-		struct session *ptr = &sessions[proto][i];
+	while (!active && i < count) {
+		struct session *ptr = &table[i];
 
 		if (IS_ENABLED(CONFIG_NET_IPV4) &&
 		    addr->sa_family == AF_INET &&
@@ -98,22 +104,35 @@ void zperf_reset_session_stats(struct session *session)
 
 	session->counter = 0U;
 	session->start_time = 0U;
-	session->next_id = 1U;
 	session->length = 0U;
 	session->outorder = 0U;
 	session->error = 0U;
 	session->jitter = 0;
 	session->last_transit_time = 0;
+	session->min_transit_us = INT32_MAX;
+	session->last_arrival_us = 0U;
+	zperf_histogram_reset(&session->transit_hist);
+	zperf_histogram_reset(&session->gap_hist);
+	zperf_seq_tracker_init(&session->seq, 1U);
+	memset(&session->integrity, 0, sizeof(session->integrity));
+	memset(&session->sizes, 0, sizeof(session->sizes));
+}
+
+void zperf_session_table_init(struct session *table, size_t count)
+{
+	size_t i;
+
+	for (i = 0; i < count; i++) {
+		table[i].state = STATE_NULL;
+		zperf_reset_session_stats(&table[i]);
+	}
 }
 
 void zperf_session_init(void)
 {
-	int i, j;
+	int i;
 
 	for (i = 0; i < SESSION_PROTO_END; i++) {
-		for (j = 0; j < SESSION_MAX; j++) {
-			sessions[i][j].state = STATE_NULL;
-			zperf_reset_session_stats(&(sessions[i][j]));
-		}
+		zperf_session_table_init(sessions[i], SESSION_MAX);
 	}
 }
@@ -17,8 +17,14 @@
 #include "zephyr/net/net_core.h"
 
 #include "zperf_internal.h"
+#include "zperf_cpu_stats.h"
+#include "zperf_histogram.h"
+#include "zperf_seq_tracker.h"
 
 
+/* Sessions per table */
+#define SESSION_MAX CONFIG_NET_ZPERF_MAX_SESSIONS
+
 /* Type definition */
 enum state {
 	STATE_NULL, /* Session has not yet started */
@@ -52,7 +58,6 @@ struct session {
 
 	/* Stat data */
 	uint32_t counter;
-	uint32_t next_id;
 	uint32_t outorder;
 	uint32_t error;
 	uint64_t length;
@@ -61,12 +66,37 @@ struct session {
 	int32_t jitter;
 	int32_t last_transit_time;
 
+	/* Latency distributions, timestamps from k_cycle_get_64() */
+	int32_t min_transit_us;
+	uint64_t last_arrival_us;
+	struct zperf_histogram transit_hist;
+	struct zperf_histogram gap_hist;
+
+	/* Loss and reordering, packet ids start at 1 */
+	struct zperf_seq_tracker seq;
+
+	/* Payload verification */
+	struct zperf_integrity integrity;
+
+	/* Packets received by size */
+	struct zperf_size_stats sizes;
+
+	/* Scheduler counters at session start */
+	struct zperf_cpu_sample cpu;
+
+	/* Header of the client, for a tradeoff test sent back at the end */
+	struct zperf_client_hdr_v1 client_hdr;
+
 	/* Stats packet*/
 	struct zperf_server_hdr stat;
 };
 
 struct session *get_session(const struct sockaddr *addr,
 			    enum session_proto proto);
+/* Same as get_session(), in a table owned by the caller, e.g. one per port */
+struct session *get_session_in(struct session *table, size_t count,
+			       const struct sockaddr *addr);
+void zperf_session_table_init(struct session *table, size_t count);
 void zperf_session_init(void);
 void zperf_reset_session_stats(struct session *session);
 
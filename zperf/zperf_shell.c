@@ -9,7 +9,7 @@
 #include <zephyr/logging/log.h>
 LOG_MODULE_DECLARE(net_zperf, CONFIG_NET_ZPERF_LOG_LEVEL);
 
-/* #include <ctype.h> */
+#include <ctype.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <strings.h>
@@ -22,6 +22,7 @@ LOG_MODULE_DECLARE(net_zperf, CONFIG_NET_ZPERF_LOG_LEVEL);
 #include <zephyr/net/socket.h>
 #include <zperf.h>
 
+#include "zperf_console.h"
 #include "zperf_internal.h"
 
 #include "zperf_session.h"
@@ -155,6 +156,110 @@ static long parse_number(const char *string, const uint32_t *divisor_arr, const
     return (*divisor == 0U) ? dec : dec * *divisor;
 }
 
+static void print_cpu_stats(const shell_handle_t sh, const struct zperf_cpu_stats *cpu)
+{
+    if (cpu->nb_tasks == 0U)
+    {
+        return;
+    }
+
+    printf("CPU usage over ");
+    print_number(sh, cpu->interval_us, TIME_US, TIME_US_UNIT);
+    printf(":\n");
+    printf(" %-16s%8s%12s\n", "task", "cpu", "switches");
+
+    for (uint32_t i = 0; i < cpu->nb_tasks; i++)
+    {
+        const struct zperf_task_stats *task = &cpu->task[i];
+
+        printf(" %-16s%6u.%u%%%12u\n", task->name, task->cpu_permille / 10U, task->cpu_permille % 10U,
+               task->switches);
+    }
+}
+
+static void print_latency(const shell_handle_t sh, const char *name, const struct zperf_latency *latency)
+{
+    if (latency->count == 0U)
+    {
+        return;
+    }
+
+    printf(" %s (us):\tmin %u mean %u p50 %u p90 %u p99 %u p99.9 %u max %u\n", name, latency->min_us,
+           latency->mean_us, latency->p50_us, latency->p90_us, latency->p99_us, latency->p999_us, latency->max_us);
+}
+
+static void print_seq_hist(const shell_handle_t sh, const uint32_t *hist)
+{
+    for (uint32_t i = 0; i < ZPERF_SEQ_HIST_BUCKETS; i++)
+    {
+        if (hist[i] == 0U)
+        {
+            continue;
+        }
+
+        if (i == 0U)
+        {
+            printf(" 1:%u", hist[i]);
+        }
+        else if (i == ZPERF_SEQ_HIST_BUCKETS - 1U)
+        {
+            printf(" %u+:%u", 1U << i, hist[i]);
+        }
+        else
+        {
+            printf(" %u-%u:%u", 1U << i, (2U << i) - 1U, hist[i]);
+        }
+    }
+
+    printf("\n");
+}
+
+static void print_seq_stats(const shell_handle_t sh, const struct zperf_seq_stats *seq)
+{
+    printf(" late packets:\t\t%u\n", seq->late);
+    printf(" duplicate packets:\t%u\n", seq->duplicates);
+
+    printf(" loss bursts:\t\t%u (max %u)", seq->loss_bursts, seq->max_loss_burst);
+    print_seq_hist(sh, seq->loss_burst_hist);
+
+    printf(" reorder extent:\t%u max", seq->max_reorder);
+    print_seq_hist(sh, seq->reorder_hist);
+
+    if (seq->tx_bursts != 0U)
+    {
+        printf(" sender bursts:\t\t%u, %u losing packets (max %u)", seq->tx_bursts, seq->tx_lossy_bursts,
+               seq->tx_max_burst_loss);
+        print_seq_hist(sh, seq->tx_burst_loss_hist);
+    }
+}
+
+static void print_integrity(const shell_handle_t sh, const struct zperf_integrity *integrity, bool is_udp)
+{
+    if (integrity->bytes_checked == 0U)
+    {
+        return;
+    }
+
+    printf(" payload checked:\t%llu bytes\n", (unsigned long long)integrity->bytes_checked);
+    printf(" corrupt bytes:\t\t%llu in %u %s\n", (unsigned long long)integrity->corrupt_bytes,
+           integrity->corrupt_chunks, is_udp ? "packets" : "reads");
+
+    if (integrity->corrupt_bytes == 0U)
+    {
+        return;
+    }
+
+    if (is_udp)
+    {
+        printf(" first corrupt byte:\tpacket %u offset %llu\n", integrity->first_mismatch_id,
+               (unsigned long long)integrity->first_mismatch);
+    }
+    else
+    {
+        printf(" first corrupt byte:\tstream offset %llu\n", (unsigned long long)integrity->first_mismatch);
+    }
+}
+
 static shell_status_t parse_ipv6_addr(const shell_handle_t sh, char *host, char *port, struct sockaddr_in6 *addr)
 {
     int ret;
@@ -206,15 +311,170 @@ static shell_status_t parse_ipv4_addr(const shell_handle_t sh, char *host, char
     return kStatus_SHELL_Success;
 }
 
+static shell_status_t parse_arg(size_t *i, size_t argc, char *argv[])
+{
+    int res = -1;
+    const char *str = argv[*i] + 2;
+    char *endptr;
+
+    if (*str == 0)
+    {
+        if (*i + 1 >= argc)
+        {
+            return -1;
+        }
+
+        *i += 1;
+        str = argv[*i];
+    }
+
+    errno = 0;
+    if (strncmp(str, "0x", 2) == 0)
+    {
+        res = strtol(str, &endptr, 16);
+    }
+    else
+    {
+        res = strtol(str, &endptr, 10);
+    }
+
+    if (errno || (endptr == str))
+    {
+        return -kStatus_SHELL_Error;
+    }
+
+    return res;
+}
+
+/* Parse a port, a range or a list of both, e.g. "5001-5004,6000" */
+static shell_status_t parse_ports(const char *str, struct zperf_download_params *param)
+{
+    const char *p = str;
+
+    param->num_ports = 0;
+    while (*p != '\0')
+    {
+        char *end;
+        unsigned long first = strtoul(p, &end, 10);
+        unsigned long last = first;
+
+        if (end == p)
+        {
+            return -kStatus_SHELL_Error;
+        }
+        p = end;
+        if (*p == '-')
+        {
+            last = strtoul(++p, &end, 10);
+            if (end == p)
+            {
+                return -kStatus_SHELL_Error;
+            }
+            p = end;
+        }
+        if ((first == 0) || (last > UINT16_MAX) || (first > last) ||
+            (last - first >= ZPERF_MAX_PORTS - param->num_ports))
+        {
+            return -kStatus_SHELL_Error;
+        }
+        for (; first <= last; first++)
+        {
+            param->ports[param->num_ports++] = (uint16_t)first;
+        }
+        if (*p == ',')
+        {
+            p++;
+        }
+        else if (*p != '\0')
+        {
+            return -kStatus_SHELL_Error;
+        }
+    }
+
+    if (param->num_ports == 0)
+    {
+        return -kStatus_SHELL_Error;
+    }
+    param->port = param->ports[0];
+
+    return kStatus_SHELL_Success;
+}
+
 static shell_status_t zperf_bind_host(const shell_handle_t sh, size_t argc, char *argv[],
                                       struct zperf_download_params *param)
 {
-    int ret;
+    int start = 0;
+    size_t opt_cnt = 0;
 
     /* Parse options */
+    for (size_t i = 1; i < argc; ++i)
+    {
+        if (*argv[i] != '-')
+        {
+            break;
+        }
+
+        switch (argv[i][1])
+        {
+        case 'V': {
+            int seed = parse_arg(&i, argc, argv);
+
+            if (seed <= 0)
+            {
+                printf("Parse error: %s\n", argv[i]);
+                return -kStatus_SHELL_Error;
+            }
+
+            param->pattern_seed = seed;
+            opt_cnt += 2;
+            break;
+        }
+
+        case 'B': {
+            int packets = parse_arg(&i, argc, argv);
+
+            if (packets <= 0)
+            {
+                printf("Parse error: %s\n", argv[i]);
+                return -kStatus_SHELL_Error;
+            }
+
+            param->burst_packets = packets;
+            opt_cnt += 2;
+            break;
+        }
+
+        case 'w': {
+            long bytes = (i + 1 < argc) ? parse_number(argv[i + 1], K, K_UNIT) : 0;
+
+            if (bytes <= 0)
+            {
+                printf("Parse error: %s\n", argv[i]);
+                return -kStatus_SHELL_Error;
+            }
+
+            param->rcvbuf = bytes;
+            i++;
+            opt_cnt += 2;
+            break;
+        }
+
+        default:
+            printf("Unrecognized argument: %s\n", argv[i]);
+            return -kStatus_SHELL_Error;
+        }
+    }
+
+    start += opt_cnt;
+    argc -= opt_cnt;
+
     if (argc >= 2)
     {
-        param->port = strtoul(argv[1], NULL, 10);
+        if (parse_ports(argv[start + 1], param) < 0)
+        {
+            printf("Cannot parse ports \"%s\"\n", argv[start + 1]);
+            return -kStatus_SHELL_Error;
+        }
     }
     else
     {
@@ -223,19 +483,19 @@ static shell_status_t zperf_bind_host(const shell_handle_t sh, size_t argc, char
 
     if (argc >= 3)
     {
-        char *addr_str = argv[2];
-        struct sockaddr addr;
+        char *addr_str = argv[start + 2];
+        /* Large enough for an IPv6 address, e.g. a group to join */
+        struct sockaddr_storage addr;
 
         memset(&addr, 0, sizeof(addr));
 
-        ret = net_ipaddr_parse(addr_str, strlen(addr_str), &addr);
-        if (ret < 0)
+        if (!net_ipaddr_parse(addr_str, strlen(addr_str), (struct sockaddr *)&addr))
         {
             printf("Cannot parse address \"%s\"\n", addr_str);
-            return ret;
+            return -kStatus_SHELL_Error;
         }
 
-        memcpy(&param->addr, &addr, sizeof(struct sockaddr));
+        memcpy(&param->addr, &addr, sizeof(addr));
     }
 
     return kStatus_SHELL_Success;
@@ -329,7 +589,7 @@ static void udp_session_cb(enum zperf_status status, struct zperf_results *resul
     switch (status)
     {
     case ZPERF_SESSION_STARTED:
-        printf("New session started.\n");
+        printf("New session started on port %u.\n", result->port);
         break;
 
     case ZPERF_SESSION_FINISHED: {
@@ -346,7 +606,7 @@ static void udp_session_cb(enum zperf_status status, struct zperf_results *resul
             rate_in_kbps = 0U;
         }
 
-        printf("End of session!\n");
+        printf("End of session on port %u!\n", result->port);
 
         printf(" duration:\t\t");
         print_number(sh, result->time_in_us, TIME_US, TIME_US_UNIT);
@@ -355,6 +615,7 @@ static void udp_session_cb(enum zperf_status status, struct zperf_results *resul
         printf(" received packets:\t%u\n", result->nb_packets_rcvd);
         printf(" nb packets lost:\t%u\n", result->nb_packets_lost);
         printf(" nb packets outorder:\t%u\n", result->nb_packets_outorder);
+        print_seq_stats(sh, &result->seq);
 
         printf(" jitter:\t\t\t");
         print_number(sh, result->jitter_in_us, TIME_US, TIME_US_UNIT);
@@ -364,6 +625,13 @@ static void udp_session_cb(enum zperf_status status, struct zperf_results *resul
         print_number(sh, rate_in_kbps, KBPS, KBPS_UNIT);
         printf("\n");
 
+        print_latency(sh, "transit", &result->transit);
+        print_latency(sh, "gap", &result->gap);
+        print_integrity(sh, &result->integrity, true);
+        print_size_stats(sh, &result->sizes);
+
+        print_cpu_stats(sh, &result->cpu);
+
         break;
     }
 
@@ -377,6 +645,32 @@ static shell_status_t cmd_udp_download_stop(const shell_handle_t sh, size_t argc
 {
     int ret;
 
+    /* Ports given: close only them, the server stops with its last port */
+    if (argc >= 2)
+    {
+        struct zperf_download_params param = {0};
+
+        if (parse_ports(argv[1], &param) < 0)
+        {
+            printf("Cannot parse ports \"%s\"\n", argv[1]);
+            return -kStatus_SHELL_Error;
+        }
+
+        for (int i = 0; i < param.num_ports; i++)
+        {
+            if (zperf_udp_download_stop_port(param.ports[i]) < 0)
+            {
+                printf("UDP server not listening on port %u\n", param.ports[i]);
+            }
+            else
+            {
+                printf("UDP server port %u closed\n", param.ports[i]);
+            }
+        }
+
+        return kStatus_SHELL_Success;
+    }
+
     ret = zperf_udp_download_stop();
     if (ret < 0)
     {
@@ -408,9 +702,13 @@ static shell_status_t cmd_udp_download(const shell_handle_t sh, size_t argc, cha
         ret = zperf_udp_download(&param, udp_session_cb, (void *)sh);
         if (ret == -EALREADY)
         {
-            printf("UDP server already started!\n");
+            printf("UDP server already listening on these ports!\n");
             return -kStatus_SHELL_Error;
         }
+        else if (ret == -ENOMEM)
+        {
+            printf("UDP server listens on %d ports at most, some were not added\n", ZPERF_MAX_PORTS);
+        }
         else if (ret < 0)
         {
             printf("Failed to start UDP server!\n");
@@ -419,7 +717,19 @@ static shell_status_t cmd_udp_download(const shell_handle_t sh, size_t argc, cha
 
         k_yield();
 
-        printf("UDP server started on port %u\n", param.port);
+        if (param.num_ports > 1)
+        {
+            printf("UDP server started on ports");
+            for (int i = 0; i < param.num_ports; i++)
+            {
+                printf(" %u", param.ports[i]);
+            }
+            printf("\n");
+        }
+        else
+        {
+            printf("UDP server started on port %u\n", param.port);
+        }
 
         return kStatus_SHELL_Success;
     }
@@ -474,6 +784,10 @@ static void shell_udp_upload_print_stats(const shell_handle_t sh, struct zperf_r
 
         printf("Num packets out order:\t%u\n", results->nb_packets_outorder);
         printf("Num packets lost:\t%u\n", results->nb_packets_lost);
+        if (results->nb_receivers != 0U)
+        {
+            printf("Receivers:\t\t%u, the server column is the first one\n", results->nb_receivers);
+        }
 
         printf("Jitter:\t\t\t");
         print_number(sh, results->jitter_in_us, TIME_US, TIME_US_UNIT);
@@ -484,7 +798,75 @@ static void shell_udp_upload_print_stats(const shell_handle_t sh, struct zperf_r
         printf("\t(");
         print_number(sh, client_rate_in_kbps, KBPS, KBPS_UNIT);
         printf(")\n");
+
+        print_cpu_stats(sh, &results->cpu);
+    }
+}
+
+/* A line per receiver of a multicast upload, as its report comes */
+static void udp_receiver_cb(const struct sockaddr *addr, const struct zperf_results *results, void *user_data)
+{
+    const shell_handle_t sh = user_data;
+    char name[INET6_ADDRSTRLEN];
+    const void *ip = (addr->sa_family == AF_INET6) ? (const void *)&net_sin6(addr)->sin6_addr
+                                                   : (const void *)&net_sin(addr)->sin_addr;
+    uint32_t rate_in_kbps = 0U;
+
+    if (lwip_inet_ntop(addr->sa_family, ip, name, sizeof(name)) == NULL)
+    {
+        strcpy(name, "?");
+    }
+
+    if (results->time_in_us != 0U)
+    {
+        rate_in_kbps = (uint32_t)(((uint64_t)results->total_len * (uint64_t)8 * (uint64_t)USEC_PER_SEC) /
+                                  ((uint64_t)results->time_in_us * 1024U));
+    }
+
+    printf("Receiver %s:	%u packets, %u lost, %u out of order, jitter ", name, results->nb_packets_rcvd,
+           results->nb_packets_lost, results->nb_packets_outorder);
+    print_number(sh, results->jitter_in_us, TIME_US, TIME_US_UNIT);
+    printf(", ");
+    print_number(sh, rate_in_kbps, KBPS, KBPS_UNIT);
+    printf("\n");
+}
+
+static const char *const tcp_limit_names[ZPERF_TCP_LIMITS] = {"app", "sndbuf", "cwnd", "rwnd"};
+
+/* A line of the time series of a sampled TCP upload */
+static void tcp_sample_cb(const struct zperf_tcp_sample *sample, void *user_data)
+{
+    const shell_handle_t sh = user_data;
+
+    print_number(sh, sample->time_us, TIME_US, TIME_US_UNIT);
+    printf("\t%u\t%u\t\t%u\t%u\t%u\t%u\t%u\t%u\t%s%s\n", sample->cwnd, sample->ssthresh, sample->snd_wnd,
+           sample->in_flight, sample->snd_queuelen, sample->srtt_ms, sample->rto_ms, sample->nrtx,
+           tcp_limit_names[sample->limit], sample->fast_recovery ? ", recovery" : "");
+}
+
+static void print_tcp_stats(const shell_handle_t sh, const struct zperf_tcp_stats *tcp)
+{
+    int i;
+
+    if (tcp->samples == 0U)
+    {
+        return;
+    }
+
+    printf("cwnd:\t\tmin %u, mean %u, max %u bytes, dropped %u times\n", tcp->cwnd_min, tcp->cwnd_mean,
+           tcp->cwnd_max, tcp->cwnd_drops);
+    printf("ssthresh:\tmin %u bytes\n", tcp->ssthresh_min);
+    printf("RTT:\t\t%u ms (+/- %u ms) at the end, max %u ms, RTO max %u ms\n", tcp->last.srtt_ms,
+           tcp->last.rttvar_ms, tcp->srtt_max_ms, tcp->rto_max_ms);
+    printf("Retransmits:\tup to %u of a segment\n", tcp->nrtx_max);
+    printf("Windows:\tsend %u, receive %u bytes at the end\n", tcp->last.snd_wnd, tcp->last.rcv_wnd);
+    printf("Limited by:\t");
+    for (i = 0; i < ZPERF_TCP_LIMITS; i++)
+    {
+        printf("%s %u%%%s", tcp_limit_names[i], (tcp->limit[i] * 100U) / tcp->samples,
+               (i + 1 < ZPERF_TCP_LIMITS) ? ", " : "");
     }
+    printf(" of %u samples\n", tcp->samples);
 }
 
 static void shell_tcp_upload_print_stats(const shell_handle_t sh, struct zperf_results *results)
@@ -514,6 +896,9 @@ static void shell_tcp_upload_print_stats(const shell_handle_t sh, struct zperf_r
         printf("Rate:\t\t");
         print_number(sh, client_rate_in_kbps, KBPS, KBPS_UNIT);
         printf("\n");
+
+        print_tcp_stats(sh, &results->tcp);
+        print_cpu_stats(sh, &results->cpu);
     }
 }
 
@@ -608,22 +993,160 @@ static void tcp_upload_cb(enum zperf_status status, struct zperf_results *result
  /* 	(void)net_icmp_cleanup_ctx(&ctx); */
  /* } */
  
-static shell_status_t execute_upload(const shell_handle_t sh, const struct zperf_upload_params *param, bool is_udp,
-                                     bool async)
+static void tcp_session_cb(enum zperf_status status, struct zperf_results *result, void *user_data);
+
+static uint32_t shell_rate_kbps(uint64_t bytes, uint32_t time_us)
 {
+    if (time_us == 0U)
+    {
+        return 0U;
+    }
 
-    struct zperf_results results = {0};
+    return (uint32_t)((bytes * 8ULL * (uint64_t)USEC_PER_SEC) / ((uint64_t)time_us * 1024ULL));
+}
+
+/* Upload and data sent back by the server, at the same time for iperf -d,
+ * one after the other for -r, or only the data of the server for -Z
+ */
+static shell_status_t execute_dual_upload(const shell_handle_t sh, const struct zperf_upload_params *param,
+                                          bool is_udp)
+{
+    struct zperf_results tx = {0};
+    struct zperf_results rx = {0};
+    uint32_t tx_kbps, rx_kbps;
     int ret;
-    printf("Duration:\t");
-    print_number(sh, param->duration_ms * USEC_PER_MSEC, TIME_US, TIME_US_UNIT);
-    printf("\n");
-    printf("Packet size:\t%u bytes\n", param->packet_size);
-    printf("Rate:\t\t%u kbps\n", param->rate_kbps);
-    printf("Starting...\n");
 
-    if (IS_ENABLED(CONFIG_NET_IPV6) && param->peer_addr.ss_family == AF_INET6)
+    if (param->options.dual == ZPERF_DUAL_REVERSE)
     {
-        struct sockaddr_in6 *ipv6 = (struct sockaddr_in6 *)&param->peer_addr;
+        printf("Receiving from the server on the same connection\n");
+    }
+    else
+    {
+        printf("Receiving back on port %u\n", param->options.dual_port);
+    }
+
+    ret = zperf_dual_upload(param, is_udp ? IPPROTO_UDP : IPPROTO_TCP, &tx, &rx);
+    if (ret == -ENOTSUP)
+    {
+        printf("Reverse test is only supported with TCP\n");
+        return -kStatus_SHELL_Error;
+    }
+    else if (ret < 0)
+    {
+        printf("Test with the server sending failed (%d)\n", ret);
+        return ret;
+    }
+
+    if (param->options.dual == ZPERF_DUAL_REVERSE)
+    {
+        printf("Data sent by the server:\n");
+        tcp_session_cb(ZPERF_SESSION_FINISHED, &rx, (void *)sh);
+        return kStatus_SHELL_Success;
+    }
+
+    if (is_udp)
+    {
+        shell_udp_upload_print_stats(sh, &tx);
+        printf("-\nData sent back by the server:\n");
+        udp_session_cb(ZPERF_SESSION_FINISHED, &rx, (void *)sh);
+    }
+    else
+    {
+        shell_tcp_upload_print_stats(sh, &tx);
+        printf("-\nData sent back by the server:\n");
+        tcp_session_cb(ZPERF_SESSION_FINISHED, &rx, (void *)sh);
+    }
+
+    /* Both directions one after the other, no total */
+    if (param->options.dual == ZPERF_DUAL_TRADEOFF)
+    {
+        return kStatus_SHELL_Success;
+    }
+
+    /* Both directions as seen from here */
+    tx_kbps = shell_rate_kbps((uint64_t)tx.nb_packets_sent * tx.packet_size, tx.client_time_in_us);
+    rx_kbps = shell_rate_kbps(rx.total_len, rx.time_in_us);
+
+    printf("-\nTotal rate:\t\t");
+    print_number(sh, tx_kbps + rx_kbps, KBPS, KBPS_UNIT);
+    printf("\t(sent ");
+    print_number(sh, tx_kbps, KBPS, KBPS_UNIT);
+    printf(", received ");
+    print_number(sh, rx_kbps, KBPS, KBPS_UNIT);
+    printf(")\n");
+
+    return kStatus_SHELL_Success;
+}
+
+/* Upload to an iperf3 server, which sends back what it received */
+static shell_status_t execute_iperf3_upload(const shell_handle_t sh, const struct zperf_upload_params *param,
+                                            bool is_udp)
+{
+    struct zperf_results results = {0};
+    int ret;
+
+    ret = zperf_iperf3_upload(param, is_udp ? IPPROTO_UDP : IPPROTO_TCP, &results);
+    if (ret < 0)
+    {
+        printf("iperf3 %s upload failed (%d)\n", is_udp ? "UDP" : "TCP", ret);
+        return ret;
+    }
+
+    if (is_udp)
+    {
+        shell_udp_upload_print_stats(sh, &results);
+        return kStatus_SHELL_Success;
+    }
+
+    shell_tcp_upload_print_stats(sh, &results);
+
+    printf("Server duration:\t");
+    print_number(sh, results.time_in_us, TIME_US, TIME_US_UNIT);
+    printf("\n");
+    printf("Server rate:\t");
+    print_number(sh, shell_rate_kbps(results.total_len, results.time_in_us), KBPS, KBPS_UNIT);
+    printf("\n");
+
+    return kStatus_SHELL_Success;
+}
+
+static shell_status_t execute_upload(const shell_handle_t sh, const struct zperf_upload_params *param, bool is_udp,
+                                     bool async, bool iperf3)
+{
+
+    struct zperf_results results = {0};
+    int ret;
+    printf("Duration:\t");
+    print_number(sh, param->duration_ms * USEC_PER_MSEC, TIME_US, TIME_US_UNIT);
+    printf("\n");
+    printf("Packet size:\t%u bytes\n", param->packet_size);
+    printf("Rate:\t\t%u kbps\n", param->rate_kbps);
+    if (param->options.pattern_seed != 0U)
+    {
+        printf("Pattern seed:\t%u\n", param->options.pattern_seed);
+    }
+    if (param->options.burst_packets != 0U)
+    {
+        printf("Bursts:\t\t%u packets every %u ms%s\n", param->options.burst_packets,
+               param->options.burst_period_ms, param->options.poisson ? " on average" : "");
+    }
+    else if (param->options.poisson)
+    {
+        printf("Arrivals:\tPoisson\n");
+    }
+    if (param->options.sndbuf != 0U)
+    {
+        printf("Send buffer:\t%u bytes\n", param->options.sndbuf);
+    }
+    printf("Starting...\n");
+    if (param->options.sample_cb != NULL)
+    {
+        printf("Time\tcwnd\tssthresh\twnd\tflight\tqueue\tsrtt\trto\trtx\tlimit\n");
+    }
+
+    if (IS_ENABLED(CONFIG_NET_IPV6) && param->peer_addr.ss_family == AF_INET6)
+    {
+        struct sockaddr_in6 *ipv6 = (struct sockaddr_in6 *)&param->peer_addr;
         /* For IPv6, we should make sure that neighbor discovery
          * has been done for the peer. So send ping here, wait
          * some time and start the test after that.
@@ -631,9 +1154,33 @@ static shell_status_t execute_upload(const shell_handle_t sh, const struct zperf
          /* send_ping(sh, &ipv6->sin6_addr, MSEC_PER_SEC); */
     }
 
+    if (iperf3)
+    {
+        if (async || (param->options.dual != ZPERF_DUAL_NONE) || (param->options.pattern_seed != 0U))
+        {
+            printf("-3 can not be used with -a, -d, -r, -Z or -V\n");
+            return -kStatus_SHELL_Error;
+        }
+
+        return execute_iperf3_upload(sh, param, is_udp);
+    }
+
+    if (param->options.dual != ZPERF_DUAL_NONE)
+    {
+        if (async)
+        {
+            printf("-a can not be used with -d, -r or -Z\n");
+            return -kStatus_SHELL_Error;
+        }
+
+        return execute_dual_upload(sh, param, is_udp);
+    }
+
     if (is_udp && IS_ENABLED(CONFIG_NET_UDP))
     {
-        uint32_t packet_duration = zperf_packet_duration(param->packet_size, param->rate_kbps);
+        /* Bursts may be sent back to back */
+        uint32_t packet_duration =
+            (param->rate_kbps != 0U) ? zperf_packet_duration(param->packet_size, param->rate_kbps) : 0U;
 
         printf("Rate:\t\t");
         print_number(sh, param->rate_kbps, KBPS, KBPS_UNIT);
@@ -711,48 +1258,230 @@ static shell_status_t execute_upload(const shell_handle_t sh, const struct zperf
     return kStatus_SHELL_Success;
 }
 
-static shell_status_t parse_arg(size_t *i, size_t argc, char *argv[])
+/* Longest line of a file of packet sizes */
+#define SIZES_LINE_MAX 128
+
+/* Read a file of "<size> <weight>" lines, # starts a comment */
+static int parse_sizes_file(const char *path, struct zperf_size_schedule *sched)
 {
-    int res = -1;
-    const char *str = argv[*i] + 2;
-    char *endptr;
+    static uint16_t sizes[ZPERF_SIZE_SCHEDULE_LEN];
+    static uint32_t weights[ZPERF_SIZE_SCHEDULE_LEN];
+    char line[SIZES_LINE_MAX];
+    size_t count = 0;
+    int lineno = 0;
+    FILE *file;
+    int ret = 0;
 
-    if (*str == 0)
+    file = fopen(path, "r");
+    if (file == NULL)
     {
-        if (*i + 1 >= argc)
+        printf("Can't open %s\n", path);
+        return -1;
+    }
+
+    while ((ret == 0) && (fgets(line, sizeof(line), file) != NULL))
+    {
+        unsigned long size, weight = 0;
+        char *p, *end;
+
+        lineno++;
+        if ((p = strchr(line, '#')) != NULL)
+        {
+            *p = '\0';
+        }
+        for (p = line; isspace((unsigned char)*p); p++)
+        {
+        }
+        if (*p == '\0')
+        {
+            continue;
+        }
+
+        size = strtoul(p, &end, 10);
+        if (end != p)
+        {
+            weight = strtoul(p = end, &end, 10);
+        }
+        for (; isspace((unsigned char)*end); end++)
+        {
+        }
+        if ((end == p) || (*end != '\0') || (size == 0) || (size > PACKET_SIZE_MAX) || (weight > UINT32_MAX))
+        {
+            printf("%s:%d: expected <size> <weight>, sizes up to %d\n", path, lineno, PACKET_SIZE_MAX);
+            ret = -1;
+        }
+        else if (count == ZPERF_SIZE_SCHEDULE_LEN)
+        {
+            printf("%s: more than %d sizes\n", path, ZPERF_SIZE_SCHEDULE_LEN);
+            ret = -1;
+        }
+        else
+        {
+            sizes[count] = size;
+            weights[count++] = weight;
+        }
+    }
+
+    fclose(file);
+
+    if ((ret == 0) && (zperf_size_schedule_mix(sched, sizes, weights, count) < 0))
+    {
+        printf("%s: no size with a weight\n", path);
+        ret = -1;
+    }
+
+    return ret;
+}
+
+static uint32_t sizes_mean(const struct zperf_size_schedule *sched)
+{
+    uint32_t total = 0;
+    uint16_t i;
+
+    for (i = 0; i < sched->len; i++)
+    {
+        total += sched->size[i];
+    }
+
+    return total / sched->len;
+}
+
+/* Build the schedule of a traffic profile: imix, <min>-<max> or a file */
+static int parse_sizes(const char *profile, int family, struct zperf_size_schedule *sched)
+{
+    unsigned long min, max;
+    char *end;
+
+    if (strcmp(profile, "imix") == 0)
+    {
+        return zperf_size_schedule_imix(sched, family);
+    }
+
+    min = strtoul(profile, &end, 10);
+    if ((end != profile) && (*end == '-') && isdigit((unsigned char)end[1]))
+    {
+        max = strtoul(end + 1, &end, 10);
+        if ((*end != '\0') || (min > max) || (max > PACKET_SIZE_MAX))
         {
+            printf("Invalid size range %s, sizes up to %d\n", profile, PACKET_SIZE_MAX);
             return -1;
         }
 
-        *i += 1;
-        str = argv[*i];
+        return zperf_size_schedule_uniform(sched, min, max);
     }
 
-    errno = 0;
-    if (strncmp(str, "0x", 2) == 0)
+    return parse_sizes_file(profile, sched);
+}
+
+static void print_sizes(const shell_handle_t sh, const struct zperf_size_schedule *sched)
+{
+    uint16_t min = UINT16_MAX;
+    uint16_t i;
+
+    for (i = 0; i < sched->len; i++)
     {
-        res = strtol(str, &endptr, 16);
+        min = MIN(min, sched->size[i]);
     }
-    else
+
+    printf("Packet sizes:\t%u to %u bytes, mean %u\n", min, sched->max, (unsigned int)sizes_mean(sched));
+}
+
+static void print_size_stats(const shell_handle_t sh, const struct zperf_size_stats *sizes)
+{
+    int i;
+
+    printf(" packet sizes:\t");
+    for (i = 0; i < ZPERF_SIZE_BUCKETS; i++)
     {
-        res = strtol(str, &endptr, 10);
+        if (sizes->count[i] == 0U)
+        {
+            continue;
+        }
+
+        if (i == 0)
+        {
+            printf(" <64:%u", sizes->count[i]);
+        }
+        else if (i == ZPERF_SIZE_BUCKETS - 1)
+        {
+            printf(" %u+:%u", 32U << i, sizes->count[i]);
+        }
+        else
+        {
+            printf(" %u-%u:%u", 32U << i, (64U << i) - 1U, sizes->count[i]);
+        }
     }
 
-    if (errno || (endptr == str))
+    printf("\n");
+}
+
+/* Parse "<first>/<second>", two numbers */
+static int parse_pair(const char *str, uint32_t *first, uint32_t *second)
+{
+    char *end;
+
+    *first = strtoul(str, &end, 10);
+    if ((end == str) || (*end != '/') || !isdigit((unsigned char)end[1]))
     {
-        return -kStatus_SHELL_Error;
+        return -1;
     }
 
-    return res;
+    *second = strtoul(end + 1, &end, 10);
+
+    return (*end == '\0') ? 0 : -1;
+}
+
+/* Bursts of packets every period ms, or on ms at the rate then off ms */
+static int set_bursts(struct zperf_upload_params *param, uint32_t first, uint32_t second, bool on_off)
+{
+    uint32_t size = param->packet_size;
+    uint64_t packets;
+
+    if (param->options.dual != ZPERF_DUAL_NONE)
+    {
+        printf("Bursts can not be sent with -d, -r or -Z\n");
+        return -1;
+    }
+
+    if (!on_off)
+    {
+        param->options.burst_packets = first;
+        param->options.burst_period_ms = second;
+        return 0;
+    }
+
+    if (param->rate_kbps == 0U)
+    {
+        printf("-O needs a rate\n");
+        return -1;
+    }
+
+    /* The packets sent in the on time, of the mean size of a profile */
+    if (param->options.sizes != NULL)
+    {
+        size = sizes_mean(param->options.sizes);
+    }
+    packets = ((uint64_t)first * param->rate_kbps * 1024U) / (8U * MSEC_PER_SEC * MAX(size, 1U));
+
+    param->options.burst_packets = MAX(packets, 1U);
+    param->options.burst_period_ms = first + second;
+
+    return 0;
 }
 
 static shell_status_t shell_cmd_upload(const shell_handle_t sh, size_t argc, char *argv[], enum net_ip_protocol proto)
 {
+    static struct zperf_size_schedule sizes;
     struct zperf_upload_params param = {0};
     struct sockaddr_in6 ipv6 = {.sin6_family = AF_INET6};
     struct sockaddr_in ipv4 = {.sin_family = AF_INET};
     char *port_str;
+    const char *profile = NULL;
+    /* -b packets/period or -O on/off, in ms */
+    uint32_t burst[2] = {0};
+    bool on_off = false;
     bool async = false;
+    bool iperf3 = false;
     bool is_udp;
     int start = 0;
     size_t opt_cnt = 0;
@@ -789,6 +1518,44 @@ static shell_status_t shell_cmd_upload(const shell_handle_t sh, size_t argc, cha
             opt_cnt += 1;
             break;
 
+        case '3':
+            iperf3 = true;
+            opt_cnt += 1;
+            break;
+
+        case 'd':
+            param.options.dual = ZPERF_DUAL_BIDIR;
+            opt_cnt += 1;
+            break;
+
+        case 'r':
+            param.options.dual = ZPERF_DUAL_TRADEOFF;
+            opt_cnt += 1;
+            break;
+
+        case 'Z':
+            param.options.dual = ZPERF_DUAL_REVERSE;
+            opt_cnt += 1;
+            break;
+
+        case 'D': {
+            int port = parse_arg(&i, argc, argv);
+
+            if (port <= 0 || port > UINT16_MAX)
+            {
+                printf("Parse error: %s\n", argv[i]);
+                return -kStatus_SHELL_Error;
+            }
+
+            if (param.options.dual == ZPERF_DUAL_NONE)
+            {
+                param.options.dual = ZPERF_DUAL_BIDIR;
+            }
+            param.options.dual_port = port;
+            opt_cnt += 2;
+            break;
+        }
+
         case 'n':
             if (is_udp)
             {
@@ -799,49 +1566,151 @@ static shell_status_t shell_cmd_upload(const shell_handle_t sh, size_t argc, cha
             opt_cnt += 1;
             break;
 
-#ifdef CONFIG_NET_CONTEXT_PRIORITY
-        case 'p':
-            param.options.priority = parse_arg(&i, argc, argv);
-            if (param.options.priority < 0 || param.options.priority > UINT8_MAX)
+        case 'T': {
+            int ttl = parse_arg(&i, argc, argv);
+
+            if (!is_udp || ttl <= 0 || ttl > UINT8_MAX)
             {
                 printf("Parse error: %s\n", argv[i]);
                 return -kStatus_SHELL_Error;
             }
+
+            param.options.mcast_ttl = ttl;
             opt_cnt += 2;
             break;
-#endif /* CONFIG_NET_CONTEXT_PRIORITY */
-
-        default:
-            printf("Unrecognized argument: %s\n", argv[i]);
-            return -kStatus_SHELL_Error;
         }
-    }
 
-    start += opt_cnt;
-    argc -= opt_cnt;
+        case 'L':
+            if (!is_udp)
+            {
+                printf("TCP does not support -L option\n");
+                return -kStatus_SHELL_Error;
+            }
+            param.options.mcast_loop = true;
+            opt_cnt += 1;
+            break;
 
-    if (argc < 2)
-    {
-        printf("Not enough parameters.\n");
+        case 'V': {
+            int seed = parse_arg(&i, argc, argv);
 
-        if (is_udp)
-        {
-            if (IS_ENABLED(CONFIG_NET_UDP))
+            if (seed <= 0)
             {
-                /* shell_help(sh); */
-                printf("help");
+                printf("Parse error: %s\n", argv[i]);
                 return -kStatus_SHELL_Error;
             }
+
+            param.options.pattern_seed = seed;
+            opt_cnt += 2;
+            break;
         }
-        else
-        {
-            if (IS_ENABLED(CONFIG_NET_TCP))
+
+        case 'm':
+            if (!is_udp || (i + 1 >= argc))
             {
-                /* shell_help(sh); */
-                printf("help");
+                printf("Parse error: %s\n", argv[i]);
                 return -kStatus_SHELL_Error;
             }
-        }
+            profile = argv[++i];
+            opt_cnt += 2;
+            break;
+
+        case 'b':
+        case 'O':
+            if (!is_udp || (i + 1 >= argc) || (parse_pair(argv[i + 1], &burst[0], &burst[1]) < 0) ||
+                (burst[0] == 0U) || (burst[1] == 0U))
+            {
+                printf("Parse error: %s\n", argv[i]);
+                return -kStatus_SHELL_Error;
+            }
+            on_off = (argv[i][1] == 'O');
+            i++;
+            opt_cnt += 2;
+            break;
+
+        case 'E':
+            if (!is_udp)
+            {
+                printf("TCP does not support -E option\n");
+                return -kStatus_SHELL_Error;
+            }
+            param.options.poisson = true;
+            opt_cnt += 1;
+            break;
+
+        case 'w': {
+            long bytes = (i + 1 < argc) ? parse_number(argv[i + 1], K, K_UNIT) : 0;
+
+            if (is_udp || (bytes <= 0) || (bytes > TCP_SND_BUF))
+            {
+                printf("Parse error: %s, a TCP send buffer up to %d bytes\n", argv[i], TCP_SND_BUF);
+                return -kStatus_SHELL_Error;
+            }
+
+            param.options.sndbuf = bytes;
+            i++;
+            opt_cnt += 2;
+            break;
+        }
+
+        case 'i': {
+            int interval = parse_arg(&i, argc, argv);
+
+            if (is_udp || interval <= 0)
+            {
+                printf("Parse error: %s\n", argv[i]);
+                return -kStatus_SHELL_Error;
+            }
+
+            param.options.sample_ms = interval;
+            param.options.sample_cb = tcp_sample_cb;
+            param.options.sample_user_data = (void *)sh;
+            opt_cnt += 2;
+            break;
+        }
+
+#ifdef CONFIG_NET_CONTEXT_PRIORITY
+        case 'p':
+            param.options.priority = parse_arg(&i, argc, argv);
+            if (param.options.priority < 0 || param.options.priority > UINT8_MAX)
+            {
+                printf("Parse error: %s\n", argv[i]);
+                return -kStatus_SHELL_Error;
+            }
+            opt_cnt += 2;
+            break;
+#endif /* CONFIG_NET_CONTEXT_PRIORITY */
+
+        default:
+            printf("Unrecognized argument: %s\n", argv[i]);
+            return -kStatus_SHELL_Error;
+        }
+    }
+
+    start += opt_cnt;
+    argc -= opt_cnt;
+
+    if (argc < 2)
+    {
+        printf("Not enough parameters.\n");
+
+        if (is_udp)
+        {
+            if (IS_ENABLED(CONFIG_NET_UDP))
+            {
+                /* shell_help(sh); */
+                printf("help");
+                return -kStatus_SHELL_Error;
+            }
+        }
+        else
+        {
+            if (IS_ENABLED(CONFIG_NET_TCP))
+            {
+                /* shell_help(sh); */
+                printf("help");
+                return -kStatus_SHELL_Error;
+            }
+        }
 
         return -kStatus_SHELL_Error;
     }
@@ -930,7 +1799,46 @@ static shell_status_t shell_cmd_upload(const shell_handle_t sh, size_t argc, cha
         param.rate_kbps = 10U;
     }
 
-    return execute_upload(sh, &param, is_udp, async);
+    /* The server sends back to the port of the test by default, like iperf */
+    if ((param.options.dual != ZPERF_DUAL_NONE) && (param.options.dual_port == 0U))
+    {
+        param.options.dual_port = strtoul(port_str, NULL, 10);
+    }
+
+    if (profile != NULL)
+    {
+        /* The schedule is rebuilt by the next command */
+        if (async)
+        {
+            printf("-m can not be used with -a\n");
+            return -kStatus_SHELL_Error;
+        }
+        if (parse_sizes(profile, param.peer_addr.ss_family, &sizes) < 0)
+        {
+            return -kStatus_SHELL_Error;
+        }
+        print_sizes(sh, &sizes);
+        param.options.sizes = &sizes;
+    }
+
+    if (burst[0] != 0U)
+    {
+        if (set_bursts(&param, burst[0], burst[1], on_off) < 0)
+        {
+            return -kStatus_SHELL_Error;
+        }
+    }
+    else if (param.rate_kbps == 0U)
+    {
+        printf("Only bursts can be sent at rate 0\n");
+        return -kStatus_SHELL_Error;
+    }
+
+    /* Only called for a multicast address */
+    param.options.receiver_cb = udp_receiver_cb;
+    param.options.receiver_user_data = (void *)sh;
+
+    return execute_upload(sh, &param, is_udp, async, iperf3);
 }
 
 static shell_status_t cmd_tcp_upload(const shell_handle_t sh, size_t argc, char *argv[])
@@ -949,6 +1857,7 @@ static shell_status_t shell_cmd_upload2(const shell_handle_t sh, size_t argc, ch
     sa_family_t family;
     uint8_t is_udp;
     bool async = false;
+    bool iperf3 = false;
     int start = 0;
     size_t opt_cnt = 0;
 
@@ -983,6 +1892,44 @@ static shell_status_t shell_cmd_upload2(const shell_handle_t sh, size_t argc, ch
             opt_cnt += 1;
             break;
 
+        case '3':
+            iperf3 = true;
+            opt_cnt += 1;
+            break;
+
+        case 'd':
+            param.options.dual = ZPERF_DUAL_BIDIR;
+            opt_cnt += 1;
+            break;
+
+        case 'r':
+            param.options.dual = ZPERF_DUAL_TRADEOFF;
+            opt_cnt += 1;
+            break;
+
+        case 'Z':
+            param.options.dual = ZPERF_DUAL_REVERSE;
+            opt_cnt += 1;
+            break;
+
+        case 'D': {
+            int port = parse_arg(&i, argc, argv);
+
+            if (port <= 0 || port > UINT16_MAX)
+            {
+                printf("Parse error: %s\n", argv[i]);
+                return -kStatus_SHELL_Error;
+            }
+
+            if (param.options.dual == ZPERF_DUAL_NONE)
+            {
+                param.options.dual = ZPERF_DUAL_BIDIR;
+            }
+            param.options.dual_port = port;
+            opt_cnt += 2;
+            break;
+        }
+
         case 'n':
             if (is_udp)
             {
@@ -993,6 +1940,44 @@ static shell_status_t shell_cmd_upload2(const shell_handle_t sh, size_t argc, ch
             opt_cnt += 1;
             break;
 
+        case 'T': {
+            int ttl = parse_arg(&i, argc, argv);
+
+            if (!is_udp || ttl <= 0 || ttl > UINT8_MAX)
+            {
+                printf("Parse error: %s\n", argv[i]);
+                return -kStatus_SHELL_Error;
+            }
+
+            param.options.mcast_ttl = ttl;
+            opt_cnt += 2;
+            break;
+        }
+
+        case 'L':
+            if (!is_udp)
+            {
+                printf("TCP does not support -L option\n");
+                return -kStatus_SHELL_Error;
+            }
+            param.options.mcast_loop = true;
+            opt_cnt += 1;
+            break;
+
+        case 'V': {
+            int seed = parse_arg(&i, argc, argv);
+
+            if (seed <= 0)
+            {
+                printf("Parse error: %s\n", argv[i]);
+                return -kStatus_SHELL_Error;
+            }
+
+            param.options.pattern_seed = seed;
+            opt_cnt += 2;
+            break;
+        }
+
 #ifdef CONFIG_NET_CONTEXT_PRIORITY
         case 'p':
             param.options.priority = parse_arg(&i, argc, argv);
@@ -1093,7 +2078,17 @@ static shell_status_t shell_cmd_upload2(const shell_handle_t sh, size_t argc, ch
         param.rate_kbps = 10U;
     }
 
-    return execute_upload(sh, &param, is_udp, async);
+    /* The server sends back to the port of the test by default, like iperf */
+    if ((param.options.dual != ZPERF_DUAL_NONE) && (param.options.dual_port == 0U))
+    {
+        param.options.dual_port = DEF_PORT;
+    }
+
+    /* Only called for a multicast address */
+    param.options.receiver_cb = udp_receiver_cb;
+    param.options.receiver_user_data = (void *)sh;
+
+    return execute_upload(sh, &param, is_udp, async, iperf3);
 }
 
 static shell_status_t cmd_tcp_upload2(const shell_handle_t sh, size_t argc, char *argv[])
@@ -1177,6 +2172,9 @@ static void tcp_session_cb(enum zperf_status status, struct zperf_results *resul
         print_number(sh, rate_in_kbps, KBPS, KBPS_UNIT);
         printf("\n");
 
+        print_integrity(sh, &result->integrity, false);
+        print_cpu_stats(sh, &result->cpu);
+
         break;
     }
 
@@ -1218,6 +2216,12 @@ static shell_status_t cmd_tcp_download(const shell_handle_t sh, size_t argc, cha
             return -kStatus_SHELL_Error;
         }
 
+        if (param.num_ports > 1)
+        {
+            printf("TCP server listens on a single port\n");
+            return -kStatus_SHELL_Error;
+        }
+
         ret = zperf_tcp_download(&param, tcp_session_cb, (void *)sh);
         if (ret == -EALREADY)
         {
@@ -1240,8 +2244,89 @@ static shell_status_t cmd_tcp_download(const shell_handle_t sh, size_t argc, cha
     }
 }
 
-/* static shell_status_t cmd_version(const shell_handle_t sh, size_t argc, char *argv[]) */
-static shell_status_t cmd_version(void)
+/* Results of the iperf3 server, only a UDP test receives packets */
+static void iperf3_session_cb(enum zperf_status status, struct zperf_results *result, void *user_data)
+{
+    switch (status)
+    {
+    case ZPERF_SESSION_STARTED:
+        printf("New iperf3 session started on port %u.\n", result->port);
+        break;
+
+    case ZPERF_SESSION_FINISHED:
+        if (result->nb_packets_rcvd != 0U)
+        {
+            udp_session_cb(status, result, user_data);
+        }
+        else
+        {
+            tcp_session_cb(status, result, user_data);
+        }
+        break;
+
+    case ZPERF_SESSION_ERROR:
+        printf("iperf3 session error.\n");
+        break;
+    }
+}
+
+static shell_status_t cmd_iperf3_download_stop(const shell_handle_t sh, size_t argc, char *argv[])
+{
+    int ret;
+
+    ret = zperf_iperf3_download_stop();
+    if (ret < 0)
+    {
+        printf("iperf3 server not running!\n");
+        return -ret;
+    }
+
+    printf("iperf3 server stopped\n");
+
+    return kStatus_SHELL_Success;
+}
+
+static shell_status_t cmd_iperf3_download(const shell_handle_t sh, size_t argc, char *argv[])
+{
+    struct zperf_download_params param = {0};
+    int ret;
+
+    ret = zperf_bind_host(sh, argc, argv, &param);
+    if (ret < 0)
+    {
+        printf("Unable to bind host.\n");
+        return -kStatus_SHELL_Error;
+    }
+
+    if (argc < 2)
+    {
+        param.port = IPERF3_DEF_PORT;
+    }
+
+    if ((param.num_ports > 1) || (param.pattern_seed != 0U))
+    {
+        printf("iperf3 server listens on a single port, without -V\n");
+        return -kStatus_SHELL_Error;
+    }
+
+    ret = zperf_iperf3_download(&param, iperf3_session_cb, (void *)sh);
+    if (ret == -EALREADY)
+    {
+        printf("iperf3 server already started!\n");
+        return -kStatus_SHELL_Error;
+    }
+    else if (ret < 0)
+    {
+        printf("Failed to start iperf3 server!\n");
+        return -kStatus_SHELL_Error;
+    }
+
+    printf("iperf3 server started on port %u\n", param.port);
+
+    return kStatus_SHELL_Success;
+}
+
+static shell_status_t cmd_version(const shell_handle_t sh, size_t argc, char *argv[])
 {
     printf("Version: %s\nConfig: %s\n", ZPERF_VERSION, CONFIG);
 
@@ -1307,173 +2392,1005 @@ void zperf_shell_init(void)
     }
 }
 
-/* SHELL_STATIC_SUBCMD_SET_CREATE(zperf_cmd_tcp_download, */
-/*                                SHELL_CMD(stop, NULL, "Stop TCP server\n", cmd_tcp_download_stop),
- * SHELL_SUBCMD_SET_END); */
-/**/
-/* SHELL_STATIC_SUBCMD_SET_CREATE(zperf_cmd_tcp, */
-/*                                SHELL_CMD(upload, NULL, */
-/*                                          "[<options>] <dest ip> <dest port> <duration> <packet size>[K]\n" */
-/*                                          "<options>     command options (optional): [-S tos -a]\n" */
-/*                                          "<dest ip>     IP destination\n" */
-/*                                          "<dest port>   port destination\n" */
-/*                                          "<duration>    of the test in seconds\n" */
-/*                                          "<packet size> Size of the packet in byte or kilobyte " */
-/*                                          "(with suffix K)\n" */
-/*                                          "Available options:\n" */
-/*                                          "-S tos: Specify IPv4/6 type of service\n" */
-/*                                          "-a: Asynchronous call (shell will not block for the upload)\n" */
-/*                                          "-n: Disable Nagle's algorithm\n" */
-/* #ifdef CONFIG_NET_CONTEXT_PRIORITY */
-/*                                          "-p: Specify custom packet priority\n" */
-/* #endif // CONFIG_NET_CONTEXT_PRIORITY */
-/*                                          "Example: tcp upload 192.0.2.2 1111 1 1K\n" */
-/*                                          "Example: tcp upload 2001:db8::2\n", */
-/*                                          cmd_tcp_upload), */
-/*                                SHELL_CMD(upload2, NULL, */
-/*                                          "[<options>] v6|v4 <duration> <packet size>[K] <baud rate>[K|M]\n" */
-/*                                          "<options>     command options (optional): [-S tos -a]\n" */
-/*                                          "<v6|v4>:      Use either IPv6 or IPv4\n" */
-/*                                          "<duration>    Duration of the test in seconds\n" */
-/*                                          "<packet size> Size of the packet in byte or kilobyte " */
-/*                                          "(with suffix K)\n" */
-/*                                          "Available options:\n" */
-/*                                          "-S tos: Specify IPv4/6 type of service\n" */
-/*                                          "-a: Asynchronous call (shell will not block for the upload)\n" */
-/* #ifdef CONFIG_NET_CONTEXT_PRIORITY */
-/*                                          "-p: Specify custom packet priority\n" */
-/* #endif // CONFIG_NET_CONTEXT_PRIORITY */
-/*                                          "Example: tcp upload2 v6 1 1K\n" */
-/*                                          "Example: tcp upload2 v4\n" */
-/*                                          "-n: Disable Nagle's algorithm\n" */
-/* #if defined(CONFIG_NET_IPV6) && defined(MY_IP6ADDR_SET) */
-/*                                          "Default IPv6 address is " MY_IP6ADDR ", destination [" DST_IP6ADDR */
-/*                                          "]:" DEF_PORT_STR "\n" */
-/* #endif */
-/* #if defined(CONFIG_NET_IPV4) && defined(MY_IP4ADDR_SET) */
-/*                                          "Default IPv4 address is " MY_IP4ADDR ", destination " DST_IP4ADDR */
-/*                                          ":" DEF_PORT_STR "\n" */
-/* #endif */
-/*                                          , */
-/*                                          cmd_tcp_upload2), */
-/*                                SHELL_CMD(download, zperf_cmd_tcp_download, */
-/*                                          "[<port>]:  Server port to listen on/connect to\n" */
-/*                                          "[<host>]:  Bind to <host>, an interface address\n" */
-/*                                          "Example: tcp download 5001 192.168.0.1\n", */
-/*                                          cmd_tcp_download), */
-/*                                SHELL_SUBCMD_SET_END); */
-/**/
-/* SHELL_STATIC_SUBCMD_SET_CREATE(zperf_cmd_udp_download, */
-/*                                SHELL_CMD(stop, NULL, "Stop UDP server\n", cmd_udp_download_stop),
- * SHELL_SUBCMD_SET_END); */
-/**/
-/* SHELL_STATIC_SUBCMD_SET_CREATE(zperf_cmd_udp, */
-/*                                SHELL_CMD(upload, NULL, */
-/*                                          "[<options>] <dest ip> [<dest port> <duration> <packet size>[K] " */
-/*                                          "<baud rate>[K|M]]\n" */
-/*                                          "<options>     command options (optional): [-S tos -a]\n" */
-/*                                          "<dest ip>     IP destination\n" */
-/*                                          "<dest port>   port destination\n" */
-/*                                          "<duration>    of the test in seconds\n" */
-/*                                          "<packet size> Size of the packet in byte or kilobyte " */
-/*                                          "(with suffix K)\n" */
-/*                                          "<baud rate>   Baudrate in kilobyte or megabyte\n" */
-/*                                          "Available options:\n" */
-/*                                          "-S tos: Specify IPv4/6 type of service\n" */
-/*                                          "-a: Asynchronous call (shell will not block for the upload)\n" */
-/* #ifdef CONFIG_NET_CONTEXT_PRIORITY */
-/*                                          "-p: Specify custom packet priority\n" */
-/* #endif // CONFIG_NET_CONTEXT_PRIORITY */
-/*                                          "Example: udp upload 192.0.2.2 1111 1 1K 1M\n" */
-/*                                          "Example: udp upload 2001:db8::2\n", */
-/*                                          cmd_udp_upload), */
-/*                                SHELL_CMD(upload2, NULL, */
-/*                                          "[<options>] v6|v4 [<duration> <packet size>[K] <baud rate>[K|M]]\n" */
-/*                                          "<options>     command options (optional): [-S tos -a]\n" */
-/*                                          "<v6|v4>:      Use either IPv6 or IPv4\n" */
-/*                                          "<duration>    Duration of the test in seconds\n" */
-/*                                          "<packet size> Size of the packet in byte or kilobyte " */
-/*                                          "(with suffix K)\n" */
-/*                                          "<baud rate>   Baudrate in kilobyte or megabyte\n" */
-/*                                          "Available options:\n" */
-/*                                          "-S tos: Specify IPv4/6 type of service\n" */
-/*                                          "-a: Asynchronous call (shell will not block for the upload)\n" */
-/* #ifdef CONFIG_NET_CONTEXT_PRIORITY */
-/*                                          "-p: Specify custom packet priority\n" */
-/* #endif // CONFIG_NET_CONTEXT_PRIORITY */
-/*                                          "Example: udp upload2 v4 1 1K 1M\n" */
-/*                                          "Example: udp upload2 v6\n" */
-/* #if defined(CONFIG_NET_IPV6) && defined(MY_IP6ADDR_SET) */
-/*                                          "Default IPv6 address is " MY_IP6ADDR ", destination [" DST_IP6ADDR */
-/*                                          "]:" DEF_PORT_STR "\n" */
-/* #endif */
-/* #if defined(CONFIG_NET_IPV4) && defined(MY_IP4ADDR_SET) */
-/*                                          "Default IPv4 address is " MY_IP4ADDR ", destination " DST_IP4ADDR */
-/*                                          ":" DEF_PORT_STR "\n" */
-/* #endif */
-/*                                          , */
-/*                                          cmd_udp_upload2), */
-/*                                SHELL_CMD(download, zperf_cmd_udp_download, */
-/*                                          "[<port>]:  Server port to listen on/connect to\n" */
-/*                                          "[<host>]:  Bind to <host>, an interface address\n" */
-/*                                          "Example: udp download 5001 192.168.0.1\n", */
-/*                                          cmd_udp_download), */
-/*                                SHELL_SUBCMD_SET_END); */
-/**/
-/* SHELL_STATIC_SUBCMD_SET_CREATE(zperf_commands, SHELL_CMD(connectap, NULL, "Connect to AP", cmd_connectap), */
-/*                                SHELL_CMD(setip, NULL, */
-/*                                          "Set IP address\n" */
-/*                                          "<my ip> <prefix len>\n" */
-/*                                          "Example setip 2001:db8::2 64\n" */
-/*                                          "Example setip 192.0.2.2\n", */
-/*                                          cmd_setip), */
-/*                                SHELL_CMD(tcp, zperf_cmd_tcp, "Upload/Download TCP data", cmd_tcp), */
-/*                                SHELL_CMD(udp, zperf_cmd_udp, "Upload/Download UDP data", cmd_udp), */
-/*                                SHELL_CMD(version, NULL, "Zperf version", cmd_version), SHELL_SUBCMD_SET_END); */
-/**/
-/* SHELL_CMD_REGISTER(zperf, zperf_commands, "Zperf commands", NULL, 0, 0); */
+/* Destination of an upload, an IPv6 or IPv4 address, or v6 or v4 for the
+   default destination of the family */
+static int shell_parse_peer(const char *addr, const char *port, struct sockaddr_storage *peer)
+{
+    struct sockaddr_in6 ipv6 = in6_addr_dst;
+    struct sockaddr_in ipv4 = in4_addr_dst;
+    unsigned long value;
+    char *end;
 
-const char *const helpmessage = "Usage:\n \
-                                  udp_upload <address> <port> <duration> <packet size> <baud rate> - udp upload\n \
-                                  tcp_upload <address> <port> <duration> <packet size> <baud rate> - tcp upload\n \
-                                  udp_download <port> <address> \n \
-                                  tcp_download <port> <address> \n";
+    value = strtoul(port, &end, 10);
+    if ((*end != '\0') || (value == 0U) || (value > UINT16_MAX))
+    {
+        printf("Invalid port %s\n", port);
+        return -1;
+    }
 
-void shell_task(struct args *args)
-{
-    if (args->argc == 1)
+    if (!strcmp(addr, "v6") || (net_addr_pton(AF_INET6, addr, &ipv6.sin6_addr) >= 0))
+    {
+        ipv6.sin6_port = htons(value);
+        copy_sockaddr_in6_to_sockaddr_storage(&ipv6, peer);
+    }
+    else if (!strcmp(addr, "v4") || (net_addr_pton(AF_INET, addr, &ipv4.sin_addr) >= 0))
     {
-        printf("%s", helpmessage);
+        ipv4.sin_port = htons(value);
+        copy_sockaddr_in_to_sockaddr_storage(&ipv4, peer);
     }
     else
     {
-        int argc = --args->argc;
-        char **argv = args->argv + 1;
+        printf("Invalid address %s\n", addr);
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Keys of a step of a test plan */
+enum plan_key
+{
+    PLAN_PROTO,
+    PLAN_ADDR,
+    PLAN_PORT,
+    PLAN_DURATION,
+    PLAN_SIZE,
+    PLAN_RATE,
+    PLAN_TOS,
+    PLAN_KEYS
+};
+
+static const char *const plan_key_names[PLAN_KEYS] = {"proto", "addr", "port", "duration", "size", "rate", "tos"};
+
+/* Value of the keys a step leaves out, the same as for the upload commands.
+   The address has to be given. */
+static const char *const plan_key_defaults[PLAN_KEYS] = {"udp", NULL, DEF_PORT_STR, "1", "256", "10K", "0"};
+
+/* Most values swept by a key in one step */
+#define PLAN_VALUES_MAX 16
+
+/* Longest line of a test plan */
+#define PLAN_LINE_MAX 512
+
+#define PLAN_CSV_HEADER                                                                                                \
+    "test,line,proto,addr,port,duration_ms,size,rate_kbps,tos,result,sent,rcvd,lost,outorder,errors,jitter_us,"      \
+    "time_us,client_time_us,server_rate_kbps,client_rate_kbps\n"
 
-        if (!strcmp(argv[0], "udp_upload"))
+/* A line of a test plan, with the values of every key, pointing into the
+   line */
+struct plan_step
+{
+    const char *values[PLAN_KEYS][PLAN_VALUES_MAX];
+    int count[PLAN_KEYS];
+};
+
+/* Split line into step, returns 1 for a step, 0 for an empty or a comment
+   line and -1 on error */
+static int plan_parse_line(char *line, struct plan_step *step)
+{
+    char *word, *value, *save, *value_save;
+    bool given = false;
+    int key;
+
+    memset(step, 0, sizeof(*step));
+    line[strcspn(line, "#\r\n")] = '\0';
+
+    for (word = strtok_r(line, " \t", &save); word != NULL; word = strtok_r(NULL, " \t", &save))
+    {
+        value = strchr(word, '=');
+        if (value == NULL)
         {
-            shell_cmd_upload(NULL, argc, argv, nip_IPPROTO_UDP);
+            printf("Expected key=value: %s\n", word);
+            return -1;
         }
-        else if (!strcmp(argv[0], "tcp_upload"))
+        *value++ = '\0';
+
+        for (key = 0; (key < PLAN_KEYS) && strcmp(word, plan_key_names[key]); key++)
         {
-            shell_cmd_upload(NULL, argc, argv, nip_IPPROTO_TCP);
         }
-        else if (!strcmp(argv[0], "udp_download"))
+        if (key == PLAN_KEYS)
         {
-            cmd_udp_download(NULL, argc, argv);
+            printf("Unknown key: %s\n", word);
+            return -1;
         }
-        else if (!strcmp(argv[0], "tcp_download"))
+
+        /* The last list of a key given twice wins */
+        step->count[key] = 0;
+        for (value = strtok_r(value, ",", &value_save); value != NULL; value = strtok_r(NULL, ",", &value_save))
         {
-            cmd_tcp_download(NULL, argc, argv);
+            if (step->count[key] == PLAN_VALUES_MAX)
+            {
+                printf("More than %d values for %s\n", PLAN_VALUES_MAX, word);
+                return -1;
+            }
+            step->values[key][step->count[key]++] = value;
         }
-        else
+        if (step->count[key] == 0)
         {
-            printf("Unknown command\n");
-            printf("%s", helpmessage);
+            printf("No value for %s\n", word);
+            return -1;
         }
+        given = true;
     }
+
+    if (!given)
+    {
+        return 0;
+    }
+
+    for (key = 0; key < PLAN_KEYS; key++)
+    {
+        if (step->count[key] != 0)
+        {
+            continue;
+        }
+        if (plan_key_defaults[key] == NULL)
+        {
+            printf("Missing %s\n", plan_key_names[key]);
+            return -1;
+        }
+        step->values[key][0] = plan_key_defaults[key];
+        step->count[key] = 1;
+    }
+
+    return 1;
+}
+
+/* Upload parameters of the test at the index idx of every key of step */
+static int plan_params(const struct plan_step *step, const int *idx, struct zperf_upload_params *param, bool *is_udp)
+{
+    const char *proto = step->values[PLAN_PROTO][idx[PLAN_PROTO]];
+    const char *addr = step->values[PLAN_ADDR][idx[PLAN_ADDR]];
+    const char *port = step->values[PLAN_PORT][idx[PLAN_PORT]];
+    const char *tos = step->values[PLAN_TOS][idx[PLAN_TOS]];
+    unsigned long value;
+    char *end;
+
+    memset(param, 0, sizeof(*param));
+
+    if (!strcmp(proto, "udp") || !strcmp(proto, "tcp"))
+    {
+        *is_udp = !strcmp(proto, "udp");
+    }
+    else
+    {
+        printf("Unknown protocol: %s\n", proto);
+        return -1;
+    }
+
+    if (shell_parse_peer(addr, port, &param->peer_addr) < 0)
+    {
+        return -1;
+    }
+
+    param->duration_ms = MSEC_PER_SEC * strtoul(step->values[PLAN_DURATION][idx[PLAN_DURATION]], NULL, 10);
+    param->packet_size = parse_number(step->values[PLAN_SIZE][idx[PLAN_SIZE]], K, K_UNIT);
+    param->rate_kbps = (parse_number(step->values[PLAN_RATE][idx[PLAN_RATE]], K, K_UNIT) + 1023) / 1024;
+    if ((param->duration_ms == 0U) || (param->packet_size == 0U) || (param->rate_kbps == 0U))
+    {
+        printf("Duration, size and rate can not be 0\n");
+        return -1;
+    }
+
+    value = strtoul(tos, &end, 0);
+    if ((*end != '\0') || (value > UINT8_MAX))
+    {
+        printf("Invalid TOS %s\n", tos);
+        return -1;
+    }
+    param->options.tos = value;
+
+    return 0;
+}
+
+static uint32_t plan_rate_kbps(uint64_t bytes, uint32_t time_in_us)
+{
+    if (time_in_us == 0U)
+    {
+        return 0U;
+    }
+
+    return (uint32_t)((bytes * 8U * USEC_PER_SEC) / ((uint64_t)time_in_us * 1024U));
+}
+
+static void plan_print_row(FILE *out, int test, int line, const struct plan_step *step, const int *idx,
+                           const struct zperf_upload_params *param, bool is_udp, int ret,
+                           const struct zperf_results *results)
+{
+    /* Only UDP gets a report of the server */
+    uint32_t server_rate = is_udp ? plan_rate_kbps(results->total_len, results->time_in_us) : 0U;
+    uint32_t client_rate = plan_rate_kbps((uint64_t)results->nb_packets_sent * results->packet_size,
+                                          results->client_time_in_us);
+
+    fprintf(out, "%d,%d,%s,%s,%s,%u,%u,%u,%u,%d,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u\n", test, line,
+            step->values[PLAN_PROTO][idx[PLAN_PROTO]], step->values[PLAN_ADDR][idx[PLAN_ADDR]],
+            step->values[PLAN_PORT][idx[PLAN_PORT]], param->duration_ms, param->packet_size, param->rate_kbps,
+            param->options.tos, ret, results->nb_packets_sent, results->nb_packets_rcvd, results->nb_packets_lost,
+            results->nb_packets_outorder, results->nb_packets_errors, results->jitter_in_us, results->time_in_us,
+            results->client_time_in_us, server_rate, client_rate);
+    fflush(out);
+}
+
+/* Run every combination of the values of step, the last key sweeps the
+   fastest, test counts the tests of the plan. Without out the parameters
+   are only checked. */
+static int plan_run_step(const struct plan_step *step, int line, int *test, FILE *out, FILE *csv)
+{
+    int idx[PLAN_KEYS] = {0};
+    struct zperf_upload_params param;
+    struct zperf_results results;
+    bool is_udp;
+    int key, ret;
+
+    do
+    {
+        if (plan_params(step, idx, &param, &is_udp) < 0)
+        {
+            return -1;
+        }
+        (*test)++;
+
+        if (out != NULL)
+        {
+            memset(&results, 0, sizeof(results));
+            ret = is_udp ? zperf_udp_upload(&param, &results) : zperf_tcp_upload(&param, &results);
+
+            plan_print_row(out, *test, line, step, idx, &param, is_udp, ret, &results);
+            if (csv != NULL)
+            {
+                plan_print_row(csv, *test, line, step, idx, &param, is_udp, ret, &results);
+            }
+        }
+
+        for (key = PLAN_KEYS - 1; key >= 0; key--)
+        {
+            if (++idx[key] < step->count[key])
+            {
+                break;
+            }
+            idx[key] = 0;
+        }
+    } while (key >= 0);
+
+    return 0;
+}
+
+static shell_status_t cmd_plan(const shell_handle_t sh, size_t argc, char *argv[])
+{
+    static char line[PLAN_LINE_MAX];
+    static struct plan_step step;
+    FILE *plan, *csv = NULL;
+    int pass, test, lineno, ret = 0;
+
+    if (argc < 2)
+    {
+        printf("Usage: plan <file> [<csv file>]\n");
+        return -kStatus_SHELL_Error;
+    }
+
+    plan = fopen(argv[1], "r");
+    if (plan == NULL)
+    {
+        printf("Can't open %s\n", argv[1]);
+        return -kStatus_SHELL_Error;
+    }
+
+    /* The whole plan is checked before the first test runs */
+    for (pass = 0; (pass < 2) && (ret >= 0); pass++)
+    {
+        rewind(plan);
+        test = 0;
+        lineno = 0;
+
+        while ((ret >= 0) && (fgets(line, sizeof(line), plan) != NULL))
+        {
+            lineno++;
+            if ((strchr(line, '\n') == NULL) && !feof(plan))
+            {
+                printf("Line longer than %d characters\n", PLAN_LINE_MAX - 1);
+                ret = -1;
+                break;
+            }
+
+            ret = plan_parse_line(line, &step);
+            if (ret > 0)
+            {
+                ret = plan_run_step(&step, lineno, &test, (pass == 0) ? NULL : stdout, csv);
+            }
+        }
+
+        if (ret < 0)
+        {
+            printf("%s:%d: invalid step\n", argv[1], lineno);
+        }
+        else if (pass == 0)
+        {
+            if ((argc > 2) && ((csv = fopen(argv[2], "w")) == NULL))
+            {
+                printf("Can't create %s\n", argv[2]);
+                ret = -1;
+                break;
+            }
+            printf("Running %d tests from %s\n", test, argv[1]);
+            printf("%s", PLAN_CSV_HEADER);
+            if (csv != NULL)
+            {
+                fprintf(csv, "%s", PLAN_CSV_HEADER);
+            }
+        }
+    }
+
+    fclose(plan);
+    if (csv != NULL)
+    {
+        fclose(csv);
+    }
+
+    return (ret < 0) ? -kStatus_SHELL_Error : kStatus_SHELL_Success;
+}
+
+/* Most packet sizes searched by one command */
+#define SEARCH_SIZES_MAX 16
+
+/* Value of the option at argv[*i], joined to it or the next argument */
+static const char *parse_value(size_t *i, size_t argc, char *argv[])
+{
+    if (argv[*i][2] != '\0')
+    {
+        return argv[*i] + 2;
+    }
+
+    return (*i + 1 < argc) ? argv[++*i] : "";
+}
+
+static void search_probe_cb(const struct zperf_search_probe *probe, void *user_data)
+{
+    const shell_handle_t sh = user_data;
+
+    printf(" ");
+    print_number(sh, probe->rate_kbps, KBPS, KBPS_UNIT);
+    printf(" trial %u:\tsent %u, received %u, loss %u.%04u%%\t%s\n", probe->trial + 1U,
+           probe->results->nb_packets_sent, probe->results->nb_packets_rcvd, probe->loss_ppm / 10000U,
+           probe->loss_ppm % 10000U, probe->passed ? "pass" : "fail");
+}
+
+static shell_status_t cmd_udp_search(const shell_handle_t sh, size_t argc, char *argv[])
+{
+    struct zperf_search_params param = {0};
+    struct zperf_search_results results[SEARCH_SIZES_MAX];
+    uint16_t sizes[SEARCH_SIZES_MAX];
+    int nb_sizes = 0;
+    char *size, *save;
+    size_t i;
+    int ret;
+
+    param.upload.options.priority = -1;
+    param.trials = 1U;
+
+    for (i = 1; (i < argc) && (*argv[i] == '-'); i++)
+    {
+        switch (argv[i][1])
+        {
+        case 'S': {
+            int tos = parse_arg(&i, argc, argv);
+
+            if (tos < 0 || tos > UINT8_MAX)
+            {
+                printf("Parse error: %s\n", argv[i]);
+                return -kStatus_SHELL_Error;
+            }
+
+            param.upload.options.tos = tos;
+            break;
+        }
+
+        case 'n': {
+            int trials = parse_arg(&i, argc, argv);
+
+            if (trials <= 0 || trials > UINT8_MAX)
+            {
+                printf("Parse error: %s\n", argv[i]);
+                return -kStatus_SHELL_Error;
+            }
+
+            param.trials = trials;
+            break;
+        }
+
+        case 'l': {
+            /* Percent, with decimals */
+            const char *str = parse_value(&i, argc, argv);
+            char *end;
+            double loss = strtod(str, &end);
+
+            if ((end == str) || (*end != '\0') || (loss < 0.0) || (loss > 100.0))
+            {
+                printf("Parse error: %s\n", argv[i]);
+                return -kStatus_SHELL_Error;
+            }
+
+            param.loss_ppm = (uint32_t)(loss * 10000.0 + 0.5);
+            break;
+        }
+
+        case 'e':
+            param.resolution_kbps = (parse_number(parse_value(&i, argc, argv), K, K_UNIT) + 1023) / 1024;
+            if (param.resolution_kbps == 0U)
+            {
+                printf("Parse error: %s\n", argv[i]);
+                return -kStatus_SHELL_Error;
+            }
+            break;
+
+        default:
+            printf("Unrecognized argument: %s\n", argv[i]);
+            return -kStatus_SHELL_Error;
+        }
+    }
+
+    if (argc - i < 5)
+    {
+        printf("Usage: udp_search [-l loss] [-n trials] [-e resolution] [-S tos] "
+               "<address> <port> <duration> <sizes> <max rate>\n");
+        return -kStatus_SHELL_Error;
+    }
+
+    if (shell_parse_peer(argv[i], argv[i + 1], &param.upload.peer_addr) < 0)
+    {
+        return -kStatus_SHELL_Error;
+    }
+
+    param.upload.duration_ms = MSEC_PER_SEC * strtoul(argv[i + 2], NULL, 10);
+    param.upload.rate_kbps = (parse_number(argv[i + 4], K, K_UNIT) + 1023) / 1024;
+    if ((param.upload.duration_ms == 0U) || (param.upload.rate_kbps == 0U))
+    {
+        printf("Duration and rate can not be 0\n");
+        return -kStatus_SHELL_Error;
+    }
+    if (param.resolution_kbps == 0U)
+    {
+        param.resolution_kbps = param.upload.rate_kbps / 100U;
+    }
+
+    for (size = strtok_r(argv[i + 3], ",", &save); size != NULL; size = strtok_r(NULL, ",", &save))
+    {
+        long value = parse_number(size, K, K_UNIT);
+
+        if ((value <= 0) || (value > PACKET_SIZE_MAX) || (nb_sizes == SEARCH_SIZES_MAX))
+        {
+            printf("Invalid packet size %s, or more than %d sizes\n", size, SEARCH_SIZES_MAX);
+            return -kStatus_SHELL_Error;
+        }
+        sizes[nb_sizes++] = value;
+    }
+
+    for (i = 0; i < (size_t)nb_sizes; i++)
+    {
+        printf("Packet size %u bytes\n", sizes[i]);
+        param.upload.packet_size = sizes[i];
+        ret = zperf_udp_search(&param, &results[i], search_probe_cb, (void *)sh);
+        if (ret < 0)
+        {
+            printf("UDP search failed (%d)\n", ret);
+            return ret;
+        }
+    }
+
+    printf("-\nThroughput, loss up to %u.%04u%%, %u trials:\n", param.loss_ppm / 10000U, param.loss_ppm % 10000U,
+           param.trials);
+    printf("Size\tRate\t\tReceived\tFrames/s\tLoss\t\tTrials\n");
+    for (i = 0; i < (size_t)nb_sizes; i++)
+    {
+        printf("%u\t", sizes[i]);
+        print_number(sh, results[i].rate_kbps, KBPS, KBPS_UNIT);
+        printf("\t");
+        print_number(sh, results[i].throughput_kbps, KBPS, KBPS_UNIT);
+        printf("\t%u\t\t%u.%04u%%\t%u\n", results[i].frames_per_sec, results[i].loss_ppm / 10000U,
+               results[i].loss_ppm % 10000U, results[i].probes);
+    }
+
+    return kStatus_SHELL_Success;
+}
+
+static void ramp_step_cb(const struct zperf_ramp_step *step, void *user_data)
+{
+    const shell_handle_t sh = user_data;
+
+    printf("%u\t", step->step + 1U);
+    print_number(sh, step->rate_kbps, KBPS, KBPS_UNIT);
+    printf("\t");
+    print_number(sh, step->throughput_kbps, KBPS, KBPS_UNIT);
+    printf("\t%u.%04u%%\t", step->loss_ppm / 10000U, step->loss_ppm % 10000U);
+    print_number(sh, step->jitter_us, TIME_US, TIME_US_UNIT);
+    printf("\t%s\n", (step->ret < 0) ? "no report" : step->saturated ? "saturated" : "");
+}
+
+static shell_status_t cmd_udp_ramp(const shell_handle_t sh, size_t argc, char *argv[])
+{
+    struct zperf_ramp_params param = {0};
+    struct zperf_ramp_results results;
+    size_t i;
+    int steps;
+    int ret;
+
+    param.upload.options.priority = -1;
+    /* 0.1% */
+    param.loss_ppm = 1000U;
+
+    for (i = 1; (i < argc) && (*argv[i] == '-'); i++)
+    {
+        switch (argv[i][1])
+        {
+        case 'S': {
+            int tos = parse_arg(&i, argc, argv);
+
+            if (tos < 0 || tos > UINT8_MAX)
+            {
+                printf("Parse error: %s\n", argv[i]);
+                return -kStatus_SHELL_Error;
+            }
+
+            param.upload.options.tos = tos;
+            break;
+        }
+
+        case 's': {
+            int settle = parse_arg(&i, argc, argv);
+
+            if (settle < 0)
+            {
+                printf("Parse error: %s\n", argv[i]);
+                return -kStatus_SHELL_Error;
+            }
+
+            param.settle_ms = settle;
+            break;
+        }
+
+        case 'l': {
+            /* Percent, with decimals */
+            const char *str = parse_value(&i, argc, argv);
+            char *end;
+            double loss = strtod(str, &end);
+
+            if ((end == str) || (*end != '\0') || (loss < 0.0) || (loss > 100.0))
+            {
+                printf("Parse error: %s\n", argv[i]);
+                return -kStatus_SHELL_Error;
+            }
+
+            param.loss_ppm = (uint32_t)(loss * 10000.0 + 0.5);
+            break;
+        }
+
+        default:
+            printf("Unrecognized argument: %s\n", argv[i]);
+            return -kStatus_SHELL_Error;
+        }
+    }
+
+    if (argc - i < 7)
+    {
+        printf("Usage: udp_ramp [-l loss] [-s settle] [-S tos] "
+               "<address> <port> <step duration> <packet size> <start rate> <end rate> <steps>\n");
+        return -kStatus_SHELL_Error;
+    }
+
+    if (shell_parse_peer(argv[i], argv[i + 1], &param.upload.peer_addr) < 0)
+    {
+        return -kStatus_SHELL_Error;
+    }
+
+    param.upload.duration_ms = MSEC_PER_SEC * strtoul(argv[i + 2], NULL, 10);
+    param.upload.packet_size = parse_number(argv[i + 3], K, K_UNIT);
+    param.upload.rate_kbps = (parse_number(argv[i + 4], K, K_UNIT) + 1023) / 1024;
+    param.end_kbps = (parse_number(argv[i + 5], K, K_UNIT) + 1023) / 1024;
+    steps = strtol(argv[i + 6], NULL, 10);
+    if ((param.upload.duration_ms == 0U) || (param.upload.rate_kbps == 0U) ||
+        (param.end_kbps < param.upload.rate_kbps) || (steps < 2) || (steps > UINT16_MAX))
+    {
+        printf("Duration and start rate can not be 0, the end rate can not be lower, 2 steps at least\n");
+        return -kStatus_SHELL_Error;
+    }
+    param.steps = steps;
+
+    printf("Step\tRate\t\tReceived\tLoss\t\tJitter\n");
+    ret = zperf_udp_ramp(&param, &results, ramp_step_cb, (void *)sh);
+    if (ret < 0)
+    {
+        printf("UDP ramp failed (%d)\n", ret);
+        return ret;
+    }
+
+    printf("-\nHighest rate received:\t");
+    print_number(sh, results.max_throughput_kbps, KBPS, KBPS_UNIT);
+    printf("\n");
+    if (results.knee_step < 0)
+    {
+        printf("Saturated from the first step\n");
+    }
+    else
+    {
+        printf("Knee:\t\t\tstep %d, ", results.knee_step + 1);
+        print_number(sh, results.knee_kbps, KBPS, KBPS_UNIT);
+        printf(" offered, ");
+        print_number(sh, results.knee_throughput_kbps, KBPS, KBPS_UNIT);
+        printf(" received%s\n", results.saturated ? "" : ", no step saturated");
+    }
+
+    return kStatus_SHELL_Success;
+}
+
+static void sweep_step_cb(const struct zperf_sweep_step *step, void *user_data)
+{
+    const shell_handle_t sh = user_data;
+
+    printf("%u\t%u\t\t", step->step + 1U, step->bytes);
+    print_number(sh, step->throughput_kbps, KBPS, KBPS_UNIT);
+    if (step->ret < 0)
+    {
+        printf("\tfailed (%d)\n", step->ret);
+    }
+    else
+    {
+        printf("\t%u\n", step->bytes_per_mbps);
+    }
+}
+
+static shell_status_t cmd_tcp_sweep(const shell_handle_t sh, size_t argc, char *argv[])
+{
+    struct zperf_sweep_params param = {0};
+    struct zperf_sweep_results results;
+    long start, end;
+    size_t i;
+    int ret;
+
+    param.upload.options.priority = -1;
+
+    for (i = 1; (i < argc) && (*argv[i] == '-'); i++)
+    {
+        switch (argv[i][1])
+        {
+        case 'S': {
+            int tos = parse_arg(&i, argc, argv);
+
+            if (tos < 0 || tos > UINT8_MAX)
+            {
+                printf("Parse error: %s\n", argv[i]);
+                return -kStatus_SHELL_Error;
+            }
+
+            param.upload.options.tos = tos;
+            break;
+        }
+
+        case 's': {
+            int settle = parse_arg(&i, argc, argv);
+
+            if (settle < 0)
+            {
+                printf("Parse error: %s\n", argv[i]);
+                return -kStatus_SHELL_Error;
+            }
+
+            param.settle_ms = settle;
+            break;
+        }
+
+        case 'n':
+            param.upload.options.tcp_nodelay = 1;
+            break;
+
+        default:
+            printf("Unrecognized argument: %s\n", argv[i]);
+            return -kStatus_SHELL_Error;
+        }
+    }
+
+    if (argc - i < 6)
+    {
+        printf("Usage: tcp_sweep [-s settle] [-n] [-S tos] "
+               "<address> <port> <step duration> <packet size> <start buffer> <end buffer>\n");
+        return -kStatus_SHELL_Error;
+    }
+
+    if (shell_parse_peer(argv[i], argv[i + 1], &param.upload.peer_addr) < 0)
+    {
+        return -kStatus_SHELL_Error;
+    }
+
+    param.upload.duration_ms = MSEC_PER_SEC * strtoul(argv[i + 2], NULL, 10);
+    param.upload.packet_size = parse_number(argv[i + 3], K, K_UNIT);
+    start = parse_number(argv[i + 4], K, K_UNIT);
+    end = parse_number(argv[i + 5], K, K_UNIT);
+    if ((param.upload.duration_ms == 0U) || (param.upload.packet_size == 0U) || (start <= 0) || (end < start) ||
+        (end > TCP_SND_BUF))
+    {
+        printf("Duration, packet size and start buffer can not be 0, the end buffer can not be lower, "
+               "nor above %d bytes\n",
+               TCP_SND_BUF);
+        return -kStatus_SHELL_Error;
+    }
+    param.start_bytes = start;
+    param.end_bytes = end;
+
+    printf("Step\tBuffer\t\tThroughput\tBytes/Mbps\n");
+    ret = zperf_tcp_sweep(&param, &results, sweep_step_cb, (void *)sh);
+    if (ret < 0)
+    {
+        printf("TCP sweep failed (%d)\n", ret);
+        return ret;
+    }
+
+    printf("-\nHighest throughput:\t");
+    print_number(sh, results.max_throughput_kbps, KBPS, KBPS_UNIT);
+    printf("\n");
+    if (results.max_throughput_kbps != 0U)
+    {
+        printf("Knee:\t\t\t%u bytes, ", results.knee_bytes);
+        print_number(sh, results.knee_throughput_kbps, KBPS, KBPS_UNIT);
+        printf(" (90%% of the highest)\n");
+    }
+
+    return kStatus_SHELL_Success;
+}
+
+static shell_status_t cmd_exit(const shell_handle_t sh, size_t argc, char *argv[])
+{
+    /* Flushes the output and writes the trace, as Ctrl-C does */
+    exit(0);
+
+    return kStatus_SHELL_Success;
+}
+
+static shell_status_t cmd_help(const shell_handle_t sh, size_t argc, char *argv[]);
+
+/* Command tables of the shell, after the SHELL_STATIC_SUBCMD_SET_CREATE()
+   tables of the Zephyr zperf shell. An entry has subcommands, a handler or
+   both, a table ends with an entry without name. */
+struct shell_cmd_entry
+{
+    const char *name;
+    const struct shell_cmd_entry *subcmds;
+    const char *help;
+    shell_status_t (*handler)(const shell_handle_t sh, size_t argc, char *argv[]);
+};
+
+static const struct shell_cmd_entry zperf_cmd_tcp_download[] = {
+    {"stop", NULL, "Stop TCP server", cmd_tcp_download_stop},
+    {NULL, NULL, NULL, NULL},
+};
+
+static const struct shell_cmd_entry zperf_cmd_tcp[] = {
+    {"upload", NULL,
+     "[<options>] <dest ip> <dest port> <duration> <packet size>[K] <baud rate>[K|M]",
+     cmd_tcp_upload},
+    {"upload2", NULL, "[<options>] v6|v4 <duration> <packet size>[K] <baud rate>[K|M]", cmd_tcp_upload2},
+    {"download", zperf_cmd_tcp_download, "[<options>] <port> [<host>]", cmd_tcp_download},
+    {"sweep", NULL, "[<options>] <dest ip> <dest port> <step duration> <packet size>[K] <start buffer>[K] <end buffer>[K]",
+     cmd_tcp_sweep},
+    {NULL, NULL, NULL, NULL},
+};
+
+static const struct shell_cmd_entry zperf_cmd_udp_download[] = {
+    {"stop", NULL, "[<ports>] Close ports, or stop UDP server", cmd_udp_download_stop},
+    {NULL, NULL, NULL, NULL},
+};
+
+static const struct shell_cmd_entry zperf_cmd_udp[] = {
+    {"upload", NULL,
+     "[<options>] <dest ip> <dest port> <duration> <packet size>[K] <baud rate>[K|M]",
+     cmd_udp_upload},
+    {"upload2", NULL, "[<options>] v6|v4 <duration> <packet size>[K] <baud rate>[K|M]", cmd_udp_upload2},
+    {"download", zperf_cmd_udp_download, "[<options>] <ports> [<host>]", cmd_udp_download},
+    {"search", NULL, "[<options>] <dest ip> <dest port> <duration> <sizes> <max rate>[K|M]", cmd_udp_search},
+    {"ramp", NULL, "[<options>] <dest ip> <dest port> <step duration> <packet size>[K] <start rate>[K|M] <end rate>[K|M] <steps>",
+     cmd_udp_ramp},
+    {NULL, NULL, NULL, NULL},
+};
+
+static const struct shell_cmd_entry zperf_cmd_iperf3_download[] = {
+    {"stop", NULL, "Stop iperf3 server", cmd_iperf3_download_stop},
+    {NULL, NULL, NULL, NULL},
+};
+
+static const struct shell_cmd_entry zperf_cmd_iperf3[] = {
+    {"download", zperf_cmd_iperf3_download, "[<port>] [<host>]", cmd_iperf3_download},
+    {NULL, NULL, NULL, NULL},
+};
+
+static const struct shell_cmd_entry zperf_commands[] = {
+    {"setip", NULL, "<my ip> [<prefix len>] Add an address to the interface", cmd_setip},
+    {"tcp", zperf_cmd_tcp, "Upload/Download TCP data", NULL},
+    {"udp", zperf_cmd_udp, "Upload/Download UDP data", NULL},
+    {"iperf3", zperf_cmd_iperf3, "iperf3 server", NULL},
+    {"plan", NULL, "<file> [<csv file>] Run a test plan", cmd_plan},
+    {"version", NULL, "Zperf version", cmd_version},
+    {"help", NULL, "Show the usage", cmd_help},
+    {"exit", NULL, "Leave zperf", cmd_exit},
+    {"quit", NULL, "Leave zperf", cmd_exit},
+    {NULL, NULL, NULL, NULL},
+};
+
+const char *const helpmessage = "Usage:\n \
+                                  udp_upload [-V seed] [-m profile] [-b packets/period|-O on/off] [-E] [-d|-r] [-D port] [-T ttl] [-L] [-3] <address> <port> <duration> <packet size> <baud rate> - udp upload\n \
+                                  tcp_upload [-V seed] [-w buffer] [-i interval] [-d|-r|-Z] [-D port] [-3] <address> <port> <duration> <packet size> <baud rate> - tcp upload\n \
+                                  udp_download [-V seed] [-B packets] [-w buffer] <ports> <address> - a multicast address joins the group\n \
+                                  udp_download_stop [ports] - close ports, or stop the UDP server\n \
+                                  tcp_download [-V seed] [-w buffer] <port> <address> \n \
+                                  tcp_download_stop - stop the TCP server\n \
+                                  iperf3_download [port] [address] - iperf3 server, port 5201 by default\n \
+                                  iperf3_download_stop - stop the iperf3 server\n \
+                                  udp_search [-l loss] [-n trials] [-e resolution] [-S tos] <address> <port> <duration> <sizes> <max rate> - highest rate losing up to loss percent\n \
+                                  udp_ramp [-l loss] [-s settle] [-S tos] <address> <port> <step duration> <packet size> <start rate> <end rate> <steps> - knee of the rate received\n \
+                                  tcp_sweep [-s settle] [-n] [-S tos] <address> <port> <step duration> <packet size> <start buffer> <end buffer> - throughput of send buffers doubling from start to end\n \
+                                  plan <file> [csv file] - run the uploads of a test plan, one result row per test\n \
+                                  setip <address> [prefix len] - add an address to the interface, the prefix length for IPv6\n \
+                                  version, help, exit\n \
+                                  -V seed: send or verify a payload pattern generated from seed (> 0)\n \
+                                  -d, -D port: the server sends back at the same time, to the port of the test or to port\n \
+                                  -r: the server sends back once the upload is over, -Z: only a zperf server sends, on the same connection\n \
+                                  -3: test against an iperf3 server\n \
+                                  -b packets/period, -O on/off: bursts of packets every period ms, or on ms at the rate every on + off ms; rate 0 sends them back to back\n \
+                                  -E: Poisson arrivals, exponential gaps between packets or bursts; -B packets: loss of every burst of that many packets\n \
+                                  -m profile: packet sizes instead of <packet size>, imix, <min>-<max> or a file of <size> <weight> lines\n \
+                                  -w buffer: send buffer of a TCP upload, receive window of a TCP server or SO_RCVBUF of a UDP server, in bytes\n \
+                                  -i interval: sample cwnd, ssthresh, windows, RTT and retransmits of a TCP upload every interval ms\n \
+                                  -T ttl, -L: TTL or hop limit of multicast datagrams, get a copy on this host\n \
+                                  ports: a port, a range or a list, e.g. 5001-5004,6000; run again to add ports\n \
+                                  Commands are run one after the other when separated by a ';' argument\n \
+                                  Without a command, or after them with --interactive, commands are read from the standard input,\n \
+                                  a line at a time; the words of a command may also be given apart, e.g. udp download stop 5001\n";
+
+static shell_status_t cmd_help(const shell_handle_t sh, size_t argc, char *argv[])
+{
+    printf("%s", helpmessage);
+
+    return kStatus_SHELL_Success;
+}
+
+static void shell_print_cmds(const struct shell_cmd_entry *table)
+{
+    for (; table->name != NULL; table++)
+    {
+        printf("  %-10s %s\n", table->name, table->help);
+    }
+}
+
+/* Entry of table whose name starts word, followed by the end of the word or
+   by '_', where the name of a subcommand may follow */
+static const struct shell_cmd_entry *shell_find_cmd(const struct shell_cmd_entry *table, const char *word,
+                                                     const char **rest)
+{
+    size_t len;
+
+    for (; table->name != NULL; table++)
+    {
+        len = strlen(table->name);
+        if (!strncmp(word, table->name, len) && ((word[len] == '\0') || (word[len] == '_')))
+        {
+            *rest = word + len;
+            return table;
+        }
+    }
+
+    return NULL;
+}
+
+/* Run a single command. Its words may be separate arguments or joined with
+   '_' (udp download stop, udp_download_stop), the handler gets the word of
+   the command as argv[0], followed by the arguments. */
+static shell_status_t shell_exec(int argc, char **argv)
+{
+    const struct shell_cmd_entry *table = zperf_commands;
+    const struct shell_cmd_entry *cmd = NULL;
+    const struct shell_cmd_entry *sub;
+    const char *word = argv[0];
+    const char *rest = "";
+    int start = 0;
+    int next = 0;
+
+    while ((table != NULL) && (word != NULL) && ((sub = shell_find_cmd(table, word, &rest)) != NULL))
+    {
+        cmd = sub;
+        start = next;
+        table = cmd->subcmds;
+        if (*rest == '_')
+        {
+            word = rest + 1;
+        }
+        else
+        {
+            word = (++next < argc) ? argv[next] : NULL;
+        }
+    }
+
+    /* Nothing found, or an unknown subcommand joined to the command */
+    if ((cmd == NULL) || (next == start && word != NULL))
+    {
+        printf("Unknown command: %s\n", argv[0]);
+        printf("Type help for the usage\n");
+        return -kStatus_SHELL_Error;
+    }
+
+    if (cmd->handler == NULL)
+    {
+        printf("%s: missing subcommand\n", cmd->name);
+        shell_print_cmds(cmd->subcmds);
+        return -kStatus_SHELL_Error;
+    }
+
+    return cmd->handler(NULL, argc - start, argv + start);
+}
+
+/* Run the commands of argv, separated by ";" arguments */
+static void shell_exec_list(int argc, char **argv)
+{
+    int len;
+
+    while (argc > 0)
+    {
+        for (len = 0; (len < argc) && strcmp(argv[len], ";"); len++)
+        {
+        }
+        if (len > 0)
+        {
+            shell_exec(len, argv);
+        }
+        argc -= (len < argc) ? len + 1 : len;
+        argv += len + 1;
+    }
+}
+
+/* Most words in a command line of the interactive shell */
+#define SHELL_ARGC_MAX 32
+
+/* Read commands from the standard input until its end, a line may hold
+   several commands separated by ';' */
+static void shell_interactive(void)
+{
+    static char line[ZPERF_CONSOLE_LINE_MAX];
+    char *argv[SHELL_ARGC_MAX];
+    char *cmd, *word, *cmd_save, *word_save;
+    int argc;
+
+    while (zperf_console_read_line("zperf> ", line, sizeof(line)) >= 0)
+    {
+        for (cmd = strtok_r(line, ";", &cmd_save); cmd != NULL; cmd = strtok_r(NULL, ";", &cmd_save))
+        {
+            argc = 0;
+            for (word = strtok_r(cmd, " \t", &word_save); (word != NULL) && (argc < (int)ARRAY_SIZE(argv));
+                 word = strtok_r(NULL, " \t", &word_save))
+            {
+                argv[argc++] = word;
+            }
+
+            if (word != NULL)
+            {
+                printf("Too many arguments\n");
+            }
+            else if (argc > 0)
+            {
+                shell_exec(argc, argv);
+            }
+        }
+    }
+}
+
+void shell_task(struct args *args)
+{
+    /* e.g. a download and an upload to it over --netif pair */
+    shell_exec_list(args->argc - 1, args->argv + 1);
+
+    if ((args->argc == 1) || args->interactive)
+    {
+        shell_interactive();
+    }
+
+    /* Receivers keep running in the background after the end of the input,
+       without a spinning shell the idle task gets to run */
     while (1)
     {
-        continue;
+        k_sleep(K_FOREVER);
     }
 }
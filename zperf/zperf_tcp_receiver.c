@@ -16,8 +16,13 @@ LOG_MODULE_DECLARE(net_zperf, CONFIG_NET_ZPERF_LOG_LEVEL);
 #include <zephyr/net/socket.h>
 #include <zperf.h>
 
+#include "lwip/api.h"
+#include "lwip/pbuf.h"
+
 #include "zperf_internal.h"
 #include "zperf_session.h"
+#include "zperf_pattern.h"
+#include "FreeRTOSTrace.h"
 
 /* To get net_sprint_ipv{4|6}_addr() */
 #define NET_LOG_ENABLED 1
@@ -35,9 +40,19 @@ LOG_MODULE_DECLARE(net_zperf, CONFIG_NET_ZPERF_LOG_LEVEL);
 #define SOCK_ID_IPV6_LISTEN 1
 #define SOCK_ID_MAX         (CONFIG_NET_ZPERF_MAX_SESSIONS + 2)
 
-#define TCP_RECEIVER_BUF_SIZE 1500
 #define POLL_TIMEOUT_MS 100
 
+/* Bytes read before the window is given back to the sender, which is also
+ * done once nothing is left to read. lwIP only announces a larger window
+ * from TCP_WND_UPDATE_THRESHOLD on.
+ */
+#define TCP_RECEIVER_RECVD_BATCH TCP_WND_UPDATE_THRESHOLD
+
+/* Return values of tcp_receive() */
+#define TCP_RECEIVE_MORE  0
+#define TCP_RECEIVE_EOF   1
+#define TCP_RECEIVE_TAKEN 2
+
 static K_THREAD_STACK_DEFINE(tcp_receiver_stack_area, TCP_RECEIVER_STACK_SIZE);
 static struct k_thread tcp_receiver_thread_data;
 
@@ -49,17 +64,62 @@ static uint16_t tcp_server_port;
 static struct sockaddr_storage tcp_server_addr;
 static K_SEM_DEFINE(tcp_server_run, 0, 1);
 
-static void tcp_received(const struct sockaddr *addr, size_t datalen)
+static bool tcp_pattern_enabled;
+static struct zperf_pattern tcp_pattern;
+static uint32_t tcp_rcvbuf;
+
+/* The stream starts with the client header, see tcp_upload() */
+#define TCP_PATTERN_START sizeof(struct zperf_client_hdr_v1)
+
+static void check_payload(struct session *session, const uint8_t *data,
+			  size_t datalen)
+{
+	struct zperf_integrity *integrity = &session->integrity;
+	uint64_t offset = session->length;
+	size_t first = 0;
+	uint32_t corrupt;
+
+	if (offset < TCP_PATTERN_START) {
+		size_t skip = MIN(TCP_PATTERN_START - offset, datalen);
+
+		data += skip;
+		datalen -= skip;
+		offset += skip;
+	}
+
+	corrupt = zperf_pattern_check(&tcp_pattern, offset, data, datalen,
+				      &first);
+	integrity->bytes_checked += datalen;
+
+	if (corrupt == 0U) {
+		return;
+	}
+
+	if (integrity->corrupt_bytes == 0U) {
+		integrity->first_mismatch = offset + first;
+		NET_WARN("Corrupt payload at stream offset %llu",
+			 (unsigned long long)(offset + first));
+	}
+
+	integrity->corrupt_bytes += corrupt;
+	integrity->corrupt_chunks++;
+}
+
+/* Returns true when sock has been taken over for a reverse test */
+static bool tcp_received(int sock, const struct sockaddr *addr,
+			 const uint8_t *data, size_t datalen)
 {
 	struct session *session;
 	int64_t time;
 
+	vTraceInstant("tcp_received", datalen);
+
 	time = k_uptime_ticks();
 
 	session = get_session(addr, SESSION_TCP);
 	if (!session) {
 		NET_ERR("Cannot get a session!");
-		return;
+		return false;
 	}
 
 	switch (session->state) {
@@ -68,14 +128,37 @@ static void tcp_received(const struct sockaddr *addr, size_t datalen)
 		zperf_reset_session_stats(session);
 		session->start_time = k_uptime_ticks();
 		session->state = STATE_ONGOING;
+		zperf_cpu_stats_begin(&session->cpu);
+
+		/* The header comes in the first segment of the stream */
+		if (datalen >= sizeof(session->client_hdr)) {
+			memcpy(&session->client_hdr, data,
+			       sizeof(session->client_hdr));
+		} else {
+			memset(&session->client_hdr, 0,
+			       sizeof(session->client_hdr));
+		}
+
+		/* Nothing is received on a reverse test, only sent */
+		if (zperf_dual_reverse(sock, &session->client_hdr)) {
+			session->state = STATE_COMPLETED;
+			return true;
+		}
 
 		if (tcp_session_cb != NULL) {
 			tcp_session_cb(ZPERF_SESSION_STARTED, NULL,
 				       tcp_user_data);
 		}
 
+		zperf_dual_reply(addr, &session->client_hdr, IPPROTO_TCP,
+				 false);
+
 		__fallthrough;
 	case STATE_ONGOING:
+		if (tcp_pattern_enabled) {
+			check_payload(session, data, datalen);
+		}
+
 		session->counter++;
 		session->length += datalen;
 
@@ -87,16 +170,23 @@ static void tcp_received(const struct sockaddr *addr, size_t datalen)
 			results.total_len = session->length;
 			results.time_in_us = k_ticks_to_us_ceil32(
 						time - session->start_time);
+			zperf_cpu_stats_end(&session->cpu, &results.cpu);
+			results.integrity = session->integrity;
 
 			if (tcp_session_cb != NULL) {
 				tcp_session_cb(ZPERF_SESSION_FINISHED, &results,
 					       tcp_user_data);
 			}
+
+			zperf_dual_reply(addr, &session->client_hdr,
+					 IPPROTO_TCP, true);
 		}
 		break;
 	default:
 		NET_ERR("Unsupported case");
 	}
+
+	return false;
 }
 
 static int tcp_bind_listen_connection(zsock_pollfd *pollfd,
@@ -138,9 +228,75 @@ static void tcp_session_error_report(void)
 	}
 }
 
+/* Read what is queued on a connection without copying it: the pbufs of the
+ * stack are counted, checked in place and freed, and the window is given
+ * back in batches. A window at most is read per call, so the other
+ * connections get their turn. Returns TCP_RECEIVE_EOF once the connection
+ * is over, TCP_RECEIVE_TAKEN when it has been taken over for a reverse
+ * test.
+ */
+static int tcp_receive(int sock, const struct sockaddr *addr)
+{
+	struct netconn *conn = zperf_tcp_conn(sock);
+	struct pbuf *p;
+	size_t total = 0;
+	size_t recvd = 0;
+	err_t err = ERR_ARG;
+
+	while (conn != NULL && total < TCP_WND) {
+		const struct pbuf *q;
+		bool taken = false;
+
+		err = netconn_recv_tcp_pbuf_flags(conn, &p,
+						  NETCONN_DONTBLOCK |
+						  NETCONN_NOAUTORCVD);
+		if (err != ERR_OK) {
+			break;
+		}
+
+		for (q = p; q != NULL && !taken; q = q->next) {
+			if (q->len != 0U) {
+				taken = tcp_received(sock, addr, q->payload,
+						     q->len);
+			}
+		}
+		recvd += p->tot_len;
+		total += p->tot_len;
+		pbuf_free(p);
+
+		if (taken) {
+			netconn_tcp_recvd(conn, recvd);
+			return TCP_RECEIVE_TAKEN;
+		}
+
+		if (recvd >= TCP_RECEIVER_RECVD_BATCH) {
+			netconn_tcp_recvd(conn, recvd);
+			recvd = 0;
+		}
+	}
+
+	if (recvd != 0U) {
+		netconn_tcp_recvd(conn, recvd);
+	}
+
+	/* Poll tells about the rest */
+	if (err == ERR_WOULDBLOCK || err == ERR_OK) {
+		return TCP_RECEIVE_MORE;
+	}
+
+	if (err != ERR_CLSD) {
+		NET_ERR("recv failed on IPv%d socket (%d)",
+			(addr->sa_family == AF_INET ? 4 : 6), err);
+		tcp_session_error_report();
+	}
+
+	/* This will close the zperf session */
+	return tcp_received(sock, addr, NULL, 0) ? TCP_RECEIVE_TAKEN :
+						   TCP_RECEIVE_EOF;
+}
+
 static void tcp_server_session(void)
 {
-	static uint8_t buf[TCP_RECEIVER_BUF_SIZE];
 	static zsock_pollfd fds[SOCK_ID_MAX];
 	static struct sockaddr_storage sock_addr[SOCK_ID_MAX];
 	int ret;
@@ -298,6 +454,11 @@ use_any_ipv6:
 					NET_ERR("Dropping TCP connection, reached maximum limit.");
 					zsock_close(sock);
 				} else {
+					if (tcp_rcvbuf != 0U &&
+					    zperf_set_tcp_buffers(sock, 0U, tcp_rcvbuf) < 0) {
+						NET_WARN("Failed to set the receive window");
+					}
+
 					fds[j].fd = sock;
 					fds[j].events = ZSOCK_POLLIN;
 					memcpy(&sock_addr[j],
@@ -305,20 +466,14 @@ use_any_ipv6:
 					       addrlen);
 				}
 			} else if ((i > SOCK_ID_IPV6_LISTEN) && (i < SOCK_ID_MAX)) {
-				ret = zsock_recv(fds[i].fd, buf, sizeof(buf), 0);
-				if (ret < 0) {
-					NET_ERR("recv failed on IPv%d socket (%d)",
-						(sock_addr[i].ss_family == AF_INET
-							? 4 : 6),
-						errno);
-					tcp_session_error_report();
-					/* This will close the zperf session */
-					ret = 0;
-				}
-
-				tcp_received((struct sockaddr*)(&sock_addr[i]), ret);
-
-				if (ret == 0) {
+				ret = tcp_receive(fds[i].fd,
+						  (struct sockaddr*)(&sock_addr[i]));
+				if (ret == TCP_RECEIVE_TAKEN) {
+					/* The uploader closes it */
+					fds[i].fd = -1;
+					memset(&sock_addr[i], 0,
+					sizeof(struct sockaddr_storage));
+				} else if (ret == TCP_RECEIVE_EOF) {
 					zsock_close(fds[i].fd);
 					fds[i].fd = -1;
 					memset(&sock_addr[i], 0,
@@ -392,6 +547,12 @@ int zperf_tcp_download(const struct zperf_download_params *param,
 	tcp_server_stop = false;
 	memcpy(&tcp_server_addr, &param->addr, sizeof(struct sockaddr));
 
+	tcp_pattern_enabled = (param->pattern_seed != 0U);
+	if (tcp_pattern_enabled) {
+		zperf_pattern_init(&tcp_pattern, param->pattern_seed);
+	}
+	tcp_rcvbuf = param->rcvbuf;
+
 	k_sem_give(&tcp_server_run);
 
 	return 0;
@@ -16,11 +16,15 @@ LOG_MODULE_DECLARE(net_zperf, CONFIG_NET_ZPERF_LOG_LEVEL);
 #include <zperf.h>
 
 #include "zperf_internal.h"
+#include "zperf_cpu_stats.h"
+#include "zperf_pattern.h"
 
 static char sample_packet[PACKET_SIZE_MAX];
 
 static struct zperf_async_upload_context tcp_async_upload_ctx;
 
+static struct zperf_pattern tcp_pattern;
+
 static ssize_t sendall(int sock, const void *buf, size_t len)
 {
 	while (len) {
@@ -39,15 +43,68 @@ static ssize_t sendall(int sock, const void *buf, size_t len)
 	return 0;
 }
 
-static int tcp_upload(int sock,
-		      unsigned int duration_in_ms,
-		      unsigned int packet_size,
+/* Add a sample to the summary of the upload, cwnd_sum keeps the mean */
+static void tcp_sample_add(struct zperf_tcp_stats *stats, uint64_t *cwnd_sum,
+			   const struct zperf_tcp_sample *sample)
+{
+	if (stats->samples == 0U) {
+		stats->cwnd_min = sample->cwnd;
+		stats->ssthresh_min = sample->ssthresh;
+	} else if (sample->cwnd < stats->last.cwnd) {
+		stats->cwnd_drops++;
+	}
+
+	stats->cwnd_min = MIN(stats->cwnd_min, sample->cwnd);
+	stats->cwnd_max = MAX(stats->cwnd_max, sample->cwnd);
+	stats->ssthresh_min = MIN(stats->ssthresh_min, sample->ssthresh);
+	stats->srtt_max_ms = MAX(stats->srtt_max_ms, sample->srtt_ms);
+	stats->rto_max_ms = MAX(stats->rto_max_ms, sample->rto_ms);
+	stats->nrtx_max = MAX(stats->nrtx_max, sample->nrtx);
+	stats->limit[sample->limit]++;
+
+	*cwnd_sum += sample->cwnd;
+	stats->samples++;
+	stats->cwnd_mean = (uint32_t)(*cwnd_sum / stats->samples);
+	stats->last = *sample;
+}
+
+/* Sample the connection and hand the sample to the callback of the upload */
+static void tcp_sample(int sock, const struct zperf_upload_params *param,
+		       int64_t start_time, struct zperf_tcp_stats *stats,
+		       uint64_t *cwnd_sum)
+{
+	struct zperf_tcp_sample sample;
+
+	if (zperf_tcp_sample(sock, &sample) < 0) {
+		return;
+	}
+	sample.time_us = k_ticks_to_us_ceil32(k_uptime_ticks() - start_time);
+
+	tcp_sample_add(stats, cwnd_sum, &sample);
+
+	if (param->options.sample_cb != NULL) {
+		param->options.sample_cb(&sample,
+					 param->options.sample_user_data);
+	}
+}
+
+static int tcp_upload(int sock, enum zperf_wire wire,
+		      const struct zperf_upload_params *param,
+		      const struct zperf_pattern *pattern,
 		      struct zperf_results *results)
 {
+	struct zperf_client_hdr_v1 hdr;
+	unsigned int duration_in_ms = param->duration_ms;
+	unsigned int packet_size = param->packet_size;
 	k_timepoint_t end = sys_timepoint_calc(K_MSEC(duration_in_ms));
 	int64_t start_time, end_time;
 	uint32_t nb_packets = 0U, nb_errors = 0U;
 	uint32_t alloc_errors = 0U;
+	struct zperf_cpu_sample cpu;
+	struct zperf_tcp_stats stats = { 0 };
+	uint64_t cwnd_sum = 0U;
+	int64_t sample_ticks = 0, next_sample = 0;
+	uint64_t offset = 0U;
 	int ret = 0;
 
 	if (packet_size > PACKET_SIZE_MAX) {
@@ -57,17 +114,40 @@ static int tcp_upload(int sock,
 	}
 
 	/* Start the loop */
+	zperf_cpu_stats_begin(&cpu);
 	start_time = k_uptime_ticks();
+	if (param->options.sample_ms != 0U) {
+		sample_ticks = MAX(k_ms_to_ticks_ceil32(param->options.sample_ms), 1U);
+		next_sample = start_time + sample_ticks;
+	}
 
 	(void)memset(sample_packet, 'z', sizeof(sample_packet));
 
-	/* Set the "flags" field in start of the packet to be 0.
-	 * As the protocol is not properly described anywhere, it is
-	 * not certain if this is a proper thing to do.
+	/* An iperf2 stream starts with the client header, its flags tell
+	 * the server whether to send back.
 	 */
-	(void)memset(sample_packet, 0, sizeof(uint32_t));
+	if (wire == ZPERF_WIRE_IPERF2) {
+		zperf_client_hdr_fill(&hdr, IPPROTO_TCP, param->options.dual,
+				      param->options.dual_port,
+				      packet_size, 0U, duration_in_ms);
+		ret = sendall(sock, &hdr, sizeof(hdr));
+		if (ret < 0) {
+			NET_ERR("Failed to send the header (%d)", errno);
+			return -errno;
+		}
+
+		offset = sizeof(hdr);
+	}
 
 	do {
+		/* The pattern covers the whole stream but the header */
+		if (pattern != NULL) {
+			zperf_pattern_fill(pattern, offset,
+					   (uint8_t *)sample_packet,
+					   packet_size);
+			offset += packet_size;
+		}
+
 		/* Send the packet */
 		ret = sendall(sock, sample_packet, packet_size);
 		if (ret < 0) {
@@ -92,6 +172,14 @@ static int tcp_upload(int sock,
 			nb_packets++;
 		}
 
+		if (sample_ticks != 0 && k_uptime_ticks() >= next_sample) {
+			tcp_sample(sock, param, start_time, &stats, &cwnd_sum);
+			/* A send that blocked for long skips the samples missed */
+			while (next_sample <= k_uptime_ticks()) {
+				next_sample += sample_ticks;
+			}
+		}
+
 #if defined(CONFIG_ARCH_POSIX)
 		k_busy_wait(100 * USEC_PER_MSEC);
 #else
@@ -100,7 +188,12 @@ static int tcp_upload(int sock,
 
 	} while (!sys_timepoint_expired(end));
 
+	/* The state the upload ends in, whether sampled or not */
+	tcp_sample(sock, param, start_time, &stats, &cwnd_sum);
+	results->tcp = stats;
+
 	end_time = k_uptime_ticks();
+	zperf_cpu_stats_end(&cpu, &results->cpu);
 
 	/* Add result coming from the client */
 	results->nb_packets_sent = nb_packets;
@@ -125,10 +218,36 @@ static int tcp_upload(int sock,
 	return 0;
 }
 
+int zperf_tcp_upload_sock(int sock, const struct zperf_upload_params *param,
+			  enum zperf_wire wire, struct zperf_results *result)
+{
+	const struct zperf_pattern *pattern = NULL;
+
+	if (param->options.tcp_nodelay &&
+	    zsock_setsockopt(sock, IPPROTO_TCP, TCP_NODELAY,
+			     &param->options.tcp_nodelay,
+			     sizeof(param->options.tcp_nodelay)) != 0) {
+		NET_WARN("Failed to set IPPROTO_TCP - TCP_NODELAY socket option.");
+		return -EINVAL;
+	}
+
+	if (param->options.sndbuf != 0U &&
+	    zperf_set_tcp_buffers(sock, param->options.sndbuf, 0U) < 0) {
+		NET_WARN("Failed to set the send buffer.");
+		return -EINVAL;
+	}
+
+	if (param->options.pattern_seed != 0U) {
+		zperf_pattern_init(&tcp_pattern, param->options.pattern_seed);
+		pattern = &tcp_pattern;
+	}
+
+	return tcp_upload(sock, wire, param, pattern, result);
+}
+
 int zperf_tcp_upload(const struct zperf_upload_params *param,
 		     struct zperf_results *result)
 {
-
 	int sock;
 	int ret;
 
@@ -142,15 +261,7 @@ int zperf_tcp_upload(const struct zperf_upload_params *param,
 		return sock;
 	}
 
-	if (param->options.tcp_nodelay &&
-	    zsock_setsockopt(sock, IPPROTO_TCP, TCP_NODELAY,
-			     &param->options.tcp_nodelay,
-			     sizeof(param->options.tcp_nodelay)) != 0) {
-		NET_WARN("Failed to set IPPROTO_TCP - TCP_NODELAY socket option.");
-		return -EINVAL;
-	}
-
-	ret = tcp_upload(sock, param->duration_ms, param->packet_size, result);
+	ret = zperf_tcp_upload_sock(sock, param, ZPERF_WIRE_IPERF2, result);
 
 	zsock_close(sock);
 
@@ -167,7 +278,15 @@ static void tcp_upload_async_work(struct k_work *work)
 	upload_ctx->callback(ZPERF_SESSION_STARTED, NULL,
 			     upload_ctx->user_data);
 
-	ret = zperf_tcp_upload(&upload_ctx->param, &result);
+	if (upload_ctx->sock >= 0) {
+		ret = zperf_tcp_upload_sock(upload_ctx->sock,
+					    &upload_ctx->param,
+					    ZPERF_WIRE_IPERF2, &result);
+		zsock_close(upload_ctx->sock);
+	} else {
+		ret = zperf_tcp_upload(&upload_ctx->param, &result);
+	}
+
 	if (ret < 0) {
 		upload_ctx->callback(ZPERF_SESSION_ERROR, NULL,
 				     upload_ctx->user_data);
@@ -179,6 +298,13 @@ static void tcp_upload_async_work(struct k_work *work)
 
 int zperf_tcp_upload_async(const struct zperf_upload_params *param,
 			   zperf_callback callback, void *user_data)
+{
+	return zperf_tcp_upload_sock_async(-1, param, callback, user_data);
+}
+
+int zperf_tcp_upload_sock_async(int sock,
+				const struct zperf_upload_params *param,
+				zperf_callback callback, void *user_data)
 {
 	if (param == NULL || callback == NULL) {
 		return -EINVAL;
@@ -189,6 +315,7 @@ int zperf_tcp_upload_async(const struct zperf_upload_params *param,
 	}
 
 	memcpy(&tcp_async_upload_ctx.param, param, sizeof(*param));
+	tcp_async_upload_ctx.sock = sock;
 	tcp_async_upload_ctx.callback = callback;
 	tcp_async_upload_ctx.user_data = user_data;
 
@@ -4,6 +4,7 @@
  * SPDX-License-Identifier: Apache-2.0
  */
 
+#include <limits.h>
 #include <stdio.h>
 #include <zephyr/logging/log.h>
 LOG_MODULE_DECLARE(net_zperf, CONFIG_NET_ZPERF_LOG_LEVEL);
@@ -18,6 +19,8 @@ LOG_MODULE_DECLARE(net_zperf, CONFIG_NET_ZPERF_LOG_LEVEL);
 
 #include "zperf_internal.h"
 #include "zperf_session.h"
+#include "zperf_pattern.h"
+#include "FreeRTOSTrace.h"
 
 /* To get net_sprint_ipv{4|6}_addr() */
 #define NET_LOG_ENABLED 1
@@ -41,17 +44,44 @@ static struct sockaddr_in *in4_addr_my;
 #define UDP_RECEIVER_BUF_SIZE 1500
 #define POLL_TIMEOUT_MS 100
 
+/* Packets giving the reference transit time, not in the histogram */
+#define TRANSIT_WARMUP_PACKETS 16
+
 static K_THREAD_STACK_DEFINE(udp_receiver_stack_area, UDP_RECEIVER_STACK_SIZE);
 static struct k_thread udp_receiver_thread_data;
 
+#define UDP_PORTS_MAX ZPERF_MAX_PORTS
+
+/* A server port with its sockets and sessions, used by the receiver thread */
+struct udp_port {
+	uint16_t port; /* 0 if unused */
+	int fd[SOCK_ID_MAX];
+	struct session sessions[SESSION_MAX];
+};
+
+static struct udp_port udp_ports[UDP_PORTS_MAX];
+
 static zperf_callback udp_session_cb;
 static void *udp_user_data;
 static bool udp_server_running;
 static bool udp_server_stop;
-static uint16_t udp_server_port;
 static struct sockaddr_storage udp_server_addr;
 static K_SEM_DEFINE(udp_server_run, 0, 1);
 
+/* Ports requested by the application, applied by the receiver thread */
+static K_SEM_DEFINE(udp_server_lock, 1, 1);
+static uint16_t udp_server_ports[UDP_PORTS_MAX];
+static int udp_server_num_ports;
+static bool udp_server_reconfig;
+
+static bool udp_pattern_enabled;
+static struct zperf_pattern udp_pattern;
+
+/* Packets per burst of the senders, 0 if unknown */
+static uint32_t udp_burst_packets;
+/* SO_RCVBUF of the sockets opened, 0 for the default */
+static int udp_rcvbuf;
+
 static inline void build_reply(struct zperf_udp_datagram *hdr,
 			       struct zperf_server_hdr *stat,
 			       uint8_t *buf)
@@ -100,15 +130,83 @@ static int zperf_receiver_send_stat(int sock, const struct sockaddr *addr,
 	return ret;
 }
 
-static void udp_received(int sock, const struct sockaddr *addr, uint8_t *data,
+static void record_latency(struct session *session, uint64_t arrival_us,
+			   const struct zperf_udp_datagram *hdr)
+{
+	int32_t transit;
+
+	/* Only the variation of the transit time is meaningful, measure it
+	 * from the fastest of the first packets. A moving minimum would
+	 * shift the samples recorded before it was reached.
+	 */
+	transit = (int32_t)((uint32_t)arrival_us -
+			    (ntohl(hdr->tv_sec) * USEC_PER_SEC +
+			     ntohl(hdr->tv_usec)));
+	if (session->counter <= TRANSIT_WARMUP_PACKETS) {
+		if (transit < session->min_transit_us) {
+			session->min_transit_us = transit;
+		}
+	} else {
+		/* A faster packet later on is as fast as it gets */
+		zperf_histogram_record(&session->transit_hist,
+				       (transit > session->min_transit_us) ?
+				       (uint32_t)transit -
+				       (uint32_t)session->min_transit_us : 0U);
+	}
+
+	zperf_histogram_record(&session->gap_hist,
+			       (uint32_t)MIN(arrival_us -
+					     session->last_arrival_us,
+					     UINT32_MAX));
+	session->last_arrival_us = arrival_us;
+}
+
+static void check_payload(struct session *session, uint32_t id,
+			  const uint8_t *data, size_t datalen)
+{
+	struct zperf_integrity *integrity = &session->integrity;
+	size_t first = 0;
+	uint32_t corrupt;
+
+	if (datalen <= UDP_PAYLOAD_OFFSET) {
+		return;
+	}
+
+	corrupt = zperf_pattern_check(&udp_pattern,
+				      zperf_pattern_udp_offset(id),
+				      data + UDP_PAYLOAD_OFFSET,
+				      datalen - UDP_PAYLOAD_OFFSET, &first);
+	integrity->bytes_checked += datalen - UDP_PAYLOAD_OFFSET;
+
+	if (corrupt == 0U) {
+		return;
+	}
+
+	if (integrity->corrupt_bytes == 0U) {
+		integrity->first_mismatch = UDP_PAYLOAD_OFFSET + first;
+		integrity->first_mismatch_id = id;
+		NET_WARN("Corrupt payload in packet %u at byte %zu", id,
+			 UDP_PAYLOAD_OFFSET + first);
+	}
+
+	integrity->corrupt_bytes += corrupt;
+	integrity->corrupt_chunks++;
+}
+
+static void udp_received(struct udp_port *uport, int sock,
+			 const struct sockaddr *addr, uint8_t *data,
 			 size_t datalen)
 {
+	struct zperf_results results;
 	struct zperf_udp_datagram *hdr;
 	struct session *session;
 	int32_t transit_time;
+	uint64_t arrival_us;
 	int64_t time;
 	int32_t id;
 
+	vTraceInstant("udp_received", datalen);
+
 	if (datalen < sizeof(struct zperf_udp_datagram)) {
 		NET_WARN("Short iperf packet!");
 		return;
@@ -116,8 +214,9 @@ static void udp_received(int sock, const struct sockaddr *addr, uint8_t *data,
 
 	hdr = (struct zperf_udp_datagram *)data;
 	time = k_uptime_ticks();
+	arrival_us = k_cyc_to_us_floor64(k_cycle_get_64());
 
-	session = get_session(addr, SESSION_UDP);
+	session = get_session_in(uport->sessions, SESSION_MAX, addr);
 	if (!session) {
 		NET_ERR("Cannot get a session!");
 		return;
@@ -138,27 +237,53 @@ static void udp_received(int sock, const struct sockaddr *addr, uint8_t *data,
 			}
 		} else {
 			zperf_reset_session_stats(session);
+			session->seq.tx_burst_len = udp_burst_packets;
 			session->state = STATE_ONGOING;
 			session->start_time = time;
+			session->last_arrival_us = arrival_us;
+			zperf_cpu_stats_begin(&session->cpu);
 
 			/* Start a new session! */
 			if (udp_session_cb != NULL) {
-				udp_session_cb(ZPERF_SESSION_STARTED, NULL,
+				memset(&results, 0, sizeof(results));
+				results.port = uport->port;
+				udp_session_cb(ZPERF_SESSION_STARTED, &results,
 					       udp_user_data);
 			}
+
+			/* Kept for a tradeoff test, answered at the end */
+			if (datalen >= UDP_PAYLOAD_OFFSET) {
+				memcpy(&session->client_hdr,
+				       data + sizeof(*hdr),
+				       sizeof(session->client_hdr));
+			} else {
+				memset(&session->client_hdr, 0,
+				       sizeof(session->client_hdr));
+			}
+
+			zperf_dual_reply(addr, &session->client_hdr,
+					 IPPROTO_UDP, false);
 		}
 		break;
 	case STATE_ONGOING:
 		if (id < 0) { /* Negative id means session end. */
-			struct zperf_results results = { 0 };
 			uint32_t duration;
 
+			memset(&results, 0, sizeof(results));
+			results.port = uport->port;
+
 			duration = k_ticks_to_us_ceil32(time -
 							session->start_time);
 
 			/* Update state machine */
 			session->state = STATE_COMPLETED;
 
+			/* The last packet carries the number of packets sent */
+			zperf_seq_tracker_finish(&session->seq, (uint32_t)-id,
+						 &results.seq);
+			session->error = results.seq.lost;
+			session->outorder = results.seq.reordered;
+
 			/* Fill statistics */
 			session->stat.flags = 0x80000000;
 			session->stat.total_len1 = session->length >> 32;
@@ -184,19 +309,30 @@ static void udp_received(int sock, const struct sockaddr *addr, uint8_t *data,
 			results.time_in_us = duration;
 			results.jitter_in_us = session->jitter;
 			results.packet_size = session->length / session->counter;
+			zperf_cpu_stats_end(&session->cpu, &results.cpu);
+			zperf_histogram_summarize(&session->transit_hist,
+						  &results.transit);
+			zperf_histogram_summarize(&session->gap_hist,
+						  &results.gap);
+			results.integrity = session->integrity;
+			results.sizes = session->sizes;
 
 			if (udp_session_cb != NULL) {
 				udp_session_cb(ZPERF_SESSION_FINISHED, &results,
 					       udp_user_data);
 			}
+
+			zperf_dual_reply(addr, &session->client_hdr,
+					 IPPROTO_UDP, true);
 		} else {
 			/* Update counter */
 			session->counter++;
 			session->length += datalen;
+			session->sizes.count[zperf_size_bucket(datalen)]++;
 
 			/* Compute jitter */
 			transit_time = time_delta(
-				k_ticks_to_us_ceil32(time),
+				(uint32_t)arrival_us,
 				ntohl(hdr->tv_sec) * USEC_PER_SEC +
 				ntohl(hdr->tv_usec));
 			if (session->last_transit_time != 0) {
@@ -213,16 +349,13 @@ static void udp_received(int sock, const struct sockaddr *addr, uint8_t *data,
 
 			session->last_transit_time = transit_time;
 
+			record_latency(session, arrival_us, hdr);
+
 			/* Check header id */
-			if (id != session->next_id) {
-				if (id < session->next_id) {
-					session->outorder++;
-				} else {
-					session->error += id - session->next_id;
-					session->next_id = id + 1;
-				}
-			} else {
-				session->next_id++;
+			zperf_seq_tracker_update(&session->seq, id);
+
+			if (udp_pattern_enabled) {
+				check_payload(session, id, data, datalen);
 			}
 		}
 		break;
@@ -231,28 +364,39 @@ static void udp_received(int sock, const struct sockaddr *addr, uint8_t *data,
 	}
 }
 
-static void udp_server_session(void)
+/* Datagrams beyond the buffer are dropped by the stack */
+static void udp_set_rcvbuf(int sock)
 {
-	static uint8_t buf[UDP_RECEIVER_BUF_SIZE];
-	zsock_pollfd fds[SOCK_ID_MAX] = { 0 };
+	if (udp_rcvbuf != 0 &&
+	    zsock_setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &udp_rcvbuf,
+			     sizeof(udp_rcvbuf)) != 0) {
+		NET_WARN("Failed to set SO_RCVBUF (%d)", errno);
+	}
+}
 
+/* Bind the IPv4 and IPv6 sockets of a port */
+static int udp_port_open(struct udp_port *uport, uint16_t port)
+{
 	int ret;
 
-	for (int i = 0; i < ARRAY_SIZE(fds); i++) {
-		fds[i].fd = -1;
+	uport->port = port;
+	for (int i = 0; i < SOCK_ID_MAX; i++) {
+		uport->fd[i] = -1;
 	}
+	zperf_session_table_init(uport->sessions, SESSION_MAX);
 
 	if (IS_ENABLED(CONFIG_NET_IPV4)) {
 		const struct in_addr *in4_addr = NULL;
 
 		in4_addr_my = zperf_get_sin();
 
-		fds[SOCK_ID_IPV4].fd = zsock_socket(AF_INET, SOCK_DGRAM,
-						    IPPROTO_UDP);
-		if (fds[SOCK_ID_IPV4].fd < 0) {
+		uport->fd[SOCK_ID_IPV4] = zsock_socket(AF_INET, SOCK_DGRAM,
+						       IPPROTO_UDP);
+		if (uport->fd[SOCK_ID_IPV4] < 0) {
 			NET_ERR("Cannot create IPv4 network socket.");
-			goto error;
+			return -errno;
 		}
+		udp_set_rcvbuf(uport->fd[SOCK_ID_IPV4]);
 
 		in4_addr = &net_sin((struct sockaddr*)(&udp_server_addr))->sin_addr;
 
@@ -275,19 +419,27 @@ use_any_ipv4:
 		NET_INFO("Binding to %s",
 			 net_sprint_ipv4_addr(&in4_addr_my->sin_addr));
 
-		in4_addr_my->sin_port = htons(udp_server_port);
+		in4_addr_my->sin_port = htons(port);
 
-		ret = zsock_bind(fds[SOCK_ID_IPV4].fd,
+		ret = zsock_bind(uport->fd[SOCK_ID_IPV4],
 				 (struct sockaddr *)in4_addr_my,
 				 sizeof(struct sockaddr_in));
 		if (ret < 0) {
 			NET_ERR("Cannot bind IPv4 UDP port %d (%d)",
 				ntohs(in4_addr_my->sin_port),
 				errno);
-			goto error;
+			return -errno;
 		}
 
-		fds[SOCK_ID_IPV4].events = ZSOCK_POLLIN;
+		/* Bound to a group, only its datagrams are received */
+		if (udp_server_addr.ss_family == AF_INET &&
+		    net_ipv4_is_addr_mcast(in4_addr)) {
+			ret = zperf_join_mcast_group(uport->fd[SOCK_ID_IPV4],
+				(struct sockaddr *)&udp_server_addr);
+			if (ret < 0) {
+				return ret;
+			}
+		}
 	}
 #if 1
 	if (IS_ENABLED(CONFIG_NET_IPV6)) {
@@ -295,12 +447,13 @@ use_any_ipv4:
 
 		in6_addr_my = zperf_get_sin6();
 
-		fds[SOCK_ID_IPV6].fd = zsock_socket(AF_INET6, SOCK_DGRAM,
-						    IPPROTO_UDP);
-		if (fds[SOCK_ID_IPV6].fd < 0) {
+		uport->fd[SOCK_ID_IPV6] = zsock_socket(AF_INET6, SOCK_DGRAM,
+						       IPPROTO_UDP);
+		if (uport->fd[SOCK_ID_IPV6] < 0) {
 			NET_ERR("Cannot create IPv4 network socket.");
-			goto error;
+			return -errno;
 		}
+		udp_set_rcvbuf(uport->fd[SOCK_ID_IPV6]);
 
 		in6_addr = &net_sin6((struct sockaddr*)(&udp_server_addr))->sin6_addr;
 
@@ -326,26 +479,168 @@ use_any_ipv6:
 		NET_INFO("Binding to %s",
 			 net_sprint_ipv6_addr(&in6_addr_my->sin6_addr));
 
-		in6_addr_my->sin6_port = htons(udp_server_port);
+		in6_addr_my->sin6_port = htons(port);
 
-		ret = zsock_bind(fds[SOCK_ID_IPV6].fd,
+		ret = zsock_bind(uport->fd[SOCK_ID_IPV6],
 				 (struct sockaddr *)in6_addr_my,
 				 sizeof(struct sockaddr_in6));
 		if (ret < 0) {
 			NET_ERR("Cannot bind IPv6 UDP port %d (%d)",
 				ntohs(in6_addr_my->sin6_port),
 				ret);
-			goto error;
+			return -errno;
 		}
 
-		fds[SOCK_ID_IPV6].events = ZSOCK_POLLIN;
+		if (udp_server_addr.ss_family == AF_INET6 &&
+		    net_ipv6_is_addr_mcast(in6_addr)) {
+			ret = zperf_join_mcast_group(uport->fd[SOCK_ID_IPV6],
+				(struct sockaddr *)&udp_server_addr);
+			if (ret < 0) {
+				return ret;
+			}
+		}
 	}
 #endif
-	NET_INFO("Listening on port %d", udp_server_port);
+	NET_INFO("Listening on port %d", port);
+
+	return 0;
+}
+
+static void udp_port_close(struct udp_port *uport)
+{
+	for (int i = 0; i < SOCK_ID_MAX; i++) {
+		if (uport->fd[i] >= 0) {
+			zsock_close(uport->fd[i]);
+			uport->fd[i] = -1;
+		}
+	}
+	uport->port = 0U;
+}
+
+/* Remove a port from the requested ones, returns false if it was not there */
+static bool udp_server_forget(uint16_t port)
+{
+	bool found = false;
+
+	k_sem_take(&udp_server_lock, K_FOREVER);
+	for (int i = 0; i < udp_server_num_ports; i++) {
+		if (udp_server_ports[i] == port) {
+			udp_server_ports[i] =
+				udp_server_ports[--udp_server_num_ports];
+			udp_server_reconfig = true;
+			found = true;
+			break;
+		}
+	}
+	k_sem_give(&udp_server_lock);
+
+	return found;
+}
+
+/* Close the ports removed and open the ports added since the last call */
+static void udp_server_apply(void)
+{
+	uint16_t ports[UDP_PORTS_MAX];
+	int num;
+
+	k_sem_take(&udp_server_lock, K_FOREVER);
+	num = udp_server_num_ports;
+	memcpy(ports, udp_server_ports, sizeof(ports));
+	udp_server_reconfig = false;
+	k_sem_give(&udp_server_lock);
+
+	for (int i = 0; i < UDP_PORTS_MAX; i++) {
+		int j;
+
+		if (udp_ports[i].port == 0U) {
+			continue;
+		}
+
+		for (j = 0; j < num && ports[j] != udp_ports[i].port; j++) {
+		}
+
+		if (j == num) {
+			NET_INFO("Closing port %d", udp_ports[i].port);
+			udp_port_close(&udp_ports[i]);
+		}
+	}
+
+	for (int j = 0; j < num; j++) {
+		struct udp_port *free = NULL;
+		int i;
+
+		for (i = 0; i < UDP_PORTS_MAX; i++) {
+			if (udp_ports[i].port == ports[j]) {
+				break;
+			}
+
+			if (free == NULL && udp_ports[i].port == 0U) {
+				free = &udp_ports[i];
+			}
+		}
+
+		if (i < UDP_PORTS_MAX || free == NULL) {
+			continue;
+		}
+
+		if (udp_port_open(free, ports[j]) < 0) {
+			udp_port_close(free);
+			udp_server_forget(ports[j]);
+			if (udp_session_cb != NULL) {
+				udp_session_cb(ZPERF_SESSION_ERROR, NULL,
+					       udp_user_data);
+			}
+		}
+	}
+}
+
+/* Poll all sockets of all ports, owner[] tells the port of each one */
+static int udp_server_pollfds(zsock_pollfd *fds, struct udp_port **owner)
+{
+	int nfds = 0;
+
+	for (int i = 0; i < UDP_PORTS_MAX; i++) {
+		for (int j = 0; j < SOCK_ID_MAX; j++) {
+			if (udp_ports[i].port == 0U || udp_ports[i].fd[j] < 0) {
+				continue;
+			}
+
+			fds[nfds].fd = udp_ports[i].fd[j];
+			fds[nfds].events = ZSOCK_POLLIN;
+			fds[nfds].revents = 0;
+			owner[nfds] = &udp_ports[i];
+			nfds++;
+		}
+	}
+
+	return nfds;
+}
+
+static void udp_server_session(void)
+{
+	static uint8_t buf[UDP_RECEIVER_BUF_SIZE];
+	zsock_pollfd fds[UDP_PORTS_MAX * SOCK_ID_MAX] = { 0 };
+	struct udp_port *owner[UDP_PORTS_MAX * SOCK_ID_MAX];
+	int nfds = 0;
+	int ret;
 
 	while (true) {
-		ret = zsock_poll(fds, ARRAY_SIZE(fds), POLL_TIMEOUT_MS);
-        
+		if (udp_server_stop) {
+			goto cleanup;
+		}
+
+		if (udp_server_reconfig) {
+			udp_server_apply();
+			nfds = udp_server_pollfds(fds, owner);
+			if (nfds == 0) {
+				/* Failed ports have been reported already */
+				NET_ERR("UDP receiver has no port left");
+				goto cleanup;
+			}
+		}
+
+		ret = zsock_poll(fds, nfds, POLL_TIMEOUT_MS);
+
 		if (ret < 0) {
 			NET_ERR("UDP receiver poll error (%d)", errno);
 			goto error;
@@ -359,30 +654,40 @@ use_any_ipv6:
 			continue;
 		}
 
-		for (int i = 0; i < ARRAY_SIZE(fds); i++) {
-			struct sockaddr addr;
+		for (int i = 0; i < nfds; i++) {
+			struct sockaddr_storage addr;
 			socklen_t addrlen = sizeof(addr);
 
 			if ((fds[i].revents & ZSOCK_POLLERR) ||
 			    (fds[i].revents & ZSOCK_POLLNVAL)) {
-				NET_ERR("UDP receiver IPv%d socket error",
-					(i == SOCK_ID_IPV4) ? 4 : 6);
-				goto error;
-			}
-
-			if (!(fds[i].revents & ZSOCK_POLLIN)) {
+				NET_ERR("UDP receiver port %d socket error",
+					owner[i]->port);
+				ret = -EIO;
+			} else if (!(fds[i].revents & ZSOCK_POLLIN)) {
 				continue;
+			} else {
+				ret = zsock_recvfrom(fds[i].fd, buf,
+						     sizeof(buf), 0,
+						     (struct sockaddr *)&addr,
+						     &addrlen);
+				if (ret < 0) {
+					NET_ERR("recv failed on port %d (%d)",
+						owner[i]->port, errno);
+				}
 			}
 
-			ret = zsock_recvfrom(fds[i].fd, buf, sizeof(buf), 0,
-					     &addr, &addrlen);
 			if (ret < 0) {
-				NET_ERR("recv failed on IPv%d socket (%d)",
-					(i == SOCK_ID_IPV4) ? 4 : 6, errno);
-				goto error;
+				/* Drop the port, the others keep running */
+				udp_server_forget(owner[i]->port);
+				if (udp_session_cb != NULL) {
+					udp_session_cb(ZPERF_SESSION_ERROR,
+						       NULL, udp_user_data);
+				}
+				break;
 			}
 
-			udp_received(fds[i].fd, &addr, buf, ret);
+			udp_received(owner[i], fds[i].fd,
+				     (struct sockaddr *)&addr, buf, ret);
 		}
 	}
 
@@ -392,11 +697,17 @@ error:
 	}
 
 cleanup:
-	for (int i = 0; i < ARRAY_SIZE(fds); i++) {
-		if (fds[i].fd >= 0) {
-			zsock_close(fds[i].fd);
+	for (int i = 0; i < UDP_PORTS_MAX; i++) {
+		if (udp_ports[i].port != 0U) {
+			udp_port_close(&udp_ports[i]);
 		}
 	}
+
+	/* A later zperf_udp_download() starts the server again */
+	k_sem_take(&udp_server_lock, K_FOREVER);
+	udp_server_num_ports = 0;
+	udp_server_running = false;
+	k_sem_give(&udp_server_lock);
 }
 
 static void udp_receiver_thread(void *ptr1)
@@ -411,13 +722,15 @@ static void udp_receiver_thread(void *ptr1)
 		k_sem_take(&udp_server_run, K_FOREVER);
 
 		udp_server_session();
-
-		udp_server_running = false;
 	}
 }
 
 void zperf_udp_receiver_init(void)
 {
+    k_sem_init(&udp_server_lock,
+               udp_server_lock.initial_count,
+               udp_server_lock.max_count);
+
     udp_receiver_thread_data.name = "reciever";
     udp_receiver_thread_data.task_hanble = handle;
 	k_thread_create(&udp_receiver_thread_data,
@@ -434,24 +747,75 @@ void zperf_udp_receiver_init(void)
 int zperf_udp_download(const struct zperf_download_params *param,
 		       zperf_callback callback, void *user_data)
 {
+	const uint16_t *ports;
+	int num_ports;
+	int added = 0;
+	bool start;
+	int ret = 0;
+
 	if (param == NULL || callback == NULL) {
 		return -EINVAL;
 	}
 
-	if (udp_server_running) {
-		return -EALREADY;
+	ports = (param->num_ports > 0U) ? param->ports : &param->port;
+	num_ports = (param->num_ports > 0U) ? param->num_ports : 1;
+
+	k_sem_take(&udp_server_lock, K_FOREVER);
+
+	for (int i = 0; i < num_ports; i++) {
+		int j;
+
+		for (j = 0; j < udp_server_num_ports &&
+			    udp_server_ports[j] != ports[i]; j++) {
+		}
+
+		if (j < udp_server_num_ports) {
+			continue;
+		}
+
+		if (udp_server_num_ports == UDP_PORTS_MAX) {
+			ret = -ENOMEM;
+			break;
+		}
+
+		udp_server_ports[udp_server_num_ports++] = ports[i];
+		added++;
 	}
 
-	udp_session_cb = callback;
-	udp_user_data  = user_data;
-	udp_server_port = param->port;
-	udp_server_running = true;
-	udp_server_stop = false;
-	memcpy(&udp_server_addr, &param->addr, sizeof(struct sockaddr));
+	/* Ports served already keep reporting where they did */
+	if (added > 0) {
+		udp_session_cb = callback;
+		udp_user_data  = user_data;
+		memcpy(&udp_server_addr, &param->addr,
+		       sizeof(udp_server_addr));
 
-	k_sem_give(&udp_server_run);
+		udp_pattern_enabled = (param->pattern_seed != 0U);
+		if (udp_pattern_enabled) {
+			zperf_pattern_init(&udp_pattern, param->pattern_seed);
+		}
+		udp_burst_packets = param->burst_packets;
+		udp_rcvbuf = (int)MIN(param->rcvbuf, (uint32_t)INT_MAX);
 
-	return 0;
+		udp_server_reconfig = true;
+	}
+
+	start = !udp_server_running && added > 0;
+	if (start) {
+		udp_server_running = true;
+		udp_server_stop = false;
+	}
+
+	k_sem_give(&udp_server_lock);
+
+	if (start) {
+		k_sem_give(&udp_server_run);
+	}
+
+	if (ret < 0) {
+		return ret;
+	}
+
+	return (added > 0) ? 0 : -EALREADY;
 }
 
 int zperf_udp_download_stop(void)
@@ -465,3 +829,17 @@ int zperf_udp_download_stop(void)
 
 	return 0;
 }
+
+int zperf_udp_download_stop_port(uint16_t port)
+{
+	if (!udp_server_running || !udp_server_forget(port)) {
+		return -ENOENT;
+	}
+
+	/* The server ends when its last port is gone */
+	if (udp_server_num_ports == 0) {
+		return zperf_udp_download_stop();
+	}
+
+	return 0;
+}
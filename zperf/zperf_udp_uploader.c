@@ -15,6 +15,8 @@ LOG_MODULE_DECLARE(net_zperf, CONFIG_NET_ZPERF_LOG_LEVEL);
 #include <zperf.h>
 
 #include "zperf_internal.h"
+#include "zperf_cpu_stats.h"
+#include "zperf_pattern.h"
 
 static uint8_t sample_packet[sizeof(struct zperf_udp_datagram) +
 			     sizeof(struct zperf_client_hdr_v1) +
@@ -22,6 +24,20 @@ static uint8_t sample_packet[sizeof(struct zperf_udp_datagram) +
 
 static struct zperf_async_upload_context udp_async_upload_ctx;
 
+static struct zperf_pattern udp_pattern;
+
+/* Receivers of a multicast upload which reported, by address */
+#define UDP_GROUP_RECEIVERS_MAX 16
+/* Reports of the other receivers are awaited this long after the last */
+#define UDP_GROUP_WAIT_MS 500
+
+static struct sockaddr_storage udp_group_receivers[UDP_GROUP_RECEIVERS_MAX];
+static struct zperf_results udp_group_report;
+
+/* Gaps of Poisson arrivals, built by the first upload using them */
+static uint16_t udp_exp_scale[ZPERF_EXP_SCHEDULE_LEN];
+static bool udp_exp_ready;
+
 static inline void zperf_upload_decode_stat(const uint8_t *data,
 					    size_t datalen,
 					    struct zperf_results *results)
@@ -47,7 +63,82 @@ static inline void zperf_upload_decode_stat(const uint8_t *data,
 		ntohl(UNALIGNED_GET(&stat->jitter1)) * USEC_PER_SEC;
 }
 
+static bool udp_same_receiver(const struct sockaddr *a,
+			      const struct sockaddr *b)
+{
+	if (a->sa_family != b->sa_family) {
+		return false;
+	}
+
+	if (a->sa_family == AF_INET) {
+		return net_sin(a)->sin_port == net_sin(b)->sin_port &&
+		       net_ipv4_addr_cmp(&net_sin(a)->sin_addr,
+					 &net_sin(b)->sin_addr);
+	}
+
+	return net_sin6(a)->sin6_port == net_sin6(b)->sin6_port &&
+	       net_ipv6_addr_cmp(&net_sin6(a)->sin6_addr,
+				 &net_sin6(b)->sin6_addr);
+}
+
+/* Every receiver of a group answers the end of a multicast upload. The
+ * first report fills results, each one is passed to the receiver callback
+ * of the upload, once per receiver.
+ */
+static void udp_group_add_report(const struct sockaddr_storage *addr,
+				 const uint8_t *data, size_t datalen,
+				 const struct zperf_upload_params *param,
+				 struct zperf_results *results)
+{
+	uint16_t i;
+
+	for (i = 0U; i < results->nb_receivers; i++) {
+		if (udp_same_receiver((const struct sockaddr *)addr,
+				      (const struct sockaddr *)
+				      &udp_group_receivers[i])) {
+			/* Answer to the end of test sent again */
+			return;
+		}
+	}
+
+	if (i == UDP_GROUP_RECEIVERS_MAX) {
+		NET_WARN("Too many receivers, a report is ignored");
+		return;
+	}
+
+	memcpy(&udp_group_receivers[i], addr, sizeof(*addr));
+	results->nb_receivers++;
+
+	if (i == 0U) {
+		zperf_upload_decode_stat(data, datalen, results);
+	}
+
+	if (param->options.receiver_cb != NULL) {
+		memset(&udp_group_report, 0, sizeof(udp_group_report));
+		zperf_upload_decode_stat(data, datalen, &udp_group_report);
+		param->options.receiver_cb((const struct sockaddr *)addr,
+					   &udp_group_report,
+					   param->options.receiver_user_data);
+	}
+}
+
+/* Send to the connected peer, or to group if it is a multicast upload */
+static int udp_send(int sock, const struct sockaddr *group,
+		    const void *data, size_t len)
+{
+	if (group == NULL) {
+		return zsock_send(sock, data, len, 0);
+	}
+
+	return zsock_sendto(sock, data, len, 0, group,
+			    (group->sa_family == AF_INET6) ?
+			    sizeof(struct sockaddr_in6) :
+			    sizeof(struct sockaddr_in));
+}
+
 static inline int zperf_upload_fin(int sock,
+				   const struct sockaddr *group,
+				   const struct zperf_upload_params *param,
 				   uint32_t nb_packets,
 				   uint64_t end_time,
 				   uint32_t packet_size,
@@ -55,6 +146,8 @@ static inline int zperf_upload_fin(int sock,
 {
 	uint8_t stats[sizeof(struct zperf_udp_datagram) +
 		      sizeof(struct zperf_server_hdr)] = { 0 };
+	struct sockaddr_storage from;
+	socklen_t fromlen;
 	struct zperf_udp_datagram *datagram;
 	struct zperf_client_hdr_v1 *hdr;
 	uint32_t secs = k_ticks_to_ms_ceil32(end_time) / 1000U;
@@ -91,7 +184,7 @@ static inline int zperf_upload_fin(int sock,
 		hdr->num_of_bytes = htonl(packet_size);
 
 		/* Send the packet */
-		ret = zsock_send(sock, sample_packet, packet_size, 0);
+		ret = udp_send(sock, group, sample_packet, packet_size);
 		if (ret < 0) {
 			NET_ERR("Failed to send the packet (%d)", errno);
 			continue;
@@ -105,7 +198,9 @@ static inline int zperf_upload_fin(int sock,
 			continue;
 		}
 
-		ret = zsock_recv(sock, stats, sizeof(stats), 0);
+		fromlen = sizeof(from);
+		ret = zsock_recvfrom(sock, stats, sizeof(stats), 0,
+				     (struct sockaddr *)&from, &fromlen);
 		if (ret == -EAGAIN) {
 			NET_WARN("Stats receive timeout");
 		} else if (ret < 0) {
@@ -113,13 +208,33 @@ static inline int zperf_upload_fin(int sock,
 		}
 	}
 
-	/* Decode statistics */
-	if (ret > 0) {
-		zperf_upload_decode_stat(stats, ret, results);
-	} else {
+	if (ret <= 0) {
 		return ret;
 	}
 
+	if (group != NULL) {
+		results->nb_receivers = 0U;
+		rcvtimeo.tv_sec = 0;
+		rcvtimeo.tv_usec = UDP_GROUP_WAIT_MS * USEC_PER_MSEC;
+		(void)zsock_setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO,
+				       &rcvtimeo, sizeof(rcvtimeo));
+
+		/* Until the receivers stop answering */
+		do {
+			udp_group_add_report(&from, stats, ret, param,
+					     results);
+			fromlen = sizeof(from);
+			ret = zsock_recvfrom(sock, stats, sizeof(stats), 0,
+					     (struct sockaddr *)&from,
+					     &fromlen);
+		} while (ret > 0);
+
+		return 0;
+	}
+
+	/* Decode statistics */
+	zperf_upload_decode_stat(stats, ret, results);
+
 	/* Drain RX */
 	while (true) {
 		ret = zsock_recv(sock, stats, sizeof(stats), ZSOCK_MSG_DONTWAIT);
@@ -133,21 +248,93 @@ static inline int zperf_upload_fin(int sock,
 	return 0;
 }
 
-static int udp_upload(int sock, int port,
-		      unsigned int duration_in_ms,
-		      unsigned int packet_size,
-		      unsigned int rate_in_kbps,
+/* Ticks to wait for a time of us, with the part below a tick carried over
+ * in owed_us, so that gaps of changing lengths keep to their mean
+ */
+static uint32_t udp_owed_ticks(uint32_t us, uint32_t *owed_us)
+{
+	uint32_t ticks;
+
+	*owed_us += us;
+	ticks = k_us_to_ticks_ceil32(*owed_us);
+	*owed_us -= k_ticks_to_us_ceil32(ticks);
+
+	return ticks;
+}
+
+/* Time of a packet of size bytes at the rate, scaled by scale / 256. At
+ * rate 0 packets go back to back.
+ */
+static uint32_t udp_packet_us(uint32_t size, uint32_t rate_in_kbps,
+			      uint16_t scale)
+{
+	if (rate_in_kbps == 0U) {
+		return 0U;
+	}
+
+	return ((uint64_t)zperf_packet_duration(size, rate_in_kbps) *
+		scale) >> 8;
+}
+
+/* Factor of the nth exponential gap, 256 for a constant one */
+static inline uint16_t udp_gap_scale(const uint16_t *scale, uint32_t n)
+{
+	return (scale != NULL) ? scale[n % ZPERF_EXP_SCHEDULE_LEN] : 256U;
+}
+
+static int udp_upload(int sock, const struct sockaddr *group,
+		      enum zperf_wire wire,
+		      const struct zperf_upload_params *param,
+		      const struct zperf_pattern *pattern,
 		      struct zperf_results *results)
 {
-	uint32_t packet_duration_us = zperf_packet_duration(packet_size, rate_in_kbps);
-	uint32_t packet_duration = k_us_to_ticks_ceil32(packet_duration_us);
-	uint32_t delay = packet_duration;
+	const struct zperf_size_schedule *sizes = param->options.sizes;
+	uint32_t burst_packets = param->options.burst_packets;
+	uint32_t burst_period_us = param->options.burst_period_ms *
+				   USEC_PER_MSEC;
+	const uint16_t *packet_scale = NULL;
+	const uint16_t *burst_scale = NULL;
+	unsigned int duration_in_ms = param->duration_ms;
+	unsigned int packet_size = param->packet_size;
+	unsigned int rate_in_kbps = param->rate_kbps;
+	uint32_t owed_us = 0U;
+	uint32_t burst_owed_us = 0U;
+	uint32_t packet_duration;
+	uint32_t delay;
 	uint32_t nb_packets = 0U;
-	int64_t start_time, end_time;
+	uint64_t bytes_sent = 0U;
+	int64_t start_time, end_time, burst_time;
 	int64_t print_time, last_loop_time;
 	uint32_t print_period;
+	struct zperf_cpu_sample cpu;
 	int ret;
 
+	/* The largest packet of a schedule stands for it in the headers */
+	if (sizes != NULL) {
+		if (sizes->len == 0U) {
+			return -EINVAL;
+		}
+		packet_size = sizes->max;
+	}
+
+	/* Only bursts may go back to back */
+	if (rate_in_kbps == 0U && burst_packets == 0U) {
+		return -EINVAL;
+	}
+
+	if (param->options.poisson) {
+		if (!udp_exp_ready) {
+			zperf_exp_schedule(udp_exp_scale);
+			udp_exp_ready = true;
+		}
+		/* Packets keep to the rate within a burst */
+		if (burst_packets != 0U) {
+			burst_scale = udp_exp_scale;
+		} else {
+			packet_scale = udp_exp_scale;
+		}
+	}
+
 	if (packet_size > PACKET_SIZE_MAX) {
 		NET_WARN("Packet size too large! max size: %u",
 			 PACKET_SIZE_MAX);
@@ -158,9 +345,16 @@ static int udp_upload(int sock, int port,
 		packet_size = sizeof(struct zperf_udp_datagram);
 	}
 
+	packet_duration = k_us_to_ticks_ceil32(
+		udp_packet_us((sizes != NULL) ? sizes->size[0] : packet_size,
+			      rate_in_kbps, udp_gap_scale(packet_scale, 0U)));
+	delay = packet_duration;
+
 	/* Start the loop */
+	zperf_cpu_stats_begin(&cpu);
 	start_time = k_uptime_ticks();
 	last_loop_time = start_time;
+	burst_time = start_time;
 	end_time = start_time + k_ms_to_ticks_ceil64(duration_in_ms);
 
 	/* Print log every seconds */
@@ -169,18 +363,37 @@ static int udp_upload(int sock, int port,
 
 	(void)memset(sample_packet, 'z', sizeof(sample_packet));
 
+	/* The same in every packet, a server may start on any of them */
+	if (wire == ZPERF_WIRE_IPERF2) {
+		zperf_client_hdr_fill((struct zperf_client_hdr_v1 *)
+				      (sample_packet +
+				       sizeof(struct zperf_udp_datagram)),
+				      IPPROTO_UDP, param->options.dual,
+				      param->options.dual_port,
+				      packet_size, rate_in_kbps,
+				      duration_in_ms);
+	}
+
 	do {
 		struct zperf_udp_datagram *datagram;
-		struct zperf_client_hdr_v1 *hdr;
+		struct zperf_iperf3_datagram *datagram3;
+		uint32_t size = packet_size;
 		uint64_t usecs64;
 		uint32_t secs, usecs;
 		int64_t loop_time;
 		int32_t adjust;
+		uint32_t wait;
 
 		/* Timestamp */
 		loop_time = k_uptime_ticks();
 
-		/* Algorithm to maintain a given baud rate */
+		if (sizes != NULL) {
+			size = sizes->size[nb_packets % sizes->len];
+		}
+
+		/* Algorithm to maintain a given baud rate, packet_duration
+		 * is the time of the previous packet
+		 */
 		if (last_loop_time != loop_time) {
 			adjust = packet_duration;
 			adjust -= (int32_t)(loop_time - last_loop_time);
@@ -198,35 +411,68 @@ static int udp_upload(int sock, int port,
 
 		last_loop_time = loop_time;
 
-		usecs64 = k_ticks_to_us_floor64(loop_time);
+		/* Stamped with the clock of the receiver's latency histograms,
+		 * a tick is far coarser than a transit time.
+		 */
+		usecs64 = k_cyc_to_us_floor64(k_cycle_get_64());
 		secs = usecs64 / USEC_PER_SEC;
 		usecs = usecs64 - (uint64_t)secs * USEC_PER_SEC;
 
 		/* Fill the packet header */
-		datagram = (struct zperf_udp_datagram *)sample_packet;
+		if (wire == ZPERF_WIRE_IPERF3) {
+			datagram3 = (struct zperf_iperf3_datagram *)
+					sample_packet;
 
-		datagram->id = htonl(nb_packets);
-		datagram->tv_sec = htonl(secs);
-		datagram->tv_usec = htonl(usecs);
+			datagram3->tv_sec = htonl(secs);
+			datagram3->tv_usec = htonl(usecs);
+			datagram3->pcount = htonl(nb_packets + 1U);
+		} else {
+			datagram = (struct zperf_udp_datagram *)sample_packet;
 
-		hdr = (struct zperf_client_hdr_v1 *)(sample_packet +
-						     sizeof(*datagram));
-		hdr->flags = 0;
-		hdr->num_of_threads = htonl(1);
-		hdr->port = htonl(port);
-		hdr->buffer_len = sizeof(sample_packet) -
-			sizeof(*datagram) - sizeof(*hdr);
-		hdr->bandwidth = htonl(rate_in_kbps);
-		hdr->num_of_bytes = htonl(packet_size);
+			datagram->id = htonl(nb_packets);
+			datagram->tv_sec = htonl(secs);
+			datagram->tv_usec = htonl(usecs);
+		}
+
+		if (pattern != NULL && size > UDP_PAYLOAD_OFFSET) {
+			zperf_pattern_fill(pattern,
+					   zperf_pattern_udp_offset(nb_packets),
+					   sample_packet + UDP_PAYLOAD_OFFSET,
+					   size - UDP_PAYLOAD_OFFSET);
+		}
 
 		/* Send the packet */
-		ret = zsock_send(sock, sample_packet, packet_size, 0);
+		ret = udp_send(sock, group, sample_packet, size);
         
 		if (ret < 0) {
 			NET_ERR("Failed to send the packet (%d)", errno);
 			return -errno;
 		} else {
 			nb_packets++;
+			bytes_sent += size;
+		}
+
+		packet_duration = udp_owed_ticks(
+			udp_packet_us(size, rate_in_kbps,
+				      udp_gap_scale(packet_scale, nb_packets)),
+			&owed_us);
+		wait = delay;
+
+		/* The gap to the next burst follows the last packet of one,
+		 * and is what this loop should have taken for the adjustment
+		 */
+		if (burst_packets != 0U && nb_packets % burst_packets == 0U) {
+			int64_t now = k_uptime_ticks();
+			uint32_t bursts = nb_packets / burst_packets;
+
+			burst_time += udp_owed_ticks(
+				((uint64_t)burst_period_us *
+				 udp_gap_scale(burst_scale, bursts - 1U)) >> 8,
+				&burst_owed_us);
+			if (burst_time > last_loop_time) {
+				packet_duration = burst_time - last_loop_time;
+			}
+			wait = (burst_time > now) ? burst_time - now : 0U;
 		}
 
 		if (IS_ENABLED(CONFIG_NET_ZPERF_LOG_LEVEL_DBG)) {
@@ -242,25 +488,31 @@ static int udp_upload(int sock, int port,
 #if defined(CONFIG_ARCH_POSIX)
 		k_busy_wait(USEC_PER_MSEC);
 #else
-		if (delay != 0) {
-			k_sleep(K_TICKS(delay));
+		if (wait != 0) {
+			k_sleep(K_TICKS(wait));
 		}
 #endif
 	} while (last_loop_time < end_time);
 
 	end_time = k_uptime_ticks();
+	zperf_cpu_stats_end(&cpu, &results->cpu);
 
-	ret = zperf_upload_fin(sock, nb_packets, end_time, packet_size,
-			       results);
-	if (ret < 0) {
-		return ret;
+	/* iperf3 has the results sent over its control connection */
+	if (wire == ZPERF_WIRE_IPERF2) {
+		ret = zperf_upload_fin(sock, group, param, nb_packets,
+				       end_time, packet_size, results);
+		if (ret < 0) {
+			return ret;
+		}
 	}
 
 	/* Add result coming from the client */
 	results->nb_packets_sent = nb_packets;
 	results->client_time_in_us =
 				k_ticks_to_us_ceil32(end_time - start_time);
-	results->packet_size = packet_size;
+	/* The mean size, so that the sent bytes come out right */
+	results->packet_size = (nb_packets != 0U) ?
+			       bytes_sent / nb_packets : packet_size;
 
 	return 0;
 }
@@ -269,7 +521,8 @@ int zperf_udp_upload(const struct zperf_upload_params *param,
 		     struct zperf_results *result)
 {
 
-	int port = 0;
+	const struct zperf_pattern *pattern = NULL;
+	const struct sockaddr *group = NULL;
 	int sock;
 	int ret;
 
@@ -277,13 +530,8 @@ int zperf_udp_upload(const struct zperf_upload_params *param,
 		return -EINVAL;
 	}
 
-	if (param->peer_addr.ss_family == AF_INET) {
-		port = ntohs(net_sin((struct sockaddr*)(&param->peer_addr))->sin_port);
-#if 1
-	} else if (param->peer_addr.ss_family == AF_INET6) {
-		port = ntohs(net_sin6((struct sockaddr*)(&param->peer_addr))->sin6_port);
-#endif
-	} else {
+	if (param->peer_addr.ss_family != AF_INET &&
+	    param->peer_addr.ss_family != AF_INET6) {
 		NET_ERR("Invalid address family (%d)",
 			param->peer_addr.ss_family);
 		return -EINVAL;
@@ -295,14 +543,42 @@ int zperf_udp_upload(const struct zperf_upload_params *param,
 		return sock;
 	}
 
-	ret = udp_upload(sock, port, param->duration_ms, param->packet_size,
-			 param->rate_kbps, result);
+	if (zperf_is_mcast_addr((struct sockaddr *)(&param->peer_addr))) {
+		group = (struct sockaddr *)(&param->peer_addr);
+		ret = zperf_set_mcast_tx_opts(sock, param->options.mcast_ttl,
+					      param->options.mcast_loop);
+		if (ret < 0) {
+			zsock_close(sock);
+			return ret;
+		}
+	}
+
+	if (param->options.pattern_seed != 0U) {
+		zperf_pattern_init(&udp_pattern, param->options.pattern_seed);
+		pattern = &udp_pattern;
+	}
+
+	ret = udp_upload(sock, group, ZPERF_WIRE_IPERF2, param, pattern,
+			 result);
 
 	zsock_close(sock);
 
 	return ret;
 }
 
+int zperf_udp_upload_sock(int sock, const struct zperf_upload_params *param,
+			  enum zperf_wire wire, struct zperf_results *result)
+{
+	const struct zperf_pattern *pattern = NULL;
+
+	if (param->options.pattern_seed != 0U) {
+		zperf_pattern_init(&udp_pattern, param->options.pattern_seed);
+		pattern = &udp_pattern;
+	}
+
+	return udp_upload(sock, NULL, wire, param, pattern, result);
+}
+
 static void udp_upload_async_work(struct k_work *work)
 {
 	struct zperf_async_upload_context *upload_ctx =